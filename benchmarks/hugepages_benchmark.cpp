@@ -0,0 +1,194 @@
+/**
+ * Copyright (c) 2018-2024, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file hugepages_benchmark.cpp
+ * @brief Measures the cartesian and compose stages of the point cloud
+ * pipeline with the buffers backed by regular pages, transparent hugepages and
+ * locked transparent hugepages
+ *
+ * usage: hugepages_benchmark [scans=500]
+ *
+ * The buffers mirror what a driver running a 2048x10 dual return 128 beam
+ * sensor holds: a ring of 10 LidarScans, the xyz lut, the points buffer and
+ * the organized cloud. Each configuration allocates its own buffers so the
+ * pages of one run are not reused by the next. Results depend on the system
+ * THP setting, with `always` the baseline already gets hugepages, use `madvise`
+ * to see the difference.
+ */
+
+// prevent clang-format from altering the location of "ouster_ros/os_ros.h", the
+// header file needs to be the first include due to PCL_NO_PRECOMPILE flag
+// clang-format off
+#include "ouster_ros/os_ros.h"
+// clang-format on
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "ouster_ros/os_point.h"
+#include "ouster_ros/sensor_point_types.h"
+#include "../src/impl/cartesian.h"
+#include "../src/memory_pinning.h"
+#include "../src/point_cloud_compose.h"
+
+using namespace ouster_ros;
+using namespace ouster::sdk::core;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+constexpr int RING_SIZE = 10;
+constexpr int BEAMS = 128;
+
+SensorInfo make_sensor_info() {
+    auto info = default_sensor_info(LidarMode::MODE_2048x10);
+    info.format.udp_profile_lidar = UDPProfileLidar::RNG19_RFL8_SIG16_NIR16_DUAL;
+    info.format.pixels_per_column = BEAMS;
+    info.format.pixel_shift_by_row.resize(BEAMS);
+    info.beam_altitude_angles.resize(BEAMS);
+    info.beam_azimuth_angles.resize(BEAMS);
+    for (int i = 0; i < BEAMS; ++i) {
+        info.format.pixel_shift_by_row[i] = (i % 4) * 12;
+        info.beam_altitude_angles[i] = 22.5 - 45.0 * i / (BEAMS - 1);
+        info.beam_azimuth_angles[i] = (i % 4) * 1.5 - 2.25;
+    }
+    return info;
+}
+
+size_t anon_huge_pages_kb() {
+    std::ifstream smaps("/proc/self/smaps_rollup");
+    std::string key;
+    size_t value;
+    while (smaps >> key) {
+        if (key == "AnonHugePages:" && smaps >> value) return value;
+        smaps.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    }
+    return 0;
+}
+
+struct Stats {
+    std::vector<double> samples_us;
+
+    void add(Clock::duration d) {
+        samples_us.push_back(
+            std::chrono::duration<double, std::micro>(d).count());
+    }
+
+    void print(const std::string& name) {
+        std::sort(samples_us.begin(), samples_us.end());
+        double mean = 0;
+        for (auto s : samples_us) mean += s;
+        mean /= samples_us.size();
+        const auto n = samples_us.size();
+        std::cout << "  " << std::left << std::setw(10) << name << std::right
+                  << std::fixed << std::setprecision(1)
+                  << " mean=" << std::setw(8) << mean
+                  << " p50=" << std::setw(8) << samples_us[n / 2]
+                  << " p99=" << std::setw(8) << samples_us[n * 99 / 100]
+                  << " us" << std::endl;
+    }
+};
+
+void run(const std::string& label, const SensorInfo& info,
+         const memory::BufferPinning& pinning, int scans) {
+    const auto W = info.format.columns_per_frame;
+    const auto H = info.format.pixels_per_column;
+
+    std::vector<std::unique_ptr<LidarScan>> ring;
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<uint32_t> range_dist(0, 100000);
+    for (int i = 0; i < RING_SIZE; ++i) {
+        ring.push_back(std::make_unique<LidarScan>(
+            W, H, info.format.udp_profile_lidar));
+        for (auto field : {ChanField::RANGE, ChanField::RANGE2}) {
+            auto range = ring.back()->field<uint32_t>(field);
+            for (int j = 0; j < range.size(); ++j)
+                range.data()[j] = range_dist(rng);
+        }
+    }
+
+    auto xyz_lut = make_xyz_lut(W, H, RANGE_UNIT, info.beam_to_lidar_transform,
+                                info.lidar_to_sensor_transform,
+                                info.beam_azimuth_angles,
+                                info.beam_altitude_angles);
+    ArrayX3fR lut_direction = xyz_lut.direction.cast<float>();
+    ArrayX3fR lut_offset = xyz_lut.offset.cast<float>();
+    PointCloudXYZf points(lut_direction.rows(), lut_offset.cols());
+    Cloud<ouster_ros::Point> cloud{W, H};
+
+    memory::PinnedRegions pinned(pinning);
+    for (const auto& ls : ring) {
+        for (const auto& f : ls->fields())
+            pinned.pin(f.second.get(), f.second.bytes());
+        pinned.pin_container(ls->timestamp());
+    }
+    pinned.pin_container(lut_direction);
+    pinned.pin_container(lut_offset);
+    pinned.pin_container(points);
+    pinned.pin_container(cloud.points);
+
+    Stats cartesian, compose;
+    Point_RNG19_RFL8_SIG16_NIR16_DUAL staging_pt;
+    for (int i = 0; i < scans; ++i) {
+        const auto& ls = *ring[i % RING_SIZE];
+        for (int r = 0; r < 2; ++r) {
+            auto range = ls.field<uint32_t>(r == 0 ? ChanField::RANGE
+                                                   : ChanField::RANGE2);
+            auto t0 = Clock::now();
+            ouster::cartesianT(points, range, lut_direction, lut_offset, 0U,
+                               std::numeric_limits<uint32_t>::max(),
+                               std::numeric_limits<float>::quiet_NaN());
+            auto t1 = Clock::now();
+            if (r == 0) {
+                scan_to_cloud_f<Profile_RNG19_RFL8_SIG16_NIR16_DUAL.size(),
+                                Profile_RNG19_RFL8_SIG16_NIR16_DUAL>(
+                    cloud, staging_pt, points, 0, ls,
+                    info.format.pixel_shift_by_row, true, true, 1);
+            } else {
+                scan_to_cloud_f<
+                    Profile_RNG19_RFL8_SIG16_NIR16_DUAL_2ND_RETURN.size(),
+                    Profile_RNG19_RFL8_SIG16_NIR16_DUAL_2ND_RETURN>(
+                    cloud, staging_pt, points, 0, ls,
+                    info.format.pixel_shift_by_row, true, true, 1);
+            }
+            auto t2 = Clock::now();
+            cartesian.add(t1 - t0);
+            compose.add(t2 - t1);
+        }
+    }
+
+    std::cout << label << " (pinned " << pinned.pinned_bytes() / (1 << 20)
+              << " MiB, AnonHugePages " << anon_huge_pages_kb() / 1024
+              << " MiB)" << std::endl;
+    cartesian.print("cartesian");
+    compose.print("compose");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    const int scans = argc > 1 ? std::stoi(argv[1]) : 500;
+    const auto info = make_sensor_info();
+
+    std::ifstream thp("/sys/kernel/mm/transparent_hugepage/enabled");
+    std::string thp_mode;
+    std::getline(thp, thp_mode);
+    std::cout << "transparent_hugepage: " << thp_mode << std::endl;
+
+    memory::BufferPinning none, thp_only, thp_mlock;
+    thp_only.hugepages = true;
+    thp_mlock.hugepages = true;
+    thp_mlock.mlock = true;
+
+    run("4K pages", info, none, scans);
+    run("hugepages", info, thp_only, scans);
+    run("hugepages + mlock", info, thp_mlock, scans);
+    return 0;
+}
@@ -0,0 +1,119 @@
+/**
+ * Copyright (c) 2018-2024, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file packet_crc_benchmark.cpp
+ * @brief Measures the cost per lidar packet of the crc verification of the
+ * FUSA profile, folded with PCLMULQDQ and with the lookup tables
+ *
+ * usage: packet_crc_benchmark [packets=100000]
+ *
+ * The packets are those of a 2048x10 FUSA_RNG15_RFL8_NIR8_DUAL sensor with 32,
+ * 64 and 128 beams. Each sample times a batch of 64 packets taken in turn from
+ * a pool much larger than the last level cache, like packets that just came
+ * off the socket, and reports the time per packet.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <ouster/types.h>
+
+#include "../src/packet_crc.h"
+
+using namespace ouster_ros;
+using namespace ouster::sdk::core;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+constexpr size_t BATCH = 64;
+constexpr size_t POOL_BYTES = 256 << 20;
+
+SensorInfo make_sensor_info(int beams) {
+    auto info = default_sensor_info(LidarMode::MODE_2048x10);
+    info.format.udp_profile_lidar = UDPProfileLidar::FUSA_RNG15_RFL8_NIR8_DUAL;
+    info.format.pixels_per_column = beams;
+    return info;
+}
+
+struct Stats {
+    std::vector<double> samples_ns;
+
+    void add(Clock::duration d, size_t packets) {
+        samples_ns.push_back(
+            std::chrono::duration<double, std::nano>(d).count() / packets);
+    }
+
+    void print(const std::string& name, size_t packet_size) {
+        std::sort(samples_ns.begin(), samples_ns.end());
+        double mean = 0;
+        for (auto s : samples_ns) mean += s;
+        mean /= samples_ns.size();
+        const auto n = samples_ns.size();
+        std::cout << "  " << std::left << std::setw(10) << name << std::right
+                  << std::fixed << std::setprecision(1)
+                  << " mean=" << std::setw(8) << mean
+                  << " p50=" << std::setw(8) << samples_ns[n / 2]
+                  << " p99=" << std::setw(8) << samples_ns[n * 99 / 100]
+                  << " ns/packet " << std::setprecision(2) << std::setw(6)
+                  << packet_size / mean << " GB/s" << std::endl;
+    }
+};
+
+void run(int beams, size_t packets) {
+    const auto info = make_sensor_info(beams);
+    const auto& pf = get_format(info);
+    const size_t size = pf.lidar_packet_size;
+
+    // packets closed by a valid crc, so that every verification succeeds
+    const size_t pool_packets = std::max<size_t>(POOL_BYTES / size, BATCH);
+    std::vector<std::vector<uint8_t>> pool(pool_packets,
+                                           std::vector<uint8_t>(size));
+    std::mt19937 rng(42);
+    for (auto& buf : pool) {
+        for (auto& b : buf) b = static_cast<uint8_t>(rng());
+        const auto crc =
+            crc::crc64(buf.data(), size - PacketCrc::CRC_SIZE, false);
+        for (size_t i = 0; i < PacketCrc::CRC_SIZE; ++i)
+            buf[size - PacketCrc::CRC_SIZE + i] =
+                static_cast<uint8_t>(crc >> (8 * i));
+    }
+
+    std::cout << beams << " beams, " << size << " bytes per packet"
+              << std::endl;
+    for (bool clmul : {false, true}) {
+        const PacketCrc packet_crc(pf, clmul);
+        if (clmul && !crc::clmul_supported()) {
+            std::cout << "  pclmul     not supported by this cpu" << std::endl;
+            continue;
+        }
+        Stats stats;
+        size_t failures = 0;
+        size_t next = 0;
+        for (size_t i = 0; i < packets; i += BATCH) {
+            const auto t0 = Clock::now();
+            for (size_t j = 0; j < BATCH; ++j) {
+                const auto& buf = pool[next];
+                next = (next + 1) % pool.size();
+                failures += !packet_crc.valid(buf.data(), buf.size());
+            }
+            stats.add(Clock::now() - t0, BATCH);
+        }
+        stats.print(packet_crc.implementation(), size);
+        if (failures) std::cerr << "unexpected crc failures!" << std::endl;
+    }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    const size_t packets = argc > 1 ? std::stoul(argv[1]) : 100000;
+    for (int beams : {32, 64, 128}) run(beams, packets);
+    return 0;
+}
@@ -0,0 +1,178 @@
+/**
+ * Copyright (c) 2018-2024, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file packet_decoder_benchmark.cpp
+ * @brief Measures the cost per lidar packet of batching the fields of the
+ * profiles with specialized decoders, with the ScanBatcher of the SDK and with
+ * the ProfileScanBatcher using the scalar and the AVX2 kernels
+ *
+ * usage: packet_decoder_benchmark [frames=200]
+ *
+ * The packets are those of a 1024x10 sensor with 64 and 128 beams holding
+ * random pixel data, batched into all the fields of the profile. Each sample
+ * times the packets of a frame taken in turn from a pool of frames larger than
+ * the last level cache, like packets that just came off the socket, and
+ * reports the time per packet. The kernels are also timed on their own
+ * through PacketDecoder::decode, without the batching of the headers.
+ */
+
+// prevent clang-format from altering the location of "ouster_ros/os_ros.h", the
+// header file needs to be the first include due to PCL_NO_PRECOMPILE flag
+// clang-format off
+#include "ouster_ros/os_ros.h"
+// clang-format on
+#include <ouster/impl/packet_writer.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../src/packet_decoder.h"
+
+using namespace ouster_ros;
+using namespace ouster::sdk::core;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+constexpr size_t POOL_BYTES = 64 << 20;
+
+struct Stats {
+    std::vector<double> samples_ns;
+
+    void add(Clock::duration d, size_t packets) {
+        samples_ns.push_back(
+            std::chrono::duration<double, std::nano>(d).count() / packets);
+    }
+
+    void print(const std::string& name) {
+        std::sort(samples_ns.begin(), samples_ns.end());
+        double mean = 0;
+        for (auto s : samples_ns) mean += s;
+        mean /= samples_ns.size();
+        const auto n = samples_ns.size();
+        std::cout << "  " << std::left << std::setw(14) << name << std::right
+                  << std::fixed << std::setprecision(1)
+                  << " mean=" << std::setw(8) << mean
+                  << " p50=" << std::setw(8) << samples_ns[n / 2]
+                  << " p99=" << std::setw(8) << samples_ns[n * 99 / 100]
+                  << " ns/packet" << std::endl;
+    }
+};
+
+using Frame = std::vector<LidarPacket>;
+
+// frames of packets with random pixel data and column headers that batch
+// into complete scans
+std::vector<Frame> make_frames(const SensorInfo& info) {
+    impl::PacketWriter writer(info);
+    const int packets_per_frame =
+        info.format.columns_per_frame / info.format.columns_per_packet;
+    const size_t frame_bytes = packets_per_frame * writer.lidar_packet_size;
+    std::vector<Frame> frames(std::max<size_t>(POOL_BYTES / frame_bytes, 2));
+    std::mt19937 rng(42);
+    for (auto& frame : frames) {
+        for (int i = 0; i < packets_per_frame; ++i) {
+            LidarPacket p;
+            p.buf.resize(writer.lidar_packet_size);
+            for (auto& b : p.buf) b = static_cast<uint8_t>(rng());
+            for (int c = 0; c < writer.columns_per_packet; ++c) {
+                auto* col = writer.nth_col(c, p.buf.data());
+                const uint16_t m_id = i * writer.columns_per_packet + c;
+                writer.set_col_measurement_id(col, m_id);
+                writer.set_col_timestamp(col, m_id);
+                writer.set_col_status(col, 0x01);
+            }
+            frame.push_back(std::move(p));
+        }
+    }
+    return frames;
+}
+
+template <typename Batcher>
+void run(const std::string& name, const SensorInfo& info, Batcher& batcher,
+         std::vector<Frame>& frames, size_t samples) {
+    impl::PacketWriter writer(info);
+    const auto field_types = get_field_types(info.format.udp_profile_lidar);
+    std::vector<LidarScan> scans;
+    for (int i = 0; i < 2; ++i)
+        scans.emplace_back(info.format.columns_per_frame,
+                           info.format.pixels_per_column, field_types,
+                           info.format.columns_per_packet);
+
+    Stats stats;
+    size_t completed = 0;
+    for (size_t i = 0; i < samples + 1; ++i) {
+        auto& frame = frames[i % frames.size()];
+        for (auto& p : frame)
+            writer.set_frame_id(p.buf.data(), static_cast<uint32_t>(i + 1));
+        const auto t0 = Clock::now();
+        for (const auto& p : frame)
+            completed += batcher(p, scans[completed % 2]);
+        // the first frame only primes the scans
+        if (i) stats.add(Clock::now() - t0, frame.size());
+    }
+    stats.print(name);
+    if (completed != samples)
+        std::cerr << "unexpected number of completed scans!" << std::endl;
+}
+
+void run_kernels(const std::string& name, const SensorInfo& info,
+                 const PacketDecoder& decoder, const std::vector<Frame>& frames,
+                 size_t samples) {
+    LidarScan scan(info.format.columns_per_frame,
+                   info.format.pixels_per_column,
+                   get_field_types(info.format.udp_profile_lidar),
+                   info.format.columns_per_packet);
+    std::vector<uint8_t> written(info.format.columns_per_frame);
+    Stats stats;
+    for (size_t i = 0; i < samples; ++i) {
+        const auto& frame = frames[i % frames.size()];
+        const auto t0 = Clock::now();
+        for (const auto& p : frame) decoder.decode(p.buf.data(), scan, written);
+        stats.add(Clock::now() - t0, frame.size());
+    }
+    stats.print(name);
+}
+
+void run(UDPProfileLidar profile, int beams, size_t samples) {
+    auto info = default_sensor_info(LidarMode::MODE_1024x10);
+    info.format.udp_profile_lidar = profile;
+    info.format.pixels_per_column = beams;
+    auto frames = make_frames(info);
+    const auto field_types = get_field_types(profile);
+
+    std::cout << to_string(profile) << ", " << beams << " beams, "
+              << get_format(info).lidar_packet_size << " bytes per packet"
+              << std::endl;
+    ScanBatcher sdk(info);
+    run("ScanBatcher", info, sdk, frames, samples);
+    for (bool avx2 : {false, true}) {
+        if (avx2 && !decoding::avx2_supported()) {
+            std::cout << "  avx2           not supported by this cpu"
+                      << std::endl;
+            continue;
+        }
+        ProfileScanBatcher batcher(info, field_types, 2, avx2);
+        run(batcher.implementation(), info, batcher, frames, samples);
+        const PacketDecoder decoder(info, field_types, avx2);
+        run_kernels(std::string(decoder.implementation()) + " kernels", info,
+                    decoder, frames, samples);
+    }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    const size_t frames = argc > 1 ? std::stoul(argv[1]) : 200;
+    for (auto profile : {UDPProfileLidar::RNG19_RFL8_SIG16_NIR16,
+                         UDPProfileLidar::RNG15_RFL8_NIR8,
+                         UDPProfileLidar::RNG19_RFL8_SIG16_NIR16_DUAL})
+        for (int beams : {64, 128}) run(profile, beams, frames);
+    return 0;
+}
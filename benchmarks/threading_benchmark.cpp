@@ -0,0 +1,217 @@
+/**
+ * Copyright (c) 2018-2024, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file threading_benchmark.cpp
+ * @brief Compares the THREADED and INLINE scan processing models of the
+ * LidarPacketHandler
+ *
+ * usage: taskset -c 0,1 threading_benchmark [scans=100]
+ *
+ * Packets of a 1024x10 dual return 128 beam sensor are synthesized once and
+ * then fed by a receive thread at the rate the sensor would send them, the
+ * processing pipeline is a point cloud processor with the `original` point
+ * type. Per model the benchmark reports the latency from the last packet of a
+ * frame to the end of its processing, the cpu time and the number of context
+ * switches per scan and the scans that were dropped or throttled. Run it
+ * pinned to the number of cores of the target, e.g. with taskset.
+ */
+
+// prevent clang-format from altering the location of "ouster_ros/os_ros.h", the
+// header file needs to be the first include due to PCL_NO_PRECOMPILE flag
+// clang-format off
+#include "ouster_ros/os_ros.h"
+// clang-format on
+
+#include <sched.h>
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <ouster/impl/packet_writer.h>
+
+#include "../src/lidar_packet_handler.h"
+#include "../src/point_cloud_processor_factory.h"
+
+using namespace ouster_ros;
+using namespace ouster::sdk::core;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+constexpr int BEAMS = 128;
+// distinct frame ids cycled through by the feeder, the latency of a frame is
+// looked up by its id so this has to exceed the frames in flight
+constexpr int FRAMES = 8;
+
+SensorInfo make_sensor_info() {
+    auto info = default_sensor_info(LidarMode::MODE_1024x10);
+    info.config.lidar_mode = LidarMode::MODE_1024x10;
+    info.format.udp_profile_lidar = UDPProfileLidar::RNG19_RFL8_SIG16_NIR16_DUAL;
+    info.format.pixels_per_column = BEAMS;
+    info.format.pixel_shift_by_row.resize(BEAMS);
+    info.beam_altitude_angles.resize(BEAMS);
+    info.beam_azimuth_angles.resize(BEAMS);
+    for (int i = 0; i < BEAMS; ++i) {
+        info.format.pixel_shift_by_row[i] = (i % 4) * 6;
+        info.beam_altitude_angles[i] = 22.5 - 45.0 * i / (BEAMS - 1);
+        info.beam_azimuth_angles[i] = (i % 4) * 1.5 - 2.25;
+    }
+    return info;
+}
+
+std::vector<std::vector<LidarPacket>> make_frames(const SensorInfo& info) {
+    const auto W = info.format.columns_per_frame;
+    const auto H = info.format.pixels_per_column;
+    impl::PacketWriter pw{info};
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<uint32_t> range_dist(500, 100000);
+    std::vector<std::vector<LidarPacket>> frames;
+    for (int f = 0; f < FRAMES; ++f) {
+        LidarScan ls(W, H, info.format.udp_profile_lidar);
+        ls.frame_id = f;
+        for (auto field : {ChanField::RANGE, ChanField::RANGE2}) {
+            auto range = ls.field<uint32_t>(field);
+            for (int j = 0; j < range.size(); ++j)
+                range.data()[j] = range_dist(rng);
+        }
+        for (size_t c = 0; c < W; ++c) {
+            ls.timestamp()[c] = (f * W + c) * 100000ULL;
+            ls.measurement_id()[c] = c;
+            ls.status()[c] = 1;
+        }
+        frames.push_back(impl::scan_to_packets(ls, pw, 0, 0));
+    }
+    return frames;
+}
+
+struct Usage {
+    double cpu_s;
+    long switches;
+
+    static Usage now() {
+        rusage ru;
+        getrusage(RUSAGE_SELF, &ru);
+        return {ru.ru_utime.tv_sec + ru.ru_stime.tv_sec +
+                    (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1e-6,
+                ru.ru_nvcsw + ru.ru_nivcsw};
+    }
+};
+
+void run(const std::string& label, const SensorInfo& info,
+         const std::vector<std::vector<LidarPacket>>& frames,
+         const threading::InlineProcessing& inline_processing, int scans) {
+    std::vector<std::atomic<int64_t>> frame_fed_ns(FRAMES);
+    std::vector<double> latencies_us;
+    latencies_us.reserve(scans);
+
+    std::vector<LidarScanProcessor> processors;
+    processors.push_back(
+        PointCloudProcessorFactory::create_point_cloud_processor(
+            "original", info, "os_lidar", true, true, true, 0,
+            std::numeric_limits<uint32_t>::max(), 1, "",
+            [](const PointCloudProcessor_OutputType&) {}));
+    processors.push_back([&](const LidarScan& ls, uint64_t, const ros::Time&) {
+        const auto done = Clock::now().time_since_epoch().count();
+        latencies_us.push_back(
+            (done - frame_fed_ns[ls.frame_id % FRAMES].load()) / 1e3);
+    });
+
+    auto stats = std::make_shared<PipelineStats>();
+    stats->register_processor("point_cloud");
+    stats->register_processor("latency");
+
+    const auto usage_start = Usage::now();
+    {
+        auto handler = LidarPacketHandler::create(
+            info, processors, "", 0, 0.0f, stats, {}, {}, nullptr,
+            inline_processing);
+
+        // emulates the sensor connection thread, packets are sent at the rate
+        // of the sensor
+        std::thread receiver([&]() {
+            pthread_setname_np(pthread_self(), "os_sensor_recv");
+            const auto packets = frames[0].size();
+            const auto period = std::chrono::nanoseconds(static_cast<int64_t>(
+                1e9 / frequency_of_lidar_mode(info.config.lidar_mode.value()) /
+                packets));
+            auto next = Clock::now();
+            // one extra frame to complete the last measured one
+            for (int f = 0; f <= scans; ++f) {
+                const auto& frame = frames[f % FRAMES];
+                for (size_t p = 0; p < packets; ++p) {
+                    std::this_thread::sleep_until(next);
+                    next += period;
+                    if (p + 1 == packets)
+                        frame_fed_ns[f % FRAMES] =
+                            Clock::now().time_since_epoch().count();
+                    handler(frame[p]);
+                }
+            }
+        });
+        receiver.join();
+        // let the processing thread drain the ring
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }
+    const auto usage_end = Usage::now();
+
+    const auto processed = latencies_us.size();
+    std::sort(latencies_us.begin(), latencies_us.end());
+    double mean = 0;
+    for (auto l : latencies_us) mean += l;
+    mean /= std::max<size_t>(processed, 1);
+
+    std::cout << label << std::endl
+              << std::fixed << std::setprecision(1)
+              << "  scans processed " << processed << "/" << scans
+              << ", dropped packets " << stats->dropped_packets.load()
+              << ", throttled scans " << stats->scans_throttled.load()
+              << std::endl;
+    if (processed) {
+        std::cout << "  latency mean=" << mean
+                  << " p50=" << latencies_us[processed / 2]
+                  << " p99=" << latencies_us[processed * 99 / 100] << " us"
+                  << std::endl;
+    }
+    std::cout << "  cpu per scan "
+              << 1e3 * (usage_end.cpu_s - usage_start.cpu_s) / scans
+              << " ms, context switches per scan "
+              << double(usage_end.switches - usage_start.switches) / scans
+              << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    const int scans = argc > 1 ? std::stoi(argv[1]) : 100;
+    const auto info = make_sensor_info();
+    const auto frames = make_frames(info);
+
+    cpu_set_t cpus;
+    sched_getaffinity(0, sizeof(cpus), &cpus);
+    std::cout << "cpus available: " << CPU_COUNT(&cpus)
+              << ", packets per frame: " << frames[0].size() << std::endl;
+    // the models only differ once the receive and processing threads can run
+    // side by side, which is what the comparison is about
+    if (CPU_COUNT(&cpus) < 2)
+        std::cerr << "a single cpu is available, run the comparison pinned to "
+                     "2 cores (taskset -c 0,1)" << std::endl;
+
+    threading::InlineProcessing inline_processing;
+    inline_processing.enabled = true;
+    // as if the driver managed to grow the socket buffer to a frame of packets
+    inline_processing.deadline = threading::receive_buffer_deadline(
+        threading::frame_receive_bytes(info), info);
+
+    run("THREADED", info, frames, {}, scans);
+    run("INLINE", info, frames, inline_processing, scans);
+    return 0;
+}
@@ -0,0 +1,115 @@
+/**
+ * Copyright (c) 2018-2024, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file lidar_scan_plugin.h
+ * @brief Interface for custom per scan stages loaded into os_driver/os_cloud
+ *
+ * Plugins run on the lidar scan processing thread after the built-in
+ * processors and get direct access to the LidarScan and the xyz coordinates
+ * computed for the point cloud, without going through a PointCloud2. The
+ * coordinates are only those of the scan when LidarScanProducts::xyz_valid
+ * says so.
+ *
+ * A plugin package exports its classes with pluginlib:
+ *
+ *   // ground_removal.cpp
+ *   #include <pluginlib/class_list_macros.h>
+ *   #include <ouster_ros/lidar_scan_plugin.h>
+ *   class GroundRemoval : public ouster_ros::LidarScanPlugin { ... };
+ *   PLUGINLIB_EXPORT_CLASS(my_pkg::GroundRemoval, ouster_ros::LidarScanPlugin)
+ *
+ *   <!-- plugins.xml -->
+ *   <library path="lib/libmy_pkg">
+ *     <class type="my_pkg::GroundRemoval"
+ *            base_class_type="ouster_ros::LidarScanPlugin"/>
+ *   </library>
+ *
+ *   <!-- package.xml -->
+ *   <export><ouster_ros plugin="${prefix}/plugins.xml"/></export>
+ *
+ * and gets loaded by listing it in the `scan_plugins` launch arg:
+ *   roslaunch ouster_ros driver.launch scan_plugins:="my_pkg::GroundRemoval"
+ */
+
+#pragma once
+
+#include <ros/ros.h>
+
+#include <ouster/lidar_scan.h>
+#include <ouster/types.h>
+#include <ouster/xyzlut.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ouster_ros {
+
+/**
+ * Products of the built-in processors for the current scan, only valid for
+ * the duration of LidarScanPlugin::process.
+ */
+struct LidarScanProducts {
+    // cartesian coordinates of every pixel for each return, in the same
+    // staggered row major layout as the LidarScan fields with NaNs for pixels
+    // outside of [min_range, max_range] or masked out. Empty unless the PCL
+    // processor is enabled.
+    std::vector<const ouster::sdk::core::PointCloudXYZf*> xyz;
+
+    // frame_id and timestamp of the scan xyz was computed for, -1 and 0 while
+    // nothing was computed. The PCL processor doesn't run on every scan when
+    // it is decimated, shed past its deadline or dropped under overload, xyz
+    // then still holds the coordinates of an earlier scan.
+    int64_t frame_id = -1;
+    uint64_t scan_ts = 0;
+
+    // whether xyz holds the coordinates of the given scan
+    bool xyz_valid(const ouster::sdk::core::LidarScan& scan,
+                   uint64_t scan_ts) const {
+        return !xyz.empty() && frame_id != -1 && frame_id == scan.frame_id &&
+               this->scan_ts == scan_ts;
+    }
+};
+
+class LidarScanPlugin {
+   public:
+    virtual ~LidarScanPlugin() = default;
+
+    /**
+     * Invoked once the sensor metadata is known, before the first scan.
+     * @param[in] nh node handle of the hosting nodelet.
+     * @param[in] pnh private node handle of the hosting nodelet.
+     * @param[in] info sensor metadata.
+     */
+    virtual void initialize(ros::NodeHandle& nh, ros::NodeHandle& pnh,
+                            const ouster::sdk::core::SensorInfo& info) = 0;
+
+    /**
+     * Lists the LidarScan fields read by the plugin, fields that no processor
+     * or plugin needs aren't decoded. Defaults to every field of the profile.
+     */
+    virtual std::vector<std::string> required_fields(
+        const ouster::sdk::core::SensorInfo& info) const {
+        std::vector<std::string> fields;
+        for (const auto& ft :
+             ouster::sdk::core::get_field_types(info.format.udp_profile_lidar))
+            fields.push_back(ft.name);
+        return fields;
+    }
+
+    /**
+     * Invoked for every scan on the lidar scan processing thread, the scan
+     * and products must not be retained past the call. Long running work
+     * delays the publishing of the next scans.
+     * @param[in] scan the lidar scan.
+     * @param[in] scan_ts the scan timestamp in nanoseconds.
+     * @param[in] msg_ts the timestamp used for the published messages.
+     * @param[in] products outputs of the built-in processors.
+     */
+    virtual void process(const ouster::sdk::core::LidarScan& scan,
+                         uint64_t scan_ts, const ros::Time& msg_ts,
+                         const LidarScanProducts& products) = 0;
+};
+
+}  // namespace ouster_ros
@@ -68,6 +68,22 @@ std::vector<sensor_msgs::Imu> packet_to_imu_msgs(
     const ros::Time& timestamp,
     const ouster::sdk::core::SensorInfo& sensor_info);
 
+/**
+ * Parse an imu packet message into a preallocated list of ROS imu messages
+ * @param[out] msgs the ROS imu messages, the vector is cleared and refilled
+ * while retaining its capacity to avoid reallocating on every packet
+ * @param[in] imu_packet the raw IMU packet populated by read_imu_packet
+ * @param[in] timestamp the timestamp to give the resulting ROS message
+ * @param[in] frame the frame to set in the resulting ROS message
+ * @param[in] sensor_info the sensor information
+ */
+void packet_to_imu_msgs(
+    std::vector<sensor_msgs::Imu>& msgs,
+    const ouster::sdk::core::ImuPacket& imu_packet,
+    const std::string& frame,
+    const ros::Time& timestamp,
+    const ouster::sdk::core::SensorInfo& sensor_info);
+
 /**
  * Convert transformation matrix return by sensor to ROS transform
  * @param[in] mat transformation matrix return by sensor
@@ -100,6 +116,27 @@ sensor_msgs::LaserScan lidar_scan_to_laser_scan_msg(
     const uint16_t ring, const std::vector<int>& pixel_shift_by_row,
     const int return_index);
 
+/**
+ * Same as lidar_scan_to_laser_scan_msg but fills a preallocated message in
+ * place, reusing the ranges and intensities buffers of the message.
+ * @param[out] msg LaserScan message to populate
+ * @param[in] ls lidar scan object
+ * @param[in] timestamp value to set as the timestamp of the generated
+ * @param[in] frame the parent frame of the generated laser scan message
+ * @param[in] lidar_mode lidar mode (width x frequency)
+ * @param[in] ring selected ring to be published
+ * @param[in] pixel_shift_by_row pixel shifts by row
+ * @param[in] return_index index of return desired starting at 0
+ */
+void lidar_scan_to_laser_scan_msg(
+    sensor_msgs::LaserScan& msg,
+    const ouster::sdk::core::LidarScan& ls,
+    const ros::Time& timestamp,
+    const std::string &frame,
+    const ouster::sdk::core::LidarMode lidar_mode,
+    const uint16_t ring, const std::vector<int>& pixel_shift_by_row,
+    const int return_index);
+
 /**
  * Parse a LidarPacket and generate the Telemetry message
  * @param[in] lidar_packet lidar packet to parse telemetry data from
@@ -135,6 +172,23 @@ inline ouster::sdk::core::img_t<T> get_or_fill_zero(const std::string& field,
     return result;
 }
 
+/**
+ * Same as get_or_fill_zero but writes into a preallocated destination
+ * @remark dest is only resized if its dimensions don't match the scan which
+ * means no allocations occur once dest has been sized properly.
+ */
+template <typename T>
+inline void get_or_fill_zero(const std::string& field,
+                             const ouster::sdk::core::LidarScan& ls,
+                             ouster::sdk::core::img_t<T>& dest) {
+    dest.resize(ls.h, ls.w);
+    if (!ls.has_field(field)) {
+        dest.setZero();
+        return;
+    }
+    ouster::sdk::core::impl::visit_field(ls, field, read_and_cast(), dest);
+}
+
 /**
  * simple utility function that ensures we don't wrap around uint64_t due
  * to a negative value being bigger than ts value in absolute terms.
@@ -31,6 +31,30 @@ using ouster::sdk::core::ChanFieldType;
 template <size_t N>
 using ChanFieldTable = Table<const char*, ChanFieldType, N>;
 
+template <ChanFieldType T>
+struct TypeSelector { /*undefined*/
+};
+
+template <>
+struct TypeSelector<ChanFieldType::UINT8> {
+    typedef uint8_t type;
+};
+
+template <>
+struct TypeSelector<ChanFieldType::UINT16> {
+    typedef uint16_t type;
+};
+
+template <>
+struct TypeSelector<ChanFieldType::UINT32> {
+    typedef uint32_t type;
+};
+
+template <>
+struct TypeSelector<ChanFieldType::UINT64> {
+    typedef uint64_t type;
+};
+
 }
 
 
@@ -0,0 +1,385 @@
+/**
+ * Copyright (c) 2018-2024, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file shm_packet_ring.h
+ * @brief Fans the raw packets received by a single os_sensor out to the other
+ * processes of the host through a ring in POSIX shared memory
+ *
+ * With a multicast sensor every process that wants raw packets otherwise joins
+ * the group and receives and decodes the packets on its own. With
+ * packet_fanout set, os_sensor copies each packet it receives into a ring of
+ * slots once, and any number of readers on the host take the packets from the
+ * ring:
+ *
+ *   ouster_ros::ShmPacketRingReader reader;
+ *   if (reader.attach(ouster_ros::shm::packet_ring_name(
+ *           nh.resolveName("lidar_packets")))) {
+ *       std::vector<uint8_t> buf;
+ *       uint64_t host_timestamp;
+ *       while (reader.read(buf, host_timestamp)) process(buf, host_timestamp);
+ *   }
+ *
+ * The writer never waits on the readers, they map the ring read only and each
+ * keeps its own position: a reader attaching at any time starts with the next
+ * packet written, one falling more than a ring behind loses the packets that
+ * were overwritten and learns how many through lost(). Every slot carries the
+ * index of the packet it holds, which the writer clears before overwriting the
+ * slot, so a reader detects a packet overwritten while it copied it.
+ *
+ * Idle readers block in wait() on a futex the writer bumps with every packet,
+ * rather than polling the head of the ring. The header also identifies the
+ * writer process, so readers of a ring left behind by a crashed writer, which
+ * never gets closed, find out through writer_alive().
+ */
+
+#pragma once
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "ouster_ros/shm_process.h"
+
+namespace ouster_ros {
+
+namespace shm {
+
+// placed at the start of the ring, followed by the slots
+struct PacketRingHeader {
+    static constexpr uint32_t MAGIC = 0x4f535032;  // "OSP2"
+
+    std::atomic<uint32_t> magic;   // set once the ring is initialized
+    uint32_t slot_count;
+    uint64_t slot_size;            // payload bytes of a slot
+    uint64_t slot_stride;          // bytes from one slot to the next
+    std::atomic<uint64_t> head;    // number of packets written
+    std::atomic<uint32_t> closed;  // set once the writer is gone
+    // futex bumped and woken after every packet and when the ring closes
+    std::atomic<uint32_t> signal;
+    uint32_t writer_pid;
+    // start time of the writer process, tells it apart from a later process
+    // reusing its pid
+    uint64_t writer_start;
+    // pid namespace of the writer, its pid means nothing in other namespaces
+    uint64_t writer_pid_ns;
+};
+
+// placed at the start of every slot, followed by the packet
+struct PacketSlotHeader {
+    // index + 1 of the packet held, zero while the slot is being written
+    std::atomic<uint64_t> stamp;
+    std::atomic<uint64_t> host_timestamp;
+    std::atomic<uint64_t> size;
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free &&
+                  std::atomic<uint64_t>::is_always_lock_free,
+              "shared memory atomics need to be lock free");
+
+// keeps the header and the packets of the slots cache line aligned
+constexpr size_t RING_HEADER_SIZE = 64;
+constexpr size_t SLOT_HEADER_SIZE = 64;
+static_assert(sizeof(PacketRingHeader) <= RING_HEADER_SIZE, "header too large");
+static_assert(sizeof(PacketSlotHeader) <= SLOT_HEADER_SIZE, "header too large");
+
+inline size_t slot_stride(size_t slot_size) {
+    return SLOT_HEADER_SIZE + (slot_size + 63) / 64 * 64;
+}
+
+inline size_t ring_length(size_t slot_count, size_t slot_size) {
+    return RING_HEADER_SIZE + slot_count * slot_stride(slot_size);
+}
+
+inline PacketSlotHeader* slot(PacketRingHeader* header, uint64_t index) {
+    return reinterpret_cast<PacketSlotHeader*>(
+        reinterpret_cast<uint8_t*>(header) + RING_HEADER_SIZE +
+        (index % header->slot_count) * header->slot_stride);
+}
+
+inline uint8_t* packet(PacketSlotHeader* slot) {
+    return reinterpret_cast<uint8_t*>(slot) + SLOT_HEADER_SIZE;
+}
+
+inline void futex_wake(std::atomic<uint32_t>& word) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, INT_MAX,
+            nullptr, nullptr, 0);
+}
+
+// returns once word no longer holds value, on a wake up or once timeout expires
+inline void futex_wait(const std::atomic<uint32_t>& word, uint32_t value,
+                       std::chrono::nanoseconds timeout) {
+    const auto secs = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+    struct timespec ts;
+    ts.tv_sec = secs.count();
+    ts.tv_nsec = (timeout - secs).count();
+    syscall(SYS_futex,
+            reinterpret_cast<uint32_t*>(const_cast<std::atomic<uint32_t>*>(&word)),
+            FUTEX_WAIT, value, &ts, nullptr, 0);
+}
+
+// the ring of the packets published on topic, a fully resolved topic name
+inline std::string packet_ring_name(const std::string& topic) {
+    std::string name = "/ouster_ros";
+    for (char c : topic) name += (c == '/' ? '_' : c);
+    return name + "_ring";
+}
+
+}  // namespace shm
+
+/**
+ * Producer side: creates the ring, writes to it from a single thread and
+ * unlinks it once destroyed.
+ */
+class ShmPacketRingWriter {
+   public:
+    /**
+     * @param[in] name name of the shm object, see shm::packet_ring_name.
+     * @param[in] slots number of packets the ring holds.
+     * @param[in] slot_size largest packet the ring takes.
+     */
+    ShmPacketRingWriter(const std::string& name, size_t slots,
+                        size_t slot_size)
+        : name_(name), length_(shm::ring_length(slots, slot_size)) {
+        if (slots == 0 || slots > UINT32_MAX)
+            throw std::invalid_argument("invalid number of packet ring slots");
+        // drop leftovers of a previous run that didn't shut down cleanly
+        shm_unlink(name_.c_str());
+        // readers only map the ring for reading
+        int fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+        if (fd < 0)
+            throw std::runtime_error("failed to create packet ring " + name_);
+        void* addr = MAP_FAILED;
+        // populated upfront so that writes don't fault on the receive thread
+        if (ftruncate(fd, length_) == 0)
+            addr = mmap(nullptr, length_, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd, 0);
+        ::close(fd);
+        if (addr == MAP_FAILED) {
+            shm_unlink(name_.c_str());
+            throw std::runtime_error("failed to map packet ring " + name_);
+        }
+        header_ = static_cast<shm::PacketRingHeader*>(addr);
+        header_->slot_count = static_cast<uint32_t>(slots);
+        header_->slot_size = slot_size;
+        header_->slot_stride = shm::slot_stride(slot_size);
+        header_->head.store(0);
+        header_->closed.store(0);
+        header_->signal.store(0);
+        header_->writer_pid = static_cast<uint32_t>(getpid());
+        header_->writer_start = shm::process_start_time(header_->writer_pid);
+        header_->writer_pid_ns = shm::pid_namespace();
+        for (size_t i = 0; i < slots; ++i) {
+            auto slot = shm::slot(header_, i);
+            slot->stamp.store(0);
+            slot->size.store(0);
+        }
+        // readers ignore the ring until its magic is in place
+        header_->magic.store(shm::PacketRingHeader::MAGIC,
+                             std::memory_order_release);
+    }
+
+    ShmPacketRingWriter(const ShmPacketRingWriter&) = delete;
+    ShmPacketRingWriter& operator=(const ShmPacketRingWriter&) = delete;
+
+    // readers still attached see the ring closed and let go of it
+    ~ShmPacketRingWriter() {
+        header_->closed.store(1, std::memory_order_release);
+        header_->signal.fetch_add(1, std::memory_order_release);
+        shm::futex_wake(header_->signal);
+        munmap(header_, length_);
+        shm_unlink(name_.c_str());
+    }
+
+    /**
+     * Copies the packet into the oldest slot, whether readers are done with
+     * it or not.
+     * @return false when the packet is larger than the slots.
+     */
+    bool write(const uint8_t* data, size_t size, uint64_t host_timestamp) {
+        if (size > header_->slot_size) {
+            ++oversized_;
+            return false;
+        }
+        const uint64_t index = header_->head.load(std::memory_order_relaxed);
+        auto slot = shm::slot(header_, index);
+        slot->stamp.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot->host_timestamp.store(host_timestamp, std::memory_order_relaxed);
+        slot->size.store(size, std::memory_order_relaxed);
+        std::memcpy(shm::packet(slot), data, size);
+        slot->stamp.store(index + 1, std::memory_order_release);
+        header_->head.store(index + 1, std::memory_order_release);
+        // a wake up without waiters is a cheap syscall, the readers map the
+        // ring read only and can't tell the writer they are waiting
+        header_->signal.fetch_add(1, std::memory_order_release);
+        shm::futex_wake(header_->signal);
+        return true;
+    }
+
+    const std::string& name() const { return name_; }
+
+    size_t slots() const { return header_->slot_count; }
+
+    uint64_t written() const {
+        return header_->head.load(std::memory_order_relaxed);
+    }
+
+    // number of packets dropped for being larger than the slots
+    uint64_t oversized() const { return oversized_; }
+
+   private:
+    const std::string name_;
+    const size_t length_;
+    shm::PacketRingHeader* header_ = nullptr;
+    uint64_t oversized_ = 0;
+};
+
+/**
+ * Consumer side: maps a ring created by a ShmPacketRingWriter read only and
+ * reads the packets written after it attached, from a single thread.
+ */
+class ShmPacketRingReader {
+   public:
+    ShmPacketRingReader() = default;
+    ShmPacketRingReader(const ShmPacketRingReader&) = delete;
+    ShmPacketRingReader& operator=(const ShmPacketRingReader&) = delete;
+
+    ~ShmPacketRingReader() { detach(); }
+
+    /**
+     * Maps the ring, the next read returns the next packet written.
+     * @return false when the ring doesn't exist or isn't ready yet.
+     */
+    bool attach(const std::string& name) {
+        detach();
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0) return false;
+        struct stat st;
+        void* addr = MAP_FAILED;
+        if (fstat(fd, &st) == 0 &&
+            static_cast<size_t>(st.st_size) >= shm::RING_HEADER_SIZE)
+            addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (addr == MAP_FAILED) return false;
+
+        auto header = static_cast<shm::PacketRingHeader*>(addr);
+        const size_t length = st.st_size;
+        if (header->magic.load(std::memory_order_acquire) !=
+                shm::PacketRingHeader::MAGIC || header->slot_count == 0 ||
+            header->slot_stride != shm::slot_stride(header->slot_size) ||
+            length < shm::ring_length(header->slot_count, header->slot_size)) {
+            munmap(addr, length);
+            return false;
+        }
+        header_ = header;
+        length_ = length;
+        next_ = header_->head.load(std::memory_order_acquire);
+        lost_ = 0;
+        return true;
+    }
+
+    void detach() {
+        if (header_) munmap(header_, length_);
+        header_ = nullptr;
+        length_ = 0;
+    }
+
+    bool attached() const { return header_ != nullptr; }
+
+    // whether the writer of the ring is gone, the reader should detach
+    bool closed() const {
+        return header_->closed.load(std::memory_order_acquire) != 0;
+    }
+
+    /**
+     * Whether the process of the writer still runs, a writer that crashed
+     * leaves the ring open. Reads /proc so it isn't meant to be called per
+     * packet.
+     * @return true when it can't be told from this process.
+     */
+    bool writer_alive() const {
+        if (header_->writer_start == 0 || header_->writer_pid_ns == 0 ||
+            header_->writer_pid_ns != shm::pid_namespace())
+            return true;
+        return shm::process_start_time(header_->writer_pid) ==
+               header_->writer_start;
+    }
+
+    /**
+     * Blocks until a packet is written after the last one read, the ring is
+     * closed or the timeout expires.
+     * @return whether there is a packet to read or the ring was closed.
+     */
+    bool wait(std::chrono::nanoseconds timeout) {
+        const uint32_t signal =
+            header_->signal.load(std::memory_order_acquire);
+        if (ready()) return true;
+        shm::futex_wait(header_->signal, signal, timeout);
+        return ready();
+    }
+
+    /**
+     * Copies the next packet into buf, skipping over the packets overwritten
+     * before they could be read.
+     * @return false when there is no new packet.
+     */
+    bool read(std::vector<uint8_t>& buf, uint64_t& host_timestamp) {
+        const uint64_t slots = header_->slot_count;
+        while (true) {
+            const uint64_t head = header_->head.load(std::memory_order_acquire);
+            if (next_ == head) return false;
+            if (head - next_ > slots) {
+                // lapped by the writer
+                lost_ += head - next_ - slots;
+                next_ = head - slots;
+            }
+            if (copy(next_++, buf, host_timestamp)) return true;
+            ++lost_;
+        }
+    }
+
+    // number of packets the writer overwrote before they were read since the
+    // ring was attached
+    uint64_t lost() const { return lost_; }
+
+   private:
+    bool ready() const {
+        return next_ != header_->head.load(std::memory_order_acquire) ||
+               closed();
+    }
+
+    // false when the slot no longer holds the packet of the given index
+    bool copy(uint64_t index, std::vector<uint8_t>& buf,
+              uint64_t& host_timestamp) {
+        auto slot = shm::slot(header_, index);
+        if (slot->stamp.load(std::memory_order_acquire) != index + 1)
+            return false;
+        const size_t size = slot->size.load(std::memory_order_relaxed);
+        host_timestamp = slot->host_timestamp.load(std::memory_order_relaxed);
+        if (size > header_->slot_size) return false;
+        buf.resize(size);
+        std::memcpy(buf.data(), shm::packet(slot), size);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slot->stamp.load(std::memory_order_relaxed) == index + 1;
+    }
+
+    shm::PacketRingHeader* header_ = nullptr;
+    size_t length_ = 0;
+    uint64_t next_ = 0;
+    uint64_t lost_ = 0;
+};
+
+}  // namespace ouster_ros
@@ -0,0 +1,49 @@
+/**
+ * Copyright (c) 2018-2024, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file shm_process.h
+ * @brief Identifies the processes sharing memory segments, a pid only names
+ * the same process within the pid namespace it was taken from
+ */
+
+#pragma once
+
+#include <sys/stat.h>
+
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+namespace ouster_ros {
+
+namespace shm {
+
+// start time of the process in clock ticks since boot, 0 when unknown
+inline uint64_t process_start_time(uint32_t pid) {
+    std::ifstream stat_file("/proc/" + std::to_string(pid) + "/stat");
+    std::string stat;
+    std::getline(stat_file, stat);
+    // the process name is enclosed in parentheses and may hold spaces
+    auto close = stat.rfind(')');
+    if (close == std::string::npos) return 0;
+    std::istringstream rest(stat.substr(close + 2));
+    std::string field;
+    // the start time is the 22nd field of stat, the remainder starts at the
+    // 3rd field
+    for (int i = 3; i < 22; ++i) rest >> field;
+    uint64_t start = 0;
+    rest >> start;
+    return start;
+}
+
+// inode of the pid namespace of this process, 0 when unknown
+inline uint64_t pid_namespace() {
+    struct stat st;
+    return stat("/proc/self/ns/pid", &st) == 0 ? st.st_ino : 0;
+}
+
+}  // namespace shm
+
+}  // namespace ouster_ros
@@ -0,0 +1,524 @@
+/**
+ * Copyright (c) 2018-2024, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file shm_transport.h
+ * @brief Moves point clouds and images to other processes through POSIX shared
+ * memory instead of TCPROS
+ *
+ * The driver writes the payload of each message into one of a small ring of
+ * shared memory segments and publishes a ShmPointCloud2/ShmImage handle which
+ * carries the message metadata and a ShmBuffer reference to the segment.
+ * Consumers map the segment once and access the payload in place:
+ *
+ *   ouster_ros::ShmReader reader;
+ *   void on_cloud(const ouster_ros::ShmPointCloud2::ConstPtr& msg) {
+ *       auto view = reader.acquire(msg->buffer);
+ *       if (!view) return;  // the driver already reused the segment
+ *       process(msg->cloud, view.data(), view.size());
+ *   }  // the segment is released once the view goes out of scope
+ *
+ * A segment that is held by a reader is never overwritten, the driver moves on
+ * to the next free one and skips the message when all of them are held.
+ * Readers should therefore release their views promptly. The references are
+ * also kept per reader process so that those of a process that died while
+ * holding a segment are taken back instead of pinning the segment for good.
+ * Reader processes are told apart by their pid and pid namespace, a process
+ * only takes back the references of processes in its own pid namespace.
+ *
+ * Every ShmWriter stamps its segments and handles with a random id, a driver
+ * restarting under the same name recreates the segments and readers still
+ * mapping the old ones remap them on the first handle of the new writer.
+ */
+
+#pragma once
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/PointCloud2.h>
+
+#include "ouster_ros/ShmBuffer.h"
+#include "ouster_ros/ShmImage.h"
+#include "ouster_ros/ShmPointCloud2.h"
+#include "ouster_ros/shm_process.h"
+
+namespace ouster_ros {
+
+namespace shm {
+
+// the references a reader process holds on a segment
+struct Holder {
+    // set while reclaim() frees the slot, beyond any valid pid
+    static constexpr uint32_t RECLAIMING = 0xffffffffu;
+
+    std::atomic<uint32_t> pid;  // 0 while the slot is free
+    std::atomic<uint32_t> refs;
+    // pid namespace the pid belongs to, 0 until the slot is fully claimed
+    std::atomic<uint64_t> pid_ns;
+};
+
+// placed at the start of every segment, followed by the payload
+struct SegmentHeader {
+    static constexpr uint32_t MAGIC = 0x4f534d33;  // "OSM3"
+    // set in refs while the writer owns the segment
+    static constexpr uint32_t WRITING = 0x80000000u;
+    // number of reader processes that can hold the segment at the same time
+    static constexpr size_t MAX_HOLDERS = 8;
+
+    std::atomic<uint32_t> magic;  // set once the segment is initialized
+    std::atomic<uint32_t> refs;   // number of readers holding the segment
+    std::atomic<uint64_t> seq;    // sequence of the current payload, 0 if none
+    uint64_t capacity;            // payload bytes following the header
+    uint64_t size;                // payload bytes in use
+    uint64_t writer;              // id of the ShmWriter that created it
+    Holder holders[MAX_HOLDERS];
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free &&
+                  std::atomic<uint64_t>::is_always_lock_free,
+              "shared memory atomics need to be lock free");
+
+// keeps the payload cache line aligned
+constexpr size_t PAYLOAD_OFFSET = 192;
+static_assert(sizeof(SegmentHeader) <= PAYLOAD_OFFSET, "header too large");
+
+inline uint8_t* payload(SegmentHeader* header) {
+    return reinterpret_cast<uint8_t*>(header) + PAYLOAD_OFFSET;
+}
+
+// a pid we aren't allowed to signal still belongs to a live process, only
+// meaningful for pids of the pid namespace of the caller
+inline bool alive(uint32_t pid) {
+    return kill(static_cast<pid_t>(pid), 0) == 0 || errno != ESRCH;
+}
+
+// the slot of the process among the holders of the segment, claims a free one
+// on the first use and nullptr when all of them are taken
+inline Holder* holder(SegmentHeader* header, uint32_t pid, uint64_t pid_ns) {
+    for (auto& h : header->holders)
+        if (h.pid.load(std::memory_order_relaxed) == pid &&
+            h.pid_ns.load(std::memory_order_acquire) == pid_ns)
+            return &h;
+    for (auto& h : header->holders) {
+        uint32_t free = 0;
+        if (h.pid.compare_exchange_strong(free, pid,
+                                          std::memory_order_relaxed)) {
+            h.pid_ns.store(pid_ns, std::memory_order_release);
+            return &h;
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * Takes back the references held by processes of the pid namespace pid_ns
+ * that are gone and frees their slots, safe to call from any process at any
+ * time. The pids of other namespaces can't be checked from here and neither
+ * can any pid when the namespace is unknown.
+ * @return the number of references taken back.
+ */
+inline uint32_t reclaim(SegmentHeader* header, uint64_t pid_ns) {
+    if (pid_ns == 0) return 0;
+    uint32_t reclaimed = 0;
+    for (auto& h : header->holders) {
+        uint32_t pid = h.pid.load(std::memory_order_relaxed);
+        if (pid == 0 || pid == Holder::RECLAIMING ||
+            h.pid_ns.load(std::memory_order_acquire) != pid_ns || alive(pid))
+            continue;
+        // a single process frees the slot, claims only take free slots
+        if (!h.pid.compare_exchange_strong(pid, Holder::RECLAIMING,
+                                           std::memory_order_acquire))
+            continue;
+        // readers count a reference towards refs before their own slot, the
+        // slot never holds more than the process added to refs
+        const uint32_t refs = h.refs.exchange(0, std::memory_order_acq_rel);
+        if (refs) header->refs.fetch_sub(refs, std::memory_order_release);
+        h.pid_ns.store(0, std::memory_order_relaxed);
+        h.pid.store(0, std::memory_order_release);
+        reclaimed += refs;
+    }
+    return reclaimed;
+}
+
+// a random nonzero id telling writers that reuse a name apart
+inline uint64_t writer_id() {
+    std::random_device rd;
+    const uint64_t id =
+        (static_cast<uint64_t>(rd()) << 32 | rd()) ^
+        static_cast<uint64_t>(
+            std::chrono::steady_clock::now().time_since_epoch().count()) ^
+        static_cast<uint64_t>(getpid());
+    return id ? id : 1;
+}
+
+// shm object names may only contain a single leading slash
+inline std::string segment_name(const std::string& prefix, size_t index) {
+    std::string name = "/ouster_ros";
+    for (char c : prefix) name += (c == '/' ? '_' : c);
+    return name + "_" + std::to_string(index);
+}
+
+}  // namespace shm
+
+/**
+ * Producer side: owns a ring of shared memory segments and unlinks them once
+ * destroyed. Segments are created lazily and grown to fit the payload, failing
+ * to do so doesn't throw but fails the write, see failed() and error().
+ */
+class ShmWriter {
+   public:
+    /**
+     * @param[in] prefix unique name of the stream, typically the topic name.
+     * @param[in] segments number of segments in the ring.
+     */
+    ShmWriter(const std::string& prefix, size_t segments)
+        : segments_(segments),
+          id_(shm::writer_id()),
+          pid_ns_(shm::pid_namespace()) {
+        if (segments == 0)
+            throw std::invalid_argument("shm transport needs a segment");
+        for (size_t i = 0; i < segments_.size(); ++i)
+            segments_[i].name = shm::segment_name(prefix, i);
+    }
+
+    ShmWriter(const ShmWriter&) = delete;
+    ShmWriter& operator=(const ShmWriter&) = delete;
+
+    ~ShmWriter() {
+        for (auto& s : segments_) {
+            if (!s.header) continue;
+            munmap(s.header, s.mapped);
+            shm_unlink(s.name.c_str());
+        }
+    }
+
+    /**
+     * Copies the payload into the next segment that isn't held by a reader.
+     * When every segment is held the references of readers that died are
+     * taken back before giving up.
+     * @return the reference to publish or nothing if every segment is held or
+     * a segment couldn't be created or grown.
+     */
+    std::optional<ShmBuffer> write(const uint8_t* data, size_t size) {
+        for (int attempt = 0; attempt < 2; ++attempt) {
+            for (size_t k = 0; k < segments_.size(); ++k) {
+                auto& s = segments_[(next_ + k) % segments_.size()];
+                if (!s.header && !open(s, size)) return fail();
+                uint32_t expected = 0;
+                if (!s.header->refs.compare_exchange_strong(
+                        expected, shm::SegmentHeader::WRITING,
+                        std::memory_order_acquire))
+                    continue;
+
+                if (s.header->capacity < size && !grow(s, size)) {
+                    s.header->refs.store(0, std::memory_order_release);
+                    return fail();
+                }
+                s.header->seq.store(0, std::memory_order_relaxed);
+                if (size) std::memcpy(shm::payload(s.header), data, size);
+                s.header->size = size;
+                s.header->seq.store(++seq_, std::memory_order_release);
+                s.header->refs.store(0, std::memory_order_release);
+
+                next_ = (next_ + k + 1) % segments_.size();
+                ShmBuffer buffer;
+                buffer.segment = s.name;
+                buffer.writer = id_;
+                buffer.seq = seq_;
+                buffer.size = size;
+                return buffer;
+            }
+            if (attempt == 0 && reclaim() == 0) break;
+        }
+        ++skipped_;
+        return std::nullopt;
+    }
+
+    // number of writes skipped because every segment was held by readers
+    uint64_t skipped() const { return skipped_; }
+
+    // number of writes that failed to create or grow a segment
+    uint64_t failed() const { return failed_; }
+
+    // describes the last failed write
+    const std::string& error() const { return error_; }
+
+    // number of references taken back from readers that died holding them
+    uint64_t reclaimed() const { return reclaimed_; }
+
+   private:
+    struct Segment {
+        std::string name;
+        shm::SegmentHeader* header = nullptr;
+        size_t mapped = 0;
+    };
+
+    std::optional<ShmBuffer> fail() {
+        ++failed_;
+        return std::nullopt;
+    }
+
+    uint32_t reclaim() {
+        uint32_t refs = 0;
+        for (auto& s : segments_)
+            if (s.header) refs += shm::reclaim(s.header, pid_ns_);
+        reclaimed_ += refs;
+        return refs;
+    }
+
+    bool open(Segment& s, size_t capacity) {
+        // drop leftovers of a previous run that didn't shut down cleanly
+        shm_unlink(s.name.c_str());
+        // readers need write access to take references, share with the group
+        int fd = shm_open(s.name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0660);
+        if (fd < 0) return error("failed to create shm segment ", s);
+        void* addr = map(fd, capacity);
+        if (addr == MAP_FAILED) {
+            shm_unlink(s.name.c_str());
+            return error("failed to map shm segment ", s);
+        }
+        s.header = static_cast<shm::SegmentHeader*>(addr);
+        s.mapped = shm::PAYLOAD_OFFSET + capacity;
+        s.header->capacity = capacity;
+        s.header->writer = id_;
+        s.header->refs.store(0);
+        s.header->seq.store(0);
+        s.header->size = 0;
+        for (auto& h : s.header->holders) {
+            h.pid.store(0);
+            h.refs.store(0);
+            h.pid_ns.store(0);
+        }
+        // readers ignore the segment until its magic is in place
+        s.header->magic.store(shm::SegmentHeader::MAGIC,
+                              std::memory_order_release);
+        return true;
+    }
+
+    // only called while the segment is owned by the writer, keeps the current
+    // mapping when growing fails
+    bool grow(Segment& s, size_t capacity) {
+        int fd = shm_open(s.name.c_str(), O_RDWR, 0);
+        if (fd < 0) return error("failed to open shm segment ", s);
+        void* addr = map(fd, capacity);
+        if (addr == MAP_FAILED) return error("failed to grow shm segment ", s);
+        munmap(s.header, s.mapped);
+        s.header = static_cast<shm::SegmentHeader*>(addr);
+        s.mapped = shm::PAYLOAD_OFFSET + capacity;
+        s.header->capacity = capacity;
+        return true;
+    }
+
+    // sizes and maps the segment, takes ownership of fd
+    static void* map(int fd, size_t capacity) {
+        const size_t length = shm::PAYLOAD_OFFSET + capacity;
+        void* addr = MAP_FAILED;
+        if (ftruncate(fd, length) == 0)
+            addr = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED,
+                        fd, 0);
+        ::close(fd);
+        return addr;
+    }
+
+    bool error(const char* what, const Segment& s) {
+        error_ = what + s.name + ": " + std::strerror(errno);
+        return false;
+    }
+
+    std::vector<Segment> segments_;
+    const uint64_t id_;
+    const uint64_t pid_ns_;
+    size_t next_ = 0;
+    uint64_t seq_ = 0;
+    uint64_t skipped_ = 0;
+    uint64_t failed_ = 0;
+    uint64_t reclaimed_ = 0;
+    std::string error_;
+};
+
+/**
+ * A payload held in shared memory, the segment stays reserved for as long as
+ * the view is alive.
+ */
+class ShmView {
+   public:
+    ShmView() = default;
+    ShmView(shm::SegmentHeader* header, shm::Holder* holder, size_t size)
+        : header_(header), holder_(holder), size_(size) {}
+    ShmView(ShmView&& other) noexcept { *this = std::move(other); }
+    ShmView& operator=(ShmView&& other) noexcept {
+        release();
+        std::swap(header_, other.header_);
+        std::swap(holder_, other.holder_);
+        size_ = other.size_;
+        return *this;
+    }
+    ShmView(const ShmView&) = delete;
+    ShmView& operator=(const ShmView&) = delete;
+    ~ShmView() { release(); }
+
+    explicit operator bool() const { return header_ != nullptr; }
+    const uint8_t* data() const { return shm::payload(header_); }
+    size_t size() const { return size_; }
+
+    void release() {
+        if (header_) {
+            holder_->refs.fetch_sub(1, std::memory_order_relaxed);
+            header_->refs.fetch_sub(1, std::memory_order_release);
+        }
+        header_ = nullptr;
+    }
+
+   private:
+    shm::SegmentHeader* header_ = nullptr;
+    shm::Holder* holder_ = nullptr;
+    size_t size_ = 0;
+};
+
+/**
+ * Consumer side: maps the segments referenced by ShmBuffer messages and keeps
+ * them mapped for reuse. The reader must outlive the views it hands out.
+ */
+class ShmReader {
+   public:
+    ShmReader()
+        : pid_(static_cast<uint32_t>(getpid())),
+          pid_ns_(shm::pid_namespace()) {}
+    ShmReader(const ShmReader&) = delete;
+    ShmReader& operator=(const ShmReader&) = delete;
+
+    ~ShmReader() {
+        for (auto& m : mappings_) munmap(m.second.first, m.second.second);
+    }
+
+    /**
+     * Reserves the segment referenced by buffer.
+     * @return an empty view if the segment is missing, being written,
+     * already holds a newer payload or is held by too many processes.
+     */
+    ShmView acquire(const ShmBuffer& buffer) {
+        auto header = map(buffer.segment, buffer.size, buffer.writer);
+        if (!header) return {};
+        auto holder = shm::holder(header, pid_, pid_ns_);
+        if (!holder && shm::reclaim(header, pid_ns_))
+            holder = shm::holder(header, pid_, pid_ns_);
+        if (!holder) return {};
+
+        uint32_t refs = header->refs.load(std::memory_order_relaxed);
+        do {
+            if (refs & shm::SegmentHeader::WRITING) return {};
+        } while (!header->refs.compare_exchange_weak(
+            refs, refs + 1, std::memory_order_acquire));
+        holder->refs.fetch_add(1, std::memory_order_relaxed);
+
+        if (header->seq.load(std::memory_order_acquire) != buffer.seq) {
+            holder->refs.fetch_sub(1, std::memory_order_relaxed);
+            header->refs.fetch_sub(1, std::memory_order_release);
+            return {};
+        }
+        return ShmView(header, holder, buffer.size);
+    }
+
+    ShmView acquire(const ShmPointCloud2& msg) { return acquire(msg.buffer); }
+    ShmView acquire(const ShmImage& msg) { return acquire(msg.buffer); }
+
+   private:
+    shm::SegmentHeader* map(const std::string& name, size_t size,
+                            uint64_t writer) {
+        const size_t length = shm::PAYLOAD_OFFSET + size;
+        auto it = mappings_.find(name);
+        if (it != mappings_.end()) {
+            auto header = static_cast<shm::SegmentHeader*>(it->second.first);
+            if (it->second.second >= length && header->writer == writer)
+                return header;
+            // the writer grew the segment or a new writer recreated it
+            munmap(it->second.first, it->second.second);
+            mappings_.erase(it);
+        }
+
+        int fd = shm_open(name.c_str(), O_RDWR, 0);
+        if (fd < 0) return nullptr;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < length) {
+            ::close(fd);
+            return nullptr;
+        }
+        void* addr = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (addr == MAP_FAILED) return nullptr;
+
+        auto header = static_cast<shm::SegmentHeader*>(addr);
+        if (header->magic.load(std::memory_order_acquire) !=
+                shm::SegmentHeader::MAGIC ||
+            header->writer != writer) {
+            // not ready yet or referenced by a handle of the previous writer
+            munmap(addr, st.st_size);
+            return nullptr;
+        }
+        mappings_[name] = {addr, static_cast<size_t>(st.st_size)};
+        return header;
+    }
+
+    const uint32_t pid_;
+    const uint64_t pid_ns_;
+    std::map<std::string, std::pair<void*, size_t>> mappings_;
+};
+
+/**
+ * Writes the data of the cloud into shared memory.
+ * @return the handle to publish or nothing when every segment is held.
+ */
+inline std::optional<ShmPointCloud2> to_shm_msg(
+    ShmWriter& writer, const sensor_msgs::PointCloud2& cloud) {
+    auto buffer = writer.write(cloud.data.data(), cloud.data.size());
+    if (!buffer) return std::nullopt;
+    ShmPointCloud2 msg;
+    msg.buffer = std::move(*buffer);
+    msg.cloud.header = cloud.header;
+    msg.cloud.height = cloud.height;
+    msg.cloud.width = cloud.width;
+    msg.cloud.fields = cloud.fields;
+    msg.cloud.is_bigendian = cloud.is_bigendian;
+    msg.cloud.point_step = cloud.point_step;
+    msg.cloud.row_step = cloud.row_step;
+    msg.cloud.is_dense = cloud.is_dense;
+    return msg;
+}
+
+/**
+ * Writes the data of the image into shared memory.
+ * @return the handle to publish or nothing when every segment is held.
+ */
+inline std::optional<ShmImage> to_shm_msg(ShmWriter& writer,
+                                          const sensor_msgs::Image& image) {
+    auto buffer = writer.write(image.data.data(), image.data.size());
+    if (!buffer) return std::nullopt;
+    ShmImage msg;
+    msg.buffer = std::move(*buffer);
+    msg.image.header = image.header;
+    msg.image.height = image.height;
+    msg.image.width = image.width;
+    msg.image.encoding = image.encoding;
+    msg.image.is_bigendian = image.is_bigendian;
+    msg.image.step = image.step;
+    return msg;
+}
+
+}  // namespace ouster_ros
@@ -0,0 +1,142 @@
+/**
+ * Copyright (c) 2018-2024, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file adaptive_quality.h
+ * @brief Trades the resolution of the outputs for the frame rate when the
+ * processing of a scan can't keep up with the sensor
+ *
+ * Without it an overloaded pipeline fills up the lidar scans ring until every
+ * other scan gets thrown away, halving the frame rate of all outputs. The
+ * AdaptiveQuality controller compares the time spent processing each scan to
+ * the frame period and steps through the degradation levels:
+ *   0: full quality
+ *   1: point clouds keep every 2nd row
+ *   2: point clouds keep every 4th row
+ *   3: every 4th row and the low priority processors are skipped
+ * A level is raised after a few consecutive scans over the high watermark and
+ * lowered again once the utilization stayed below the low watermark for a
+ * while. When lowering a level immediately overloads the pipeline again the
+ * wait before the next attempt is doubled, which keeps the controller from
+ * oscillating around a load that sits in between two levels.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <vector>
+
+#include <ouster/types.h>
+
+namespace ouster_ros {
+
+class AdaptiveQuality {
+   public:
+    // invoked on the processing thread whenever the level changes
+    using LevelChangedFn = std::function<void(int level)>;
+
+    static constexpr int FULL_QUALITY = 0;
+    static constexpr int MAX_LEVEL = 3;
+    // level from which the low priority processors are skipped
+    static constexpr int SKIP_LOW_PRIORITY_LEVEL = 3;
+
+    // utilization = processing time of a scan / frame period
+    static constexpr double HIGH_UTILIZATION = 0.9;
+    static constexpr double LOW_UTILIZATION = 0.5;
+    static constexpr int RAISE_AFTER_SCANS = 3;
+    static constexpr int RESTORE_AFTER_SCANS = 30;
+    static constexpr int MAX_RESTORE_AFTER_SCANS = 16 * RESTORE_AFTER_SCANS;
+
+    explicit AdaptiveQuality(std::chrono::nanoseconds frame_period,
+                             LevelChangedFn on_level_changed = {})
+        : frame_period_(frame_period),
+          on_level_changed_(std::move(on_level_changed)) {}
+
+    static std::chrono::nanoseconds frame_period_of(
+        const ouster::sdk::core::SensorInfo& info) {
+        const double frequency = ouster::sdk::core::frequency_of_lidar_mode(
+            info.config.lidar_mode.value());
+        return std::chrono::nanoseconds{
+            static_cast<int64_t>(1e9 / std::max(frequency, 1.0))};
+    }
+
+    // processors are identified by their index within the LidarPacketHandler
+    void set_low_priority(size_t processor) {
+        if (low_priority_.size() <= processor)
+            low_priority_.resize(processor + 1, false);
+        low_priority_[processor] = true;
+    }
+
+    bool skip(size_t processor) const {
+        return level() >= SKIP_LOW_PRIORITY_LEVEL &&
+               processor < low_priority_.size() && low_priority_[processor];
+    }
+
+    int level() const { return level_.load(std::memory_order_relaxed); }
+
+    // the factor by which the rows of the point clouds are reduced
+    int row_decimation() const {
+        static constexpr int row_decimation_of_level[MAX_LEVEL + 1] = {1, 2, 4,
+                                                                       4};
+        return row_decimation_of_level[level()];
+    }
+
+    /**
+     * Feeds the time spent processing the last scan to the controller, called
+     * once per scan from the thread that runs the processors.
+     */
+    void update(std::chrono::nanoseconds processing_time) {
+        const double utilization =
+            frame_period_.count() > 0
+                ? double(processing_time.count()) / frame_period_.count()
+                : 0.0;
+        ++scans_since_change_;
+        if (utilization > HIGH_UTILIZATION) {
+            scans_under_ = 0;
+            if (++scans_over_ >= RAISE_AFTER_SCANS && level() < MAX_LEVEL) {
+                // the last restore didn't hold, wait longer before the next
+                if (last_change_restored_ &&
+                    scans_since_change_ < restore_after_ + RAISE_AFTER_SCANS)
+                    restore_after_ = std::min(2 * restore_after_,
+                                              MAX_RESTORE_AFTER_SCANS);
+                else
+                    restore_after_ = RESTORE_AFTER_SCANS;
+                set_level(level() + 1, false);
+            }
+        } else if (utilization < LOW_UTILIZATION) {
+            scans_over_ = 0;
+            if (++scans_under_ >= restore_after_ && level() > FULL_QUALITY)
+                set_level(level() - 1, true);
+        } else {
+            scans_over_ = 0;
+            scans_under_ = 0;
+        }
+    }
+
+   private:
+    void set_level(int level, bool restored) {
+        level_.store(level, std::memory_order_relaxed);
+        last_change_restored_ = restored;
+        scans_since_change_ = 0;
+        scans_over_ = 0;
+        scans_under_ = 0;
+        if (on_level_changed_) on_level_changed_(level);
+    }
+
+    std::chrono::nanoseconds frame_period_;
+    LevelChangedFn on_level_changed_;
+    std::vector<bool> low_priority_;
+    std::atomic<int> level_{FULL_QUALITY};
+
+    // only touched by the processing thread
+    int scans_over_ = 0;
+    int scans_under_ = 0;
+    int scans_since_change_ = 0;
+    int restore_after_ = RESTORE_AFTER_SCANS;
+    bool last_change_restored_ = false;
+};
+
+}  // namespace ouster_ros
@@ -0,0 +1,219 @@
+/**
+ * Copyright (c) 2018-2024, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file async_publisher.h
+ * @brief Publishes the messages produced by the processors on a dedicated
+ * thread so that slow subscribers can't stall the scan processing
+ *
+ * ros::Publisher::publish serializes the message and may block on the socket
+ * of a slow TCPROS subscriber. With the AsyncPublisher the processing thread
+ * only hands the message over and moves on to the next scan. Every topic keeps
+ * at most one message waiting to be published: a newer message replaces a
+ * pending one that the publisher thread didn't get to yet (latest wins).
+ *
+ * Messages change hands by swapping their contents, no copy is made once the
+ * buffers of a topic are initialized. The processor gets back the buffer of an
+ * older message which holds the same layout and is overwritten on the next
+ * scan. Every topic keeps a spare message for its pending one, the topics
+ * added together share the one being published since the publisher thread
+ * publishes one message at a time.
+ */
+
+#pragma once
+
+#include <pthread.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "diagnostics.h"
+
+namespace ouster_ros {
+
+class AsyncPublisher {
+    struct TopicBase {
+        virtual ~TopicBase() = default;
+        // publishes the pending message if any, called without the lock held
+        virtual bool flush(std::mutex& mutex) = 0;
+    };
+
+   public:
+    template <typename MsgT>
+    class Topic : public TopicBase {
+       public:
+        using PublishFn = std::function<void(const MsgT&)>;
+
+        // the message being published, shared by the topics added together
+        struct InFlight {
+            // only touched by the publisher thread once initialized
+            MsgT msg;
+            // guarded by the owner's mutex
+            bool initialized = false;
+        };
+
+        Topic(AsyncPublisher& owner, PublishFn publish_fn,
+              std::shared_ptr<InFlight> in_flight)
+            : owner_(owner),
+              publish_fn_(std::move(publish_fn)),
+              in_flight_(std::move(in_flight)) {}
+
+        /**
+         * Hands msg over to the publisher thread, msg receives the contents of
+         * an older message of the topic in exchange.
+         */
+        void publish(MsgT& msg) {
+            {
+                std::lock_guard<std::mutex> lock(owner_.mutex);
+                if (!initialized) {
+                    // the first message gives the spare buffers their layout
+                    pending_msg = msg;
+                    initialized = true;
+                    if (!in_flight_->initialized) {
+                        in_flight_->msg = msg;
+                        in_flight_->initialized = true;
+                    }
+                }
+                if (pending) {
+                    ++owner_.superseded;
+                    if (owner_.stats_) ++owner_.stats_->msgs_superseded;
+                }
+                std::swap(msg, pending_msg);
+                pending = true;
+                owner_.wakeups = true;
+            }
+            owner_.has_pending.notify_one();
+        }
+
+       private:
+        bool flush(std::mutex& mutex) override {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!pending) return false;
+                std::swap(pending_msg, in_flight_->msg);
+                pending = false;
+            }
+            publish_fn_(in_flight_->msg);
+            return true;
+        }
+
+        AsyncPublisher& owner_;
+        PublishFn publish_fn_;
+        // guarded by the owner's mutex
+        MsgT pending_msg;
+        bool pending = false;
+        bool initialized = false;
+        std::shared_ptr<InFlight> in_flight_;
+    };
+
+    explicit AsyncPublisher(std::shared_ptr<PipelineStats> stats = nullptr)
+        : stats_(stats) {
+        publisher_thread = std::thread([this]() {
+            pthread_setname_np(pthread_self(), "os_publisher");
+            run();
+        });
+    }
+
+    AsyncPublisher(const AsyncPublisher&) = delete;
+    AsyncPublisher& operator=(const AsyncPublisher&) = delete;
+
+    ~AsyncPublisher() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            active = false;
+        }
+        has_pending.notify_one();
+        publisher_thread.join();
+    }
+
+    /**
+     * Registers a topic, publish_fn is invoked on the publisher thread with
+     * the latest message handed over to the topic.
+     */
+    template <typename MsgT>
+    std::shared_ptr<Topic<MsgT>> add_topic(
+        typename Topic<MsgT>::PublishFn publish_fn) {
+        return add_topic<MsgT>(
+            std::move(publish_fn),
+            std::make_shared<typename Topic<MsgT>::InFlight>());
+    }
+
+    /**
+     * Creates count topics that pass their index along to publish_fn. Their
+     * messages are expected to share the same layout, like the returns of a
+     * point cloud, so they share the message being published.
+     */
+    template <typename MsgT>
+    std::vector<std::shared_ptr<Topic<MsgT>>> add_topics(
+        size_t count, std::function<void(size_t, const MsgT&)> publish_fn) {
+        auto in_flight = std::make_shared<typename Topic<MsgT>::InFlight>();
+        std::vector<std::shared_ptr<Topic<MsgT>>> topics_added;
+        for (size_t i = 0; i < count; ++i) {
+            topics_added.push_back(add_topic<MsgT>(
+                [publish_fn, i](const MsgT& msg) { publish_fn(i, msg); },
+                in_flight));
+        }
+        return topics_added;
+    }
+
+    /**
+     * The number of spare messages held for count topics added together once
+     * they all published, on top of those of the caller.
+     */
+    static size_t spare_msgs(size_t count) { return count ? count + 1 : 0; }
+
+    // number of messages replaced before they could be published
+    uint64_t superseded_msgs() const { return superseded.load(); }
+
+   private:
+    template <typename MsgT>
+    std::shared_ptr<Topic<MsgT>> add_topic(
+        typename Topic<MsgT>::PublishFn publish_fn,
+        std::shared_ptr<typename Topic<MsgT>::InFlight> in_flight) {
+        auto topic = std::make_shared<Topic<MsgT>>(*this, std::move(publish_fn),
+                                                   std::move(in_flight));
+        std::lock_guard<std::mutex> lock(mutex);
+        topics.push_back(topic);
+        return topic;
+    }
+
+    void run() {
+        std::vector<std::shared_ptr<TopicBase>> snapshot;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                has_pending.wait(lock, [this] { return !active || wakeups; });
+                if (!active) return;
+                wakeups = false;
+                snapshot = topics;
+            }
+            // keep going until every topic is drained, messages handed over
+            // while publishing would otherwise wait for the next wakeup
+            bool published;
+            do {
+                published = false;
+                for (auto& topic : snapshot) published |= topic->flush(mutex);
+            } while (published);
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable has_pending;
+    std::vector<std::shared_ptr<TopicBase>> topics;
+    bool active = true;
+    bool wakeups = false;
+    std::atomic<uint64_t> superseded{0};
+    std::shared_ptr<PipelineStats> stats_;
+    std::thread publisher_thread;
+};
+
+template <typename MsgT>
+using AsyncTopics = std::vector<std::shared_ptr<AsyncPublisher::Topic<MsgT>>>;
+
+}  // namespace ouster_ros
@@ -0,0 +1,185 @@
+/**
+ * Copyright (c) 2018-2024, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file auto_exposure.h
+ * @brief Auto exposure and beam uniformity correction of the images that work
+ * in buffers sized once
+ *
+ * They follow the scheme of the AutoExposure and BeamUniformityCorrector of
+ * the SDK, which allocate their working buffers on every call. Here the
+ * buffers are sized for the image dimensions upfront and reused for every
+ * scan.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include <ouster/types.h>
+
+namespace ouster_ros {
+
+namespace image {
+
+/**
+ * Stretches the contrast of an image so that its lo_percentile pixel maps to 0
+ * and its 1 - hi_percentile pixel to 1. The percentiles are sampled from the
+ * nonzero pixels every update_every images and damped across updates.
+ */
+class AutoExposure {
+   public:
+    static constexpr double DEFAULT_PERCENTILE = 0.1;
+    static constexpr int DEFAULT_UPDATE_EVERY = 3;
+    // every STRIDE-th pixel is sampled
+    static constexpr size_t STRIDE = 4;
+    static constexpr double DAMPING = 0.9;
+
+    /**
+     * @param[in] pixels number of pixels of the images, sizes the samples.
+     */
+    explicit AutoExposure(size_t pixels,
+                          double lo_percentile = DEFAULT_PERCENTILE,
+                          double hi_percentile = DEFAULT_PERCENTILE,
+                          int update_every = DEFAULT_UPDATE_EVERY)
+        : lo_percentile_(lo_percentile),
+          hi_percentile_(hi_percentile),
+          update_every_(update_every) {
+        samples.reserve((pixels + STRIDE - 1) / STRIDE);
+    }
+
+    /**
+     * Scales the image in place.
+     * @param[in] update_state whether this image counts towards the updates,
+     * e.g. only the first return of a dual return sensor does.
+     */
+    void operator()(Eigen::Ref<ouster::sdk::core::img_t<float>> image,
+                    bool update_state = true) {
+        if (update_state && counter == 0) update(image);
+        if (update_state) counter = (counter + 1) % update_every_;
+
+        const float lo = lo_state;
+        const float scale = hi_state > lo_state ? 1.0 / (hi_state - lo_state)
+                                                : 1.0;
+        image = ((image - lo) * scale).max(0.0f).min(1.0f);
+    }
+
+    // bytes of the working buffer
+    size_t memory_bytes() const { return samples.capacity() * sizeof(float); }
+
+   private:
+    void update(const Eigen::Ref<ouster::sdk::core::img_t<float>>& image) {
+        const size_t n = image.size();
+        const size_t cols = image.cols();
+        // missing returns aren't sampled, stays within the reserved capacity
+        samples.clear();
+        for (size_t i = 0; i < n; i += STRIDE) {
+            const float px = image(i / cols, i % cols);
+            if (px > 0) samples.push_back(px);
+        }
+        if (samples.empty()) return;
+
+        const size_t lo_k = samples.size() * lo_percentile_;
+        const size_t hi_k =
+            std::max<size_t>(samples.size() * (1.0 - hi_percentile_), 1) - 1;
+        std::nth_element(samples.begin(), samples.begin() + lo_k,
+                         samples.end());
+        const double lo = samples[lo_k];
+        std::nth_element(samples.begin(), samples.begin() + hi_k,
+                         samples.end());
+        const double hi = samples[hi_k];
+
+        if (!initialized) {
+            initialized = true;
+            lo_state = lo;
+            hi_state = hi;
+        }
+        lo_state = DAMPING * lo_state + (1.0 - DAMPING) * lo;
+        hi_state = DAMPING * hi_state + (1.0 - DAMPING) * hi;
+    }
+
+    const double lo_percentile_;
+    const double hi_percentile_;
+    const int update_every_;
+    std::vector<float> samples;
+    int counter = 0;
+    bool initialized = false;
+    // the identity until the first update
+    double lo_state = 0;
+    double hi_state = 1;
+};
+
+/**
+ * Removes the dark count offset of every beam, i.e. row, of an image. The
+ * offsets are the accumulated medians of the differences between neighbouring
+ * rows, updated every update_every images and damped across updates.
+ */
+class BeamUniformityCorrector {
+   public:
+    static constexpr int DEFAULT_UPDATE_EVERY = 8;
+    static constexpr float DAMPING = 0.92f;
+
+    BeamUniformityCorrector(size_t rows, size_t cols,
+                            int update_every = DEFAULT_UPDATE_EVERY)
+        : update_every_(update_every),
+          row_diff(cols),
+          new_dark_count(rows),
+          dark_count(Eigen::ArrayXf::Zero(rows)) {}
+
+    /**
+     * Corrects the image in place.
+     * @param[in] update_state whether this image counts towards the updates.
+     */
+    void operator()(Eigen::Ref<ouster::sdk::core::img_t<float>> image,
+                    bool update_state = true) {
+        if (update_state && counter == 0) update(image);
+        if (update_state) counter = (counter + 1) % update_every_;
+
+        image.colwise() -= dark_count;
+        image = image.max(0.0f);
+    }
+
+    // bytes of the working buffers
+    size_t memory_bytes() const {
+        return (row_diff.capacity() + new_dark_count.size() +
+                dark_count.size()) *
+               sizeof(float);
+    }
+
+   private:
+    void update(const Eigen::Ref<ouster::sdk::core::img_t<float>>& image) {
+        const auto rows = image.rows();
+        const auto cols = image.cols();
+        if (rows == 0 || cols == 0) return;
+
+        new_dark_count[0] = 0;
+        for (Eigen::Index u = 1; u < rows; ++u) {
+            for (Eigen::Index v = 0; v < cols; ++v)
+                row_diff[v] = image(u, v) - image(u - 1, v);
+            const auto median = row_diff.begin() + cols / 2;
+            std::nth_element(row_diff.begin(), median, row_diff.end());
+            new_dark_count[u] = new_dark_count[u - 1] + *median;
+        }
+        // the darkest beam is the reference
+        new_dark_count -= new_dark_count.minCoeff();
+
+        if (initialized)
+            dark_count =
+                DAMPING * dark_count + (1.0f - DAMPING) * new_dark_count;
+        else
+            dark_count = new_dark_count;
+        initialized = true;
+    }
+
+    const int update_every_;
+    std::vector<float> row_diff;
+    Eigen::ArrayXf new_dark_count;
+    Eigen::ArrayXf dark_count;
+    int counter = 0;
+    bool initialized = false;
+};
+
+}  // namespace image
+
+}  // namespace ouster_ros
@@ -0,0 +1,417 @@
+/**
+ * Copyright (c) 2018-2024, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file diagnostics.h
+ * @brief Collects pipeline health statistics and publishes them through
+ * diagnostic_msgs
+ */
+
+#pragma once
+
+#include <diagnostic_msgs/DiagnosticArray.h>
+#include <nodelet/nodelet.h>
+#include <ros/ros.h>
+#include <unistd.h>
+
+#include <dirent.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace ouster_ros {
+
+/**
+ * Thread safe counters updated by the packet handlers, processors and
+ * publishers of a nodelet. The hot paths only perform relaxed atomic
+ * operations; names are registered once before processing starts.
+ */
+class PipelineStats {
+   public:
+    struct Timing {
+        std::atomic<uint64_t> total_ns{0};
+        std::atomic<uint64_t> max_ns{0};
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> skipped{0};
+    };
+
+    std::atomic<uint64_t> lidar_packets{0};
+    std::atomic<uint64_t> imu_packets{0};
+    std::atomic<uint64_t> dropped_packets{0};
+    std::atomic<uint64_t> scans_completed{0};
+    std::atomic<uint64_t> scans_skipped{0};
+    std::atomic<uint64_t> scans_throttled{0};
+    // scans completed by the packet of their last column instead of the first
+    // packet of the next frame, and packets of theirs that arrived after it
+    std::atomic<uint64_t> scans_completed_early{0};
+    std::atomic<uint64_t> late_packets{0};
+    // time gained by the early completions, measured once the next frame
+    // starts
+    std::atomic<uint64_t> early_completion_gain_ns{0};
+    std::atomic<uint64_t> early_completion_gains{0};
+    // replaced by a newer message before the async publisher got to them
+    std::atomic<uint64_t> msgs_superseded{0};
+    // degradation level picked by the adaptive quality, 0 is full quality
+    std::atomic<int> quality_level{0};
+    std::atomic<size_t> ring_capacity{0};
+    std::atomic<size_t> ring_high_water_mark{0};
+    // lidar packets waiting for the decode thread, the capacity stays zero
+    // when the packets are decoded on the receive thread
+    std::atomic<size_t> packet_queue_capacity{0};
+    std::atomic<size_t> packet_queue_depth{0};
+    std::atomic<size_t> packet_queue_high_water_mark{0};
+    std::atomic<uint64_t> packet_queue_drops{0};
+    // lidar packets dropped for a crc that doesn't match their content
+    std::atomic<uint64_t> crc_failures{0};
+
+    void update_ring_occupancy(size_t size) {
+        auto hwm = ring_high_water_mark.load(std::memory_order_relaxed);
+        while (size > hwm &&
+               !ring_high_water_mark.compare_exchange_weak(
+                   hwm, size, std::memory_order_relaxed)) {
+        }
+    }
+
+    void update_packet_queue_depth(size_t depth) {
+        packet_queue_depth.store(depth, std::memory_order_relaxed);
+        auto hwm = packet_queue_high_water_mark.load(std::memory_order_relaxed);
+        while (depth > hwm &&
+               !packet_queue_high_water_mark.compare_exchange_weak(
+                   hwm, depth, std::memory_order_relaxed)) {
+        }
+    }
+
+    void add_early_completion_gain(uint64_t ns) {
+        early_completion_gain_ns.fetch_add(ns, std::memory_order_relaxed);
+        early_completion_gains.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * Registers a processor, processors are expected to be registered in the
+     * same order they are handed to the LidarPacketHandler.
+     */
+    void register_processor(const std::string& name) {
+        std::lock_guard<std::mutex> lock(names_mutex);
+        processor_names.push_back(name);
+        processor_timings.push_back(std::make_unique<Timing>());
+    }
+
+    void add_processor_time(size_t index, uint64_t ns) {
+        if (index >= processor_timings.size()) return;
+        auto& t = *processor_timings[index];
+        t.total_ns.fetch_add(ns, std::memory_order_relaxed);
+        t.count.fetch_add(1, std::memory_order_relaxed);
+        auto max_ns = t.max_ns.load(std::memory_order_relaxed);
+        while (ns > max_ns && !t.max_ns.compare_exchange_weak(
+                                  max_ns, ns, std::memory_order_relaxed)) {
+        }
+    }
+
+    void add_processor_skip(size_t index) {
+        if (index >= processor_timings.size()) return;
+        processor_timings[index]->skipped.fetch_add(1,
+                                                    std::memory_order_relaxed);
+    }
+
+    /**
+     * Registers an output topic and returns the id to be used with
+     * add_published_bytes
+     */
+    size_t register_topic(const std::string& topic) {
+        std::lock_guard<std::mutex> lock(names_mutex);
+        topic_names.push_back(topic);
+        topic_bytes.push_back(std::make_unique<std::atomic<uint64_t>>(0));
+        return topic_names.size() - 1;
+    }
+
+    void add_published_bytes(size_t topic_id, uint64_t bytes) {
+        if (topic_id >= topic_bytes.size()) return;
+        topic_bytes[topic_id]->fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    template <typename MsgT>
+    void add_published_msg(size_t topic_id, const MsgT& msg) {
+        if (topic_id >= topic_bytes.size()) return;
+        add_published_bytes(topic_id,
+                            ros::serialization::serializationLength(msg));
+    }
+
+    void set_memory_footprint(const std::string& component, size_t bytes) {
+        std::lock_guard<std::mutex> lock(names_mutex);
+        memory_footprint[component] = bytes;
+    }
+
+   private:
+    friend class DiagnosticsPublisher;
+
+    std::mutex names_mutex;
+    std::vector<std::string> processor_names;
+    std::vector<std::unique_ptr<Timing>> processor_timings;
+    std::vector<std::string> topic_names;
+    std::vector<std::unique_ptr<std::atomic<uint64_t>>> topic_bytes;
+    std::map<std::string, size_t> memory_footprint;
+};
+
+/**
+ * Periodically converts PipelineStats into a DiagnosticArray and publishes
+ * it on the /diagnostics topic along with process level metrics (RSS and per
+ * thread cpu usage) gathered from procfs.
+ */
+class DiagnosticsPublisher {
+   public:
+    DiagnosticsPublisher(const std::string& parent_name,
+                         std::shared_ptr<PipelineStats> stats)
+        : node_name(parent_name), stats_(stats) {}
+
+    const std::string& getName() const { return node_name; }
+
+    void start(ros::NodeHandle& nh, const std::string& hardware_id,
+               double period = 1.0) {
+        hardware_id_ = hardware_id;
+        diagnostics_pub =
+            nh.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 1);
+        last_update = std::chrono::steady_clock::now();
+        timer = nh.createTimer(ros::Duration(period),
+                               [this](const ros::TimerEvent&) { publish(); });
+    }
+
+   private:
+    template <typename T>
+    static void add_value(diagnostic_msgs::DiagnosticStatus& status,
+                          const std::string& key, const T& value) {
+        diagnostic_msgs::KeyValue kv;
+        kv.key = key;
+        std::ostringstream os;
+        os << std::fixed << std::setprecision(2) << value;
+        kv.value = os.str();
+        status.values.push_back(kv);
+    }
+
+    static uint64_t delta(const std::atomic<uint64_t>& counter,
+                          uint64_t& previous) {
+        const auto current = counter.load(std::memory_order_relaxed);
+        const auto d = current - previous;
+        previous = current;
+        return d;
+    }
+
+    static size_t read_rss_bytes() {
+        std::ifstream statm("/proc/self/statm");
+        size_t pages = 0, resident = 0;
+        statm >> pages >> resident;
+        return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    }
+
+    // returns a map of thread id to (name, utime + stime in clock ticks)
+    static std::map<std::string, std::pair<std::string, uint64_t>>
+    read_thread_times() {
+        std::map<std::string, std::pair<std::string, uint64_t>> times;
+        DIR* dir = opendir("/proc/self/task");
+        if (!dir) return times;
+        while (auto entry = readdir(dir)) {
+            std::string tid = entry->d_name;
+            if (tid == "." || tid == "..") continue;
+            std::ifstream stat_file("/proc/self/task/" + tid + "/stat");
+            std::string stat;
+            std::getline(stat_file, stat);
+            // the thread name is enclosed in parentheses and may hold spaces
+            auto open = stat.find('(');
+            auto close = stat.rfind(')');
+            if (open == std::string::npos || close == std::string::npos)
+                continue;
+            std::istringstream rest(stat.substr(close + 2));
+            std::string field;
+            uint64_t utime = 0, stime = 0;
+            // utime and stime are the 14th and 15th fields of stat, the
+            // remainder starts at the 3rd field
+            for (int i = 3; i <= 15 && rest >> field; ++i) {
+                if (i == 14) utime = std::stoull(field);
+                if (i == 15) stime = std::stoull(field);
+            }
+            times[tid] = {stat.substr(open + 1, close - open - 1),
+                          utime + stime};
+        }
+        closedir(dir);
+        return times;
+    }
+
+    void publish() {
+        using namespace std::chrono;
+        const auto now = steady_clock::now();
+        const double dt =
+            std::max(duration<double>(now - last_update).count(), 1e-6);
+        last_update = now;
+
+        diagnostic_msgs::DiagnosticArray msg;
+        msg.header.stamp = ros::Time::now();
+
+        diagnostic_msgs::DiagnosticStatus pipeline;
+        pipeline.name = node_name + ": pipeline";
+        pipeline.hardware_id = hardware_id_;
+
+        const auto& s = *stats_;
+        const auto lidar_packets = delta(s.lidar_packets, prev.lidar_packets);
+        const auto imu_packets = delta(s.imu_packets, prev.imu_packets);
+        const auto dropped = delta(s.dropped_packets, prev.dropped_packets) +
+                             delta(s.packet_queue_drops, prev.packet_queue_drops) +
+                             delta(s.crc_failures, prev.crc_failures);
+        const auto completed = delta(s.scans_completed, prev.scans_completed);
+        const auto skipped = delta(s.scans_skipped, prev.scans_skipped);
+        const auto throttled = delta(s.scans_throttled, prev.scans_throttled);
+
+        add_value(pipeline, "lidar packets rate (Hz)", lidar_packets / dt);
+        add_value(pipeline, "imu packets rate (Hz)", imu_packets / dt);
+        add_value(pipeline, "scans completed rate (Hz)", completed / dt);
+        add_value(pipeline, "scans completed", stats_->scans_completed.load());
+        add_value(pipeline, "dropped packets", stats_->dropped_packets.load());
+        add_value(pipeline, "skipped scans", stats_->scans_skipped.load());
+        add_value(pipeline, "throttled scans", stats_->scans_throttled.load());
+        add_value(pipeline, "superseded messages",
+                  stats_->msgs_superseded.load());
+        add_value(pipeline, "quality level", stats_->quality_level.load());
+        add_value(pipeline, "ring capacity", stats_->ring_capacity.load());
+        add_value(pipeline, "ring high water mark",
+                  stats_->ring_high_water_mark.load());
+        if (stats_->packet_queue_capacity.load() > 0) {
+            add_value(pipeline, "packet queue capacity",
+                      stats_->packet_queue_capacity.load());
+            add_value(pipeline, "packet queue depth",
+                      stats_->packet_queue_depth.load());
+            add_value(pipeline, "packet queue high water mark",
+                      stats_->packet_queue_high_water_mark.load());
+            add_value(pipeline, "packet queue drops",
+                      stats_->packet_queue_drops.load());
+        }
+        const auto gains =
+            delta(s.early_completion_gains, prev.early_completion_gains);
+        const auto gain_ns =
+            delta(s.early_completion_gain_ns, prev.early_completion_gain_ns);
+        if (stats_->scans_completed_early.load() > 0) {
+            add_value(pipeline, "scans completed early",
+                      stats_->scans_completed_early.load());
+            add_value(pipeline, "early completion avg gain (ms)",
+                      gains ? gain_ns / 1e6 / gains : 0.0);
+            add_value(pipeline, "late packets dropped",
+                      stats_->late_packets.load());
+        }
+        if (stats_->crc_failures.load() > 0)
+            add_value(pipeline, "crc failures", stats_->crc_failures.load());
+
+        if (dropped > 0 || throttled > 0) {
+            pipeline.level = diagnostic_msgs::DiagnosticStatus::WARN;
+            std::ostringstream os;
+            os << "dropped " << dropped << " packets, throttled " << throttled
+               << " scans in the last " << std::setprecision(3) << dt << "s";
+            pipeline.message = os.str();
+        } else if (skipped > 0) {
+            pipeline.level = diagnostic_msgs::DiagnosticStatus::WARN;
+            pipeline.message =
+                "scans skipped due to insufficient valid columns";
+        } else if (stats_->quality_level.load() > 0) {
+            pipeline.level = diagnostic_msgs::DiagnosticStatus::WARN;
+            pipeline.message = "outputs degraded to keep up with the sensor";
+        } else {
+            pipeline.level = diagnostic_msgs::DiagnosticStatus::OK;
+            pipeline.message = "OK";
+        }
+
+        diagnostic_msgs::DiagnosticStatus processing;
+        processing.name = node_name + ": processing";
+        processing.hardware_id = hardware_id_;
+        processing.level = diagnostic_msgs::DiagnosticStatus::OK;
+        processing.message = "OK";
+
+        diagnostic_msgs::DiagnosticStatus resources;
+        resources.name = node_name + ": resources";
+        resources.hardware_id = hardware_id_;
+        resources.level = diagnostic_msgs::DiagnosticStatus::OK;
+        resources.message = "OK";
+
+        {
+            std::lock_guard<std::mutex> lock(stats_->names_mutex);
+            for (size_t i = 0; i < stats_->processor_names.size(); ++i) {
+                auto& t = *stats_->processor_timings[i];
+                const auto count = t.count.exchange(0);
+                const auto total_ns = t.total_ns.exchange(0);
+                const auto max_ns = t.max_ns.exchange(0);
+                const auto& name = stats_->processor_names[i];
+                add_value(processing, name + " avg time (ms)",
+                          count ? total_ns / 1e6 / count : 0.0);
+                add_value(processing, name + " max time (ms)", max_ns / 1e6);
+                add_value(processing, name + " skipped scans", t.skipped.load());
+            }
+
+            prev.topic_bytes.resize(stats_->topic_bytes.size(), 0);
+            for (size_t i = 0; i < stats_->topic_names.size(); ++i) {
+                const auto bytes =
+                    delta(*stats_->topic_bytes[i], prev.topic_bytes[i]);
+                add_value(processing,
+                          stats_->topic_names[i] + " bandwidth (MB/s)",
+                          bytes / dt / 1e6);
+            }
+
+            for (const auto& m : stats_->memory_footprint) {
+                add_value(resources, m.first + " memory (MB)",
+                          m.second / 1e6);
+            }
+        }
+
+        add_value(resources, "process rss (MB)", read_rss_bytes() / 1e6);
+
+        const double ticks_per_sec = static_cast<double>(sysconf(_SC_CLK_TCK));
+        auto thread_times = read_thread_times();
+        for (const auto& t : thread_times) {
+            const auto& name = t.second.first;
+            // only report the threads owned by the ouster nodelets
+            if (name.rfind("os_", 0) != 0) continue;
+            auto it = prev.thread_ticks.find(t.first);
+            if (it != prev.thread_ticks.end()) {
+                const auto ticks = t.second.second - it->second;
+                add_value(resources, name + " (" + t.first + ") cpu (%)",
+                          100.0 * ticks / ticks_per_sec / dt);
+            }
+        }
+        prev.thread_ticks.clear();
+        for (const auto& t : thread_times)
+            prev.thread_ticks[t.first] = t.second.second;
+
+        msg.status.push_back(pipeline);
+        msg.status.push_back(processing);
+        msg.status.push_back(resources);
+        diagnostics_pub.publish(msg);
+    }
+
+   private:
+    std::string node_name;
+    std::string hardware_id_;
+    std::shared_ptr<PipelineStats> stats_;
+    ros::Publisher diagnostics_pub;
+    ros::Timer timer;
+    std::chrono::steady_clock::time_point last_update;
+
+    struct {
+        uint64_t lidar_packets = 0;
+        uint64_t imu_packets = 0;
+        uint64_t dropped_packets = 0;
+        uint64_t packet_queue_drops = 0;
+        uint64_t crc_failures = 0;
+        uint64_t scans_completed = 0;
+        uint64_t scans_skipped = 0;
+        uint64_t scans_throttled = 0;
+        uint64_t early_completion_gains = 0;
+        uint64_t early_completion_gain_ns = 0;
+        std::vector<uint64_t> topic_bytes;
+        std::map<std::string, uint64_t> thread_ticks;
+    } prev;
+};
+
+}  // namespace ouster_ros
@@ -0,0 +1,135 @@
+/**
+ * Copyright (c) 2018-2024, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file event_log.h
+ * @brief Rate limited reporting of the warnings raised on the hot paths
+ *
+ * Conditions like a full lidar scans ring are detected once per packet or
+ * per scan and tend to fire in bursts exactly when the pipeline is already
+ * behind. Logging each occurrence formats a string and takes the logging locks
+ * on the receive and processing threads. Instead the hot paths record events
+ * into lock-free counters and a background thread periodically turns the
+ * counters into a single summary line per event, e.g.
+ *   "lidar_scans full, dropped 412 packets in the last 1s"
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <ros/console.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ouster_ros {
+
+class EventLog {
+   public:
+    /**
+     * Writes the summary of an event given the number of occurrences and the
+     * value recorded last within the period, invoked on the background thread.
+     */
+    using SummaryFn = std::function<void(std::ostream& os, uint64_t count,
+                                         uint64_t last_value, double period_s)>;
+
+    class Event {
+       public:
+        explicit Event(SummaryFn summary) : summary_(std::move(summary)) {}
+
+        // safe to call from any thread, never blocks nor allocates
+        void record(uint64_t value = 0) noexcept {
+            last_value_.store(value, std::memory_order_relaxed);
+            count_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+       private:
+        friend class EventLog;
+        SummaryFn summary_;
+        std::atomic<uint64_t> count_{0};
+        std::atomic<uint64_t> last_value_{0};
+    };
+
+    /**
+     * @param[in] name logger name used for the summaries.
+     * @param[in] period interval at which the summaries are emitted.
+     */
+    explicit EventLog(const std::string& name,
+                      std::chrono::milliseconds period = std::chrono::seconds(1))
+        : name_(name), period_(period) {
+        thread_ = std::thread([this]() {
+            pthread_setname_np(pthread_self(), "os_event_log");
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (!stop_cv_.wait_for(lock, period_, [this] { return !active_; }))
+                drain(lock);
+        });
+    }
+
+    EventLog(const EventLog&) = delete;
+    EventLog& operator=(const EventLog&) = delete;
+
+    ~EventLog() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            active_ = false;
+        }
+        stop_cv_.notify_one();
+        thread_.join();
+        // report what happened since the last period
+        std::unique_lock<std::mutex> lock(mutex_);
+        drain(lock);
+    }
+
+    /**
+     * Registers an event, the returned reference stays valid for the lifetime
+     * of the EventLog.
+     */
+    Event& add(SummaryFn summary) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        events_.push_back(std::make_unique<Event>(std::move(summary)));
+        return *events_.back();
+    }
+
+    // reports the pending events right away
+    void flush() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        drain(lock);
+    }
+
+   private:
+    void drain(std::unique_lock<std::mutex>&) {
+        const auto now = std::chrono::steady_clock::now();
+        const double period_s =
+            std::chrono::duration<double>(now - last_drain_).count();
+        last_drain_ = now;
+        for (auto& e : events_) {
+            const auto count = e->count_.exchange(0, std::memory_order_relaxed);
+            if (count == 0) continue;
+            std::ostringstream os;
+            e->summary_(os, count,
+                        e->last_value_.load(std::memory_order_relaxed),
+                        period_s);
+            ROS_WARN_STREAM_NAMED(name_, os.str());
+        }
+    }
+
+    std::string name_;
+    std::chrono::milliseconds period_;
+    std::mutex mutex_;
+    std::condition_variable stop_cv_;
+    bool active_ = true;
+    std::vector<std::unique_ptr<Event>> events_;
+    std::chrono::steady_clock::time_point last_drain_ =
+        std::chrono::steady_clock::now();
+    std::thread thread_;
+};
+
+}  // namespace ouster_ros
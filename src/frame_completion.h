@@ -0,0 +1,148 @@
+/**
+ * Copyright (c) 2018-2024, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file frame_completion.h
+ * @brief Completes a lidar scan as soon as the last column expected of its
+ * frame has been batched
+ *
+ * The ScanBatcher only learns that a frame is over when the first packet of
+ * the next frame arrives, which holds every scan back by one packet interval,
+ * and by the rest of the rotation when the azimuth window ends well before
+ * 360 degrees. The last column of a frame is known from the column window of
+ * the sensor: the end of the window, or the last column of the scan when the
+ * window wraps around the start of the frame. The packet holding that column
+ * completes the scan right away and the ScanBatcher starts the next scan with
+ * the first packet of the next frame. When that packet gets lost the scan
+ * completes on the next frame as before.
+ *
+ * Packets of the frame that arrive after its last column, i.e. reordered on
+ * the network, are dropped: their columns are zeroed like those of missing
+ * packets.
+ */
+
+#pragma once
+
+#include <ouster/lidar_scan.h>
+#include <ouster/types.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+
+namespace ouster_ros {
+
+class EarlyFrameCompletion {
+   public:
+    enum class Admission {
+        BATCH,       // batch the packet as usual
+        START_SCAN,  // first packet after a scan completed early
+        DROP_LATE    // packet of a scan that already completed
+    };
+
+    explicit EarlyFrameCompletion(const ouster::sdk::core::SensorInfo& info)
+        : w(info.format.columns_per_frame),
+          last_m_id(expected_last_measurement_id(info)) {}
+
+    // the measurement id of the last column the sensor sends in a frame
+    static size_t expected_last_measurement_id(
+        const ouster::sdk::core::SensorInfo& info) {
+        const auto& window = info.format.column_window;
+        const int w = info.format.columns_per_frame;
+        if (window.first <= window.second && window.second >= 0 &&
+            window.second < w)
+            return window.second;
+        return w - 1;
+    }
+
+    size_t last_measurement_id() const { return last_m_id; }
+
+    /**
+     * Called before a packet is batched into ls. Once a scan completed early,
+     * the first packet of a later frame starts a new scan in ls: the frame_id
+     * of ls is reset the way the ScanBatcher expects to start a new scan.
+     * @return whether the packet is to be batched and if it starts a scan.
+     */
+    Admission admit(const ouster::sdk::core::PacketFormat& pf,
+                    const uint8_t* lidar_buf,
+                    ouster::sdk::core::LidarScan& ls) {
+        if (!awaiting_next_frame_) return Admission::BATCH;
+        if (late(pf, lidar_buf)) return Admission::DROP_LATE;
+        awaiting_next_frame_ = false;
+        ls.frame_id = -1;
+        gain_ = std::chrono::steady_clock::now() - completed_at_;
+        return Admission::START_SCAN;
+    }
+
+    // whether the packet belongs to the scan completed early, or an older one
+    bool late(const ouster::sdk::core::PacketFormat& pf,
+              const uint8_t* lidar_buf) const {
+        if (!awaiting_next_frame_) return false;
+        const auto ahead = static_cast<uint16_t>(pf.frame_id(lidar_buf) -
+                                                 completed_frame_id_);
+        return static_cast<int16_t>(ahead) <= 0;
+    }
+
+    /**
+     * Called once a packet was batched into ls without completing it.
+     * @return true when the packet holds the last column of the frame of ls,
+     * the columns past the packet are to be zeroed with zero_trailing_columns
+     * once the batcher has written the headers of ls.
+     */
+    bool completes(const ouster::sdk::core::PacketFormat& pf,
+                   const uint8_t* lidar_buf,
+                   const ouster::sdk::core::LidarScan& ls) {
+        const uint16_t f_id = pf.frame_id(lidar_buf);
+        if (static_cast<int64_t>(f_id) != ls.frame_id) return false;
+        size_t next_col = 0;
+        for (int c = 0; c < pf.columns_per_packet; ++c) {
+            const size_t m_id =
+                pf.col_measurement_id(pf.nth_col(c, lidar_buf));
+            if (m_id < w) next_col = std::max(next_col, m_id + 1);
+        }
+        if (next_col <= last_m_id) return false;
+        next_col_ = next_col;
+        completed_frame_id_ = f_id;
+        completed_at_ = std::chrono::steady_clock::now();
+        awaiting_next_frame_ = true;
+        return true;
+    }
+
+    // zeroes the columns past the packet that completed ls, like the
+    // ScanBatcher does with the columns it got no packet for
+    void zero_trailing_columns(ouster::sdk::core::LidarScan& ls) const {
+        if (next_col_ >= w) return;
+        const size_t cols = w - next_col_;
+        ls.timestamp().segment(next_col_, cols).setZero();
+        ls.measurement_id().segment(next_col_, cols).setZero();
+        ls.status().segment(next_col_, cols).setZero();
+        for (auto& f : ls.fields()) {
+            auto* field = static_cast<uint8_t*>(f.second.get());
+            const size_t size = f.second.bytes() / (w * ls.h);
+            for (size_t r = 0; r < ls.h; ++r)
+                std::memset(field + (r * w + next_col_) * size, 0,
+                            cols * size);
+        }
+    }
+
+    // true between the early completion of a scan and the next frame
+    bool awaiting_next_frame() const { return awaiting_next_frame_; }
+
+    /**
+     * Time between the last early completion and the first packet of the
+     * next frame, which would have completed the scan otherwise.
+     */
+    std::chrono::nanoseconds gain() const { return gain_; }
+
+   private:
+    const size_t w;
+    const size_t last_m_id;
+    bool awaiting_next_frame_ = false;
+    uint16_t completed_frame_id_ = 0;
+    size_t next_col_ = 0;
+    std::chrono::steady_clock::time_point completed_at_;
+    std::chrono::nanoseconds gain_{0};
+};
+
+}  // namespace ouster_ros
@@ -16,7 +16,11 @@
 
 #include <sensor_msgs/image_encodings.h>
 
-#include "ouster/image_processing.h"
+#include "async_publisher.h"
+#include "auto_exposure.h"
+#include "memory_budget.h"
+#include "perf_counters.h"
+#include "tracepoints.h"
 
 namespace ouster_ros {
 
@@ -26,14 +30,30 @@ class ImageProcessor {
    public:
     using OutputType =
         std::map<std::string, std::shared_ptr<sensor_msgs::Image>>;
-    using PostProcessingFn = std::function<void(OutputType)>;
+    using PostProcessingFn = std::function<void(const OutputType&)>;
+    // tells per field whether anybody consumes its image, fields without an
+    // entry are always computed
+    using FieldsWanted = std::map<std::string, std::function<bool()>>;
 
    public:
     ImageProcessor(const ouster::sdk::core::SensorInfo& info,
                    const std::string& frame_id,
                    const std::string& mask_path,
-                   PostProcessingFn func)
-        : frame(frame_id), post_processing_fn(func), info_(info) {
+                   PostProcessingFn func,
+                   memory::MemoryBudget* budget = nullptr,
+                   FieldsWanted fields_wanted = {})
+        : frame(frame_id),
+          post_processing_fn(func),
+          fields_wanted_(std::move(fields_wanted)),
+          info_(info),
+          nearir_ae(info.format.pixels_per_column *
+                    info.format.columns_per_frame),
+          signal_ae(info.format.pixels_per_column *
+                    info.format.columns_per_frame),
+          reflec_ae(info.format.pixels_per_column *
+                    info.format.columns_per_frame),
+          nearir_buc(info.format.pixels_per_column,
+                     info.format.columns_per_frame) {
         uint32_t H = info.format.pixels_per_column;
         uint32_t W = info.format.columns_per_frame;
 
@@ -52,9 +72,39 @@ class ImageProcessor {
 
         for (auto it = image_msgs.begin(); it != image_msgs.end(); ++it) {
             init_image_msg(*it->second, H, W, frame);
+            // the entries are only assigned per scan, which doesn't allocate
+            published_msgs[it->first] = nullptr;
         }
 
         mask = impl::load_mask<pixel_type>(mask_path, H, W);
+
+        // staging buffers are allocated once and reused for every scan
+        reflectivity.resize(H, W);
+        signal.resize(H, W);
+        near_ir.resize(H, W);
+        signal_image_eigen.resize(H, W);
+        reflec_image_eigen.resize(H, W);
+        nearir_image_eigen.resize(H, W);
+
+        if (budget) {
+            size_t msg_bytes = 0;
+            for (const auto& it : image_msgs) msg_bytes += it.second->data.size();
+            budget->account("image msgs", msg_bytes);
+            if (budget->async_publish())
+                budget->account("image async msgs",
+                                AsyncPublisher::spare_msgs(image_msgs.size()) *
+                                    H * W * sizeof(pixel_type));
+            budget->account(
+                "image staging",
+                reflectivity.size() * sizeof(uint16_t) +
+                    signal.size() * sizeof(uint32_t) +
+                    near_ir.size() * sizeof(uint16_t) +
+                    (signal_image_eigen.size() + reflec_image_eigen.size() +
+                     nearir_image_eigen.size()) * sizeof(float) +
+                    mask.size() * sizeof(pixel_type) +
+                    nearir_ae.memory_bytes() + signal_ae.memory_bytes() +
+                    reflec_ae.memory_bytes() + nearir_buc.memory_bytes());
+        }
     }
 
    private:
@@ -73,36 +123,66 @@ class ImageProcessor {
     }
 
    private:
+    bool field_wanted(const std::string& field) const {
+        auto it = fields_wanted_.find(field);
+        return it == fields_wanted_.end() || it->second();
+    }
+
     void process(const ouster::sdk::core::LidarScan& lidar_scan, uint64_t,
                  const ros::Time& msg_ts) {
+        bool any_wanted = false;
+        for (auto it = image_msgs.begin(); it != image_msgs.end(); ++it) {
+            const bool wanted = field_wanted(it->first);
+            published_msgs[it->first] = wanted ? it->second : nullptr;
+            any_wanted |= wanted;
+        }
+        if (!any_wanted) return;
+
         process_return(lidar_scan, 0);
         if (info_.num_returns() == 2) process_return(lidar_scan, 1);
         for (auto it = image_msgs.begin(); it != image_msgs.end(); ++it) {
             it->second->header.stamp = msg_ts;
         }
-        if (post_processing_fn) post_processing_fn(image_msgs);
+        perf_image_ae.report();
+        OUSTER_ROS_TRACE2(publish_start, trace::current_handler(),
+                          trace::IMAGE);
+        if (post_processing_fn) post_processing_fn(published_msgs);
+        OUSTER_ROS_TRACE2(publish_end, trace::current_handler(),
+                          trace::IMAGE);
     }
 
     // TODO: this functin could be benefit of some refactor
     void process_return(const ouster::sdk::core::LidarScan& lidar_scan, int return_index) {
         const bool first = return_index == 0;
 
+        const auto range_field = impl::scan_return(ChanField::RANGE, !first);
+        const auto signal_field = impl::scan_return(ChanField::SIGNAL, !first);
+        const auto reflec_field =
+            impl::scan_return(ChanField::REFLECTIVITY, !first);
+        const auto nearir_field = impl::scan_return(ChanField::NEAR_IR, !first);
+        const bool range_wanted = published_msgs[range_field] != nullptr;
+        const bool signal_wanted = published_msgs[signal_field] != nullptr;
+        const bool reflec_wanted = published_msgs[reflec_field] != nullptr;
+        const bool nearir_wanted = published_msgs[nearir_field] != nullptr;
+        if (!range_wanted && !signal_wanted && !reflec_wanted && !nearir_wanted)
+            return;
+
         // across supported lidar profiles range is always 32-bit
         auto range_channel = first ? ChanField::RANGE : ChanField::RANGE2;
-        ouster::sdk::core::img_t<uint32_t> range =
-            lidar_scan.field<uint32_t>(range_channel);
+        auto range = lidar_scan.field<uint32_t>(range_channel);
 
-        ouster::sdk::core::img_t<uint16_t> reflectivity = impl::get_or_fill_zero<uint16_t>(
-            impl::scan_return(ChanField::REFLECTIVITY, !first),
-            lidar_scan);
+        impl::get_or_fill_zero<uint16_t>(
+            impl::scan_return(ChanField::REFLECTIVITY, !first), lidar_scan,
+            reflectivity);
 
-        ouster::sdk::core::img_t<uint32_t> signal = impl::get_or_fill_zero<uint32_t>(
-            impl::scan_return(ChanField::SIGNAL, !first), lidar_scan);
+        impl::get_or_fill_zero<uint32_t>(
+            impl::scan_return(ChanField::SIGNAL, !first), lidar_scan, signal);
 
         // TODO: note that near_ir will be processed twice for DUAL return
         // sensor
-        ouster::sdk::core::img_t<uint16_t> near_ir = impl::get_or_fill_zero<uint16_t>(
-            impl::scan_return(ouster::sdk::core::ChanField::NEAR_IR, !first), lidar_scan);
+        impl::get_or_fill_zero<uint16_t>(
+            impl::scan_return(ouster::sdk::core::ChanField::NEAR_IR, !first),
+            lidar_scan, near_ir);
 
         uint32_t H = info_.format.pixels_per_column;
         uint32_t W = info_.format.columns_per_frame;
@@ -123,10 +203,6 @@ class ImageProcessor {
 
         const auto& px_offset = info_.format.pixel_shift_by_row;
 
-        ouster::sdk::core::img_t<float> signal_image_eigen(H, W);
-        ouster::sdk::core::img_t<float> reflec_image_eigen(H, W);
-        ouster::sdk::core::img_t<float> nearir_image_eigen(H, W);
-
         const auto rg = range.data();
         const auto sg = signal.data();
         const auto rf = reflectivity.data();
@@ -147,35 +223,66 @@ class ImageProcessor {
             }
         }
 
-        signal_ae(signal_image_eigen, first);
-        reflec_ae(reflec_image_eigen, first);
-        nearir_buc(nearir_image_eigen);
-        nearir_ae(nearir_image_eigen, first);
-        nearir_image_eigen = nearir_image_eigen.sqrt();
-        signal_image_eigen = signal_image_eigen.sqrt();
+        // auto exposure only runs for the images somebody listens to
+        {
+            OUSTER_ROS_PERF_SCOPE(perf_image_ae);
+            if (signal_wanted) {
+                signal_ae(signal_image_eigen, first);
+                signal_image_eigen = signal_image_eigen.sqrt();
+            }
+            if (reflec_wanted) reflec_ae(reflec_image_eigen, first);
+            if (nearir_wanted) {
+                nearir_buc(nearir_image_eigen);
+                nearir_ae(nearir_image_eigen, first);
+                nearir_image_eigen = nearir_image_eigen.sqrt();
+            }
+        }
 
         // copy data into image messages
-        signal_image_map =
-            (signal_image_eigen * pixel_value_max).cast<pixel_type>();
-        reflec_image_map =
-            (reflec_image_eigen * pixel_value_max).cast<pixel_type>();
-        nearir_image_map =
-            (nearir_image_eigen * pixel_value_max).cast<pixel_type>();
+        if (signal_wanted)
+            signal_image_map =
+                (signal_image_eigen * pixel_value_max).cast<pixel_type>();
+        if (reflec_wanted)
+            reflec_image_map =
+                (reflec_image_eigen * pixel_value_max).cast<pixel_type>();
+        if (nearir_wanted)
+            nearir_image_map =
+                (nearir_image_eigen * pixel_value_max).cast<pixel_type>();
 
         if (mask.size() != 0) {
-            range_image_map = range_image_map * mask;
-            signal_image_map = signal_image_map * mask;
-            reflec_image_map = reflec_image_map * mask;
-            nearir_image_map = nearir_image_map * mask;
+            if (range_wanted) range_image_map = range_image_map * mask;
+            if (signal_wanted) signal_image_map = signal_image_map * mask;
+            if (reflec_wanted) reflec_image_map = reflec_image_map * mask;
+            if (nearir_wanted) nearir_image_map = nearir_image_map * mask;
         }
     }
 
    public:
+    /**
+     * Lists the LidarScan fields read by the processor, fields missing from
+     * the sensor profile are rendered as blank images.
+     */
+    static std::vector<std::string> required_fields(
+        const ouster::sdk::core::SensorInfo& info) {
+        std::vector<std::string> fields{ChanField::RANGE, ChanField::SIGNAL,
+                                        ChanField::REFLECTIVITY,
+                                        ChanField::NEAR_IR};
+        if (info.num_returns() > 1) {
+            fields.emplace_back(ChanField::RANGE2);
+            fields.emplace_back(ChanField::SIGNAL2);
+            fields.emplace_back(ChanField::REFLECTIVITY2);
+        }
+        return fields;
+    }
+
     static LidarScanProcessor create(const ouster::sdk::core::SensorInfo& info,
                                      const std::string& frame,
                                      const std::string& mask_path,
-                                     PostProcessingFn func) {
-        auto handler = std::make_shared<ImageProcessor>(info, frame, mask_path, func);
+                                     PostProcessingFn func,
+                                     memory::MemoryBudget* budget = nullptr,
+                                     FieldsWanted fields_wanted = {}) {
+        auto handler = std::make_shared<ImageProcessor>(
+            info, frame, mask_path, func, budget, std::move(fields_wanted));
         return [handler](const ouster::sdk::core::LidarScan& lidar_scan, uint64_t scan_ts,
                          const ros::Time& msg_ts) {
             handler->process(lidar_scan, scan_ts, msg_ts);
@@ -185,13 +292,27 @@ class ImageProcessor {
    private:
     std::string frame;
     OutputType image_msgs;
+    // entries of image_msgs handed over for this scan, null when not computed
+    OutputType published_msgs;
     PostProcessingFn post_processing_fn;
+    FieldsWanted fields_wanted_;
     ouster::sdk::core::SensorInfo info_;
 
-    ouster::sdk::core::AutoExposure nearir_ae, signal_ae, reflec_ae;
-    ouster::sdk::core::BeamUniformityCorrector nearir_buc;
+    // unlike those of the SDK they don't allocate per scan
+    image::AutoExposure nearir_ae, signal_ae, reflec_ae;
+    image::BeamUniformityCorrector nearir_buc;
 
     ouster::sdk::core::img_t<pixel_type> mask;
+
+    // per scan staging buffers
+    ouster::sdk::core::img_t<uint16_t> reflectivity;
+    ouster::sdk::core::img_t<uint32_t> signal;
+    ouster::sdk::core::img_t<uint16_t> near_ir;
+    ouster::sdk::core::img_t<float> signal_image_eigen;
+    ouster::sdk::core::img_t<float> reflec_image_eigen;
+    ouster::sdk::core::img_t<float> nearir_image_eigen;
+
+    perf::Stage perf_image_ae{"image_ae"};
 };
 
 }  // namespace ouster_ros
\ No newline at end of file
@@ -1,6 +1,10 @@
 #pragma once
 
 #include <ouster/lidar_scan.h>
+#include <ouster/xyzlut.h>
+
+#include <cmath>
+#include <optional>
 
 namespace ouster {
 
@@ -62,4 +66,243 @@ void cartesianT(ouster::sdk::core::PointCloudXYZ<T>& points,
     }
 }
 
+/**
+ * A factored form of the xyz lut of OS sensors. Every pixel of an OS lut is a
+ * combination of the cosine and sine of the encoder angle of its column with a
+ * set of per beam vectors:
+ *   lut(u, v) = cos(theta_v) * p(u) + sin(theta_v) * q(u) + z(u)
+ * which takes O(W + H) memory instead of O(W * H) for the full lut.
+ */
+template <typename T>
+struct CompactXYZLut {
+    Eigen::Array<T, Eigen::Dynamic, 1> cos_encoder;  // per column
+    Eigen::Array<T, Eigen::Dynamic, 1> sin_encoder;  // per column
+    ouster::sdk::core::ArrayX3R<T> direction_p, direction_q, direction_z;
+    ouster::sdk::core::ArrayX3R<T> offset_p, offset_q, offset_z;
+
+    size_t bytes() const {
+        return (cos_encoder.size() + sin_encoder.size() +
+                direction_p.size() + direction_q.size() + direction_z.size() +
+                offset_p.size() + offset_q.size() + offset_z.size()) *
+               sizeof(T);
+    }
+};
+
+namespace impl {
+
+// projects a W x H lut component onto the per beam p, q, z vectors, the
+// encoder angles sample a full revolution so cos, sin and 1 are orthogonal
+template <typename T, typename Lut>
+void fit_compact_component(const Lut& lut, size_t w, size_t h,
+                           const Eigen::ArrayXd& ce, const Eigen::ArrayXd& se,
+                           ouster::sdk::core::ArrayX3R<T>& p,
+                           ouster::sdk::core::ArrayX3R<T>& q,
+                           ouster::sdk::core::ArrayX3R<T>& z, double& error) {
+    p.resize(h, 3);
+    q.resize(h, 3);
+    z.resize(h, 3);
+    double max_abs = 0.0;
+    error = 0.0;
+    for (size_t u = 0; u < h; ++u) {
+        for (int k = 0; k < 3; ++k) {
+            double sp = 0.0, sq = 0.0, sz = 0.0;
+            for (size_t v = 0; v < w; ++v) {
+                const double l = lut(u * w + v, k);
+                sp += ce(v) * l;
+                sq += se(v) * l;
+                sz += l;
+            }
+            sp *= 2.0 / w;
+            sq *= 2.0 / w;
+            sz /= w;
+            for (size_t v = 0; v < w; ++v) {
+                const double l = lut(u * w + v, k);
+                max_abs = std::max(max_abs, std::abs(l));
+                error = std::max(
+                    error, std::abs(l - (ce(v) * sp + se(v) * sq + sz)));
+            }
+            p(u, k) = static_cast<T>(sp);
+            q(u, k) = static_cast<T>(sq);
+            z(u, k) = static_cast<T>(sz);
+        }
+    }
+    // relative to the largest element of the component
+    if (max_abs > 0.0) error /= max_abs;
+}
+
+}  // namespace impl
+
+/**
+ * Factors the supplied xyz lut into a CompactXYZLut.
+ *
+ * @return the compact lut or nothing when the lut can't be represented in the
+ * factored form within the given relative tolerance (e.g. luts of sensors
+ * with per pixel beam angles)
+ */
+template <typename T>
+std::optional<CompactXYZLut<T>> make_compact_xyz_lut(
+    const ouster::sdk::core::XYZLut& lut, size_t w, size_t h,
+    double tolerance = 1e-6) {
+    if (w < 3 || static_cast<size_t>(lut.direction.rows()) != w * h)
+        return std::nullopt;
+
+    Eigen::ArrayXd ce(w), se(w);
+    for (size_t v = 0; v < w; ++v) {
+        ce(v) = std::cos(2.0 * M_PI * v / w);
+        se(v) = std::sin(2.0 * M_PI * v / w);
+    }
+
+    CompactXYZLut<T> compact;
+    double direction_error, offset_error;
+    impl::fit_compact_component<T>(lut.direction, w, h, ce, se,
+                                   compact.direction_p, compact.direction_q,
+                                   compact.direction_z, direction_error);
+    impl::fit_compact_component<T>(lut.offset, w, h, ce, se, compact.offset_p,
+                                   compact.offset_q, compact.offset_z,
+                                   offset_error);
+    if (direction_error > tolerance || offset_error > tolerance)
+        return std::nullopt;
+
+    compact.cos_encoder = ce.cast<T>();
+    compact.sin_encoder = se.cast<T>();
+    return compact;
+}
+
+/**
+ * Same as the cartesianT above but evaluates the lut of each pixel from a
+ * CompactXYZLut, trading a few extra multiplications per point for a lut that
+ * is orders of magnitude smaller.
+ */
+template <typename T>
+void cartesianT(ouster::sdk::core::PointCloudXYZ<T>& points,
+                const Eigen::Ref<const ouster::sdk::core::img_t<uint32_t>>& range,
+                const CompactXYZLut<T>& lut, uint32_t min_r, uint32_t max_r,
+                T invalid) {
+    const auto w = lut.cos_encoder.size();
+    const auto h = lut.direction_p.rows();
+    assert(points.rows() == w * h && "points & lut size mismatch");
+    assert(points.rows() == range.size() &&
+           "points and range image size mismatch");
+
+    const auto pts = points.data();
+    const auto* const rng = range.data();
+    const auto* const ce = lut.cos_encoder.data();
+    const auto* const se = lut.sin_encoder.data();
+
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp parallel for schedule(static)
+#endif
+    for (auto u = 0; u < h; ++u) {
+        const auto* const dp = lut.direction_p.data() + u * 3;
+        const auto* const dq = lut.direction_q.data() + u * 3;
+        const auto* const dz = lut.direction_z.data() + u * 3;
+        const auto* const op = lut.offset_p.data() + u * 3;
+        const auto* const oq = lut.offset_q.data() + u * 3;
+        const auto* const oz = lut.offset_z.data() + u * 3;
+        for (auto v = 0; v < w; ++v) {
+            const auto i = u * w + v;
+            const auto r = rng[i];
+            auto* const pt = pts + i * 3;
+            if (r <= min_r || r >= max_r) {
+                pt[0] = pt[1] = pt[2] = invalid;
+            } else {
+                const T c = ce[v], s = se[v];
+                for (int k = 0; k < 3; ++k) {
+                    pt[k] = r * (c * dp[k] + s * dq[k] + dz[k]) +
+                            (c * op[k] + s * oq[k] + oz[k]);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Same as the cartesianT functions above but only converts the columns
+ * [first_col, first_col + cols) of the range image, the points of the other
+ * columns are left untouched. This allows converting the columns of a scan as
+ * its packets arrive.
+ *
+ * @param[in] mask optional mask in the layout of the range image that is
+ * multiplied with the range before the conversion, null to skip it.
+ */
+template <typename T>
+void cartesian_columnsT(ouster::sdk::core::PointCloudXYZ<T>& points,
+                        const Eigen::Ref<const ouster::sdk::core::img_t<uint32_t>>& range,
+                        const ouster::sdk::core::ArrayX3R<T>& direction,
+                        const ouster::sdk::core::ArrayX3R<T>& offset,
+                        uint32_t min_r, uint32_t max_r, T invalid,
+                        size_t first_col, size_t cols,
+                        const uint32_t* mask = nullptr) {
+    assert(points.rows() == direction.rows() &&
+           "points & direction row count mismatch");
+    assert(points.rows() == range.size() &&
+           "points and range image size mismatch");
+    assert(first_col + cols <= static_cast<size_t>(range.cols()) &&
+           "columns out of the range image");
+
+    const auto pts = points.data();
+    const auto* const rng = range.data();
+    const auto* const dir = direction.data();
+    const auto* const ofs = offset.data();
+    const size_t w = range.cols();
+    const size_t h = range.rows();
+
+    for (size_t u = 0; u < h; ++u) {
+        for (size_t v = first_col; v < first_col + cols; ++v) {
+            const auto i = u * w + v;
+            const uint32_t r = mask ? rng[i] * mask[i] : rng[i];
+            auto* const pt = pts + i * 3;
+            if (r <= min_r || r >= max_r) {
+                pt[0] = pt[1] = pt[2] = invalid;
+            } else {
+                for (int k = 0; k < 3; ++k)
+                    pt[k] = r * dir[i * 3 + k] + ofs[i * 3 + k];
+            }
+        }
+    }
+}
+
+template <typename T>
+void cartesian_columnsT(ouster::sdk::core::PointCloudXYZ<T>& points,
+                        const Eigen::Ref<const ouster::sdk::core::img_t<uint32_t>>& range,
+                        const CompactXYZLut<T>& lut, uint32_t min_r,
+                        uint32_t max_r, T invalid, size_t first_col,
+                        size_t cols, const uint32_t* mask = nullptr) {
+    const size_t w = lut.cos_encoder.size();
+    const size_t h = lut.direction_p.rows();
+    assert(static_cast<size_t>(points.rows()) == w * h &&
+           "points & lut size mismatch");
+    assert(points.rows() == range.size() &&
+           "points and range image size mismatch");
+    assert(first_col + cols <= w && "columns out of the range image");
+
+    const auto pts = points.data();
+    const auto* const rng = range.data();
+    const auto* const ce = lut.cos_encoder.data();
+    const auto* const se = lut.sin_encoder.data();
+
+    for (size_t u = 0; u < h; ++u) {
+        const auto* const dp = lut.direction_p.data() + u * 3;
+        const auto* const dq = lut.direction_q.data() + u * 3;
+        const auto* const dz = lut.direction_z.data() + u * 3;
+        const auto* const op = lut.offset_p.data() + u * 3;
+        const auto* const oq = lut.offset_q.data() + u * 3;
+        const auto* const oz = lut.offset_z.data() + u * 3;
+        for (size_t v = first_col; v < first_col + cols; ++v) {
+            const auto i = u * w + v;
+            const uint32_t r = mask ? rng[i] * mask[i] : rng[i];
+            auto* const pt = pts + i * 3;
+            if (r <= min_r || r >= max_r) {
+                pt[0] = pt[1] = pt[2] = invalid;
+            } else {
+                const T c = ce[v], s = se[v];
+                for (int k = 0; k < 3; ++k) {
+                    pt[k] = r * (c * dp[k] + s * dq[k] + dz[k]) +
+                            (c * op[k] + s * oq[k] + oz[k]);
+                }
+            }
+        }
+    }
+}
+
 }  // namespace ouster
@@ -19,7 +19,10 @@ namespace ouster_ros {
 class ImuPacketHandler {
    public:
     using HandlerOutput = std::vector<sensor_msgs::Imu>;
-    using HandlerType = std::function<HandlerOutput(const ouster::sdk::core::ImuPacket&)>;
+    // the handler returns a reference to a buffer that it owns and reuses on
+    // every invocation, the content remains valid until the next call
+    using HandlerType =
+        std::function<const HandlerOutput&(const ouster::sdk::core::ImuPacket&)>;
 
    public:
     static HandlerType create(const ouster::sdk::core::SensorInfo& info,
@@ -60,8 +63,13 @@ class ImuPacketHandler {
                 }};
         }
 
-        return [pf, frame, timestamper, info](const ouster::sdk::core::ImuPacket& imu_packet) {
-            return packet_to_imu_msgs(imu_packet, frame, timestamper(imu_packet), info);
+        auto imu_msgs = std::make_shared<HandlerOutput>();
+        return [pf, frame, timestamper, info, imu_msgs](
+                   const ouster::sdk::core::ImuPacket& imu_packet)
+                   -> const HandlerOutput& {
+            packet_to_imu_msgs(*imu_msgs, imu_packet, frame,
+                               timestamper(imu_packet), info);
+            return *imu_msgs;
         };
     }
 };
@@ -14,22 +14,28 @@
 #include "ouster_ros/os_ros.h"
 // clang-format on
 
+#include "tracepoints.h"
+
 namespace ouster_ros {
 
 class LaserScanProcessor {
    public:
     using OutputType = std::vector<std::shared_ptr<sensor_msgs::LaserScan>>;
-    using PostProcessingFn = std::function<void(OutputType)>;
+    using PostProcessingFn = std::function<void(const OutputType&)>;
+    // one entry per return, see PointCloudProcessor_ReturnsWanted
+    using ReturnsWanted = std::vector<std::function<bool()>>;
 
    public:
     LaserScanProcessor(const ouster::sdk::core::SensorInfo& info,
                        const std::string& frame_id, uint16_t ring,
-                       PostProcessingFn func)
+                       PostProcessingFn func, ReturnsWanted returns_wanted = {})
         : frame(frame_id),
           ld_mode(info.config.lidar_mode.value()),
           ring_(ring),
           pixel_shift_by_row(info.format.pixel_shift_by_row),
           scan_msgs(info.num_returns()),
+          published_msgs(info.num_returns()),
+          returns_wanted_(std::move(returns_wanted)),
           post_processing_fn(func) {
         for (size_t i = 0; i < scan_msgs.size(); ++i)
             scan_msgs[i] = std::make_shared<sensor_msgs::LaserScan>();
@@ -46,21 +52,47 @@ class LaserScanProcessor {
    private:
     void process(const ouster::sdk::core::LidarScan& lidar_scan, uint64_t,
                  const ros::Time& msg_ts) {
+        bool any_wanted = false;
         for (size_t i = 0; i < scan_msgs.size(); ++i) {
-            *scan_msgs[i] =
-                lidar_scan_to_laser_scan_msg(lidar_scan, msg_ts, frame, ld_mode,
-                                             ring_, pixel_shift_by_row, i);
+            published_msgs[i] = nullptr;
+            if (!returns_wanted_.empty() && !returns_wanted_[i]()) continue;
+            lidar_scan_to_laser_scan_msg(*scan_msgs[i], lidar_scan, msg_ts,
+                                         frame, ld_mode, ring_,
+                                         pixel_shift_by_row, i);
+            published_msgs[i] = scan_msgs[i];
+            any_wanted = true;
         }
+        if (!any_wanted) return;
 
-        if (post_processing_fn) post_processing_fn(scan_msgs);
+        OUSTER_ROS_TRACE2(publish_start, trace::current_handler(),
+                          trace::LASER_SCAN);
+        if (post_processing_fn) post_processing_fn(published_msgs);
+        OUSTER_ROS_TRACE2(publish_end, trace::current_handler(),
+                          trace::LASER_SCAN);
     }
 
    public:
+    /**
+     * Lists the LidarScan fields read by the processor: the range and signal
+     * of each return.
+     */
+    static std::vector<std::string> required_fields(
+        const ouster::sdk::core::SensorInfo& info) {
+        using ouster::sdk::core::ChanField;
+        std::vector<std::string> fields{ChanField::RANGE, ChanField::SIGNAL};
+        if (info.num_returns() > 1) {
+            fields.emplace_back(ChanField::RANGE2);
+            fields.emplace_back(ChanField::SIGNAL2);
+        }
+        return fields;
+    }
+
     static LidarScanProcessor create(const ouster::sdk::core::SensorInfo& info,
                                      const std::string& frame, uint16_t ring,
-                                     PostProcessingFn func) {
-        auto handler =
-            std::make_shared<LaserScanProcessor>(info, frame, ring, func);
+                                     PostProcessingFn func,
+                                     ReturnsWanted returns_wanted = {}) {
+        auto handler = std::make_shared<LaserScanProcessor>(
+            info, frame, ring, func, std::move(returns_wanted));
 
         return [handler](const ouster::sdk::core::LidarScan& lidar_scan, uint64_t scan_ts,
                          const ros::Time& msg_ts) {
@@ -74,6 +106,9 @@ class LaserScanProcessor {
     uint16_t ring_;
     std::vector<int> pixel_shift_by_row;
     OutputType scan_msgs;
+    // entries of scan_msgs handed over for this scan, null when not computed
+    OutputType published_msgs;
+    ReturnsWanted returns_wanted_;
     PostProcessingFn post_processing_fn;
 };
 
@@ -17,20 +17,37 @@
 #include <pcl_conversions/pcl_conversions.h>
 #include <nodelet/nodelet.h>
 
+#include "adaptive_quality.h"
+#include "diagnostics.h"
+#include "event_log.h"
+#include "frame_completion.h"
 #include "lock_free_ring_buffer.h"
+#include "memory_budget.h"
+#include "memory_pinning.h"
+#include "packet_crc.h"
+#include "packet_decoder.h"
+#include "perf_counters.h"
+#include "processor_schedule.h"
+#include "processor_swap.h"
+#include "scan_columns_observers.h"
+#include "threading_model.h"
+#include "tracepoints.h"
+#include "worker_pool.h"
+#include <algorithm>
 #include <optional>
 #include <chrono>
+#include <iomanip>
 #include <mutex>
 #include <condition_variable>
+#include <pthread.h>
 #include <thread>
 #include <vector>
 #include <string>
 
 namespace {
 
-template <typename T, typename UnaryPredicate>
-int find_if_reverse(const Eigen::Array<T, -1, 1>& array,
-                    UnaryPredicate predicate) {
+template <typename ArrayType, typename UnaryPredicate>
+int find_if_reverse(const ArrayType& array, UnaryPredicate predicate) {
     auto p = array.data() + array.size() - 1;
     do {
         if (predicate(*p)) return p - array.data();
@@ -60,9 +77,14 @@ namespace ouster_ros {
 using LidarScanProcessor =
     std::function<void(const ouster::sdk::core::LidarScan&, uint64_t, const ros::Time&)>;
 
+using LidarScanProcessorSwap = ProcessorSwap<LidarScanProcessor>;
+
 class LidarPacketHandler {
     using LidarPacketAccumlator =
         std::function<bool(const ouster::sdk::core::LidarPacket&)>;
+    // views the timestamps of the scan in place rather than copying them
+    using ScanTimestamps = Eigen::Ref<
+        const ouster::sdk::core::LidarScan::Header<uint64_t>>;
 
    public:
     using HandlerOutput = ouster::sdk::core::LidarScan;
@@ -74,30 +96,123 @@ class LidarPacketHandler {
                        const std::vector<LidarScanProcessor>& handlers,
                        const std::string& timestamp_mode,
                        int64_t ptp_utc_tai_offset,
-                       float min_scan_valid_columns_ratio)
-        : ring_buffer(LIDAR_SCAN_COUNT),
+                       float min_scan_valid_columns_ratio,
+                       std::shared_ptr<PipelineStats> stats = nullptr,
+                       const memory::BufferPinning& pinning = {},
+                       const std::vector<std::string>& fields = {},
+                       memory::MemoryBudget* budget = nullptr,
+                       const threading::InlineProcessing& inline_processing = {},
+                       std::shared_ptr<AdaptiveQuality> quality = nullptr,
+                       const std::vector<ProcessorPolicy>& policies = {},
+                       std::shared_ptr<LidarScanProcessorSwap> swap = nullptr,
+                       std::shared_ptr<threading::WorkerPool> pool = nullptr,
+                       std::shared_ptr<ScanColumnsObservers> column_observers = nullptr,
+                       bool early_frame_completion = false,
+                       bool verify_crc = false)
+        : ring_buffer(inline_processing.enabled
+                          ? ring_capacity(true)
+                          : ring_depth(info, fields, budget)),
+          pinned_scans(pinning),
           lidar_scan_handlers{handlers},
+          schedule(policies, handlers.size()),
           ptp_utc_tai_offset_(ptp_utc_tai_offset),
-          min_scan_valid_columns_ratio_(min_scan_valid_columns_ratio) {
-        // initialize lidar_scan processor and buffer
-        scan_batcher = std::make_unique<ouster::sdk::core::ScanBatcher>(info);
+          min_scan_valid_columns_ratio_(min_scan_valid_columns_ratio),
+          inline_processing_(inline_processing),
+          event_log(getName()),
+          quality_(quality),
+          swap_(swap),
+          pool_(inline_processing.enabled ? nullptr : pool),
+          column_observers_(column_observers),
+          stats_(stats) {
+        register_events(info);
+
+        lidar_scans.resize(ring_buffer.capacity());
+        mutexes.resize(ring_buffer.capacity());
+        scan_completed_at.resize(ring_buffer.capacity());
+        scan_estimated_ts.resize(ring_buffer.capacity());
+        scan_estimated_msg_ts.resize(ring_buffer.capacity());
+
+        // the ScanBatcher only decodes the fields present in the target scan
+        const auto field_types = scan_field_types(info, fields);
+        if (!fields.empty()) {
+            std::string names;
+            for (const auto& ft : field_types)
+                names += (names.empty() ? "" : ", ") + ft.name;
+            NODELET_INFO_STREAM("decoding lidar scan fields: " << names);
+        }
 
-        lidar_scans.resize(LIDAR_SCAN_COUNT);
-        mutexes.resize(LIDAR_SCAN_COUNT);
+        // initialize lidar_scan processor and buffer
+        create_scan_batcher(info, field_types);
+        if (early_frame_completion) {
+            frame_completion_ = std::make_unique<EarlyFrameCompletion>(info);
+            NODELET_INFO_STREAM(
+                "completing lidar scans on the packet of measurement id "
+                << frame_completion_->last_measurement_id());
+        }
+        if (verify_crc) {
+            if (PacketCrc::supported(info.format.udp_profile_lidar)) {
+                packet_crc_ = std::make_unique<PacketCrc>(
+                    ouster::sdk::core::get_format(info));
+                NODELET_INFO_STREAM("verifying the crc of lidar packets ("
+                                    << packet_crc_->implementation() << ")");
+            } else {
+                NODELET_WARN_STREAM(
+                    "verify_crc ignored, the lidar packets of the udp profile "
+                    << to_string(info.format.udp_profile_lidar)
+                    << " carry no crc");
+            }
+        }
 
         for (size_t i = 0; i < lidar_scans.size(); ++i) {
             lidar_scans[i] = std::make_unique<ouster::sdk::core::LidarScan>(
                 info.format.columns_per_frame, info.format.pixels_per_column,
-                info.format.udp_profile_lidar);
+                field_types, info.format.columns_per_packet);
             mutexes[i] = std::make_unique<std::mutex>();
+            pin_lidar_scan(*lidar_scans[i]);
+        }
+        if (pinning.enabled()) {
+            NODELET_INFO_STREAM("pinned " << pinned_scans.pinned_bytes()
+                                          << " bytes of the lidar scans ring");
         }
 
-        lidar_scans_processing_thread = std::make_unique<std::thread>([this]() {
-            while (lidar_scans_processing_active) {
-                process_scans();
+        if (stats_) stats_->ring_capacity = ring_buffer.capacity();
+
+        if (budget) {
+            budget->account("lidar scans ring",
+                            lidar_scans.size() *
+                                lidar_scan_memory_bytes(*lidar_scans[0]));
+            if (profile_batcher)
+                budget->account("profile batcher scans",
+                                profile_batcher->memory_bytes());
+            if (budget->limited() && budget->total() > budget->limit()) {
+                NODELET_WARN_STREAM(
+                    "memory budget exceeded with the minimal ring of "
+                    << lidar_scans.size() << " lidar scans, consider "
+                    "disabling some processors or using a smaller lidar mode");
             }
-            NODELET_DEBUG("lidar_scans_processing_thread done.");
-        });
+        }
+
+        if (inline_processing_.enabled) {
+            NODELET_INFO_STREAM(
+                "processing lidar scans inline, deadline per scan: "
+                << std::chrono::duration<double, std::milli>(
+                       inline_processing_.deadline)
+                       .count()
+                << " ms");
+        } else if (pool_) {
+            pool_queue = pool_->create_queue([this]() { process_next_scan(); });
+            NODELET_INFO_STREAM("processing lidar scans on the shared pool of "
+                                << pool_->size() << " threads");
+        } else {
+            lidar_scans_processing_thread =
+                std::make_unique<std::thread>([this]() {
+                    pthread_setname_np(pthread_self(), "os_scan_proc");
+                    while (lidar_scans_processing_active) {
+                        process_scans();
+                    }
+                    NODELET_DEBUG("lidar_scans_processing_thread done.");
+                });
+        }
 
         // initalize time handlers
         scan_col_ts_spacing_ns = compute_scan_col_ts_spacing_ns(info.config.lidar_mode.value());
@@ -124,8 +239,16 @@ class LidarPacketHandler {
 
         lidar_packet_accumlator = LidarPacketAccumlator{
             [this, pf, lidar_handler](const ouster::sdk::core::LidarPacket& lidar_packet) {
+                if (stats_) ++stats_->lidar_packets;
+                if (packet_crc_ && !packet_crc_->valid(lidar_packet.buf.data(),
+                                                       lidar_packet.buf.size())) {
+                    crc_failure_event->record();
+                    if (stats_) ++stats_->crc_failures;
+                    return false;
+                }
                 if (ring_buffer.full()) {
-                    NODELET_WARN("lidar_scans full, DROPPING PACKET");
+                    dropped_packet_event->record();
+                    if (stats_) ++stats_->dropped_packets;
                     return false;
                 }
                 bool result = false;
@@ -133,23 +256,46 @@ class LidarPacketHandler {
                     std::unique_lock<std::mutex> lock(
                         *(mutexes[ring_buffer.write_head()]));
                     auto& lidar_scan = *lidar_scans[ring_buffer.write_head()];
-                    result = lidar_handler(*this, pf, lidar_packet, lidar_scan);
+                    {
+                        OUSTER_ROS_PERF_SCOPE(perf_batching);
+                        result = lidar_handler(*this, pf, lidar_packet, lidar_scan);
+                    }
                     if (result) {
                         // count the number of valid columns in the scan
                         auto status = lidar_scan.status();
                         size_t valid_cols = std::count_if(status.data(), status.data() + status.size(),
                                [](const uint32_t s) { return (s & 0x01); });
                         if (valid_cols < static_cast<size_t>(min_scan_valid_columns_ratio_ * status.size())) {
-                            NODELET_WARN_STREAM("number of valid columns per scan "
-                                << valid_cols << "/" << status.size()
-                                <<" which is below the ratio " << std::setprecision(4) << (100 * min_scan_valid_columns_ratio_)
-                                << "%, SKIPPING SCAN");
+                            skipped_scan_event->record(valid_cols);
+                            if (stats_) ++stats_->scans_skipped;
                             result = false;
                         }
                     }
+                    if (result) {
+                        const auto slot = ring_buffer.write_head();
+                        // processor deadlines are relative to this instant
+                        scan_completed_at[slot] =
+                            std::chrono::steady_clock::now();
+                        // the processors of a queued scan stamp their outputs
+                        // with the time of that scan, not of the last one
+                        scan_estimated_ts[slot] = lidar_scan_estimated_ts;
+                        scan_estimated_msg_ts[slot] =
+                            lidar_scan_estimated_msg_ts;
+                    }
                 }
                 if (result) {
+                    perf_batching.report();
+                    const auto slot = ring_buffer.write_head();
+                    OUSTER_ROS_TRACE4(scan_complete, trace_id, slot,
+                                      lidar_scan_estimated_ts,
+                                      lidar_packet.host_timestamp);
                     ring_buffer.write();
+                    OUSTER_ROS_TRACE3(ring_enqueue, trace_id, slot,
+                                      ring_buffer.size());
+                    if (stats_) {
+                        ++stats_->scans_completed;
+                        stats_->update_ring_occupancy(ring_buffer.size());
+                    }
                 }
                 return result;
             }};
@@ -159,27 +305,71 @@ class LidarPacketHandler {
     LidarPacketHandler& operator=(const LidarPacketHandler&) = delete;
     ~LidarPacketHandler() {
         NODELET_DEBUG("LidarPacketHandler::~LidarPacketHandler()");
-        if (lidar_scans_processing_thread->joinable()) {
+        // no scan of this handler is processed by the pool past this point
+        if (pool_queue) pool_queue->close();
+        if (lidar_scans_processing_thread &&
+            lidar_scans_processing_thread->joinable()) {
             lidar_scans_processing_active = false;
             lidar_scans_processing_thread->join();
         }
     }
 
-    void register_lidar_scan_handler(LidarScanProcessor handler) {
+    void register_lidar_scan_handler(LidarScanProcessor handler,
+                                     const ProcessorPolicy& policy = {}) {
         lidar_scan_handlers.push_back(handler);
+        auto policies = schedule.policies();
+        policies.push_back(policy);
+        schedule = ProcessorSchedule(policies, lidar_scan_handlers.size());
     }
 
-    void clear_registered_lidar_scan_handlers() { lidar_scan_handlers.clear(); }
+    void clear_registered_lidar_scan_handlers() {
+        lidar_scan_handlers.clear();
+        schedule = ProcessorSchedule({}, 0);
+    }
+
+    // number of scans the processor at index was skipped for
+    uint64_t processor_skips(size_t index) const {
+        return schedule.skipped(index);
+    }
 
    public:
     static HandlerType create(
         const ouster::sdk::core::SensorInfo& info,
         const std::vector<LidarScanProcessor>& handlers,
         const std::string& timestamp_mode, int64_t ptp_utc_tai_offset,
-        float min_scan_valid_columns_ratio) {
+        float min_scan_valid_columns_ratio,
+        std::shared_ptr<PipelineStats> stats = nullptr,
+        const memory::BufferPinning& pinning = {},
+        const std::vector<std::string>& fields = {},
+        memory::MemoryBudget* budget = nullptr,
+        const threading::InlineProcessing& inline_processing = {},
+        std::shared_ptr<AdaptiveQuality> quality = nullptr,
+        const std::vector<ProcessorPolicy>& policies = {},
+        std::shared_ptr<LidarScanProcessorSwap> swap = nullptr,
+        std::shared_ptr<threading::WorkerPool> pool = nullptr,
+        std::shared_ptr<ScanColumnsObservers> column_observers = nullptr,
+        bool early_frame_completion = false, bool verify_crc = false) {
         auto handler = std::make_shared<LidarPacketHandler>(
             info, handlers, timestamp_mode, ptp_utc_tai_offset,
-            min_scan_valid_columns_ratio);
+            min_scan_valid_columns_ratio, stats, pinning, fields, budget,
+            inline_processing, quality, policies, swap, pool,
+            column_observers, early_frame_completion, verify_crc);
+        if (inline_processing.enabled) {
+            return [handler](
+                       const ouster::sdk::core::LidarPacket& lidar_packet) {
+                if (handler->lidar_packet_accumlator(lidar_packet)) {
+                    handler->process_scan_inline();
+                }
+            };
+        }
+        if (handler->pool_queue) {
+            return [handler](
+                       const ouster::sdk::core::LidarPacket& lidar_packet) {
+                if (handler->lidar_packet_accumlator(lidar_packet)) {
+                    handler->pool_queue->notify();
+                }
+            };
+        }
         return [handler](const ouster::sdk::core::LidarPacket& lidar_packet) {
             if (handler->lidar_packet_accumlator(lidar_packet)) {
                 handler->ring_buffer_has_elements.notify_one();
@@ -189,6 +379,27 @@ class LidarPacketHandler {
 
     const std::string getName() const { return "lidar_packet_hander"; }
 
+    /**
+     * Selects the fields of the sensor profile that are listed in fields,
+     * which is usually the union of the fields required by the processors.
+     * An empty list selects all the fields of the profile.
+     */
+    static ouster::sdk::core::LidarScanFieldTypes scan_field_types(
+        const ouster::sdk::core::SensorInfo& info,
+        const std::vector<std::string>& fields) {
+        auto field_types =
+            ouster::sdk::core::get_field_types(info.format.udp_profile_lidar);
+        if (fields.empty()) return field_types;
+        field_types.erase(
+            std::remove_if(field_types.begin(), field_types.end(),
+                           [&fields](const auto& ft) {
+                               return std::find(fields.begin(), fields.end(),
+                                                ft.name) == fields.end();
+                           }),
+            field_types.end());
+        return field_types;
+    }
+
     void process_scans() {
         {
             using namespace std::chrono;
@@ -199,21 +410,148 @@ class LidarPacketHandler {
             if (ring_buffer.empty()) return;
         }
 
-        std::unique_lock<std::mutex> lock(*mutexes[ring_buffer.read_head()]);
+        process_next_scan();
+    }
 
-        for (auto h : lidar_scan_handlers) {
-            h(*lidar_scans[ring_buffer.read_head()], lidar_scan_estimated_ts,
-              lidar_scan_estimated_msg_ts);
-        }
+    // processes the scan at the read head, a throttled ring may have been
+    // drained ahead of a pending pool run
+    void process_next_scan() {
+        if (ring_buffer.empty()) return;
+        const auto slot = ring_buffer.read_head();
+        std::unique_lock<std::mutex> lock(*mutexes[slot]);
+
+        run_processors(slot);
 
-        // when we hit percent amount of the ring_buffer capacity throttle
+        // when we hit percent amount of the ring_buffer capacity throttle,
+        // with adaptive quality this only kicks in once the lowest quality
+        // level can't keep up either
         size_t read_step = 1;
         if (ring_buffer.size() > THROTTLE_PERCENT * ring_buffer.capacity()) {
-            NODELET_WARN("lidar_scans %d%% full, THROTTLING",
-                         static_cast<int>(100 * THROTTLE_PERCENT));
+            throttled_scan_event->record();
             read_step = 2;
+            if (stats_) ++stats_->scans_throttled;
         }
         ring_buffer.read(read_step);
+        OUSTER_ROS_TRACE3(ring_dequeue, trace_id, slot, ring_buffer.size());
+    }
+
+    /**
+     * Runs the processors on the scan that was just completed from the thread
+     * that feeds the packets. The remaining processors are skipped once the
+     * deadline passes since the socket isn't drained in the meantime.
+     */
+    void process_scan_inline() {
+        const auto slot = ring_buffer.read_head();
+        if (!run_processors(slot, inline_processing_.deadline)) {
+            missed_deadline_event->record();
+            if (stats_) ++stats_->scans_throttled;
+        }
+        ring_buffer.read();
+        OUSTER_ROS_TRACE3(ring_dequeue, trace_id, slot, ring_buffer.size());
+    }
+
+    // the hot paths only record events, the summaries are logged by event_log
+    void register_events(const ouster::sdk::core::SensorInfo& info) {
+        dropped_packet_event = &event_log.add(
+            [](std::ostream& os, uint64_t count, uint64_t, double period_s) {
+                os << "lidar_scans full, dropped " << count
+                   << " packets in the last " << std::setprecision(3)
+                   << period_s << "s";
+            });
+        const size_t columns = info.format.columns_per_frame;
+        skipped_scan_event = &event_log.add(
+            [columns, ratio = min_scan_valid_columns_ratio_](
+                std::ostream& os, uint64_t count, uint64_t valid_cols,
+                double period_s) {
+                os << "skipped " << count << " scans in the last "
+                   << std::setprecision(3) << period_s
+                   << "s with a number of valid columns per scan below the "
+                   << "ratio " << std::setprecision(4) << 100 * ratio
+                   << "% (last " << valid_cols << "/" << columns << ")";
+            });
+        throttled_scan_event = &event_log.add(
+            [percent = static_cast<int>(100 * THROTTLE_PERCENT)](
+                std::ostream& os, uint64_t count, uint64_t, double period_s) {
+                os << "lidar_scans " << percent << "% full, throttled "
+                   << count << " scans in the last " << std::setprecision(3)
+                   << period_s << "s";
+            });
+        missed_deadline_event = &event_log.add(
+            [](std::ostream& os, uint64_t count, uint64_t, double period_s) {
+                os << "inline scan processing exceeded its deadline on "
+                   << count << " scans in the last " << std::setprecision(3)
+                   << period_s << "s, skipped the remaining processors";
+            });
+        late_packet_event = &event_log.add(
+            [](std::ostream& os, uint64_t count, uint64_t frame_id,
+               double period_s) {
+                os << "dropped " << count << " packets that arrived after "
+                   << "the last column of their scan in the last "
+                   << std::setprecision(3) << period_s << "s (last frame "
+                   << frame_id << ")";
+            });
+        crc_failure_event = &event_log.add(
+            [](std::ostream& os, uint64_t count, uint64_t, double period_s) {
+                os << "dropped " << count << " lidar packets failing the crc "
+                   << "check in the last " << std::setprecision(3) << period_s
+                   << "s";
+            });
+        shed_processor_event = &event_log.add(
+            [](std::ostream& os, uint64_t count, uint64_t processor,
+               double period_s) {
+                os << "skipped " << count << " processor runs that couldn't "
+                   << "meet their deadline in the last "
+                   << std::setprecision(3) << period_s << "s (last: processor "
+                   << processor << ")";
+            });
+    }
+
+    // returns false when the deadline passed before all processors ran
+    bool run_processors(size_t slot, std::chrono::nanoseconds deadline =
+                                         std::chrono::nanoseconds{0}) {
+        // processors rebuilt after a change of params take over between scans
+        if (swap_) swap_->apply(lidar_scan_handlers);
+        trace::current_handler() = trace_id;
+        const auto scan_start = std::chrono::steady_clock::now();
+        const auto scan_completed = scan_completed_at[slot];
+        bool completed = true;
+        // high priority processors first
+        for (auto i : schedule.order()) {
+            const auto start = std::chrono::steady_clock::now();
+            if (deadline.count() > 0 && start - scan_start > deadline) {
+                completed = false;
+                break;
+            }
+            // decimated scans don't count as skips, the output rate is asked for
+            if (!schedule.due(i)) continue;
+            const bool deadline_lost =
+                schedule.deadline_lost(i, start - scan_completed);
+            if (deadline_lost || (quality_ && quality_->skip(i))) {
+                if (deadline_lost) {
+                    shed_processor_event->record(i);
+                    schedule.shed(i);
+                } else {
+                    schedule.skip(i);
+                }
+                if (stats_) stats_->add_processor_skip(i);
+                continue;
+            }
+            OUSTER_ROS_TRACE3(processor_start, trace_id, i, slot);
+            lidar_scan_handlers[i](*lidar_scans[slot], scan_estimated_ts[slot],
+                                   scan_estimated_msg_ts[slot]);
+            const auto duration = std::chrono::steady_clock::now() - start;
+            schedule.record(i, duration);
+            if (stats_) {
+                stats_->add_processor_time(
+                    i, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           duration)
+                           .count());
+            }
+            OUSTER_ROS_TRACE3(processor_end, trace_id, i, slot);
+        }
+        if (quality_)
+            quality_->update(std::chrono::steady_clock::now() - scan_start);
+        return completed;
     }
 
     // time interpolation methods
@@ -241,7 +579,7 @@ class LidarPacketHandler {
 
     // compute_scan_ts_0 for first scan
     uint64_t compute_scan_ts_0(
-        const ouster::sdk::core::LidarScan::Header<uint64_t>& ts_v) {
+        const ScanTimestamps& ts_v) {
         auto idx = std::find_if(ts_v.data(), ts_v.data() + ts_v.size(),
                                 [](uint64_t h) { return h != 0; });
         assert(idx != ts_v.data() + ts_v.size());  // should never happen
@@ -267,7 +605,7 @@ class LidarPacketHandler {
 
     // compute_scan_ts_n applied to all subsequent scans except first one
     uint64_t compute_scan_ts_n(
-        const ouster::sdk::core::LidarScan::Header<uint64_t>& ts_v) {
+        const ScanTimestamps& ts_v) {
         auto idx = std::find_if(ts_v.data(), ts_v.data() + ts_v.size(),
                                 [](uint64_t h) { return h != 0; });
         assert(idx != ts_v.data() + ts_v.size());  // should never happen
@@ -305,7 +643,7 @@ class LidarPacketHandler {
     bool lidar_handler_sensor_time(const ouster::sdk::core::PacketFormat&,
                                    const ouster::sdk::core::LidarPacket& lidar_packet,
                                    ouster::sdk::core::LidarScan& lidar_scan) {
-        if (!(*scan_batcher)(lidar_packet, lidar_scan)) return false;
+        if (!batch_packet(lidar_packet, lidar_scan)) return false;
         lidar_scan_estimated_ts = compute_scan_ts(lidar_scan.timestamp());
         lidar_scan_estimated_msg_ts =
             impl::ts_to_ros_time(lidar_scan_estimated_ts);
@@ -316,7 +654,7 @@ class LidarPacketHandler {
     bool lidar_handler_sensor_time_ptp(const ouster::sdk::core::PacketFormat&,
                                        const ouster::sdk::core::LidarPacket& lidar_packet,
                                        ouster::sdk::core::LidarScan& lidar_scan) {
-        if (!(*scan_batcher)(lidar_packet, lidar_scan)) return false;
+        if (!batch_packet(lidar_packet, lidar_scan)) return false;
         auto ts_v = lidar_scan.timestamp();
         for (int i = 0; i < ts_v.rows(); ++i)
             ts_v[i] = impl::ts_safe_offset_add(ts_v[i], ptp_utc_tai_offset_);
@@ -333,21 +671,139 @@ class LidarPacketHandler {
         auto packet_receive_time =
             impl::ts_to_ros_time(lidar_packet.host_timestamp);
 
-        if (!lidar_handler_ros_time_frame_ts) {
+        if (!lidar_handler_ros_time_frame_ts &&
+            !(frame_completion_ &&
+              frame_completion_->late(pf, lidar_packet.buf.data()))) {
             lidar_handler_ros_time_frame_ts = extrapolate_frame_ts(
                 pf, lidar_packet.buf.data(),
                 packet_receive_time);  // first point cloud time
         }
 
-        if (!(*scan_batcher)(lidar_packet, lidar_scan)) return false;
+        if (!batch_packet(lidar_packet, lidar_scan)) return false;
         lidar_scan_estimated_ts = compute_scan_ts(lidar_scan.timestamp());
         lidar_scan_estimated_msg_ts = lidar_handler_ros_time_frame_ts.value();
-        // set time for next point cloud msg
-        lidar_handler_ros_time_frame_ts = extrapolate_frame_ts(
-            pf, lidar_packet.buf.data(), packet_receive_time);
+        // set time for next point cloud msg, a scan completed early leaves it
+        // to the first packet of the next frame
+        if (frame_completion_ && frame_completion_->awaiting_next_frame()) {
+            lidar_handler_ros_time_frame_ts.reset();
+        } else {
+            lidar_handler_ros_time_frame_ts = extrapolate_frame_ts(
+                pf, lidar_packet.buf.data(), packet_receive_time);
+        }
         return true;
     }
 
+    /**
+     * Picks the decoders specialized for the profile when it has some, the
+     * fields without a specialized decoder are left to the ScanBatcher.
+     */
+    void create_scan_batcher(
+        const ouster::sdk::core::SensorInfo& info,
+        const ouster::sdk::core::LidarScanFieldTypes& field_types) {
+        packet_format = &ouster::sdk::core::get_format(info);
+        if (PacketDecoder::supported(info.format.udp_profile_lidar)) {
+            profile_batcher = std::make_unique<ProfileScanBatcher>(
+                info, field_types, lidar_scans.size());
+            const auto& specialized = profile_batcher->specialized_fields();
+            if (!specialized.empty()) {
+                std::string names;
+                for (const auto& name : specialized)
+                    names += (names.empty() ? "" : ", ") + name;
+                NODELET_INFO_STREAM(
+                    "decoding lidar scan fields with the decoders specialized "
+                    "for the profile ("
+                    << profile_batcher->implementation() << "): " << names);
+                return;
+            }
+            profile_batcher.reset();
+        }
+        scan_batcher = std::make_unique<ouster::sdk::core::ScanBatcher>(info);
+    }
+
+    bool batch_packet(const ouster::sdk::core::LidarPacket& lidar_packet,
+                      ouster::sdk::core::LidarScan& lidar_scan) {
+        if (frame_completion_ && !admit_packet(lidar_packet, lidar_scan))
+            return false;
+        bool completed =
+            profile_batcher ? (*profile_batcher)(lidar_packet, lidar_scan)
+                            : (*scan_batcher)(lidar_packet, lidar_scan);
+        if (column_observers_)
+            column_observers_->batched(*packet_format, lidar_packet.buf.data(),
+                                       lidar_scan, completed);
+        if (!completed && frame_completion_ &&
+            frame_completion_->completes(*packet_format,
+                                         lidar_packet.buf.data(), lidar_scan)) {
+            if (profile_batcher) profile_batcher->complete(lidar_scan);
+            frame_completion_->zero_trailing_columns(lidar_scan);
+            if (stats_) ++stats_->scans_completed_early;
+            completed = true;
+        }
+        return completed;
+    }
+
+    // drops the packets of a scan that completed early, reports the time
+    // gained once the next frame starts
+    bool admit_packet(const ouster::sdk::core::LidarPacket& lidar_packet,
+                      ouster::sdk::core::LidarScan& lidar_scan) {
+        const auto* lidar_buf = lidar_packet.buf.data();
+        switch (
+            frame_completion_->admit(*packet_format, lidar_buf, lidar_scan)) {
+            case EarlyFrameCompletion::Admission::DROP_LATE:
+                late_packet_event->record(packet_format->frame_id(lidar_buf));
+                if (stats_) ++stats_->late_packets;
+                return false;
+            case EarlyFrameCompletion::Admission::START_SCAN:
+                if (stats_)
+                    stats_->add_early_completion_gain(
+                        frame_completion_->gain().count());
+                return true;
+            default:
+                return true;
+        }
+    }
+
+    void pin_lidar_scan(const ouster::sdk::core::LidarScan& ls) {
+        if (!pinned_scans.pinning().enabled()) return;
+        pinned_scans.pin_container(ls.timestamp());
+        pinned_scans.pin_container(ls.measurement_id());
+        pinned_scans.pin_container(ls.status());
+        for (const auto& f : ls.fields())
+            pinned_scans.pin(f.second.get(), f.second.bytes());
+    }
+
+    /**
+     * The number of lidar scans held by the ring when no memory budget shrinks
+     * it.
+     */
+    static size_t ring_capacity(bool inline_processing) {
+        return inline_processing ? INLINE_LIDAR_SCAN_COUNT : LIDAR_SCAN_COUNT;
+    }
+
+    /**
+     * Picks the number of lidar scans held by the ring, a memory budget shrinks
+     * the ring down to what is left of the budget once the processors have
+     * allocated their buffers.
+     */
+    static size_t ring_depth(const ouster::sdk::core::SensorInfo& info,
+                             const std::vector<std::string>& fields,
+                             const memory::MemoryBudget* budget) {
+        if (!budget || !budget->limited()) return LIDAR_SCAN_COUNT;
+        const ouster::sdk::core::LidarScan probe(
+            info.format.columns_per_frame, info.format.pixels_per_column,
+            scan_field_types(info, fields), info.format.columns_per_packet);
+        return budget->ring_depth(lidar_scan_memory_bytes(probe),
+                                  MIN_LIDAR_SCAN_COUNT, LIDAR_SCAN_COUNT);
+    }
+
+    static size_t lidar_scan_memory_bytes(
+        const ouster::sdk::core::LidarScan& ls) {
+        size_t bytes = ls.timestamp().size() * sizeof(uint64_t) +
+                       ls.measurement_id().size() * sizeof(uint16_t) +
+                       ls.status().size() * sizeof(uint32_t);
+        for (const auto& f : ls.fields()) bytes += f.second.bytes();
+        return bytes;
+    }
+
     static double compute_scan_col_ts_spacing_ns(ouster::sdk::core::LidarMode ld_mode) {
         const auto scan_width = ouster::sdk::core::n_cols_of_lidar_mode(ld_mode);
         const auto scan_frequency = ouster::sdk::core::frequency_of_lidar_mode(ld_mode);
@@ -357,13 +813,28 @@ class LidarPacketHandler {
 
    private:
     std::unique_ptr<ouster::sdk::core::ScanBatcher> scan_batcher;
-    const int LIDAR_SCAN_COUNT = 10;
+    std::unique_ptr<ProfileScanBatcher> profile_batcher;
+    const ouster::sdk::core::PacketFormat* packet_format = nullptr;
+    std::unique_ptr<EarlyFrameCompletion> frame_completion_;
+    std::unique_ptr<PacketCrc> packet_crc_;
+    static constexpr size_t LIDAR_SCAN_COUNT = 10;
+    // the ring holds one less scan than its capacity, this keeps one scan
+    // in flight while another one is being processed
+    static constexpr size_t MIN_LIDAR_SCAN_COUNT = 3;
+    // inline processing consumes every scan before the next one is batched
+    static constexpr size_t INLINE_LIDAR_SCAN_COUNT = 2;
     const float THROTTLE_PERCENT = 0.7f;
     LockFreeRingBuffer ring_buffer;
     std::mutex ring_buffer_mutex;
     std::vector<std::unique_ptr<ouster::sdk::core::LidarScan>> lidar_scans;
     std::vector<std::unique_ptr<std::mutex>> mutexes;
+    std::vector<std::chrono::steady_clock::time_point> scan_completed_at;
+    // per slot, the timestamps of the scan it holds
+    std::vector<uint64_t> scan_estimated_ts;
+    std::vector<ros::Time> scan_estimated_msg_ts;
+    memory::PinnedRegions pinned_scans;
 
+    // only touched by the thread batching the packets
     uint64_t lidar_scan_estimated_ts;
     ros::Time lidar_scan_estimated_msg_ts;
 
@@ -375,10 +846,10 @@ class LidarPacketHandler {
     double scan_col_ts_spacing_ns;  // interval or spacing between columns of a
                                     // scan
 
-    std::function<uint64_t(const ouster::sdk::core::LidarScan::Header<uint64_t>&)>
-        compute_scan_ts;
+    std::function<uint64_t(const ScanTimestamps&)> compute_scan_ts;
 
     std::vector<LidarScanProcessor> lidar_scan_handlers;
+    ProcessorSchedule schedule;
 
     LidarPacketAccumlator lidar_packet_accumlator;
 
@@ -389,6 +860,33 @@ class LidarPacketHandler {
     int64_t ptp_utc_tai_offset_;
 
     float min_scan_valid_columns_ratio_ = 0.0f;
+
+    threading::InlineProcessing inline_processing_;
+
+    EventLog event_log;
+    EventLog::Event* dropped_packet_event;
+    EventLog::Event* skipped_scan_event;
+    EventLog::Event* throttled_scan_event;
+    EventLog::Event* missed_deadline_event;
+    EventLog::Event* shed_processor_event;
+    EventLog::Event* late_packet_event;
+    EventLog::Event* crc_failure_event;
+
+    perf::Stage perf_batching{"batching"};
+
+    // tells the tracepoints of the handlers of a process apart
+    const int trace_id = trace::next_handler_id();
+
+    std::shared_ptr<AdaptiveQuality> quality_;
+
+    std::shared_ptr<LidarScanProcessorSwap> swap_;
+
+    std::shared_ptr<threading::WorkerPool> pool_;
+    std::shared_ptr<threading::WorkerPool::Queue> pool_queue;
+
+    std::shared_ptr<ScanColumnsObservers> column_observers_;
+
+    std::shared_ptr<PipelineStats> stats_;
 };
 
 }  // namespace ouster_ros
\ No newline at end of file
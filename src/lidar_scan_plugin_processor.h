@@ -0,0 +1,102 @@
+/**
+ * Copyright (c) 2018-2024, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file lidar_scan_plugin_processor.h
+ * @brief Loads LidarScanPlugins and runs them as a LidarScanProcessor
+ */
+
+#pragma once
+
+#include <pluginlib/class_loader.h>
+
+#include <sstream>
+
+#include "lidar_packet_handler.h"
+#include "ouster_ros/lidar_scan_plugin.h"
+
+namespace ouster_ros {
+
+class LidarScanPluginProcessor {
+   public:
+    using Loader = pluginlib::ClassLoader<LidarScanPlugin>;
+    using Plugins =
+        std::vector<std::pair<std::string, std::shared_ptr<LidarScanPlugin>>>;
+
+    LidarScanPluginProcessor(const Plugins& plugins,
+                             std::shared_ptr<const LidarScanProducts> products)
+        : plugins_(plugins), products_(products) {}
+
+    /**
+     * Splits the '|' separated list of plugin classes, unlike
+     * impl::parse_tokens the listed order is kept as plugins run in sequence.
+     */
+    static std::vector<std::string> parse_names(const std::string& input) {
+        std::vector<std::string> names;
+        std::stringstream ss(input);
+        std::string name;
+        while (std::getline(ss, name, '|')) {
+            auto start = name.find_first_not_of(' ');
+            if (start == std::string::npos) continue;
+            auto end = name.find_last_not_of(' ');
+            names.push_back(name.substr(start, end - start + 1));
+        }
+        return names;
+    }
+
+    /**
+     * Instantiates and initializes the plugin classes listed in names. The
+     * loader has to outlive the returned plugins.
+     */
+    static Plugins load(Loader& loader, const std::vector<std::string>& names,
+                        ros::NodeHandle& nh, ros::NodeHandle& pnh,
+                        const ouster::sdk::core::SensorInfo& info) {
+        Plugins plugins;
+        for (const auto& name : names) {
+            std::shared_ptr<LidarScanPlugin> plugin;
+            try {
+                plugin = loader.createUniqueInstance(name);
+            } catch (const pluginlib::PluginlibException& e) {
+                ROS_FATAL_STREAM("failed to load scan plugin " << name << ": "
+                                                               << e.what());
+                throw std::runtime_error("failed to load scan plugin " + name);
+            }
+            plugin->initialize(nh, pnh, info);
+            ROS_INFO_STREAM("loaded scan plugin " << name);
+            plugins.emplace_back(name, std::move(plugin));
+        }
+        return plugins;
+    }
+
+   private:
+    void process(const ouster::sdk::core::LidarScan& lidar_scan,
+                 uint64_t scan_ts, const ros::Time& msg_ts) {
+        for (const auto& plugin : plugins_) {
+            try {
+                plugin.second->process(lidar_scan, scan_ts, msg_ts, *products_);
+            } catch (const std::exception& e) {
+                ROS_ERROR_STREAM_THROTTLE(1, "scan plugin " << plugin.first
+                                                            << " failed: "
+                                                            << e.what());
+            }
+        }
+    }
+
+   public:
+    static LidarScanProcessor create(
+        const Plugins& plugins,
+        std::shared_ptr<const LidarScanProducts> products) {
+        auto handler =
+            std::make_shared<LidarScanPluginProcessor>(plugins, products);
+        return [handler](const ouster::sdk::core::LidarScan& lidar_scan,
+                         uint64_t scan_ts, const ros::Time& msg_ts) {
+            handler->process(lidar_scan, scan_ts, msg_ts);
+        };
+    }
+
+   private:
+    Plugins plugins_;
+    std::shared_ptr<const LidarScanProducts> products_;
+};
+
+}  // namespace ouster_ros
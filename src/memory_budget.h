@@ -0,0 +1,95 @@
+/**
+ * Copyright (c) 2018-2024, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file memory_budget.h
+ * @brief Keeps track of the memory held by the long lived buffers of the
+ * pipeline and sizes the lidar scans ring to fit within a memory budget
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ouster_ros {
+namespace memory {
+
+/**
+ * Collects the size of the buffers allocated by the processors and the lidar
+ * packet handler while they are being constructed. When a limit is set the
+ * components switch to their compact variants (shared return buffers, compact
+ * xyz lut) and the lidar scans ring gets whatever is left of the budget.
+ * The object is only referenced during construction of the handlers.
+ */
+class MemoryBudget {
+   public:
+    explicit MemoryBudget(size_t limit_bytes = 0) : limit_(limit_bytes) {}
+
+    // compact buffers should be preferred over faster but larger ones
+    bool limited() const { return limit_ != 0; }
+
+    size_t limit() const { return limit_; }
+
+    /**
+     * Whether the messages of the processors are handed over to an
+     * AsyncPublisher, which keeps spare copies of them that the processors
+     * account along with their own.
+     */
+    bool async_publish() const { return async_publish_; }
+
+    void set_async_publish(bool enabled) { async_publish_ = enabled; }
+
+    void account(const std::string& component, size_t bytes) {
+        auto it = std::find_if(
+            components_.begin(), components_.end(),
+            [&component](const auto& c) { return c.first == component; });
+        if (it == components_.end())
+            components_.emplace_back(component, bytes);
+        else
+            it->second += bytes;
+        total_ += bytes;
+    }
+
+    size_t total() const { return total_; }
+
+    size_t remaining() const { return total_ < limit_ ? limit_ - total_ : 0; }
+
+    const std::vector<std::pair<std::string, size_t>>& components() const {
+        return components_;
+    }
+
+    /**
+     * Picks the number of ring slots that fit within the remaining budget,
+     * never going below min_depth or above max_depth.
+     */
+    size_t ring_depth(size_t scan_bytes, size_t min_depth,
+                      size_t max_depth) const {
+        if (!limited() || scan_bytes == 0) return max_depth;
+        return std::min(max_depth,
+                        std::max(min_depth, remaining() / scan_bytes));
+    }
+
+    std::string report() const {
+        std::ostringstream ss;
+        ss << std::fixed << std::setprecision(2) << "memory footprint "
+           << total_ / 1e6 << " MB";
+        if (limited()) ss << " of " << limit_ / 1e6 << " MB budget";
+        for (const auto& c : components_)
+            ss << "\n  " << c.first << ": " << c.second / 1e6 << " MB";
+        return ss.str();
+    }
+
+   private:
+    size_t limit_;
+    bool async_publish_ = false;
+    size_t total_ = 0;
+    std::vector<std::pair<std::string, size_t>> components_;
+};
+
+}  // namespace memory
+}  // namespace ouster_ros
@@ -0,0 +1,181 @@
+/**
+ * Copyright (c) 2018-2024, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file memory_pinning.h
+ * @brief Backs long lived scan and cloud buffers with transparent hugepages and
+ * locks them into RAM
+ *
+ * The LidarScan ring and the point cloud buffers are allocated once and then
+ * walked end to end for every scan. For large sensor modes these span several
+ * hundred MB of 4K pages which puts pressure on the TLB. The buffers are owned
+ * by sdk/pcl/ROS types with fixed allocators, so rather than allocating them
+ * from hugetlbfs the existing mappings are advised with MADV_HUGEPAGE and, on
+ * kernels that support it (>= 6.1), synchronously collapsed with MADV_COLLAPSE.
+ */
+
+#pragma once
+
+#include <ros/console.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// not exposed by older libc headers, the kernel rejects it with EINVAL when
+// unsupported which is handled gracefully
+#ifndef MADV_COLLAPSE
+#define MADV_COLLAPSE 25
+#endif
+
+namespace ouster_ros {
+namespace memory {
+
+/**
+ * Selects how long lived buffers should be backed.
+ */
+struct BufferPinning {
+    bool hugepages = false;  // advise and collapse into transparent hugepages
+    bool mlock = false;      // lock the pages into RAM to avoid page faults
+
+    bool enabled() const { return hugepages || mlock; }
+};
+
+namespace impl {
+
+// [first, second) page aligned address range
+using PageRange = std::pair<uintptr_t, uintptr_t>;
+
+/**
+ * The parts of range that none of ranges overlaps.
+ */
+inline std::vector<PageRange> uncovered(const PageRange& range,
+                                        std::vector<PageRange> ranges) {
+    std::sort(ranges.begin(), ranges.end());
+    std::vector<PageRange> parts;
+    auto pos = range.first;
+    for (const auto& r : ranges) {
+        if (r.second <= pos || r.first >= range.second) continue;
+        if (r.first > pos) parts.emplace_back(pos, r.first);
+        pos = std::max(pos, r.second);
+    }
+    if (pos < range.second) parts.emplace_back(pos, range.second);
+    return parts;
+}
+
+inline size_t length(const std::vector<PageRange>& ranges) {
+    size_t bytes = 0;
+    for (const auto& r : ranges) bytes += r.second - r.first;
+    return bytes;
+}
+
+/**
+ * The ranges locked by every PinnedRegions of the process. Locks don't stack,
+ * a single munlock releases a page however many times it was locked, so a
+ * range is only unlocked where no other locked range overlaps it.
+ */
+struct LockedRanges {
+    std::mutex mutex;
+    std::vector<PageRange> ranges;
+
+    static LockedRanges& instance() {
+        static LockedRanges locked;
+        return locked;
+    }
+};
+
+}  // namespace impl
+
+/**
+ * Applies a BufferPinning policy to a set of memory regions and releases the
+ * locks once destroyed. The owner must keep the regions alive (and must not
+ * reallocate them) for the lifetime of this object. Regions are rounded to
+ * whole pages, which neighbouring buffers of this or other objects may share.
+ */
+class PinnedRegions {
+   public:
+    explicit PinnedRegions(const BufferPinning& pinning = {})
+        : pinning_(pinning) {}
+
+    PinnedRegions(const PinnedRegions&) = delete;
+    PinnedRegions& operator=(const PinnedRegions&) = delete;
+
+    ~PinnedRegions() {
+        auto& all = impl::LockedRanges::instance();
+        std::lock_guard<std::mutex> lock(all.mutex);
+        for (const auto& r : locked) {
+            all.ranges.erase(std::find(all.ranges.begin(), all.ranges.end(), r));
+            for (const auto& part : impl::uncovered(r, all.ranges))
+                munlock(reinterpret_cast<void*>(part.first),
+                        part.second - part.first);
+        }
+    }
+
+    const BufferPinning& pinning() const { return pinning_; }
+
+    /**
+     * Pins the pages overlapping [ptr, ptr + bytes).
+     * @return the number of bytes of the pages this object had not pinned yet
+     */
+    size_t pin(const void* ptr, size_t bytes) {
+        if (!pinning_.enabled() || ptr == nullptr || bytes == 0) return 0;
+
+        static const uintptr_t page_size = sysconf(_SC_PAGESIZE);
+        const auto begin = reinterpret_cast<uintptr_t>(ptr) & ~(page_size - 1);
+        const auto end = (reinterpret_cast<uintptr_t>(ptr) + bytes +
+                          page_size - 1) & ~(page_size - 1);
+        auto addr = reinterpret_cast<void*>(begin);
+        const size_t length = end - begin;
+
+        if (pinning_.hugepages) {
+            if (madvise(addr, length, MADV_HUGEPAGE) != 0) {
+                ROS_WARN_ONCE(
+                    "madvise(MADV_HUGEPAGE) failed, transparent hugepages are "
+                    "disabled (check /sys/kernel/mm/transparent_hugepage)");
+            } else if (madvise(addr, length, MADV_COLLAPSE) != 0) {
+                // pages that are already populated will be collapsed in the
+                // background by khugepaged instead
+                ROS_DEBUG_ONCE("madvise(MADV_COLLAPSE) is not supported");
+            }
+        }
+
+        if (pinning_.mlock) {
+            auto& all = impl::LockedRanges::instance();
+            std::lock_guard<std::mutex> lock(all.mutex);
+            if (mlock(addr, length) != 0) {
+                ROS_WARN_ONCE(
+                    "mlock failed, buffers can still be paged out (raise "
+                    "RLIMIT_MEMLOCK or grant CAP_IPC_LOCK)");
+            } else {
+                locked.emplace_back(begin, end);
+                all.ranges.emplace_back(begin, end);
+            }
+        }
+
+        // pages shared with buffers pinned before are only counted once
+        const size_t added = impl::length(impl::uncovered({begin, end}, pinned));
+        pinned.emplace_back(begin, end);
+        pinned_bytes_ += added;
+        return added;
+    }
+
+    template <typename Container>
+    size_t pin_container(const Container& c) {
+        return pin(c.data(), c.size() * sizeof(*c.data()));
+    }
+
+    size_t pinned_bytes() const { return pinned_bytes_; }
+
+   private:
+    BufferPinning pinning_;
+    std::vector<impl::PageRange> pinned;
+    std::vector<impl::PageRange> locked;
+    size_t pinned_bytes_ = 0;
+};
+
+}  // namespace memory
+}  // namespace ouster_ros
@@ -17,17 +17,28 @@
 #include <ros/console.h>
 #include <ros/ros.h>
 #include <std_msgs/String.h>
+#include <std_msgs/UInt8.h>
+#include <std_srvs/Trigger.h>
 #include <sensor_msgs/Imu.h>
 #include <sensor_msgs/PointCloud2.h>
 
 #include "ouster_ros/PacketMsg.h"
+#include "diagnostics.h"
+#include "packet_subscriber.h"
 #include "os_transforms_broadcaster.h"
 #include "imu_packet_handler.h"
 #include "lidar_packet_handler.h"
 #include "point_cloud_processor.h"
 #include "laser_scan_processor.h"
 #include "point_cloud_processor_factory.h"
+#include "lidar_scan_plugin_processor.h"
+#include "async_publisher.h"
+#include "adaptive_quality.h"
+#include "processing_params.h"
+#include "processor_schedule.h"
+#include "subscriber_demand.h"
 #include "telemetry_handler.h"
+#include "worker_pool.h"
 
 namespace ouster_ros {
 
@@ -45,18 +56,43 @@ class OusterCloud : public nodelet::Nodelet {
         auto& pnh = getPrivateNodeHandle();
         auto proc_mask = pnh.param("proc_mask", std::string{"IMU|PCL|SCAN"});
         auto tokens = impl::parse_tokens(proc_mask, '|');
+        // outputs without subscribers are skipped by the processors
+        demand.set_enabled(pnh.param("lazy_processing", true));
         if (impl::check_token(tokens, "IMU")) create_imu_pub_sub();
         if (impl::check_token(tokens, "PCL")) create_point_cloud_pubs();
         if (impl::check_token(tokens, "SCAN")) create_laser_scan_pubs();
         if (impl::check_token(tokens, "TLM")) create_telemetry_pub();
+        diagnostics_enabled = impl::check_token(tokens, "DIAG");
         if (impl::check_token(tokens, "PCL") ||
             impl::check_token(tokens, "SCAN") ||
-            impl::check_token(tokens, "TLM"))
+            impl::check_token(tokens, "TLM") ||
+            !pnh.param("scan_plugins", std::string{}).empty())
             create_lidar_packets_sub();
+        create_reconfigure_processing_service();
         create_metadata_subscriber();
         NODELET_INFO("OusterCloud: nodelet created!");
     }
 
+    bool stamped_packets() {
+        return getPrivateNodeHandle().param("stamped_packets", false);
+    }
+
+    // takes the packets of topic from the ring os_sensor fans them out
+    // through when packet_fanout is set, subscribes to the topic otherwise
+    void subscribe_packets(const std::string& topic, uint32_t queue_size,
+                           ros::Subscriber& sub,
+                           std::unique_ptr<PacketFanoutSubscriber>& fanout,
+                           PacketCallback callback) {
+        if (getPrivateNodeHandle().param("packet_fanout", false)) {
+            fanout = std::make_unique<PacketFanoutSubscriber>(
+                getNodeHandle(), topic, std::move(callback));
+            return;
+        }
+        sub = ouster_ros::subscribe_packets(getNodeHandle(), topic, queue_size,
+                                            stamped_packets(),
+                                            std::move(callback));
+    }
+
     void create_metadata_subscriber() {
         metadata_sub = getNodeHandle().subscribe<std_msgs::String>(
             "metadata", 1, &OusterCloud::metadata_handler, this);
@@ -64,6 +100,9 @@ class OusterCloud : public nodelet::Nodelet {
 
     void metadata_handler(const std_msgs::String::ConstPtr& metadata_msg) {
         NODELET_INFO("OusterCloud: retrieved new sensor metadata!");
+        // no packets are handed over by the fanout while the handlers change
+        auto lidar_fanout_paused = pause_fanout(lidar_packet_fanout);
+        auto imu_fanout_paused = pause_fanout(imu_packet_fanout);
         auto info = ouster::sdk::core::SensorInfo(metadata_msg->data);
         packet_format = std::make_shared<ouster::sdk::core::PacketFormat>(
             ouster::sdk::core::get_format(info));
@@ -99,24 +138,188 @@ class OusterCloud : public nodelet::Nodelet {
             }
         }
 
+        // start with fresh counters whenever the handlers are recreated
+        if (diagnostics_enabled) create_diagnostics();
         create_handlers(info);
+        if (diagnostics) {
+            std::ostringstream hardware_id;
+            hardware_id << info.prod_line << " " << info.sn;
+            diagnostics->start(getNodeHandle(), hardware_id.str());
+        }
+    }
+
+    void create_diagnostics() {
+        pipeline_stats = std::make_shared<PipelineStats>();
+        diagnostics =
+            std::make_unique<DiagnosticsPublisher>(getName(), pipeline_stats);
+    }
+
+    // returns the ids of the given topics within pipeline_stats
+    std::vector<size_t> track_topics(const std::vector<ros::Publisher>& pubs) {
+        std::vector<size_t> ids(pubs.size(), SIZE_MAX);
+        if (!pipeline_stats) return ids;
+        for (size_t i = 0; i < pubs.size(); ++i)
+            ids[i] = pipeline_stats->register_topic(pubs[i].getTopic());
+        return ids;
+    }
+
+    void track_processor(const std::string& name) {
+        if (pipeline_stats) pipeline_stats->register_processor(name);
+    }
+
+    // rebuilds the processors whose params changed on the parameter server
+    void create_reconfigure_processing_service() {
+        reconfigure_processing_srv =
+            getNodeHandle()
+                .advertiseService<std_srvs::Trigger::Request,
+                                  std_srvs::Trigger::Response>(
+                    "reconfigure_processing",
+                    [this](std_srvs::Trigger::Request&,
+                           std_srvs::Trigger::Response& response) {
+                        auto params =
+                            ProcessingParams::read(getPrivateNodeHandle());
+                        try {
+                            auto rebuilt = processing_reconfigure.apply(params);
+                            response.success = true;
+                            response.message =
+                                rebuilt == 0
+                                    ? "no processing param changed"
+                                    : "rebuilt " + std::to_string(rebuilt) +
+                                          " processors, applied from the "
+                                          "next scan";
+                            NODELET_INFO_STREAM("reconfigure_processing: "
+                                                << response.message);
+                        } catch (const std::exception& e) {
+                            response.success = false;
+                            response.message = e.what();
+                            NODELET_ERROR_STREAM(
+                                "reconfigure_processing rejected: "
+                                << e.what());
+                        }
+                        return true;
+                    });
+
+        NODELET_INFO("reconfigure_processing service created");
+    }
+
+    // returns null unless the scans are processed on the shared worker pool
+    std::shared_ptr<threading::WorkerPool> shared_worker_pool() {
+        auto& pnh = getPrivateNodeHandle();
+        auto scan_processing =
+            pnh.param("scan_processing", std::string{"THREADED"});
+        if (scan_processing == "THREADED") return nullptr;
+        if (scan_processing != "POOLED") {
+            NODELET_FATAL_STREAM("scan_processing needs to be one of the "
+                                 "values: {THREADED, POOLED}");
+            throw std::runtime_error("invalid scan_processing value!");
+        }
+        auto threads = pnh.param("worker_pool_threads", 0);
+        if (threads < 0) {
+            NODELET_FATAL("worker_pool_threads can't be negative");
+            throw std::runtime_error("negative worker_pool_threads!");
+        }
+        auto pool = threading::WorkerPool::shared(threads);
+        if (threads > 0 && pool->size() != static_cast<size_t>(threads)) {
+            NODELET_WARN_STREAM("the worker pool of the process already runs "
+                                << pool->size()
+                                << " threads, worker_pool_threads ignored");
+        }
+        return pool;
+    }
+
+    void warn_point_type_compatibility(
+        const ouster::sdk::core::SensorInfo& info,
+        const std::string& point_type) {
+        if (PointCloudProcessorFactory::point_type_requires_intensity(
+                point_type) &&
+            !PointCloudProcessorFactory::profile_has_intensity(
+                info.format.udp_profile_lidar)) {
+            NODELET_WARN_STREAM(
+                "selected point type '" << point_type
+                << "' is not compatible with the udp profile: "
+                << to_string(info.format.udp_profile_lidar));
+        }
+    }
+
+    // one predicate per return of the sensor for the topics named after base
+    std::vector<std::function<bool()>> returns_wanted(
+        const std::string& base, const ouster::sdk::core::SensorInfo& info) {
+        std::vector<std::function<bool()>> wanted;
+        for (size_t i = 0; i < info.num_returns(); ++i)
+            wanted.push_back(demand.wanted_fn(topic_for_return(base, i)));
+        return wanted;
+    }
+
+    // returns the scheduling policy of each output token of proc_mask
+    std::map<std::string, ProcessorPolicy> parse_processor_policies() {
+        auto& pnh = getPrivateNodeHandle();
+        auto priorities = ProcessorSchedule::parse_priorities(
+            pnh.param("processor_priority", std::string{"PCL|SCAN|IMG"}));
+        std::map<std::string, std::chrono::nanoseconds> deadlines;
+        try {
+            deadlines = ProcessorSchedule::parse_deadlines(
+                pnh.param("processor_deadlines", std::string{}));
+        } catch (const std::runtime_error& e) {
+            NODELET_FATAL_STREAM(
+                e.what() << ", processor_deadlines expects a '|' separated "
+                            "list of OUTPUT:MILLISECONDS entries");
+            throw;
+        }
+        std::map<std::string, int> decimations;
+        try {
+            decimations = ProcessorSchedule::parse_every_n_scans(
+                pnh.param("processor_every_n_scans", std::string{}));
+        } catch (const std::runtime_error& e) {
+            NODELET_FATAL_STREAM(
+                e.what() << ", processor_every_n_scans expects a '|' separated "
+                            "list of OUTPUT:N entries with N >= 1");
+            throw;
+        }
+        std::map<std::string, ProcessorPolicy> policies;
+        for (const auto& p : priorities) policies[p.first].priority = p.second;
+        for (const auto& d : deadlines) policies[d.first].deadline = d.second;
+        for (const auto& d : decimations)
+            policies[d.first].every_n_scans = d.second;
+        // plugins consume the products of the other processors of the scan
+        policies["PLUGINS"].priority = std::numeric_limits<int>::min();
+        return policies;
+    }
+
+    // returns null unless the adaptive quality is enabled
+    std::shared_ptr<AdaptiveQuality> create_adaptive_quality(
+        const ouster::sdk::core::SensorInfo& info) {
+        if (!getPrivateNodeHandle().param("adaptive_quality", false))
+            return nullptr;
+        quality_pub = getNodeHandle().advertise<std_msgs::UInt8>(
+            "quality_level", 1, true);
+        auto publish_level = [this, stats = pipeline_stats](int level) {
+            std_msgs::UInt8 msg;
+            msg.data = static_cast<uint8_t>(level);
+            quality_pub.publish(msg);
+            if (stats) stats->quality_level = level;
+        };
+        publish_level(AdaptiveQuality::FULL_QUALITY);
+        return std::make_shared<AdaptiveQuality>(
+            AdaptiveQuality::frame_period_of(info), publish_level);
     }
 
     void create_imu_pub_sub() {
         imu_pub = getNodeHandle().advertise<sensor_msgs::Imu>("imu", 100);
-        imu_packet_sub = getNodeHandle().subscribe<PacketMsg>(
-            "imu_packets", 100, [this](const PacketMsg::ConstPtr msg) {
+        subscribe_packets(
+            "imu_packets", 100, imu_packet_sub, imu_packet_fanout,
+            [this](const std::vector<uint8_t>& buf, uint64_t receive_ts) {
+                if (pipeline_stats) ++pipeline_stats->imu_packets;
                 if (imu_packet_handler) {
                     // TODO[UN]: this is not ideal since we can't reuse the msg
                     // buffer Need to redefine the Packet object and allow use
                     // of array_views
-                    ImuPacket imu_packet(msg->buf.size());
+                    // NOTE: imu_packet is a member so its buffer is only
+                    // allocated once rather than on every received packet
+                    imu_packet.buf.resize(buf.size());
                     imu_packet.format = packet_format;
-                    imu_packet.host_timestamp =
-                        static_cast<uint64_t>(ros::Time::now().toNSec());
-                    memcpy(imu_packet.buf.data(), msg->buf.data(),
-                           msg->buf.size());
-                    auto imu_msgs = imu_packet_handler(imu_packet);
+                    imu_packet.host_timestamp = receive_ts;
+                    memcpy(imu_packet.buf.data(), buf.data(), buf.size());
+                    const auto& imu_msgs = imu_packet_handler(imu_packet);
                     for (const auto& msg : imu_msgs) {
                         if (msg.header.stamp > last_msg_ts)
                             last_msg_ts = msg.header.stamp;
@@ -130,8 +333,9 @@ class OusterCloud : public nodelet::Nodelet {
         // NOTE: always create the 2nd topic
         lidar_pubs.resize(2);
         for (int i = 0; i < 2; ++i) {
-            lidar_pubs[i] = getNodeHandle().advertise<sensor_msgs::PointCloud2>(
-                topic_for_return("points", i), 10);
+            lidar_pubs[i] = demand.advertise<sensor_msgs::PointCloud2>(
+                getNodeHandle(), topic_for_return("points", i), 10,
+                topic_for_return("points", i));
         }
     }
 
@@ -139,8 +343,9 @@ class OusterCloud : public nodelet::Nodelet {
         // NOTE: always create the 2nd topic
         scan_pubs.resize(2);
         for (int i = 0; i < 2; ++i) {
-            scan_pubs[i] = getNodeHandle().advertise<sensor_msgs::LaserScan>(
-                topic_for_return("scan", i), 10);
+            scan_pubs[i] = demand.advertise<sensor_msgs::LaserScan>(
+                getNodeHandle(), topic_for_return("scan", i), 10,
+                topic_for_return("scan", i));
         }
     }
 
@@ -150,14 +355,15 @@ class OusterCloud : public nodelet::Nodelet {
     }
 
     void create_lidar_packets_sub() {
-        lidar_packet_sub = getNodeHandle().subscribe<PacketMsg>(
-            "lidar_packets", 100, [this](const PacketMsg::ConstPtr msg) {
-                LidarPacket lidar_packet(msg->buf.size());
+        subscribe_packets(
+            "lidar_packets", 100, lidar_packet_sub, lidar_packet_fanout,
+            [this](const std::vector<uint8_t>& buf, uint64_t receive_ts) {
+                // NOTE: lidar_packet is a member so its buffer is only
+                // allocated once rather than on every received packet
+                lidar_packet.buf.resize(buf.size());
                 lidar_packet.format = packet_format;
-                lidar_packet.host_timestamp =
-                    static_cast<uint64_t>(ros::Time::now().toNSec());
-                memcpy(lidar_packet.buf.data(), msg->buf.data(),
-                       msg->buf.size());
+                lidar_packet.host_timestamp = receive_ts;
+                memcpy(lidar_packet.buf.data(), buf.data(), buf.size());
 
                 if (telemetry_handler) {
                     auto telemetry = telemetry_handler(lidar_packet);
@@ -193,60 +399,117 @@ class OusterCloud : public nodelet::Nodelet {
             throw std::runtime_error("min_scan_valid_columns_ratio out of bounds!");
         }
 
-        std::vector<LidarScanProcessor> processors;
+        // the processors of the previous pipeline can't be reconfigured anymore
+        processing_reconfigure.clear();
+        auto params = ProcessingParams::read(pnh);
 
-        if (impl::check_token(tokens, "PCL")) {
-            auto point_type = pnh.param("point_type", std::string{"original"});
-            auto organized = pnh.param("organized", true);
-            auto destagger = pnh.param("destagger", true);
-            auto min_range_m = pnh.param("min_range", 0.0);
-            auto max_range_m = pnh.param("max_range", 10000.0);
-            if (min_range_m < 0.0 || max_range_m < 0.0) {
-                NODELET_FATAL("min_range and max_range need to be positive");
-                throw std::runtime_error("negative range limits!");
-            }
-            if (min_range_m >= max_range_m) {
-                const auto error_msg =
-                    "min_range can't be equal or exceed max_range";
-                NODELET_FATAL(error_msg);
-                throw std::runtime_error(error_msg);
-            }
-            // convert to millimeters
-            uint32_t min_range = impl::ulround(min_range_m * 1000);
-            uint32_t max_range = impl::ulround(max_range_m * 1000);
-            auto v_reduction = pnh.param("v_reduction", 1);
-            auto valid_values = std::vector<int>{1, 2, 4, 8, 16};
-            if (std::find(valid_values.begin(), valid_values.end(), v_reduction) == valid_values.end()) {
-                NODELET_FATAL("v_reduction needs to be one of the values: {1, 2, 4, 8, 16}");
-                throw std::runtime_error("invalid v_reduction value!");
-            }
+        memory::BufferPinning pinning;
+        pinning.hugepages = pnh.param("hugepages", false);
+        pinning.mlock = pnh.param("mlock_buffers", false);
 
-            auto mask_path = pnh.param("mask_path", std::string{});
+        auto memory_budget = pnh.param("memory_budget", 0);
+        if (memory_budget < 0) {
+            NODELET_FATAL("memory_budget needs to be a positive number of MB");
+            throw std::runtime_error("negative memory_budget!");
+        }
+        memory::MemoryBudget budget(static_cast<size_t>(memory_budget) * 1000000);
+
+        // the previous handler holds on to the topics of the async publisher
+        lidar_packet_handler = nullptr;
+        async_publisher.reset();
+        if (pnh.param("async_publish", false))
+            async_publisher = std::make_unique<AsyncPublisher>(pipeline_stats);
+        budget.set_async_publish(async_publisher != nullptr);
+
+        auto scan_plugins = LidarScanPluginProcessor::parse_names(
+            pnh.param("scan_plugins", std::string{}));
+        // exposes the intermediate buffers of the processors to the plugins
+        auto products = std::make_shared<LidarScanProducts>();
+        // lets the point cloud processor convert the columns of each packet
+        std::shared_ptr<ScanColumnsObservers> column_observers;
+        if (pnh.param("incremental_xyz", false))
+            column_observers = std::make_shared<ScanColumnsObservers>(
+                LidarPacketHandler::ring_capacity(false));
+
+        auto quality = create_adaptive_quality(info);
+        auto low_priority_outputs = impl::parse_tokens(
+            pnh.param("low_priority_outputs", std::string{"IMG"}), '|');
+
+        auto output_policies = parse_processor_policies();
 
-            processors.push_back(
-                PointCloudProcessorFactory::create_point_cloud_processor(
-                    point_type, info, tf_bcast.point_cloud_frame_id(),
-                    tf_bcast.apply_lidar_to_sensor_transform(), organized,
-                    destagger, min_range, max_range, v_reduction, mask_path,
-                    [this](PointCloudProcessor_OutputType msgs) {
-                        for (size_t i = 0; i < msgs.size(); ++i) {
-                            if (msgs[i]->header.stamp > last_msg_ts)
-                                last_msg_ts = msgs[i]->header.stamp;
-                            lidar_pubs[i].publish(*msgs[i]);
-                        }
-                    }));
+        std::vector<LidarScanProcessor> processors;
+        // one entry per processor
+        std::vector<ProcessorPolicy> policies;
+        // flags the processor about to be added when its output may be
+        // dropped by the adaptive quality
+        auto mark_low_priority = [&](const std::string& output) {
+            if (quality && impl::check_token(low_priority_outputs, output))
+                quality->set_low_priority(processors.size());
+        };
+        // union of the lidar scan fields consumed by the active processors
+        std::vector<std::string> required_fields;
+        auto require = [&required_fields](std::vector<std::string> fields) {
+            required_fields.insert(required_fields.end(), fields.begin(),
+                                   fields.end());
+        };
 
-            // warn about profile incompatibility
-            if (PointCloudProcessorFactory::point_type_requires_intensity(
-                    point_type) &&
-                !PointCloudProcessorFactory::profile_has_intensity(
-                    info.format.udp_profile_lidar)) {
-                NODELET_WARN_STREAM(
-                    "selected point type '"
-                    << point_type
-                    << "' is not compatible with the udp profile: "
-                    << to_string(info.format.udp_profile_lidar));
+        if (impl::check_token(tokens, "PCL")) {
+            try {
+                params.validate_point_cloud();
+            } catch (const std::runtime_error& e) {
+                NODELET_FATAL_STREAM(e.what());
+                throw;
             }
+
+            track_processor("point_cloud");
+            mark_low_priority("PCL");
+            policies.push_back(output_policies["PCL"]);
+            auto topic_ids = track_topics(lidar_pubs);
+            std::function<void(size_t, const sensor_msgs::PointCloud2&)>
+                publish_cloud = [this, stats = pipeline_stats, topic_ids](
+                                    size_t i, const sensor_msgs::PointCloud2& msg) {
+                    lidar_pubs[i].publish(msg);
+                    if (stats) stats->add_published_msg(topic_ids[i], msg);
+                };
+            AsyncTopics<sensor_msgs::PointCloud2> async_topics;
+            if (async_publisher)
+                async_topics = async_publisher->add_topics(lidar_pubs.size(),
+                                                           publish_cloud);
+            auto publish_clouds =
+                [this, publish_cloud,
+                 async_topics](const PointCloudProcessor_OutputType& msgs) {
+                    for (size_t i = 0; i < msgs.size(); ++i) {
+                        if (!msgs[i]) continue;
+                        if (msgs[i]->header.stamp > last_msg_ts)
+                            last_msg_ts = msgs[i]->header.stamp;
+                        if (async_topics.empty())
+                            publish_cloud(i, *msgs[i]);
+                        else
+                            async_topics[i]->publish(*msgs[i]);
+                    }
+                };
+            // also rebuilds the processor when the params are reconfigured
+            auto build = [this, info, publish_clouds, pinning, products,
+                          quality, wanted = returns_wanted("points", info),
+                          column_observers, index = processors.size()](
+                             const ProcessingParams& p,
+                             memory::MemoryBudget& budget,
+                             std::function<void()>* on_swap) {
+                warn_point_type_compatibility(info, p.point_type);
+                return PointCloudProcessorFactory::create_point_cloud_processor(
+                    p.point_type, info, tf_bcast.point_cloud_frame_id(),
+                    tf_bcast.apply_lidar_to_sensor_transform(), p.organized,
+                    p.destagger, p.min_range(), p.max_range(), p.v_reduction,
+                    p.mask_path, publish_clouds, pinning, &budget, products,
+                    quality, wanted, column_observers, index, on_swap);
+            };
+            auto fields = [info](const ProcessingParams& p) {
+                return PointCloudProcessorFactory::required_fields(p.point_type,
+                                                                   info);
+            };
+            processing_reconfigure.add(processors.size(), true, build, fields);
+            processors.push_back(build(params, budget, nullptr));
+            require(fields(params));
         }
 
         if (impl::check_token(tokens, "SCAN")) {
@@ -262,23 +525,73 @@ class OusterCloud : public nodelet::Nodelet {
                     << " ring value clamped to: " << scan_ring);
             }
 
+            track_processor("laser_scan");
+            mark_low_priority("SCAN");
+            policies.push_back(output_policies["SCAN"]);
+            auto topic_ids = track_topics(scan_pubs);
+            std::function<void(size_t, const sensor_msgs::LaserScan&)>
+                publish_scan = [this, stats = pipeline_stats, topic_ids](
+                                   size_t i, const sensor_msgs::LaserScan& msg) {
+                    scan_pubs[i].publish(msg);
+                    if (stats) stats->add_published_msg(topic_ids[i], msg);
+                };
+            AsyncTopics<sensor_msgs::LaserScan> async_topics;
+            if (async_publisher)
+                async_topics =
+                    async_publisher->add_topics(scan_pubs.size(), publish_scan);
             processors.push_back(LaserScanProcessor::create(
                 info, tf_bcast.lidar_frame_id(), scan_ring,
-                [this](LaserScanProcessor::OutputType msgs) {
+                [this, publish_scan,
+                 async_topics](const LaserScanProcessor::OutputType& msgs) {
                     for (size_t i = 0; i < msgs.size(); ++i) {
+                        if (!msgs[i]) continue;
                         if (msgs[i]->header.stamp > last_msg_ts)
                             last_msg_ts = msgs[i]->header.stamp;
-                        scan_pubs[i].publish(*msgs[i]);
+                        if (async_topics.empty())
+                            publish_scan(i, *msgs[i]);
+                        else
+                            async_topics[i]->publish(*msgs[i]);
                     }
-                }));
+                },
+                returns_wanted("scan", info)));
+            require(LaserScanProcessor::required_fields(info));
+        }
+
+        if (!scan_plugins.empty()) {
+            scan_plugin_loader =
+                std::make_unique<LidarScanPluginProcessor::Loader>(
+                    "ouster_ros", "ouster_ros::LidarScanPlugin");
+            auto plugins = LidarScanPluginProcessor::load(
+                *scan_plugin_loader, scan_plugins, getNodeHandle(), pnh, info);
+            for (const auto& plugin : plugins)
+                require(plugin.second->required_fields(info));
+            track_processor("scan_plugins");
+            mark_low_priority("PLUGINS");
+            policies.push_back(output_policies["PLUGINS"]);
+            // plugins run last so they observe the products of this scan
+            processors.push_back(
+                LidarScanPluginProcessor::create(plugins, products));
         }
 
         if (impl::check_token(tokens, "PCL") ||
-            impl::check_token(tokens, "SCAN")) {
+            impl::check_token(tokens, "SCAN") || !scan_plugins.empty()) {
+            auto swap = std::make_shared<LidarScanProcessorSwap>();
             lidar_packet_handler = LidarPacketHandler::create(
                 info, processors, timestamp_mode,
                 static_cast<int64_t>(ptp_utc_tai_offset * 1e+9),
-                min_scan_valid_columns_ratio);
+                min_scan_valid_columns_ratio, pipeline_stats, pinning,
+                required_fields, &budget, {}, quality, policies, swap,
+                shared_worker_pool(), column_observers,
+                pnh.param("early_frame_completion", false),
+                pnh.param("verify_crc", false));
+            processing_reconfigure.attach(params, required_fields, swap,
+                                          budget.limit());
+
+            NODELET_INFO_STREAM(budget.report());
+            if (pipeline_stats) {
+                for (const auto& c : budget.components())
+                    pipeline_stats->set_memory_footprint(c.first, c.second);
+            }
         }
 
         if (impl::check_token(tokens, "TLM")) {
@@ -290,7 +603,11 @@ class OusterCloud : public nodelet::Nodelet {
 
    private:
     std::shared_ptr<PacketFormat> packet_format;
+    LidarPacket lidar_packet;
+    ImuPacket imu_packet;
 
+    // needs to outlive the publishers whose callbacks refer to it
+    SubscriberDemand demand;
     ros::Subscriber metadata_sub;
     ros::Subscriber imu_packet_sub;
     ros::Publisher imu_pub;
@@ -301,13 +618,30 @@ class OusterCloud : public nodelet::Nodelet {
     OusterTransformsBroadcaster tf_bcast;
 
     ImuPacketHandler::HandlerType imu_packet_handler;
+    // published to by the processing thread of the lidar packet handler
+    ros::Publisher quality_pub;
+    // needs to outlive the plugins held by the lidar packet handler
+    std::unique_ptr<LidarScanPluginProcessor::Loader> scan_plugin_loader;
+    // needs to outlive the processors that hand messages over to it
+    std::unique_ptr<AsyncPublisher> async_publisher;
     LidarPacketHandler::HandlerType lidar_packet_handler;
+    // holds on to the publishing functions of the processors it rebuilds
+    ProcessingReconfigure<LidarScanProcessor> processing_reconfigure;
+    ros::ServiceServer reconfigure_processing_srv;
 
     ros::Timer timer_;
     ros::Time last_msg_ts;
 
     ros::Publisher telemetry_pub;
     TelemetryHandler::HandlerType telemetry_handler;
+
+    bool diagnostics_enabled = false;
+    std::shared_ptr<PipelineStats> pipeline_stats;
+    std::unique_ptr<DiagnosticsPublisher> diagnostics;
+
+    // stopped ahead of the handlers their callbacks run
+    std::unique_ptr<PacketFanoutSubscriber> imu_packet_fanout;
+    std::unique_ptr<PacketFanoutSubscriber> lidar_packet_fanout;
 };
 
 }  // namespace ouster_ros
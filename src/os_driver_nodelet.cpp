@@ -12,20 +12,32 @@
 // clang-format off
 #include "ouster_ros/os_ros.h"
 // clang-format on
+#include "ouster_ros/shm_transport.h"
 
 #include <pluginlib/class_list_macros.h>
 #include <sensor_msgs/Imu.h>
 #include <sensor_msgs/PointCloud2.h>
+#include <std_msgs/UInt8.h>
+#include <std_srvs/Trigger.h>
 
+#include "diagnostics.h"
 #include "os_sensor_nodelet.h"
 #include "os_transforms_broadcaster.h"
 #include "imu_packet_handler.h"
 #include "lidar_packet_handler.h"
+#include "packet_decode_stage.h"
 #include "point_cloud_processor.h"
 #include "laser_scan_processor.h"
 #include "image_processor.h"
 #include "point_cloud_processor_factory.h"
+#include "lidar_scan_plugin_processor.h"
+#include "async_publisher.h"
+#include "adaptive_quality.h"
+#include "processing_params.h"
+#include "processor_schedule.h"
+#include "subscriber_demand.h"
 #include "telemetry_handler.h"
+#include "worker_pool.h"
 
 using ouster::sdk::core::ImuPacket;
 using ouster::sdk::core::LidarPacket;
@@ -45,12 +57,22 @@ class OusterDriver : public OusterSensor {
         auto proc_mask =
             pnh.param("proc_mask", std::string{"IMU|PCL|SCAN|IMG|RAW"});
         auto tokens = impl::parse_tokens(proc_mask, '|');
+        // outputs without subscribers are skipped by the processors
+        demand.set_enabled(pnh.param("lazy_processing", true));
+        shm_transport = pnh.param("shm_transport", false);
+        shm_segments = pnh.param("shm_segments", 3);
+        if (shm_transport && shm_segments < 1) {
+            NODELET_FATAL("shm_segments needs to be at least 1");
+            throw std::runtime_error("invalid shm_segments value!");
+        }
         if (impl::check_token(tokens, "IMU")) create_imu_pub();
         if (impl::check_token(tokens, "PCL")) create_point_cloud_pubs();
         if (impl::check_token(tokens, "SCAN")) create_laser_scan_pubs();
         if (impl::check_token(tokens, "IMG")) create_image_pubs();
         if (impl::check_token(tokens, "TLM")) create_telemetry_pub();
+        diagnostics_enabled = impl::check_token(tokens, "DIAG");
         publish_raw = impl::check_token(tokens, "RAW");
+        create_reconfigure_processing_service();
         OusterSensor::onInit();
     }
 
@@ -62,7 +84,142 @@ class OusterDriver : public OusterSensor {
         if (tf_bcast.publish_static_tf()) {
             tf_bcast.broadcast_transforms(info);
         }
+        // start with fresh counters whenever the handlers are recreated
+        if (diagnostics_enabled) create_diagnostics();
         create_handlers();
+        if (diagnostics) {
+            std::ostringstream hardware_id;
+            hardware_id << info.prod_line << " " << info.sn;
+            diagnostics->start(getNodeHandle(), hardware_id.str());
+        }
+    }
+
+    void create_diagnostics() {
+        pipeline_stats = std::make_shared<PipelineStats>();
+        diagnostics =
+            std::make_unique<DiagnosticsPublisher>(getName(), pipeline_stats);
+    }
+
+    // returns the ids of the given topics within pipeline_stats
+    std::vector<size_t> track_topics(const std::vector<ros::Publisher>& pubs) {
+        std::vector<size_t> ids(pubs.size(), SIZE_MAX);
+        if (!pipeline_stats) return ids;
+        for (size_t i = 0; i < pubs.size(); ++i)
+            ids[i] = pipeline_stats->register_topic(pubs[i].getTopic());
+        return ids;
+    }
+
+    void track_processor(const std::string& name) {
+        if (pipeline_stats) pipeline_stats->register_processor(name);
+    }
+
+    // rebuilds the processors whose params changed on the parameter server
+    void create_reconfigure_processing_service() {
+        reconfigure_processing_srv =
+            getNodeHandle()
+                .advertiseService<std_srvs::Trigger::Request,
+                                  std_srvs::Trigger::Response>(
+                    "reconfigure_processing",
+                    [this](std_srvs::Trigger::Request&,
+                           std_srvs::Trigger::Response& response) {
+                        auto params =
+                            ProcessingParams::read(getPrivateNodeHandle());
+                        try {
+                            auto rebuilt = processing_reconfigure.apply(params);
+                            response.success = true;
+                            response.message =
+                                rebuilt == 0
+                                    ? "no processing param changed"
+                                    : "rebuilt " + std::to_string(rebuilt) +
+                                          " processors, applied from the "
+                                          "next scan";
+                            NODELET_INFO_STREAM("reconfigure_processing: "
+                                                << response.message);
+                        } catch (const std::exception& e) {
+                            response.success = false;
+                            response.message = e.what();
+                            NODELET_ERROR_STREAM(
+                                "reconfigure_processing rejected: "
+                                << e.what());
+                        }
+                        return true;
+                    });
+
+        NODELET_INFO("reconfigure_processing service created");
+    }
+
+    void warn_point_type_compatibility(const std::string& point_type) {
+        if (PointCloudProcessorFactory::point_type_requires_intensity(
+                point_type) &&
+            !PointCloudProcessorFactory::profile_has_intensity(
+                info.format.udp_profile_lidar)) {
+            NODELET_WARN_STREAM(
+                "selected point type '" << point_type
+                << "' is not compatible with the udp profile: "
+                << to_string(info.format.udp_profile_lidar));
+        }
+    }
+
+    // one predicate per return of the sensor for the topics named after base
+    std::vector<std::function<bool()>> returns_wanted(
+        const std::string& base, const ouster::sdk::core::SensorInfo& info) {
+        std::vector<std::function<bool()>> wanted;
+        for (size_t i = 0; i < info.num_returns(); ++i)
+            wanted.push_back(demand.wanted_fn(topic_for_return(base, i)));
+        return wanted;
+    }
+
+    // returns the scheduling policy of each output token of proc_mask
+    std::map<std::string, ProcessorPolicy> parse_processor_policies() {
+        auto& pnh = getPrivateNodeHandle();
+        auto priorities = ProcessorSchedule::parse_priorities(
+            pnh.param("processor_priority", std::string{"PCL|SCAN|IMG"}));
+        std::map<std::string, std::chrono::nanoseconds> deadlines;
+        try {
+            deadlines = ProcessorSchedule::parse_deadlines(
+                pnh.param("processor_deadlines", std::string{}));
+        } catch (const std::runtime_error& e) {
+            NODELET_FATAL_STREAM(
+                e.what() << ", processor_deadlines expects a '|' separated "
+                            "list of OUTPUT:MILLISECONDS entries");
+            throw;
+        }
+        std::map<std::string, int> decimations;
+        try {
+            decimations = ProcessorSchedule::parse_every_n_scans(
+                pnh.param("processor_every_n_scans", std::string{}));
+        } catch (const std::runtime_error& e) {
+            NODELET_FATAL_STREAM(
+                e.what() << ", processor_every_n_scans expects a '|' separated "
+                            "list of OUTPUT:N entries with N >= 1");
+            throw;
+        }
+        std::map<std::string, ProcessorPolicy> policies;
+        for (const auto& p : priorities) policies[p.first].priority = p.second;
+        for (const auto& d : deadlines) policies[d.first].deadline = d.second;
+        for (const auto& d : decimations)
+            policies[d.first].every_n_scans = d.second;
+        // plugins consume the products of the other processors of the scan
+        policies["PLUGINS"].priority = std::numeric_limits<int>::min();
+        return policies;
+    }
+
+    // returns null unless the adaptive quality is enabled
+    std::shared_ptr<AdaptiveQuality> create_adaptive_quality(
+        const ouster::sdk::core::SensorInfo& info) {
+        if (!getPrivateNodeHandle().param("adaptive_quality", false))
+            return nullptr;
+        quality_pub = getNodeHandle().advertise<std_msgs::UInt8>(
+            "quality_level", 1, true);
+        auto publish_level = [this, stats = pipeline_stats](int level) {
+            std_msgs::UInt8 msg;
+            msg.data = static_cast<uint8_t>(level);
+            quality_pub.publish(msg);
+            if (stats) stats->quality_level = level;
+        };
+        publish_level(AdaptiveQuality::FULL_QUALITY);
+        return std::make_shared<AdaptiveQuality>(
+            AdaptiveQuality::frame_period_of(info), publish_level);
     }
 
     void create_imu_pub() {
@@ -78,8 +235,49 @@ class OusterDriver : public OusterSensor {
         // NOTE: always create the 2nd topic
         lidar_pubs.resize(2);
         for (int i = 0; i < 2; ++i) {
-            lidar_pubs[i] = getNodeHandle().advertise<sensor_msgs::PointCloud2>(
-                topic_for_return("points", i), 10);
+            lidar_pubs[i] = demand.advertise<sensor_msgs::PointCloud2>(
+                getNodeHandle(), topic_for_return("points", i), 10,
+                topic_for_return("points", i));
+        }
+        if (shm_transport) {
+            lidar_shm_pubs.resize(2);
+            lidar_shm_writers.resize(2);
+            for (int i = 0; i < 2; ++i) {
+                create_shm_pub<ShmPointCloud2>(
+                    topic_for_return("points", i), lidar_shm_pubs[i],
+                    lidar_shm_writers[i], topic_for_return("points", i));
+            }
+        }
+    }
+
+    // advertises <topic>_shm along with the segments backing it, subscribers
+    // of the shm topic count towards the demand for output key
+    template <typename ShmMsgT>
+    void create_shm_pub(const std::string& topic, ros::Publisher& pub,
+                        std::unique_ptr<ShmWriter>& writer,
+                        const std::string& key) {
+        auto& nh = getNodeHandle();
+        pub = demand.advertise<ShmMsgT>(nh, topic + "_shm", 10, key);
+        writer = std::make_unique<ShmWriter>(nh.resolveName(topic),
+                                             shm_segments);
+    }
+
+    template <typename MsgT>
+    void publish_shm(ros::Publisher& pub, ShmWriter& writer, const MsgT& msg) {
+        // skip the copy into shared memory while nobody is listening
+        if (pub.getNumSubscribers() == 0) return;
+        const auto failed = writer.failed();
+        auto shm_msg = to_shm_msg(writer, msg);
+        if (shm_msg) {
+            pub.publish(*shm_msg);
+        } else if (writer.failed() != failed) {
+            // the regular topic is still published, consumers can fall back
+            NODELET_ERROR_STREAM_THROTTLE(
+                1, writer.error() << ", SKIPPING " << pub.getTopic());
+        } else {
+            NODELET_WARN_STREAM_THROTTLE(
+                1, "all shm segments of " << pub.getTopic()
+                                          << " are held by readers, SKIPPING");
         }
     }
 
@@ -87,8 +285,9 @@ class OusterDriver : public OusterSensor {
         // NOTE: always create the 2nd topic
         scan_pubs.resize(2);
         for (int i = 0; i < 2; ++i) {
-            scan_pubs[i] = getNodeHandle().advertise<sensor_msgs::LaserScan>(
-                topic_for_return("scan", i), 10);
+            scan_pubs[i] = demand.advertise<sensor_msgs::LaserScan>(
+                getNodeHandle(), topic_for_return("scan", i), 10,
+                topic_for_return("scan", i));
         }
     }
 
@@ -104,8 +303,12 @@ class OusterDriver : public OusterSensor {
             {ChanField::REFLECTIVITY2, "reflec_image2"}};
 
         for (auto it : channel_field_topic_map) {
-            image_pubs[it.first] =
-                getNodeHandle().advertise<sensor_msgs::Image>(it.second, 100);
+            image_pubs[it.first] = demand.advertise<sensor_msgs::Image>(
+                getNodeHandle(), it.second, 100, it.first);
+            if (shm_transport) {
+                create_shm_pub<ShmImage>(it.second, image_shm_pubs[it.first],
+                                         image_shm_writers[it.first], it.first);
+            }
         }
     }
 
@@ -130,56 +333,121 @@ class OusterDriver : public OusterSensor {
             throw std::runtime_error("min_scan_valid_columns_ratio out of bounds!");
         }
 
-        auto mask_path = pnh.param("mask_path", std::string{});
+        // the processors of the previous pipeline can't be reconfigured anymore
+        processing_reconfigure.clear();
+        auto params = ProcessingParams::read(pnh);
+
+        memory::BufferPinning pinning;
+        pinning.hugepages = pnh.param("hugepages", false);
+        pinning.mlock = pnh.param("mlock_buffers", false);
+
+        auto memory_budget = pnh.param("memory_budget", 0);
+        if (memory_budget < 0) {
+            NODELET_FATAL("memory_budget needs to be a positive number of MB");
+            throw std::runtime_error("negative memory_budget!");
+        }
+        memory::MemoryBudget budget(static_cast<size_t>(memory_budget) * 1000000);
+
+        auto inline_processing = parse_scan_processing();
+
+        // the previous handler holds on to the topics of the async publisher,
+        // the decode thread feeding it stops first
+        packet_decode_stage.reset();
+        lidar_packet_handler = nullptr;
+        async_publisher.reset();
+        if (pnh.param("async_publish", false))
+            async_publisher = std::make_unique<AsyncPublisher>(pipeline_stats);
+        budget.set_async_publish(async_publisher != nullptr);
+
+        auto scan_plugins = LidarScanPluginProcessor::parse_names(
+            pnh.param("scan_plugins", std::string{}));
+        // exposes the intermediate buffers of the processors to the plugins
+        auto products = std::make_shared<LidarScanProducts>();
+        // lets the point cloud processor convert the columns of each packet
+        std::shared_ptr<ScanColumnsObservers> column_observers;
+        if (pnh.param("incremental_xyz", false))
+            column_observers = std::make_shared<ScanColumnsObservers>(
+                LidarPacketHandler::ring_capacity(inline_processing.enabled));
+
+        auto quality = create_adaptive_quality(info);
+        auto low_priority_outputs = impl::parse_tokens(
+            pnh.param("low_priority_outputs", std::string{"IMG"}), '|');
+
+        auto output_policies = parse_processor_policies();
 
         std::vector<LidarScanProcessor> processors;
+        // one entry per processor
+        std::vector<ProcessorPolicy> policies;
+        // flags the processor about to be added when its output may be
+        // dropped by the adaptive quality
+        auto mark_low_priority = [&](const std::string& output) {
+            if (quality && impl::check_token(low_priority_outputs, output))
+                quality->set_low_priority(processors.size());
+        };
+        // union of the lidar scan fields consumed by the active processors
+        std::vector<std::string> required_fields;
+        auto require = [&required_fields](std::vector<std::string> fields) {
+            required_fields.insert(required_fields.end(), fields.begin(),
+                                   fields.end());
+        };
         if (impl::check_token(tokens, "PCL")) {
-            auto point_type = pnh.param("point_type", std::string{"original"});
-            auto organized = pnh.param("organized", true);
-            auto destagger = pnh.param("destagger", true);
-            auto min_range_m = pnh.param("min_range", 0.0);
-            auto max_range_m = pnh.param("max_range", 10000.0);
-            if (min_range_m < 0.0 || max_range_m < 0.0) {
-                NODELET_FATAL("min_range and max_range need to be positive");
-                throw std::runtime_error("negative range limits!");
-            }
-            if (min_range_m >= max_range_m) {
-                const auto error_msg =
-                    "min_range can't be equal or exceed max_range";
-                NODELET_FATAL(error_msg);
-                throw std::runtime_error(error_msg);
-            }
-            // convert to millimeters
-            uint32_t min_range = impl::ulround(min_range_m * 1000);
-            uint32_t max_range = impl::ulround(max_range_m * 1000);
-            auto v_reduction = pnh.param("v_reduction", 1);
-            auto valid_values = std::vector<int>{1, 2, 4, 8, 16};
-            if (std::find(valid_values.begin(), valid_values.end(),
-                          v_reduction) == valid_values.end()) {
-                NODELET_FATAL("v_reduction needs to be one of the values: {1, 2, 4, 8, 16}");
-                throw std::runtime_error("invalid v_reduction value!");
+            try {
+                params.validate_point_cloud();
+            } catch (const std::runtime_error& e) {
+                NODELET_FATAL_STREAM(e.what());
+                throw;
             }
 
-            processors.push_back(
-                PointCloudProcessorFactory::create_point_cloud_processor(
-                    point_type, info, tf_bcast.point_cloud_frame_id(),
-                    tf_bcast.apply_lidar_to_sensor_transform(), organized,
-                    destagger, min_range, max_range, v_reduction, mask_path,
-                    [this](PointCloudProcessor_OutputType msgs) {
-                        for (size_t i = 0; i < msgs.size(); ++i)
-                            lidar_pubs[i].publish(*msgs[i]);
-                    }));
-
-            // warn about profile incompatibility
-            if (PointCloudProcessorFactory::point_type_requires_intensity(
-                    point_type) &&
-                !PointCloudProcessorFactory::profile_has_intensity(
-                    info.format.udp_profile_lidar)) {
-                NODELET_WARN_STREAM(
-                    "selected point type '" << point_type
-                    << "' is not compatible with the udp profile: "
-                    << to_string(info.format.udp_profile_lidar));
-            }
+            track_processor("point_cloud");
+            mark_low_priority("PCL");
+            policies.push_back(output_policies["PCL"]);
+            auto topic_ids = track_topics(lidar_pubs);
+            std::function<void(size_t, const sensor_msgs::PointCloud2&)>
+                publish_cloud = [this, stats = pipeline_stats, topic_ids](
+                                    size_t i, const sensor_msgs::PointCloud2& msg) {
+                    lidar_pubs[i].publish(msg);
+                    if (stats) stats->add_published_msg(topic_ids[i], msg);
+                    if (shm_transport)
+                        publish_shm(lidar_shm_pubs[i], *lidar_shm_writers[i],
+                                    msg);
+                };
+            AsyncTopics<sensor_msgs::PointCloud2> async_topics;
+            if (async_publisher)
+                async_topics = async_publisher->add_topics(lidar_pubs.size(),
+                                                           publish_cloud);
+            auto publish_clouds =
+                [publish_cloud,
+                 async_topics](const PointCloudProcessor_OutputType& msgs) {
+                    for (size_t i = 0; i < msgs.size(); ++i) {
+                        if (!msgs[i]) continue;
+                        if (async_topics.empty())
+                            publish_cloud(i, *msgs[i]);
+                        else
+                            async_topics[i]->publish(*msgs[i]);
+                    }
+                };
+            // also rebuilds the processor when the params are reconfigured
+            auto build = [this, publish_clouds, pinning, products, quality,
+                          wanted = returns_wanted("points", info),
+                          column_observers, index = processors.size()](
+                             const ProcessingParams& p,
+                             memory::MemoryBudget& budget,
+                             std::function<void()>* on_swap) {
+                warn_point_type_compatibility(p.point_type);
+                return PointCloudProcessorFactory::create_point_cloud_processor(
+                    p.point_type, info, tf_bcast.point_cloud_frame_id(),
+                    tf_bcast.apply_lidar_to_sensor_transform(), p.organized,
+                    p.destagger, p.min_range(), p.max_range(), p.v_reduction,
+                    p.mask_path, publish_clouds, pinning, &budget, products,
+                    quality, wanted, column_observers, index, on_swap);
+            };
+            auto fields = [this](const ProcessingParams& p) {
+                return PointCloudProcessorFactory::required_fields(p.point_type,
+                                                                   info);
+            };
+            processing_reconfigure.add(processors.size(), true, build, fields);
+            processors.push_back(build(params, budget, nullptr));
+            require(fields(params));
         }
 
         if (impl::check_token(tokens, "SCAN")) {
@@ -195,32 +463,142 @@ class OusterDriver : public OusterSensor {
                     << " ring value clamped to: " << scan_ring);
             }
 
+            track_processor("laser_scan");
+            mark_low_priority("SCAN");
+            policies.push_back(output_policies["SCAN"]);
+            auto topic_ids = track_topics(scan_pubs);
+            std::function<void(size_t, const sensor_msgs::LaserScan&)>
+                publish_scan = [this, stats = pipeline_stats, topic_ids](
+                                   size_t i, const sensor_msgs::LaserScan& msg) {
+                    scan_pubs[i].publish(msg);
+                    if (stats) stats->add_published_msg(topic_ids[i], msg);
+                };
+            AsyncTopics<sensor_msgs::LaserScan> async_topics;
+            if (async_publisher)
+                async_topics =
+                    async_publisher->add_topics(scan_pubs.size(), publish_scan);
             processors.push_back(LaserScanProcessor::create(
                 info, tf_bcast.lidar_frame_id(), scan_ring,
-                [this](LaserScanProcessor::OutputType msgs) {
+                [publish_scan,
+                 async_topics](const LaserScanProcessor::OutputType& msgs) {
                     for (size_t i = 0; i < msgs.size(); ++i) {
-                        scan_pubs[i].publish(*msgs[i]);
+                        if (!msgs[i]) continue;
+                        if (async_topics.empty())
+                            publish_scan(i, *msgs[i]);
+                        else
+                            async_topics[i]->publish(*msgs[i]);
                     }
-                }));
+                },
+                returns_wanted("scan", info)));
+            require(LaserScanProcessor::required_fields(info));
         }
 
         if (impl::check_token(tokens, "IMG")) {
-            processors.push_back(ImageProcessor::create(
-                info, tf_bcast.point_cloud_frame_id(), mask_path,
-                [this](ImageProcessor::OutputType msgs) {
+            track_processor("image");
+            mark_low_priority("IMG");
+            policies.push_back(output_policies["IMG"]);
+            std::map<std::string, size_t> topic_ids;
+            for (const auto& it : image_pubs)
+                topic_ids[it.first] = track_topics({it.second})[0];
+            auto publish_image = [this, stats = pipeline_stats, topic_ids](
+                                     const std::string& field,
+                                     const sensor_msgs::Image& msg) {
+                image_pubs[field].publish(msg);
+                auto id = topic_ids.find(field);
+                if (stats && id != topic_ids.end())
+                    stats->add_published_msg(id->second, msg);
+                if (shm_transport)
+                    publish_shm(image_shm_pubs[field],
+                                *image_shm_writers[field], msg);
+            };
+            std::map<std::string,
+                     std::shared_ptr<AsyncPublisher::Topic<sensor_msgs::Image>>>
+                async_topics;
+            if (async_publisher) {
+                // the images share their layout
+                std::vector<std::string> fields;
+                for (const auto& it : image_pubs) fields.push_back(it.first);
+                auto topics = async_publisher->add_topics<sensor_msgs::Image>(
+                    fields.size(),
+                    [publish_image, fields](size_t i,
+                                            const sensor_msgs::Image& msg) {
+                        publish_image(fields[i], msg);
+                    });
+                for (size_t i = 0; i < fields.size(); ++i)
+                    async_topics[fields[i]] = topics[i];
+            }
+            ImageProcessor::FieldsWanted fields_wanted;
+            for (const auto& it : image_pubs)
+                fields_wanted[it.first] = demand.wanted_fn(it.first);
+            auto publish_images =
+                [publish_image,
+                 async_topics](const ImageProcessor::OutputType& msgs) {
                     for (auto it = msgs.begin(); it != msgs.end(); ++it) {
-                        image_pubs[it->first].publish(*it->second);
+                        if (!it->second) continue;
+                        auto topic = async_topics.find(it->first);
+                        if (topic == async_topics.end())
+                            publish_image(it->first, *it->second);
+                        else
+                            topic->second->publish(*it->second);
                     }
-                }));
+                };
+            // also rebuilds the processor when the mask_path is reconfigured
+            auto build = [this, publish_images, fields_wanted](
+                             const ProcessingParams& p,
+                             memory::MemoryBudget& budget,
+                             std::function<void()>*) {
+                return ImageProcessor::create(
+                    info, tf_bcast.point_cloud_frame_id(), p.mask_path,
+                    publish_images, &budget, fields_wanted);
+            };
+            auto fields = [this](const ProcessingParams&) {
+                return ImageProcessor::required_fields(info);
+            };
+            processing_reconfigure.add(processors.size(), false, build,
+                                       fields);
+            processors.push_back(build(params, budget, nullptr));
+            require(fields(params));
+        }
+
+        if (!scan_plugins.empty()) {
+            scan_plugin_loader =
+                std::make_unique<LidarScanPluginProcessor::Loader>(
+                    "ouster_ros", "ouster_ros::LidarScanPlugin");
+            auto plugins = LidarScanPluginProcessor::load(
+                *scan_plugin_loader, scan_plugins, getNodeHandle(), pnh, info);
+            for (const auto& plugin : plugins)
+                require(plugin.second->required_fields(info));
+            track_processor("scan_plugins");
+            mark_low_priority("PLUGINS");
+            policies.push_back(output_policies["PLUGINS"]);
+            // plugins run last so they observe the products of this scan
+            processors.push_back(
+                LidarScanPluginProcessor::create(plugins, products));
         }
 
         if (impl::check_token(tokens, "PCL") ||
             impl::check_token(tokens, "SCAN") ||
-            impl::check_token(tokens, "IMG")) {
+            impl::check_token(tokens, "IMG") || !scan_plugins.empty()) {
+            auto swap = std::make_shared<LidarScanProcessorSwap>();
             lidar_packet_handler = LidarPacketHandler::create(
                 info, processors, timestamp_mode,
                 static_cast<int64_t>(ptp_utc_tai_offset * 1e+9),
-                min_scan_valid_columns_ratio);
+                min_scan_valid_columns_ratio, pipeline_stats, pinning,
+                required_fields, &budget, inline_processing, quality,
+                policies, swap, shared_worker_pool(), column_observers,
+                pnh.param("early_frame_completion", false),
+                pnh.param("verify_crc", false));
+            processing_reconfigure.attach(params, required_fields, swap,
+                                          budget.limit());
+
+            NODELET_INFO_STREAM(budget.report());
+            if (pipeline_stats) {
+                for (const auto& c : budget.components())
+                    pipeline_stats->set_memory_footprint(c.first, c.second);
+            }
+
+            if (pnh.param("decode_thread", false))
+                packet_decode_stage = create_packet_decode_stage();
         }
 
         if (impl::check_token(tokens, "TLM")) {
@@ -230,13 +608,92 @@ class OusterDriver : public OusterSensor {
         }
     }
 
+    // returns null unless the scans are processed on the shared worker pool
+    std::shared_ptr<threading::WorkerPool> shared_worker_pool() {
+        auto& pnh = getPrivateNodeHandle();
+        if (pnh.param("scan_processing", std::string{"THREADED"}) != "POOLED")
+            return nullptr;
+        auto threads = pnh.param("worker_pool_threads", 0);
+        if (threads < 0) {
+            NODELET_FATAL("worker_pool_threads can't be negative");
+            throw std::runtime_error("negative worker_pool_threads!");
+        }
+        auto pool = threading::WorkerPool::shared(threads);
+        if (threads > 0 && pool->size() != static_cast<size_t>(threads)) {
+            NODELET_WARN_STREAM("the worker pool of the process already runs "
+                                << pool->size()
+                                << " threads, worker_pool_threads ignored");
+        }
+        return pool;
+    }
+
+    // moves the batching of the lidar packets off the receive thread
+    std::unique_ptr<PacketDecodeStage> create_packet_decode_stage() {
+        auto& pnh = getPrivateNodeHandle();
+        auto packet_queue_size = pnh.param("packet_queue_size", 0);
+        if (packet_queue_size < 0) {
+            NODELET_FATAL("packet_queue_size can't be negative");
+            throw std::runtime_error("negative packet_queue_size!");
+        }
+        // two frames worth of packets unless set
+        const size_t capacity =
+            packet_queue_size > 0
+                ? static_cast<size_t>(packet_queue_size)
+                : 2 * info.format.columns_per_frame /
+                      info.format.columns_per_packet;
+        NODELET_INFO_STREAM("batching lidar packets on the decode thread, "
+                            "packet queue of " << capacity << " packets");
+        return std::make_unique<PacketDecodeStage>(
+            lidar_packet_handler, capacity,
+            ouster::sdk::core::get_format(info).lidar_packet_size, getName(),
+            pipeline_stats);
+    }
+
+    threading::InlineProcessing parse_scan_processing() {
+        auto& pnh = getPrivateNodeHandle();
+        auto scan_processing =
+            pnh.param("scan_processing", std::string{"THREADED"});
+        threading::InlineProcessing inline_processing;
+        if (scan_processing == "THREADED" || scan_processing == "POOLED")
+            return inline_processing;
+        if (scan_processing != "INLINE") {
+            NODELET_FATAL_STREAM("scan_processing needs to be one of the "
+                                 "values: {THREADED, INLINE, POOLED}");
+            throw std::runtime_error("invalid scan_processing value!");
+        }
+
+        inline_processing.enabled = true;
+        const auto frame_bytes = threading::frame_receive_bytes(info);
+        const auto lidar_port =
+            info.config.udp_port_lidar ? info.config.udp_port_lidar.value() : 0;
+        const auto receive_buffer =
+            threading::grow_udp_receive_buffer(lidar_port, frame_bytes);
+        if (receive_buffer == 0) {
+            NODELET_WARN_STREAM("couldn't find the socket bound to udp port "
+                                << lidar_port
+                                << ", inline processing runs without deadline");
+            return inline_processing;
+        }
+        if (receive_buffer < frame_bytes) {
+            NODELET_WARN_STREAM(
+                "lidar socket receive buffer of " << receive_buffer
+                << " bytes can't hold a frame of packets (" << frame_bytes
+                << " bytes), raise net.core.rmem_max to avoid packet loss");
+        }
+        inline_processing.deadline =
+            threading::receive_buffer_deadline(receive_buffer, info);
+        return inline_processing;
+    }
+
     virtual void on_lidar_packet_msg(const LidarPacket& lidar_packet) override {
         if (telemetry_handler) {
             auto telemetry = telemetry_handler(lidar_packet);
             telemetry_pub.publish(telemetry);
         }
 
-        if (lidar_packet_handler) {
+        if (packet_decode_stage) {
+            packet_decode_stage->push(lidar_packet);
+        } else if (lidar_packet_handler) {
             lidar_packet_handler(lidar_packet);
         }
 
@@ -244,8 +701,9 @@ class OusterDriver : public OusterSensor {
     }
 
     virtual void on_imu_packet_msg(const ImuPacket& imu_packet) override {
+        if (pipeline_stats) ++pipeline_stats->imu_packets;
         if (imu_packet_handler) {
-            auto imu_msgs = imu_packet_handler(imu_packet);
+            const auto& imu_msgs = imu_packet_handler(imu_packet);
             for (const auto& imu_msg : imu_msgs) {
                 imu_pub.publish(imu_msg);
             }
@@ -255,18 +713,42 @@ class OusterDriver : public OusterSensor {
     }
 
    private:
+    // needs to outlive the publishers whose callbacks refer to it
+    SubscriberDemand demand;
     ros::Publisher imu_pub;
     std::vector<ros::Publisher> lidar_pubs;
     std::vector<ros::Publisher> scan_pubs;
     std::map<std::string, ros::Publisher> image_pubs;
 
+    bool shm_transport = false;
+    int shm_segments = 3;
+    std::vector<ros::Publisher> lidar_shm_pubs;
+    std::vector<std::unique_ptr<ShmWriter>> lidar_shm_writers;
+    std::map<std::string, ros::Publisher> image_shm_pubs;
+    std::map<std::string, std::unique_ptr<ShmWriter>> image_shm_writers;
+
     OusterTransformsBroadcaster tf_bcast;
 
     ImuPacketHandler::HandlerType imu_packet_handler;
+    // published to by the processing thread of the lidar packet handler
+    ros::Publisher quality_pub;
+    // needs to outlive the plugins held by the lidar packet handler
+    std::unique_ptr<LidarScanPluginProcessor::Loader> scan_plugin_loader;
+    // needs to outlive the processors that hand messages over to it
+    std::unique_ptr<AsyncPublisher> async_publisher;
     LidarPacketHandler::HandlerType lidar_packet_handler;
+    // batches the lidar packets on its own thread when decode_thread is set
+    std::unique_ptr<PacketDecodeStage> packet_decode_stage;
+    // holds on to the publishing functions of the processors it rebuilds
+    ProcessingReconfigure<LidarScanProcessor> processing_reconfigure;
+    ros::ServiceServer reconfigure_processing_srv;
 
     bool publish_raw = false;
 
+    bool diagnostics_enabled = false;
+    std::shared_ptr<PipelineStats> pipeline_stats;
+    std::unique_ptr<DiagnosticsPublisher> diagnostics;
+
     ros::Publisher telemetry_pub;
     TelemetryHandler::HandlerType telemetry_handler;
 };
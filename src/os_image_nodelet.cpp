@@ -23,6 +23,9 @@
 
 #include "lidar_packet_handler.h"
 #include "image_processor.h"
+#include "packet_subscriber.h"
+#include "subscriber_demand.h"
+#include "worker_pool.h"
 
 namespace ouster_ros {
 
@@ -36,6 +39,8 @@ class OusterImage : public nodelet::Nodelet {
         auto& pnh = getPrivateNodeHandle();
         auto proc_mask = pnh.param("proc_mask", std::string{"IMG"});
         auto tokens = impl::parse_tokens(proc_mask, '|');
+        // images without subscribers are skipped by the processor
+        demand.set_enabled(pnh.param("lazy_processing", true));
         if (impl::check_token(tokens, "IMG")) {
             create_lidar_packets_subscriber();
             create_image_publishers();
@@ -50,18 +55,27 @@ class OusterImage : public nodelet::Nodelet {
     }
 
     void create_lidar_packets_subscriber() {
-        lidar_packet_sub = getNodeHandle().subscribe<PacketMsg>(
-            "lidar_packets", 100, [this](const PacketMsg::ConstPtr msg) {
+        auto on_packet = [this](const std::vector<uint8_t>& buf,
+                                uint64_t receive_ts) {
                 if (lidar_packet_handler) {
                     // TODO[UN]: this is not ideal since we can't reuse the msg buffer
                     // Need to redefine the Packet object and allow use of array_views
-                    LidarPacket lidar_packet(msg->buf.size());
+                    lidar_packet.buf.resize(buf.size());
                     lidar_packet.format = packet_format;
-                    memcpy(lidar_packet.buf.data(), msg->buf.data(), msg->buf.size());
-                    lidar_packet.host_timestamp = static_cast<uint64_t>(ros::Time::now().toNSec());
+                    memcpy(lidar_packet.buf.data(), buf.data(), buf.size());
+                    lidar_packet.host_timestamp = receive_ts;
                     lidar_packet_handler(lidar_packet);
                 }
-        });
+        };
+        if (getPrivateNodeHandle().param("packet_fanout", false)) {
+            lidar_packet_fanout = std::make_unique<PacketFanoutSubscriber>(
+                getNodeHandle(), "lidar_packets", on_packet);
+            return;
+        }
+        auto stamped_packets =
+            getPrivateNodeHandle().param("stamped_packets", false);
+        lidar_packet_sub = subscribe_packets(
+            getNodeHandle(), "lidar_packets", 100, stamped_packets, on_packet);
     }
 
     void create_image_publishers() {
@@ -77,12 +91,15 @@ class OusterImage : public nodelet::Nodelet {
                 {ChanField::REFLECTIVITY2, "reflec_image2"}};
 
         for (auto it : channel_field_topic_map) {
-            image_pubs[it.first] = getNodeHandle().advertise<sensor_msgs::Image>(it.second, 100);
+            image_pubs[it.first] = demand.advertise<sensor_msgs::Image>(
+                getNodeHandle(), it.second, 100, it.first);
         }
     }
 
     void metadata_handler(const std_msgs::String::ConstPtr& metadata_msg) {
         NODELET_INFO("OusterImage: retrieved new sensor metadata!");
+        // no packets are handed over by the fanout while the handler changes
+        auto fanout_paused = pause_fanout(lidar_packet_fanout);
         auto info = ouster::sdk::core::SensorInfo(metadata_msg->data);
         packet_format = std::make_shared<PacketFormat>(
             ouster::sdk::core::get_format(info));
@@ -93,6 +110,31 @@ class OusterImage : public nodelet::Nodelet {
             create_handlers(info);
     }
 
+    // returns null unless the scans are processed on the shared worker pool
+    std::shared_ptr<threading::WorkerPool> shared_worker_pool() {
+        auto& pnh = getPrivateNodeHandle();
+        auto scan_processing =
+            pnh.param("scan_processing", std::string{"THREADED"});
+        if (scan_processing == "THREADED") return nullptr;
+        if (scan_processing != "POOLED") {
+            NODELET_FATAL_STREAM("scan_processing needs to be one of the "
+                                 "values: {THREADED, POOLED}");
+            throw std::runtime_error("invalid scan_processing value!");
+        }
+        auto threads = pnh.param("worker_pool_threads", 0);
+        if (threads < 0) {
+            NODELET_FATAL("worker_pool_threads can't be negative");
+            throw std::runtime_error("negative worker_pool_threads!");
+        }
+        auto pool = threading::WorkerPool::shared(threads);
+        if (threads > 0 && pool->size() != static_cast<size_t>(threads)) {
+            NODELET_WARN_STREAM("the worker pool of the process already runs "
+                                << pool->size()
+                                << " threads, worker_pool_threads ignored");
+        }
+        return pool;
+    }
+
     void create_handlers(const ouster::sdk::core::SensorInfo& info) {
         // TODO: avoid having to replicate the parameters: 
         // timestamp_mode, ptp_utc_tai_offset, use_system_default_qos in yet
@@ -109,31 +151,43 @@ class OusterImage : public nodelet::Nodelet {
 
         auto mask_path = pnh.param("mask_path", std::string{});
 
+        ImageProcessor::FieldsWanted fields_wanted;
+        for (const auto& it : image_pubs)
+            fields_wanted[it.first] = demand.wanted_fn(it.first);
+
         std::vector<LidarScanProcessor> processors {
             ImageProcessor::create(
                 info, "os_lidar", /*TODO: tf_bcast.point_cloud_frame_id()*/
                 mask_path,
-                [this](ImageProcessor::OutputType msgs) {
+                [this](const ImageProcessor::OutputType& msgs) {
                     for (auto it = msgs.begin(); it != msgs.end(); ++it) {
-                        image_pubs[it->first].publish(*it->second);
+                        if (it->second) image_pubs[it->first].publish(*it->second);
                     }
-                })
+                },
+                nullptr, fields_wanted)
         };
 
         lidar_packet_handler = LidarPacketHandler::create(
             info, processors, timestamp_mode,
             static_cast<int64_t>(ptp_utc_tai_offset * 1e+9),
-            min_scan_valid_columns_ratio);
+            min_scan_valid_columns_ratio, nullptr, {},
+            ImageProcessor::required_fields(info), nullptr, {}, nullptr, {},
+            nullptr, shared_worker_pool());
     }
 
    private:
     std::shared_ptr<PacketFormat> packet_format;
+    LidarPacket lidar_packet;
 
+    // needs to outlive the publishers whose callbacks refer to it
+    SubscriberDemand demand;
     ros::Subscriber metadata_sub;
     ros::Subscriber lidar_packet_sub;
     std::map<std::string, ros::Publisher> image_pubs;
 
     LidarPacketHandler::HandlerType lidar_packet_handler;
+    // stopped ahead of the handler its callback runs
+    std::unique_ptr<PacketFanoutSubscriber> lidar_packet_fanout;
 };
 
 }  // namespace ouster_ros
@@ -22,6 +22,7 @@
 
 #include "ouster_ros/os_sensor_nodelet_base.h"
 #include "ouster_ros/PacketMsg.h"
+#include "ouster_ros/StampedPacketMsg.h"
 #include <ouster/os_pcap.h>
 
 using namespace std::chrono;
@@ -92,12 +93,37 @@ class OusterPcap : public OusterSensorNodeletBase {
         auto& pf = ouster::sdk::core::get_format(info);
         lidar_packet.buf.resize(pf.lidar_packet_size);
         imu_packet.buf.resize(pf.imu_packet_size);
+        lidar_stamped_packet.buf.resize(pf.lidar_packet_size);
+        imu_stamped_packet.buf.resize(pf.imu_packet_size);
     }
 
     void create_publishers() {
         auto& nh = getNodeHandle();
-        lidar_packet_pub = nh.advertise<PacketMsg>("lidar_packets", 1280);
-        imu_packet_pub = nh.advertise<PacketMsg>("imu_packets", 100);
+        stamped_packets = getPrivateNodeHandle().param("stamped_packets", false);
+        if (stamped_packets) {
+            lidar_packet_pub =
+                nh.advertise<StampedPacketMsg>("lidar_packets", 1280);
+            imu_packet_pub = nh.advertise<StampedPacketMsg>("imu_packets", 100);
+        } else {
+            lidar_packet_pub = nh.advertise<PacketMsg>("lidar_packets", 1280);
+            imu_packet_pub = nh.advertise<PacketMsg>("imu_packets", 100);
+        }
+    }
+
+    // the packets are considered received at the time they are read from the
+    // pcap file, this keeps the stamps consistent with the replay clock
+    void publish_packet(ros::Publisher& pub, PacketMsg& msg,
+                        StampedPacketMsg& stamped_msg, const uint8_t* data,
+                        size_t size) {
+        if (stamped_packets) {
+            stamped_msg.receive_stamp = ros::Time::now();
+            ++stamped_msg.seq;
+            std::memcpy(stamped_msg.buf.data(), data, size);
+            pub.publish(stamped_msg);
+        } else {
+            std::memcpy(msg.buf.data(), data, size);
+            pub.publish(msg);
+        }
     }
 
     void open_pcap(const std::string& pcap_file) {
@@ -136,14 +162,12 @@ class OusterPcap : public OusterSensorNodeletBase {
         while (ros::ok() && packet_read_active && payload_size) {
             auto start = high_resolution_clock::now();
             if (packet_info.dst_port == info.config.udp_port_imu) {
-                std::memcpy(imu_packet.buf.data(), pcap.current_data(),
-                            pf.imu_packet_size);
-                imu_packet_pub.publish(imu_packet);
+                publish_packet(imu_packet_pub, imu_packet, imu_stamped_packet,
+                               pcap.current_data(), pf.imu_packet_size);
             } else if (packet_info.dst_port == info.config.udp_port_lidar) {
-                std::memcpy(lidar_packet.buf.data(),
-                            pcap.current_data(),
-                            pf.lidar_packet_size);
-                lidar_packet_pub.publish(lidar_packet);
+                publish_packet(lidar_packet_pub, lidar_packet,
+                               lidar_stamped_packet, pcap.current_data(),
+                               pf.lidar_packet_size);
             } else {
                 NODELET_WARN_STREAM_THROTTLE(1,
                     "unknown packet /w port: "
@@ -171,6 +195,9 @@ class OusterPcap : public OusterSensorNodeletBase {
     std::shared_ptr<PcapReader> pcap;
     PacketMsg lidar_packet;
     PacketMsg imu_packet;
+    bool stamped_packets = false;
+    StampedPacketMsg lidar_stamped_packet;
+    StampedPacketMsg imu_stamped_packet;
     ros::Publisher lidar_packet_pub;
     ros::Publisher imu_packet_pub;
     bool loop;
@@ -53,26 +53,16 @@ std::vector<sensor_msgs::Imu> packet_to_imu_msgs(
     const std::string& frame,
     const ros::Time& timestamp,
     const ouster::sdk::core::SensorInfo& sensor_info) {
+    std::vector<sensor_msgs::Imu> msgs;
+    packet_to_imu_msgs(msgs, imu_packet, frame, timestamp, sensor_info);
+    return msgs;
+}
 
-    Eigen::ArrayX<uint16_t> imu_status = imu_packet.status();
-
-    auto& pf = *imu_packet.format;
-    Eigen::ArrayX<uint64_t> imu_timestamps = imu_packet.timestamp();
-    if (pf.imu_measurements_per_packet == 0) {  // Handle the LEGACY IMU profile (it would be better if the imu_packet handles this internally).
-        imu_timestamps[0] = pf.imu_gyro_ts(imu_packet.buf.data());
-    } else if ((imu_status[0] & 0x1) == 0) {    // HANDLE the case when the first imu_timestamp is unknown.
-        int imu_measurements_per_frame = pf.imu_measurements_per_packet * pf.imu_packets_per_frame;
-        double frame_ts_ns = 1e9 / sensor_info.format.fps;
-        double imu_measurement_interval = frame_ts_ns / imu_measurements_per_frame;
-        for (int i = 0; i < imu_timestamps.size(); ++i) {
-            imu_timestamps[i] = static_cast<uint64_t>(i * imu_measurement_interval);
-        }
-    }
-
-    Eigen::ArrayX3f accel = imu_packet.accel();
-    Eigen::ArrayX3f gyro = imu_packet.gyro();
+namespace {
 
-    sensor_msgs::Imu m;
+void set_imu_msg(sensor_msgs::Imu& m, const std::string& frame,
+                 const ros::Time& stamp, double ax, double ay, double az,
+                 double gx, double gy, double gz) {
     m.orientation_covariance = {-1, -1, -1, -1, -1, -1, -1, -1, -1};
     m.linear_acceleration_covariance = {0.01, 0, 0, 0, 0.01, 0, 0, 0, 0.01};
     m.angular_velocity_covariance = {6e-4, 0, 0, 0, 6e-4, 0, 0, 0, 6e-4};
@@ -80,39 +70,87 @@ std::vector<sensor_msgs::Imu> packet_to_imu_msgs(
     m.orientation.y = 0;
     m.orientation.z = 0;
     m.orientation.w = 1;
+    m.header.frame_id = frame;
+    m.header.stamp = stamp;
+    m.linear_acceleration.x = ax;
+    m.linear_acceleration.y = ay;
+    m.linear_acceleration.z = az;
+    m.angular_velocity.x = gx;
+    m.angular_velocity.y = gy;
+    m.angular_velocity.z = gz;
+}
+
+}  // namespace
 
-    // only reserve space for valid measurements
+void packet_to_imu_msgs(
+    std::vector<sensor_msgs::Imu>& msgs,
+    const ouster::sdk::core::ImuPacket& imu_packet,
+    const std::string& frame,
+    const ros::Time& timestamp,
+    const ouster::sdk::core::SensorInfo& sensor_info) {
+    auto& pf = *imu_packet.format;
+    // the LEGACY IMU profile has a single measurement, stamped with the
+    // timestamp given. It is read straight off the packet since the ImuPacket
+    // accessors allocate the arrays they return; the packet holds g and deg/s
+    if (pf.imu_measurements_per_packet == 0) {
+        constexpr double standard_g = 9.80665;
+        constexpr double deg_to_rad = M_PI / 180.0;
+        const uint8_t* buf = imu_packet.buf.data();
+        msgs.resize(1);
+        set_imu_msg(msgs[0], frame, timestamp, pf.imu_la_x(buf) * standard_g,
+                    pf.imu_la_y(buf) * standard_g,
+                    pf.imu_la_z(buf) * standard_g,
+                    pf.imu_av_x(buf) * deg_to_rad,
+                    pf.imu_av_y(buf) * deg_to_rad,
+                    pf.imu_av_z(buf) * deg_to_rad);
+        return;
+    }
+
+    // the arrays are bound as returned by the ImuPacket accessors, neither
+    // copied into arrays of our own nor modified
+    const auto& imu_status = imu_packet.status();
+    const auto& imu_timestamps = imu_packet.timestamp();
+    const auto& accel = imu_packet.accel();
+    const auto& gyro = imu_packet.gyro();
+
+    // only keep space for valid measurements, elements of msgs are reused
+    // across calls so shrinking or growing the vector within its capacity
+    // doesn't allocate
     size_t valid_count = 0;
     for (int i = 0; i < imu_status.size(); ++i) {
         if ((imu_status[i] & 0x1) != 0) {
             ++valid_count;
         }
     }
-    if (valid_count == 0) {
-        return {};
+    msgs.resize(valid_count);
+    if (valid_count == 0) return;
+
+    // HANDLE the case when the first imu_timestamp is unknown: measurements
+    // are spread evenly over the frame instead
+    const bool timestamps_known = (imu_status[0] & 0x1) != 0;
+    double imu_measurement_interval = 0.0;
+    if (!timestamps_known) {
+        int imu_measurements_per_frame =
+            pf.imu_measurements_per_packet * pf.imu_packets_per_frame;
+        double frame_ts_ns = 1e9 / sensor_info.format.fps;
+        imu_measurement_interval = frame_ts_ns / imu_measurements_per_frame;
     }
-    std::vector<sensor_msgs::Imu> msgs;
-    msgs.reserve(valid_count);
 
+    size_t k = 0;
     for (int i = 0; i < imu_status.size(); ++i) {
         if ((imu_status[i] & 0x1) == 0) {
             continue;
         }
 
-        m.header.frame_id = frame;
-        auto ts_offset = imu_timestamps[i] - imu_timestamps[0];
-        m.header.stamp = timestamp + ros::Duration(ts_offset * 1e-9);
-        m.linear_acceleration.x = accel(i, 0);
-        m.linear_acceleration.y = accel(i, 1);
-        m.linear_acceleration.z = accel(i, 2);
-        m.angular_velocity.x = gyro(i, 0);
-        m.angular_velocity.y = gyro(i, 1);
-        m.angular_velocity.z = gyro(i, 2);
-
-        msgs.push_back(m);
+        const uint64_t ts_offset =
+            timestamps_known
+                ? imu_timestamps[i] - imu_timestamps[0]
+                : static_cast<uint64_t>(i * imu_measurement_interval);
+        set_imu_msg(msgs[k++], frame,
+                    timestamp + ros::Duration(ts_offset * 1e-9), accel(i, 0),
+                    accel(i, 1), accel(i, 2), gyro(i, 0), gyro(i, 1),
+                    gyro(i, 2));
     }
-
-    return msgs;
 }
 
 namespace impl {
@@ -192,13 +230,45 @@ geometry_msgs::TransformStamped transform_to_tf_msg(
     return msg;
 }
 
-// TODO: provide a method that accepts sensor_msgs::msg::LaserScan object
 sensor_msgs::LaserScan lidar_scan_to_laser_scan_msg(
     const LidarScan& ls, const ros::Time& timestamp,
     const std::string& frame, const LidarMode ld_mode,
     const uint16_t ring, const std::vector<int>& pixel_shift_by_row,
     const int return_index) {
     sensor_msgs::LaserScan msg;
+    lidar_scan_to_laser_scan_msg(msg, ls, timestamp, frame, ld_mode, ring,
+                                 pixel_shift_by_row, return_index);
+    return msg;
+}
+
+namespace {
+
+// copies a single ring of the given field directly into the intensities of a
+// LaserScan message without materializing the whole field as a new image
+struct read_ring_intensities {
+    template <typename T>
+    void operator()(Eigen::Ref<const ouster::sdk::core::img_t<T>> field,
+                    std::vector<float>& intensities, uint16_t u,
+                    const std::vector<int>& pixel_shift_by_row) {
+        const auto w = static_cast<int>(field.cols());
+        const auto sg = field.data();
+        for (int v = 0; v < w; ++v) {
+            auto v_shift = (v + w - pixel_shift_by_row[u] + w / 2) % w;
+            auto src_idx = u * w + v_shift;
+            auto tgt_idx = w - 1 - v;
+            intensities[tgt_idx] = static_cast<float>(sg[src_idx]);
+        }
+    }
+};
+
+}  // namespace
+
+void lidar_scan_to_laser_scan_msg(
+    sensor_msgs::LaserScan& msg,
+    const LidarScan& ls, const ros::Time& timestamp,
+    const std::string& frame, const LidarMode ld_mode,
+    const uint16_t ring, const std::vector<int>& pixel_shift_by_row,
+    const int return_index) {
     msg.header.stamp = timestamp;
     msg.header.frame_id = frame;
     msg.angle_min = -M_PI;   // TODO: configure to match the actual scan window
@@ -214,13 +284,8 @@ sensor_msgs::LaserScan lidar_scan_to_laser_scan_msg(
 
     auto which_range = return_index == 0 ? ChanField::RANGE
                                          : ChanField::RANGE2;
-    ouster::sdk::core::img_t<uint32_t> range = ls.field<uint32_t>(which_range);
-    auto which_signal = return_index == 0 ? ChanField::SIGNAL
-                                          : ChanField::SIGNAL2;
-    ouster::sdk::core::img_t<uint32_t> signal =
-        impl::get_or_fill_zero<uint32_t>(which_signal, ls);
+    auto range = ls.field<uint32_t>(which_range);
     const auto rg = range.data();
-    const auto sg = signal.data();
     msg.ranges.resize(ls.w);
     msg.intensities.resize(ls.w);
 
@@ -230,10 +295,18 @@ sensor_msgs::LaserScan lidar_scan_to_laser_scan_msg(
         auto src_idx = u * ls.w + v_shift;
         auto tgt_idx = ls.w - 1 - v;
         msg.ranges[tgt_idx] = rg[src_idx] * ouster::sdk::core::RANGE_UNIT;
-        msg.intensities[tgt_idx] = static_cast<float>(sg[src_idx]);
     }
 
-    return msg;
+    auto which_signal = return_index == 0 ? ChanField::SIGNAL
+                                          : ChanField::SIGNAL2;
+    if (ls.has_field(which_signal)) {
+        ouster::sdk::core::impl::visit_field(ls, which_signal,
+                                             read_ring_intensities(),
+                                             msg.intensities, u,
+                                             pixel_shift_by_row);
+    } else {
+        std::fill(msg.intensities.begin(), msg.intensities.end(), 0.0f);
+    }
 }
 
 Telemetry lidar_packet_to_telemetry_msg(
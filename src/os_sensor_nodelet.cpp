@@ -15,12 +15,15 @@
 #include <pluginlib/class_list_macros.h>
 #include <std_srvs/Empty.h>
 
+#include <pthread.h>
+
 #include <chrono>
 
 #include <ouster/metadata.h>
 
 #include "ouster_ros/PacketMsg.h"
 #include "os_sensor_nodelet.h"
+#include "tracepoints.h"
 
 using std::to_string;
 using namespace std::chrono_literals;
@@ -730,8 +733,47 @@ void OusterSensor::create_services() {
 
 void OusterSensor::create_publishers() {
     auto& nh = getNodeHandle();
-    lidar_packet_pub = nh.advertise<PacketMsg>("lidar_packets", 1280);
-    imu_packet_pub = nh.advertise<PacketMsg>("imu_packets", 100);
+    stamped_packets = getPrivateNodeHandle().param("stamped_packets", false);
+    if (stamped_packets) {
+        lidar_packet_pub =
+            nh.advertise<StampedPacketMsg>("lidar_packets", 1280);
+        imu_packet_pub = nh.advertise<StampedPacketMsg>("imu_packets", 100);
+    } else {
+        lidar_packet_pub = nh.advertise<PacketMsg>("lidar_packets", 1280);
+        imu_packet_pub = nh.advertise<PacketMsg>("imu_packets", 100);
+    }
+    packet_fanout = getPrivateNodeHandle().param("packet_fanout", false);
+    packet_fanout_size = getPrivateNodeHandle().param("packet_fanout_size", 0);
+    if (packet_fanout && packet_fanout_size < 0) {
+        NODELET_FATAL("packet_fanout_size can't be negative");
+        throw std::runtime_error("negative packet_fanout_size!");
+    }
+}
+
+void OusterSensor::create_packet_fanout(const PacketFormat& pf) {
+    // readers of the replaced rings see them closed and attach to the new ones
+    lidar_packet_fanout.reset();
+    imu_packet_fanout.reset();
+    // four frames worth of packets unless set
+    const size_t lidar_slots =
+        packet_fanout_size > 0
+            ? static_cast<size_t>(packet_fanout_size)
+            : 4 * info.format.columns_per_frame / info.format.columns_per_packet;
+    auto& nh = getNodeHandle();
+    try {
+        lidar_packet_fanout = std::make_unique<ShmPacketRingWriter>(
+            shm::packet_ring_name(nh.resolveName("lidar_packets")),
+            lidar_slots, pf.lidar_packet_size);
+        imu_packet_fanout = std::make_unique<ShmPacketRingWriter>(
+            shm::packet_ring_name(nh.resolveName("imu_packets")),
+            IMU_FANOUT_SLOTS, pf.imu_packet_size);
+    } catch (const std::exception& e) {
+        NODELET_FATAL_STREAM("failed to set up the packet fanout: " << e.what());
+        throw;
+    }
+    NODELET_INFO_STREAM("fanning lidar packets out through "
+                        << lidar_packet_fanout->name() << " ("
+                        << lidar_slots << " packets)");
 }
 
 void OusterSensor::allocate_buffers() {
@@ -740,9 +782,12 @@ void OusterSensor::allocate_buffers() {
     lidar_packet.buf.resize(pf.lidar_packet_size);
     lidar_packet.format = packet_format;
     lidar_packet_msg.buf.resize(pf.lidar_packet_size);
+    lidar_stamped_packet_msg.buf.resize(pf.lidar_packet_size);
     imu_packet.buf.resize(pf.imu_packet_size);
     imu_packet.format = packet_format;
     imu_packet_msg.buf.resize(pf.imu_packet_size);
+    imu_stamped_packet_msg.buf.resize(pf.imu_packet_size);
+    if (packet_fanout) create_packet_fanout(pf);
 }
 
 bool OusterSensor::init_id_changed(const PacketFormat& pf,
@@ -778,6 +823,8 @@ void OusterSensor::handle_poll_client_error() {
 void OusterSensor::read_lidar_packet(ouster::sdk::sensor::Client& cli,
                                      const PacketFormat& pf) {
     if (ouster::sdk::sensor::read_lidar_packet(cli, lidar_packet)) {
+        OUSTER_ROS_TRACE2(lidar_packet_receive, lidar_packet.host_timestamp,
+                          lidar_packet.buf.size());
         read_lidar_packet_errors = 0;
         if (!is_legacy_lidar_profile(info) &&
             init_id_changed(pf, lidar_packet)) {
@@ -798,6 +845,12 @@ void OusterSensor::read_lidar_packet(ouster::sdk::sensor::Client& cli,
 }
 
 void OusterSensor::handle_lidar_packet(const LidarPacket& lidar_packet) {
+    // ahead of on_lidar_packet_msg, which may swap the buffer out
+    if (lidar_packet_fanout) {
+        lidar_packet_fanout->write(lidar_packet.buf.data(),
+                                   lidar_packet.buf.size(),
+                                   lidar_packet.host_timestamp);
+    }
     on_lidar_packet_msg(lidar_packet);
 }
 
@@ -817,6 +870,10 @@ void OusterSensor::read_imu_packet(ouster::sdk::sensor::Client& cli,
 }
 
 void OusterSensor::handle_imu_packet(const ImuPacket& imu_packet) {
+    if (imu_packet_fanout) {
+        imu_packet_fanout->write(imu_packet.buf.data(), imu_packet.buf.size(),
+                                 imu_packet.host_timestamp);
+    }
     on_imu_packet_msg(imu_packet);
 }
 
@@ -844,6 +901,8 @@ void OusterSensor::start_sensor_connection_thread() {
     sensor_connection_active = true;
     sensor_connection_thread = std::make_unique<std::thread>([this]() {
         NODELET_DEBUG("sensor_connection_thread active.");
+        // named so that diagnostics can report its cpu usage
+        pthread_setname_np(pthread_self(), "os_sensor_recv");
         auto& pf = ouster::sdk::core::get_format(info);
         while (ros::ok() && sensor_connection_active) {
             connection_loop(*sensor_client, pf);
@@ -862,11 +921,29 @@ void OusterSensor::stop_sensor_connection_thread() {
 }
 
 void OusterSensor::on_lidar_packet_msg(const LidarPacket&) {
+    if (stamped_packets) {
+        auto& msg = lidar_stamped_packet_msg;
+        msg.receive_stamp = impl::ts_to_ros_time(lidar_packet.host_timestamp);
+        ++msg.seq;
+        msg.buf.swap(lidar_packet.buf);
+        lidar_packet_pub.publish(msg);
+        OUSTER_ROS_TRACE1(lidar_packet_publish, msg.buf.size());
+        return;
+    }
     lidar_packet_msg.buf.swap(lidar_packet.buf);
     lidar_packet_pub.publish(lidar_packet_msg);
+    OUSTER_ROS_TRACE1(lidar_packet_publish, lidar_packet_msg.buf.size());
 }
 
 void OusterSensor::on_imu_packet_msg(const ImuPacket&) {
+    if (stamped_packets) {
+        auto& msg = imu_stamped_packet_msg;
+        msg.receive_stamp = impl::ts_to_ros_time(imu_packet.host_timestamp);
+        ++msg.seq;
+        msg.buf.swap(imu_packet.buf);
+        imu_packet_pub.publish(msg);
+        return;
+    }
     imu_packet_msg.buf.swap(imu_packet.buf);
     imu_packet_pub.publish(imu_packet_msg);
 }
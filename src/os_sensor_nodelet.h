@@ -24,7 +24,9 @@
 #include "ouster_ros/GetConfig.h"
 #include "ouster_ros/SetConfig.h"
 #include "ouster_ros/PacketMsg.h"
+#include "ouster_ros/StampedPacketMsg.h"
 #include "ouster_ros/os_sensor_nodelet_base.h"
+#include "ouster_ros/shm_packet_ring.h"
 
 
 namespace ouster_ros {
@@ -111,6 +113,8 @@ class OusterSensor : public OusterSensorNodeletBase {
 
     void allocate_buffers();
 
+    void create_packet_fanout(const ouster::sdk::core::PacketFormat& pf);
+
     bool init_id_changed(const ouster::sdk::core::PacketFormat& pf,
                          const ouster::sdk::core::LidarPacket& lidar_packet);
 
@@ -142,10 +146,21 @@ class OusterSensor : public OusterSensorNodeletBase {
     std::shared_ptr<ouster::sdk::sensor::Client> sensor_client;
     PacketMsg lidar_packet_msg;
     PacketMsg imu_packet_msg;
+    // used in place of the PacketMsg(s) when stamped_packets is set
+    bool stamped_packets = false;
+    StampedPacketMsg lidar_stamped_packet_msg;
+    StampedPacketMsg imu_stamped_packet_msg;
     ouster::sdk::core::LidarPacket lidar_packet;
     ouster::sdk::core::ImuPacket imu_packet;
     ros::Publisher lidar_packet_pub;
     ros::Publisher imu_packet_pub;
+    // packets are also written to shared memory rings when packet_fanout is
+    // set, for the consumers of the host that attach to them
+    bool packet_fanout = false;
+    int packet_fanout_size = 0;
+    std::unique_ptr<ShmPacketRingWriter> lidar_packet_fanout;
+    std::unique_ptr<ShmPacketRingWriter> imu_packet_fanout;
+    static constexpr size_t IMU_FANOUT_SLOTS = 256;
     ros::ServiceServer reset_srv;
     ros::ServiceServer get_config_srv;
     ros::ServiceServer set_config_srv;
@@ -0,0 +1,256 @@
+/**
+ * Copyright (c) 2018-2024, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file packet_crc.h
+ * @brief Verifies the CRC carried by the lidar packets of the FUSA profile
+ *
+ * The FUSA_RNG15_RFL8_NIR8_DUAL profile closes every lidar packet with a
+ * CRC-64/XZ (ECMA-182 polynomial, reflected, all ones init and xorout) of all
+ * the bytes of the packet before it, stored little endian in the last 8 bytes
+ * of the packet footer. The CRC a packet carries is read through the
+ * PacketFormat of the SDK, which also computes the reference the faster
+ * implementations here are tested against.
+ *
+ * On x86 the CRC is folded 64 bytes at a time with carry-less multiplications
+ * (PCLMULQDQ) when the CPU supports them, the CRC32 instruction only computes
+ * the Castagnoli CRC-32 and can't be used for it. Other CPUs, and the tail of
+ * the packet, go through a slicing-by-8 table lookup.
+ */
+
+#pragma once
+
+#include <ouster/types.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define OUSTER_ROS_CRC_CLMUL
+#endif
+
+namespace ouster_ros {
+
+namespace crc {
+
+// ECMA-182 polynomial without its x^64 term
+constexpr uint64_t CRC64_POLY = 0x42F0E1EBA9EA3693ULL;
+
+namespace impl {
+
+constexpr uint64_t reflect64(uint64_t v) {
+    uint64_t r = 0;
+    for (int i = 0; i < 64; ++i)
+        if ((v >> i) & 1) r |= 1ULL << (63 - i);
+    return r;
+}
+
+// x^n mod P
+constexpr uint64_t xpow_mod(size_t n) {
+    uint64_t r = 1;
+    for (size_t i = 0; i < n; ++i)
+        r = (r >> 63) ? (r << 1) ^ CRC64_POLY : r << 1;
+    return r;
+}
+
+constexpr uint64_t CRC64_POLY_REFLECTED = reflect64(CRC64_POLY);
+
+struct Tables {
+    std::array<std::array<uint64_t, 256>, 8> t;
+
+    Tables() {
+        for (uint64_t i = 0; i < 256; ++i) {
+            uint64_t crc = i;
+            for (int b = 0; b < 8; ++b)
+                crc = (crc & 1) ? (crc >> 1) ^ CRC64_POLY_REFLECTED : crc >> 1;
+            t[0][i] = crc;
+        }
+        for (size_t k = 1; k < t.size(); ++k)
+            for (size_t i = 0; i < 256; ++i)
+                t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xff];
+    }
+};
+
+inline const Tables& tables() {
+    static const Tables tables;
+    return tables;
+}
+
+}  // namespace impl
+
+/**
+ * Folds size bytes into the CRC register crc, i.e. the CRC before the final
+ * xor, one byte per table lookup with 8 tables.
+ */
+inline uint64_t crc64_update_portable(uint64_t crc, const uint8_t* data,
+                                      size_t size) {
+    const auto& t = impl::tables().t;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    for (; size >= 8; data += 8, size -= 8) {
+        uint64_t word;
+        std::memcpy(&word, data, sizeof(word));
+        crc ^= word;
+        crc = t[7][crc & 0xff] ^ t[6][(crc >> 8) & 0xff] ^
+              t[5][(crc >> 16) & 0xff] ^ t[4][(crc >> 24) & 0xff] ^
+              t[3][(crc >> 32) & 0xff] ^ t[2][(crc >> 40) & 0xff] ^
+              t[1][(crc >> 48) & 0xff] ^ t[0][crc >> 56];
+    }
+#endif
+    for (; size > 0; ++data, --size)
+        crc = t[0][(crc ^ *data) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+#ifdef OUSTER_ROS_CRC_CLMUL
+
+namespace impl {
+
+// constants folding a 128 bit block over distance bits, each half of the
+// block is multiplied by x^(distance + 64) and x^distance mod P, reflected and
+// shifted by one bit to make up for the reflected product
+constexpr uint64_t fold_low(size_t distance) {
+    return reflect64(xpow_mod(distance + 63));
+}
+
+constexpr uint64_t fold_high(size_t distance) {
+    return reflect64(xpow_mod(distance - 1));
+}
+
+__attribute__((target("sse2"))) inline __m128i load(const uint8_t* p) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+__attribute__((target("pclmul,sse2"))) inline __m128i fold(__m128i x,
+                                                            __m128i k) {
+    return _mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x00),
+                         _mm_clmulepi64_si128(x, k, 0x11));
+}
+
+}  // namespace impl
+
+/**
+ * Same as crc64_update_portable, folds four 128 bit lanes over 64 bytes at a
+ * time with carry-less multiplications, the remainder left in the lanes and
+ * the last bytes of data are reduced with the tables.
+ */
+__attribute__((target("pclmul,sse2"))) inline uint64_t crc64_update_clmul(
+    uint64_t crc, const uint8_t* data, size_t size) {
+    if (size < 64) return crc64_update_portable(crc, data, size);
+
+    using impl::fold;
+    using impl::load;
+    constexpr uint64_t k512_low = impl::fold_low(512);
+    constexpr uint64_t k512_high = impl::fold_high(512);
+    constexpr uint64_t k128_low = impl::fold_low(128);
+    constexpr uint64_t k128_high = impl::fold_high(128);
+    const __m128i k512 = _mm_set_epi64x(k512_high, k512_low);
+    const __m128i k128 = _mm_set_epi64x(k128_high, k128_low);
+
+    __m128i x0 = _mm_xor_si128(load(data),
+                               _mm_set_epi64x(0, static_cast<int64_t>(crc)));
+    __m128i x1 = load(data + 16);
+    __m128i x2 = load(data + 32);
+    __m128i x3 = load(data + 48);
+    data += 64;
+    size -= 64;
+    for (; size >= 64; data += 64, size -= 64) {
+        x0 = _mm_xor_si128(fold(x0, k512), load(data));
+        x1 = _mm_xor_si128(fold(x1, k512), load(data + 16));
+        x2 = _mm_xor_si128(fold(x2, k512), load(data + 32));
+        x3 = _mm_xor_si128(fold(x3, k512), load(data + 48));
+    }
+
+    __m128i x = _mm_xor_si128(fold(x0, k128), x1);
+    x = _mm_xor_si128(fold(x, k128), x2);
+    x = _mm_xor_si128(fold(x, k128), x3);
+    for (; size >= 16; data += 16, size -= 16)
+        x = _mm_xor_si128(fold(x, k128), load(data));
+
+    alignas(16) uint8_t remainder[16];
+    _mm_store_si128(reinterpret_cast<__m128i*>(remainder), x);
+    crc = crc64_update_portable(0, remainder, sizeof(remainder));
+    return crc64_update_portable(crc, data, size);
+}
+
+#endif
+
+// whether crc64 folds with carry-less multiplications on this CPU
+inline bool clmul_supported() {
+#ifdef OUSTER_ROS_CRC_CLMUL
+    static const bool supported = __builtin_cpu_supports("pclmul");
+    return supported;
+#else
+    return false;
+#endif
+}
+
+// CRC-64/XZ of size bytes
+inline uint64_t crc64(const uint8_t* data, size_t size,
+                      bool use_clmul = clmul_supported()) {
+#ifdef OUSTER_ROS_CRC_CLMUL
+    if (use_clmul) return ~crc64_update_clmul(~0ULL, data, size);
+#else
+    (void)use_clmul;
+#endif
+    return ~crc64_update_portable(~0ULL, data, size);
+}
+
+}  // namespace crc
+
+class PacketCrc {
+   public:
+    static constexpr size_t CRC_SIZE = sizeof(uint64_t);
+
+    // whether the lidar packets of the profile carry a crc
+    static bool supported(ouster::sdk::core::UDPProfileLidar profile) {
+        return profile ==
+               ouster::sdk::core::UDPProfileLidar::FUSA_RNG15_RFL8_NIR8_DUAL;
+    }
+
+    /**
+     * @param[in] pf format of the lidar packets, which must outlive this
+     * object like those returned by get_format.
+     * @param[in] use_clmul fold with carry-less multiplications, ignored when
+     * the CPU doesn't support them.
+     */
+    explicit PacketCrc(const ouster::sdk::core::PacketFormat& pf,
+                       bool use_clmul = true)
+        : pf_(pf),
+          packet_size(pf.lidar_packet_size),
+          clmul(use_clmul && crc::clmul_supported()) {}
+
+    // whether the packet carries a crc, which then gets stored to crc
+    bool expected(const uint8_t* lidar_buf, uint64_t& crc) const {
+        const auto carried = pf_.crc(lidar_buf);
+        if (!carried) return false;
+        crc = *carried;
+        return true;
+    }
+
+    // the crc of the bytes of the packet before its crc
+    uint64_t calculate(const uint8_t* lidar_buf) const {
+        return crc::crc64(lidar_buf, packet_size - CRC_SIZE, clmul);
+    }
+
+    /**
+     * @return false when the packet is shorter than the packet format or the
+     * crc it carries doesn't match its content.
+     */
+    bool valid(const uint8_t* lidar_buf, size_t size) const {
+        uint64_t crc;
+        return size >= packet_size && expected(lidar_buf, crc) &&
+               calculate(lidar_buf) == crc;
+    }
+
+    const char* implementation() const { return clmul ? "pclmul" : "table"; }
+
+   private:
+    const ouster::sdk::core::PacketFormat& pf_;
+    const size_t packet_size;
+    const bool clmul;
+};
+
+}  // namespace ouster_ros
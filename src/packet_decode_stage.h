@@ -0,0 +1,189 @@
+/**
+ * Copyright (c) 2018-2024, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file packet_decode_stage.h
+ * @brief Hands the lidar packets read from the socket over to a dedicated
+ * decode thread
+ *
+ * By default the LidarPacketHandler batches every packet on the thread that
+ * reads the sensor socket, any slowdown of the ScanBatcher or of the valid
+ * column count delays the draining of the socket and the kernel drops packets
+ * once its receive buffer is full. With the decode stage the receive thread
+ * copies the packet into a preallocated slot of a single producer single
+ * consumer ring and goes back to the socket, the `os_decode` thread batches
+ * the packets in the order they arrived.
+ *
+ * The ring is indexed by a LockFreeRingBuffer, like the lidar scans ring. The
+ * receive thread only takes a lock to wake the decode thread up after it went
+ * to sleep on an empty ring. A full ring drops the packet, as the kernel would
+ * have, and reports it through the event log.
+ */
+
+#pragma once
+
+#include <pthread.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <ouster/types.h>
+
+#include "diagnostics.h"
+#include "event_log.h"
+#include "lock_free_ring_buffer.h"
+#include "tracepoints.h"
+
+namespace ouster_ros {
+
+class PacketDecodeStage {
+   public:
+    using Handler = std::function<void(const ouster::sdk::core::LidarPacket&)>;
+
+    /**
+     * @param[in] handler invoked on the decode thread for every packet.
+     * @param[in] capacity number of packets the ring holds.
+     * @param[in] packet_size size of the lidar packets, slots are allocated
+     * upfront for packets up to this size.
+     * @param[in] name logger name of the event log.
+     * @param[in] stats receives the depth of the ring and the drops.
+     */
+    PacketDecodeStage(Handler handler, size_t capacity, size_t packet_size,
+                      const std::string& name,
+                      std::shared_ptr<PipelineStats> stats = nullptr)
+        : handler_(std::move(handler)),
+          ring(capacity + 1),
+          packets(capacity + 1),
+          event_log(name),
+          stats_(stats) {
+        for (auto& p : packets) p.buf.reserve(packet_size);
+        full_queue_event = &event_log.add(
+            [capacity](std::ostream& os, uint64_t count, uint64_t,
+                       double period_s) {
+                os << "lidar packet queue full (" << capacity
+                   << " packets), dropped " << count << " packets in the last "
+                   << std::setprecision(3) << period_s << "s";
+            });
+        if (stats_) stats_->packet_queue_capacity = capacity;
+        thread_ = std::thread([this]() {
+            pthread_setname_np(pthread_self(), "os_decode");
+            run();
+        });
+    }
+
+    PacketDecodeStage(const PacketDecodeStage&) = delete;
+    PacketDecodeStage& operator=(const PacketDecodeStage&) = delete;
+
+    // packets still queued are discarded
+    ~PacketDecodeStage() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            active_ = false;
+        }
+        has_packets.notify_one();
+        thread_.join();
+    }
+
+    /**
+     * Queues a copy of the packet, to be called from a single thread.
+     * @return false when the ring is full and the packet was dropped.
+     */
+    bool push(const ouster::sdk::core::LidarPacket& packet) {
+        if (ring.full()) {
+            full_queue_event->record();
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            if (stats_) ++stats_->packet_queue_drops;
+            return false;
+        }
+        auto& slot = packets[ring.write_head()];
+        // within the reserved capacity, resize doesn't allocate
+        slot.buf.resize(packet.buf.size());
+        std::memcpy(slot.buf.data(), packet.buf.data(), packet.buf.size());
+        slot.host_timestamp = packet.host_timestamp;
+        ring.write();
+        const auto depth = ring.size();
+        OUSTER_ROS_TRACE2(packet_enqueue, packet.host_timestamp, depth);
+        update_high_water_mark(depth);
+        if (stats_) stats_->update_packet_queue_depth(depth);
+        // pairs with the flag raised by the decode thread before it checks
+        // the ring one last time and goes to sleep
+        if (sleeping_.load()) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            has_packets.notify_one();
+        }
+        return true;
+    }
+
+    size_t capacity() const { return ring.capacity() - 1; }
+
+    // number of packets waiting for the decode thread
+    size_t size() const { return ring.size(); }
+
+    size_t high_water_mark() const {
+        return high_water_mark_.load(std::memory_order_relaxed);
+    }
+
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+   private:
+    void run() {
+        while (active_) {
+            if (ring.empty()) {
+                wait();
+                continue;
+            }
+            const auto& packet = packets[ring.read_head()];
+            OUSTER_ROS_TRACE2(packet_dequeue, packet.host_timestamp,
+                              ring.size());
+            handler_(packet);
+            ring.read();
+            if (stats_) stats_->packet_queue_depth = ring.size();
+        }
+    }
+
+    void wait() {
+        using namespace std::chrono_literals;
+        std::unique_lock<std::mutex> lock(mutex_);
+        sleeping_ = true;
+        // the timeout only bounds how long a stop can go unnoticed
+        has_packets.wait_for(lock, 100ms,
+                             [this] { return !ring.empty() || !active_; });
+        sleeping_ = false;
+    }
+
+    void update_high_water_mark(size_t depth) {
+        auto hwm = high_water_mark_.load(std::memory_order_relaxed);
+        while (depth > hwm && !high_water_mark_.compare_exchange_weak(
+                                  hwm, depth, std::memory_order_relaxed)) {
+        }
+    }
+
+    Handler handler_;
+    LockFreeRingBuffer ring;
+    std::vector<ouster::sdk::core::LidarPacket> packets;
+
+    std::mutex mutex_;
+    std::condition_variable has_packets;
+    std::atomic<bool> sleeping_{false};
+    std::atomic<bool> active_{true};
+
+    std::atomic<size_t> high_water_mark_{0};
+    std::atomic<uint64_t> dropped_{0};
+
+    EventLog event_log;
+    EventLog::Event* full_queue_event;
+    std::shared_ptr<PipelineStats> stats_;
+
+    std::thread thread_;
+};
+
+}  // namespace ouster_ros
@@ -0,0 +1,645 @@
+/**
+ * Copyright (c) 2018-2024, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file packet_decoder.h
+ * @brief Decoders of the pixel fields of lidar packets specialized for the most
+ * used lidar profiles
+ *
+ * The ScanBatcher of the SDK decodes every profile through the runtime field
+ * descriptors of the PacketFormat, looking up the offset, mask and shift of a
+ * field for every column it copies. For the RNG19_RFL8_SIG16_NIR16,
+ * RNG15_RFL8_NIR8 and RNG19_RFL8_SIG16_NIR16_DUAL profiles the layout of a
+ * pixel is known at compile time: a kernel is instantiated per field from the
+ * layouts below, with the type of the decoded values taken from the
+ * ChanFieldTables of sensor_point_types.h. The kernels write the columns of a
+ * packet straight into the fields of the LidarScan one row at a time: the
+ * values of a row are contiguous in the LidarScan while the pixels of a row
+ * are a column apart in the packet. Compilers don't vectorize such a strided
+ * gather, on x86 CPUs with AVX2 the kernels gather the words of 8 columns at
+ * once, mask and shift them and store them as a single vector, the scalar
+ * kernel handles the remaining columns and other CPUs.
+ * benchmarks/packet_decoder_benchmark.cpp compares them with the ScanBatcher.
+ *
+ * ProfileScanBatcher leaves the batching logic to the ScanBatcher: frame
+ * changes, reordered and missing packets and the column headers. The SDK
+ * batcher works on a LidarScan holding the fields without a specialized kernel
+ * only, whose headers and fields are copied into the target scan once the scan
+ * completes.
+ */
+
+#pragma once
+
+#include <ouster/lidar_scan.h>
+#include <ouster/types.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ouster_ros/sensor_point_types.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define OUSTER_ROS_DECODE_AVX2
+#endif
+
+namespace ouster_ros {
+
+using ouster::sdk::core::UDPProfileLidar;
+
+/**
+ * Location of a channel field within a pixel of a lidar packet, following the
+ * convention of the field descriptors of the PacketFormat: the word of type
+ * word at offset is masked, unless mask is zero, then shifted right by shift
+ * or left by -shift.
+ */
+struct PixelField {
+    const char* name;
+    ChanFieldType word;
+    size_t offset;
+    uint64_t mask;
+    int shift;
+};
+
+template <size_t N>
+using PixelLayout = std::array<PixelField, N>;
+
+namespace decoding {
+
+constexpr bool same_name(const char* a, const char* b) {
+    while (*a != '\0' && *a == *b) {
+        ++a;
+        ++b;
+    }
+    return *a == *b;
+}
+
+// type of the named field in the tables of a profile, referring to a field
+// missing from the tables fails to compile
+template <size_t N, size_t M>
+constexpr ChanFieldType field_type(const ChanFieldTable<N>& first,
+                                   const ChanFieldTable<M>& second,
+                                   const char* name) {
+    for (const auto& f : first)
+        if (same_name(f.first, name)) return f.second;
+    for (const auto& f : second)
+        if (same_name(f.first, name)) return f.second;
+    throw std::logic_error("field missing from the ChanFieldTable");
+}
+
+struct RNG19_RFL8_SIG16_NIR16_Layout {
+    static constexpr size_t pixel_size = 12;
+    static constexpr PixelLayout<5> fields{{
+        {ChanField::RANGE, ChanFieldType::UINT32, 0, 0x0007ffff, 0},
+        {ChanField::FLAGS, ChanFieldType::UINT8, 2, 0b11111000, 3},
+        {ChanField::REFLECTIVITY, ChanFieldType::UINT8, 4, 0, 0},
+        {ChanField::SIGNAL, ChanFieldType::UINT16, 6, 0, 0},
+        {ChanField::NEAR_IR, ChanFieldType::UINT16, 8, 0, 0},
+    }};
+    static constexpr ChanFieldType type_of(const char* name) {
+        return field_type(Profile_RNG19_RFL8_SIG16_NIR16,
+                          Profile_RNG19_RFL8_SIG16_NIR16, name);
+    }
+};
+
+struct RNG15_RFL8_NIR8_Layout {
+    static constexpr size_t pixel_size = 4;
+    static constexpr PixelLayout<4> fields{{
+        {ChanField::RANGE, ChanFieldType::UINT16, 0, 0x7fff, -3},
+        {ChanField::FLAGS, ChanFieldType::UINT8, 1, 0b10000000, 7},
+        {ChanField::REFLECTIVITY, ChanFieldType::UINT8, 2, 0xff, 0},
+        {ChanField::NEAR_IR, ChanFieldType::UINT8, 3, 0xff, -4},
+    }};
+    static constexpr ChanFieldType type_of(const char* name) {
+        return field_type(Profile_RNG15_RFL8_NIR8, Profile_RNG15_RFL8_NIR8,
+                          name);
+    }
+};
+
+struct RNG19_RFL8_SIG16_NIR16_DUAL_Layout {
+    static constexpr size_t pixel_size = 16;
+    static constexpr PixelLayout<9> fields{{
+        {ChanField::RANGE, ChanFieldType::UINT32, 0, 0x0007ffff, 0},
+        {ChanField::FLAGS, ChanFieldType::UINT8, 2, 0b11111000, 3},
+        {ChanField::REFLECTIVITY, ChanFieldType::UINT8, 3, 0xff, 0},
+        {ChanField::RANGE2, ChanFieldType::UINT32, 4, 0x0007ffff, 0},
+        {ChanField::FLAGS2, ChanFieldType::UINT8, 6, 0b11111000, 3},
+        {ChanField::REFLECTIVITY2, ChanFieldType::UINT8, 7, 0xff, 0},
+        {ChanField::SIGNAL, ChanFieldType::UINT16, 8, 0, 0},
+        {ChanField::SIGNAL2, ChanFieldType::UINT16, 10, 0, 0},
+        {ChanField::NEAR_IR, ChanFieldType::UINT16, 12, 0, 0},
+    }};
+    static constexpr ChanFieldType type_of(const char* name) {
+        return field_type(Profile_RNG19_RFL8_SIG16_NIR16_DUAL,
+                          Profile_RNG19_RFL8_SIG16_NIR16_DUAL_2ND_RETURN,
+                          name);
+    }
+};
+
+/**
+ * Decodes the field I of Layout for cols consecutive columns starting at
+ * px0, the first pixel of the first column, into the field of a LidarScan of
+ * width w starting at column m_id.
+ */
+template <typename Layout, size_t I>
+void decode_field(const uint8_t* px0, size_t col_stride, int rows, int cols,
+                  void* field, size_t w, size_t m_id) {
+    constexpr const PixelField& f = Layout::fields[I];
+    using Word = typename TypeSelector<f.word>::type;
+    using T = typename TypeSelector<Layout::type_of(f.name)>::type;
+    static_assert(sizeof(T) >= sizeof(Word),
+                  "the field type can't hold the packet word");
+    constexpr T mask = f.mask ? static_cast<T>(f.mask) : static_cast<T>(~T{0});
+
+    T* dst = static_cast<T*>(field) + m_id;
+    for (int r = 0; r < rows; ++r) {
+        const uint8_t* src = px0 + r * Layout::pixel_size + f.offset;
+        T* row = dst + r * w;
+        for (int c = 0; c < cols; ++c) {
+            Word word;
+            std::memcpy(&word, src + c * col_stride, sizeof(Word));
+            T value = static_cast<T>(word) & mask;
+            if constexpr (f.shift > 0) value >>= f.shift;
+            if constexpr (f.shift < 0) value <<= -f.shift;
+            row[c] = value;
+        }
+    }
+}
+
+#ifdef OUSTER_ROS_DECODE_AVX2
+
+// stores the low sizeof(T) bytes of the 8 lanes of v, which fit into a T
+template <typename T>
+__attribute__((target("avx2"))) inline void store8(T* dst, __m256i v) {
+    if constexpr (sizeof(T) == 4) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), v);
+    } else if constexpr (sizeof(T) == 2) {
+        // packs within the 128 bit lanes, then joins the low halves
+        const __m256i packed =
+            _mm256_permute4x64_epi64(_mm256_packus_epi32(v, v), 0x08);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst),
+                         _mm256_castsi256_si128(packed));
+    } else {
+        const __m256i packed = _mm256_packus_epi16(_mm256_packus_epi32(v, v),
+                                                   _mm256_setzero_si256());
+        const __m256i joined = _mm256_permutevar8x32_epi32(
+            packed, _mm256_setr_epi32(0, 4, 1, 1, 1, 1, 1, 1));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst),
+                         _mm256_castsi256_si128(joined));
+    }
+}
+
+/**
+ * decode_field gathering the words of 8 columns at a time. Narrower words are
+ * loaded as the 32 bit word ending with them, which stays within the packet as
+ * the columns start after the packet header.
+ */
+template <typename Layout, size_t I>
+__attribute__((target("avx2"))) void decode_field_avx2(
+    const uint8_t* px0, size_t col_stride, int rows, int cols, void* field,
+    size_t w, size_t m_id) {
+    constexpr const PixelField& f = Layout::fields[I];
+    using Word = typename TypeSelector<f.word>::type;
+    using T = typename TypeSelector<Layout::type_of(f.name)>::type;
+    if constexpr (sizeof(T) > sizeof(uint32_t)) {
+        decode_field<Layout, I>(px0, col_stride, rows, cols, field, w, m_id);
+    } else {
+        constexpr int word_shift = 8 * (sizeof(uint32_t) - sizeof(Word));
+        constexpr uint64_t type_mask =
+            sizeof(T) == 4 ? 0xffffffff : (uint64_t{1} << 8 * sizeof(T)) - 1;
+        constexpr uint32_t mask = f.mask ? f.mask : 0xffffffff;
+        const int stride = static_cast<int>(col_stride);
+        const __m256i offsets = _mm256_mullo_epi32(
+            _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+            _mm256_set1_epi32(stride));
+        const __m256i masks = _mm256_set1_epi32(static_cast<int>(mask));
+        const __m256i type_masks =
+            _mm256_set1_epi32(static_cast<int>(type_mask));
+
+        const int vector_cols = cols / 8 * 8;
+        T* dst = static_cast<T*>(field) + m_id;
+        for (int r = 0; r < rows; ++r) {
+            const uint8_t* src = px0 + r * Layout::pixel_size + f.offset +
+                                 sizeof(Word) - sizeof(uint32_t);
+            T* row = dst + r * w;
+            for (int c = 0; c < vector_cols; c += 8) {
+                __m256i v = _mm256_i32gather_epi32(
+                    reinterpret_cast<const int*>(src + c * col_stride),
+                    offsets, 1);
+                if constexpr (word_shift > 0)
+                    v = _mm256_srli_epi32(v, word_shift);
+                v = _mm256_and_si256(v, masks);
+                if constexpr (f.shift > 0) v = _mm256_srli_epi32(v, f.shift);
+                if constexpr (f.shift < 0) v = _mm256_slli_epi32(v, -f.shift);
+                // the scalar kernel shifts within T
+                if constexpr (f.shift < 0 && sizeof(T) < 4)
+                    v = _mm256_and_si256(v, type_masks);
+                store8(row + c, v);
+            }
+        }
+        if (vector_cols < cols)
+            decode_field<Layout, I>(px0 + vector_cols * col_stride, col_stride,
+                                    rows, cols - vector_cols, field, w,
+                                    m_id + vector_cols);
+    }
+}
+
+#endif
+
+// whether the kernels gather with AVX2 on this CPU
+inline bool avx2_supported() {
+#ifdef OUSTER_ROS_DECODE_AVX2
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+#else
+    return false;
+#endif
+}
+
+using FieldKernel = void (*)(const uint8_t*, size_t, int, int, void*, size_t,
+                             size_t);
+
+struct FieldDecoder {
+    const char* name;
+    ChanFieldType type;
+    FieldKernel decode;
+};
+
+template <typename Layout, size_t I>
+FieldKernel kernel(bool avx2) {
+#ifdef OUSTER_ROS_DECODE_AVX2
+    if (avx2) return &decode_field_avx2<Layout, I>;
+#else
+    (void)avx2;
+#endif
+    return &decode_field<Layout, I>;
+}
+
+template <typename Layout, size_t... I>
+std::vector<FieldDecoder> field_decoders(bool avx2,
+                                         std::index_sequence<I...>) {
+    return {{Layout::fields[I].name, Layout::type_of(Layout::fields[I].name),
+             kernel<Layout, I>(avx2)}...};
+}
+
+template <typename Layout>
+std::vector<FieldDecoder> field_decoders(bool avx2) {
+    return field_decoders<Layout>(
+        avx2, std::make_index_sequence<Layout::fields.size()>());
+}
+
+}  // namespace decoding
+
+/**
+ * Decodes the pixel fields of a profile that have a specialized kernel.
+ */
+class PacketDecoder {
+   public:
+    static bool supported(UDPProfileLidar profile) {
+        return !decoders_of(profile, false, nullptr).empty();
+    }
+
+    /**
+     * @param[in] info sensor metadata.
+     * @param[in] field_types fields of the target lidar scans, only those
+     * with a kernel are decoded.
+     * @param[in] use_avx2 gather with AVX2, ignored when the CPU doesn't
+     * support it.
+     */
+    PacketDecoder(const ouster::sdk::core::SensorInfo& info,
+                  const ouster::sdk::core::LidarScanFieldTypes& field_types,
+                  bool use_avx2 = true)
+        : pf(ouster::sdk::core::get_format(info)),
+          w(info.format.columns_per_frame),
+          rows(info.format.pixels_per_column),
+          cols(info.format.columns_per_packet),
+          avx2(use_avx2 && decoding::avx2_supported()) {
+        size_t pixel_size = 0;
+        const auto candidates =
+            decoders_of(info.format.udp_profile_lidar, avx2, &pixel_size);
+        if (candidates.empty()) return;
+
+        std::vector<uint8_t> probe(pf.lidar_packet_size);
+        std::mt19937 rng(5489u);
+        std::generate(probe.begin(), probe.end(), [&rng]() { return rng(); });
+        const uint8_t* col0 = pf.nth_col(0, probe.data());
+        col_stride = cols > 1 ? pf.nth_col(1, probe.data()) - col0 : 0;
+        if (static_cast<size_t>(pf.nth_px(1, col0) - pf.nth_px(0, col0)) !=
+            pixel_size)
+            return;
+
+        for (const auto& d : candidates) {
+            const auto ft = std::find_if(
+                field_types.begin(), field_types.end(),
+                [&d](const auto& ft) { return ft.name == d.name; });
+            if (ft == field_types.end() || ft->element_type != d.type)
+                continue;
+            // the layouts come from the sensor documentation, a firmware
+            // that lays out a field differently leaves it to the SDK
+            if (!matches_sdk(d, probe.data())) continue;
+            decoders.push_back(d);
+            names.push_back(d.name);
+        }
+    }
+
+    // the fields that are decoded by a specialized kernel
+    const std::vector<std::string>& specialized_fields() const {
+        return names;
+    }
+
+    const char* implementation() const { return avx2 ? "avx2" : "scalar"; }
+
+    /**
+     * Decodes the specialized fields of the valid columns of the packet into
+     * ls and flags them in written. Like the ScanBatcher, invalid columns are
+     * left out and zeroed by zero_missing.
+     */
+    void decode(const uint8_t* packet_buf, ouster::sdk::core::LidarScan& ls,
+                std::vector<uint8_t>& written) const {
+        const uint8_t* col0 = pf.nth_col(0, packet_buf);
+        const size_t m_first = pf.col_measurement_id(col0);
+        const size_t m_last =
+            pf.col_measurement_id(pf.nth_col(cols - 1, packet_buf));
+        const uint8_t* px0 = pf.nth_px(0, col0);
+        bool all_valid = true;
+        for (int c = 0; c < cols && all_valid; ++c)
+            all_valid = pf.col_status(pf.nth_col(c, packet_buf)) & 0x01;
+
+        // the columns of a packet are consecutive and valid, unless a packet
+        // got mangled or the sensor flagged columns, then the columns are
+        // written one by one
+        if (all_valid && m_last == m_first + cols - 1 && m_last < w) {
+            for (const auto& d : decoders)
+                d.decode(px0, col_stride, rows, cols, ls.field(d.name).get(),
+                         w, m_first);
+            std::fill(written.begin() + m_first,
+                      written.begin() + m_first + cols, 1);
+            return;
+        }
+        for (int c = 0; c < cols; ++c) {
+            const uint8_t* col = pf.nth_col(c, packet_buf);
+            const size_t m_id = pf.col_measurement_id(col);
+            if (!(pf.col_status(col) & 0x01) || m_id >= w) continue;
+            for (const auto& d : decoders)
+                d.decode(pf.nth_px(0, col), col_stride, rows, 1,
+                         ls.field(d.name).get(), w, m_id);
+            written[m_id] = 1;
+        }
+    }
+
+    // zeroes the specialized fields of the columns that weren't written
+    void zero_missing(ouster::sdk::core::LidarScan& ls,
+                      const std::vector<uint8_t>& written) const {
+        for (size_t m_id = 0; m_id < w; ++m_id) {
+            if (written[m_id]) continue;
+            for (const auto& d : decoders) {
+                auto& f = ls.field(d.name);
+                auto* field = static_cast<uint8_t*>(f.get());
+                const size_t size = f.bytes() / (w * rows);
+                for (size_t r = 0; r < rows; ++r)
+                    std::memset(field + (r * w + m_id) * size, 0, size);
+            }
+        }
+    }
+
+   private:
+    static std::vector<decoding::FieldDecoder> decoders_of(
+        UDPProfileLidar profile, bool avx2, size_t* pixel_size) {
+        using namespace decoding;
+        size_t size = 0;
+        std::vector<FieldDecoder> result;
+        switch (profile) {
+            case UDPProfileLidar::RNG19_RFL8_SIG16_NIR16:
+                size = RNG19_RFL8_SIG16_NIR16_Layout::pixel_size;
+                result = field_decoders<RNG19_RFL8_SIG16_NIR16_Layout>(avx2);
+                break;
+            case UDPProfileLidar::RNG15_RFL8_NIR8:
+                size = RNG15_RFL8_NIR8_Layout::pixel_size;
+                result = field_decoders<RNG15_RFL8_NIR8_Layout>(avx2);
+                break;
+            case UDPProfileLidar::RNG19_RFL8_SIG16_NIR16_DUAL:
+                size = RNG19_RFL8_SIG16_NIR16_DUAL_Layout::pixel_size;
+                result =
+                    field_decoders<RNG19_RFL8_SIG16_NIR16_DUAL_Layout>(avx2);
+                break;
+            default:
+                break;
+        }
+        if (pixel_size) *pixel_size = size;
+        return result;
+    }
+
+    template <typename T>
+    bool matches_sdk(const decoding::FieldDecoder& d,
+                     const uint8_t* packet_buf) const {
+        std::vector<T> expected(rows * cols), actual(rows * cols);
+        try {
+            for (int c = 0; c < cols; ++c)
+                pf.col_field(pf.nth_col(c, packet_buf), d.name,
+                             expected.data() + c, cols);
+        } catch (const std::exception&) {
+            return false;
+        }
+        d.decode(pf.nth_px(0, pf.nth_col(0, packet_buf)), col_stride, rows,
+                 cols, actual.data(), cols, 0);
+        return expected == actual;
+    }
+
+    bool matches_sdk(const decoding::FieldDecoder& d,
+                     const uint8_t* packet_buf) const {
+        switch (d.type) {
+            case ChanFieldType::UINT8:
+                return matches_sdk<uint8_t>(d, packet_buf);
+            case ChanFieldType::UINT16:
+                return matches_sdk<uint16_t>(d, packet_buf);
+            case ChanFieldType::UINT32:
+                return matches_sdk<uint32_t>(d, packet_buf);
+            case ChanFieldType::UINT64:
+                return matches_sdk<uint64_t>(d, packet_buf);
+            default:
+                return false;
+        }
+    }
+
+    const ouster::sdk::core::PacketFormat& pf;
+    size_t w;
+    size_t rows;
+    int cols;
+    bool avx2;
+    size_t col_stride = 0;
+    std::vector<decoding::FieldDecoder> decoders;
+    std::vector<std::string> names;
+};
+
+/**
+ * Drop-in replacement of the ScanBatcher that decodes the specialized fields
+ * of the target scan with a PacketDecoder.
+ */
+class ProfileScanBatcher {
+   public:
+    /**
+     * @param[in] info sensor metadata.
+     * @param[in] field_types fields of the target lidar scans.
+     * @param[in] scans number of target scans batched into in turn, e.g. the
+     * lidar scans of a ring.
+     * @param[in] use_avx2 see PacketDecoder.
+     */
+    ProfileScanBatcher(const ouster::sdk::core::SensorInfo& info,
+                       const ouster::sdk::core::LidarScanFieldTypes& field_types,
+                       size_t scans, bool use_avx2 = true)
+        : pf(ouster::sdk::core::get_format(info)),
+          decoder(info, field_types, use_avx2),
+          batcher(info),
+          cache(pf.lidar_packet_size),
+          written(info.format.columns_per_frame, 0) {
+        const auto batched_fields =
+            remaining_fields(field_types, decoder.specialized_fields());
+        // allocated upfront, the receive thread only picks from them
+        batched.reserve(scans);
+        for (size_t i = 0; i < scans; ++i)
+            batched.emplace_back(
+                nullptr, std::make_unique<ouster::sdk::core::LidarScan>(
+                             info.format.columns_per_frame,
+                             info.format.pixels_per_column, batched_fields,
+                             info.format.columns_per_packet));
+    }
+
+    const std::vector<std::string>& specialized_fields() const {
+        return decoder.specialized_fields();
+    }
+
+    const char* implementation() const { return decoder.implementation(); }
+
+    // bytes held by the scans the ScanBatcher batches into
+    size_t memory_bytes() const {
+        size_t bytes = 0;
+        for (const auto& b : batched) {
+            const auto& ls = *b.second;
+            bytes += ls.timestamp().size() * sizeof(uint64_t) +
+                     ls.measurement_id().size() * sizeof(uint16_t) +
+                     ls.status().size() * sizeof(uint32_t);
+            for (const auto& f : ls.fields()) bytes += f.second.bytes();
+        }
+        return bytes;
+    }
+
+    /**
+     * Same contract as ScanBatcher::operator(): returns true when the packet
+     * completes the scan, a packet of the next frame is kept and batched into
+     * the scan passed to the next call. A scan whose frame_id was reset to -1
+     * starts over with the packet.
+     */
+    bool operator()(const ouster::sdk::core::LidarPacket& packet,
+                    ouster::sdk::core::LidarScan& ls) {
+        auto& batched = batched_scan(ls);
+        if (ls.frame_id == -1 && batched.frame_id != -1) {
+            batched.frame_id = -1;
+            std::fill(written.begin(), written.end(), 0);
+        }
+        // the ScanBatcher batches the packet it kept first as well
+        if (cached) {
+            decoder.decode(cache.data(), ls, written);
+            cached = false;
+        }
+        const bool completed = batcher(packet, batched);
+        // the other headers are copied once the scan completes
+        ls.frame_id = batched.frame_id;
+        // packets of the previous frame are dropped by the ScanBatcher
+        const bool accepted = static_cast<int64_t>(pf.frame_id(
+                                  packet.buf.data())) == batched.frame_id;
+        if (accepted) decoder.decode(packet.buf.data(), ls, written);
+        if (!completed) return false;
+
+        if (!accepted) {
+            std::copy(packet.buf.begin(), packet.buf.end(), cache.begin());
+            cached = true;
+        }
+        finish(batched, ls);
+        return true;
+    }
+
+    /**
+     * Completes ls with the packets batched so far, for a scan completed
+     * before the first packet of the next frame arrived.
+     */
+    void complete(ouster::sdk::core::LidarScan& ls) {
+        finish(batched_scan(ls), ls);
+    }
+
+   private:
+    static ouster::sdk::core::LidarScanFieldTypes remaining_fields(
+        ouster::sdk::core::LidarScanFieldTypes field_types,
+        const std::vector<std::string>& specialized) {
+        field_types.erase(
+            std::remove_if(field_types.begin(), field_types.end(),
+                           [&specialized](const auto& ft) {
+                               return std::find(specialized.begin(),
+                                                specialized.end(),
+                                                ft.name) != specialized.end();
+                           }),
+            field_types.end());
+        return field_types;
+    }
+
+    /**
+     * The scan the ScanBatcher batches into in place of ls. Every target scan
+     * gets its own, so the headers the ScanBatcher leaves untouched, e.g. of
+     * missing packets, hold the same values as with the ScanBatcher alone.
+     */
+    ouster::sdk::core::LidarScan& batched_scan(
+        const ouster::sdk::core::LidarScan& ls) {
+        for (auto& b : batched) {
+            if (b.first == &ls) return *b.second;
+            if (b.first) continue;
+            b.first = &ls;
+            return *b.second;
+        }
+        throw std::logic_error(
+            "more target scans than the ProfileScanBatcher was created for");
+    }
+
+    void finish(const ouster::sdk::core::LidarScan& batched,
+                ouster::sdk::core::LidarScan& ls) {
+        decoder.zero_missing(ls, written);
+        std::fill(written.begin(), written.end(), 0);
+        copy_batched(batched, ls);
+    }
+
+    static void copy_batched(const ouster::sdk::core::LidarScan& batched,
+                             ouster::sdk::core::LidarScan& ls) {
+        ls.frame_id = batched.frame_id;
+        ls.frame_status = batched.frame_status;
+        ls.shutdown_countdown = batched.shutdown_countdown;
+        ls.shot_limiting_countdown = batched.shot_limiting_countdown;
+        ls.timestamp() = batched.timestamp();
+        ls.measurement_id() = batched.measurement_id();
+        ls.status() = batched.status();
+        ls.packet_timestamp() = batched.packet_timestamp();
+        ls.alert_flags() = batched.alert_flags();
+        for (const auto& f : batched.fields())
+            std::memcpy(ls.field(f.first).get(), f.second.get(),
+                        f.second.bytes());
+    }
+
+    const ouster::sdk::core::PacketFormat& pf;
+    PacketDecoder decoder;
+    ouster::sdk::core::ScanBatcher batcher;
+    // headers and fields without a kernel of each target scan, in the order
+    // the target scans were first seen
+    std::vector<std::pair<const ouster::sdk::core::LidarScan*,
+                          std::unique_ptr<ouster::sdk::core::LidarScan>>>
+        batched;
+    std::vector<uint8_t> cache;
+    bool cached = false;
+    std::vector<uint8_t> written;
+};
+
+}  // namespace ouster_ros
@@ -0,0 +1,188 @@
+/**
+ * Copyright (c) 2018-2024, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file packet_subscriber.h
+ * @brief Subscribes to raw packet topics regardless of whether they carry
+ * PacketMsg or StampedPacketMsg, or takes the packets from the shared memory
+ * ring os_sensor fans them out through
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <ros/ros.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ouster_ros/PacketMsg.h"
+#include "ouster_ros/StampedPacketMsg.h"
+#include "ouster_ros/shm_packet_ring.h"
+
+namespace ouster_ros {
+
+/**
+ * Invoked with the packet payload and the time at which the driver received
+ * it in nanoseconds.
+ */
+using PacketCallback =
+    std::function<void(const std::vector<uint8_t>& buf, uint64_t receive_ts)>;
+
+/**
+ * Subscribes to a packet topic published by os_sensor/os_pcap. When stamped is
+ * set the topic is expected to carry StampedPacketMsg and the receive time of
+ * the driver is passed through to the callback, gaps in the sequence numbers
+ * are reported as lost packets. Otherwise the topic carries the plain
+ * PacketMsg and the packet is stamped with the time the callback runs.
+ */
+inline ros::Subscriber subscribe_packets(ros::NodeHandle& nh,
+                                         const std::string& topic,
+                                         uint32_t queue_size, bool stamped,
+                                         PacketCallback callback) {
+    if (!stamped) {
+        return nh.subscribe<PacketMsg>(
+            topic, queue_size, [callback](const PacketMsg::ConstPtr msg) {
+                callback(msg->buf,
+                         static_cast<uint64_t>(ros::Time::now().toNSec()));
+            });
+    }
+
+    auto last_seq = std::make_shared<uint64_t>(0);
+    return nh.subscribe<StampedPacketMsg>(
+        topic, queue_size,
+        [callback, last_seq, topic](const StampedPacketMsg::ConstPtr msg) {
+            if (*last_seq != 0 && msg->seq > *last_seq + 1) {
+                ROS_WARN_STREAM_THROTTLE(
+                    1, topic << ": lost " << (msg->seq - *last_seq - 1)
+                             << " packets between the driver and this node");
+            }
+            *last_seq = msg->seq;
+            callback(msg->buf, msg->receive_stamp.toNSec());
+        });
+}
+
+/**
+ * Takes the packets of a topic from the shared memory ring of the os_sensor
+ * publishing it with packet_fanout set, instead of subscribing to the topic.
+ * The callback runs on a dedicated thread with the receive time of os_sensor.
+ * The ring is attached whenever it shows up, and again after os_sensor
+ * restarts or the ring stays idle, so consumers may start before or after
+ * os_sensor. Packets overwritten before they were read are reported as lost.
+ */
+class PacketFanoutSubscriber {
+   public:
+    // topic is resolved against nh the way a subscription would be
+    PacketFanoutSubscriber(ros::NodeHandle& nh, const std::string& topic,
+                           PacketCallback callback)
+        : topic_(nh.resolveName(topic)),
+          name_(shm::packet_ring_name(topic_)),
+          callback_(std::move(callback)) {
+        thread_ = std::thread([this]() {
+            pthread_setname_np(pthread_self(), "os_fanout_recv");
+            run();
+        });
+    }
+
+    PacketFanoutSubscriber(const PacketFanoutSubscriber&) = delete;
+    PacketFanoutSubscriber& operator=(const PacketFanoutSubscriber&) = delete;
+
+    ~PacketFanoutSubscriber() {
+        active_ = false;
+        thread_.join();
+    }
+
+    /**
+     * Holds the callback back for as long as the lock is held, e.g. while the
+     * state it relies on is replaced.
+     */
+    std::unique_lock<std::mutex> pause() {
+        return std::unique_lock<std::mutex>(callback_mutex_);
+    }
+
+   private:
+    void run() {
+        using namespace std::chrono;
+        std::vector<uint8_t> buf;
+        uint64_t host_timestamp;
+        auto last_packet = steady_clock::now();
+        uint64_t reported_lost = 0;
+        bool announce = true;
+        while (active_) {
+            if (!reader_.attached()) {
+                if (!reader_.attach(name_)) {
+                    std::this_thread::sleep_for(ATTACH_INTERVAL);
+                    continue;
+                }
+                if (announce) {
+                    ROS_INFO_STREAM(topic_ << ": attached to packet ring "
+                                           << name_);
+                }
+                announce = false;
+                last_packet = steady_clock::now();
+                reported_lost = 0;
+            }
+            if (reader_.read(buf, host_timestamp)) {
+                last_packet = steady_clock::now();
+                if (reader_.lost() != reported_lost) {
+                    ROS_WARN_STREAM_THROTTLE(
+                        1, topic_ << ": lost "
+                                  << (reader_.lost() - reported_lost)
+                                  << " packets overwritten in the ring before "
+                                  << "this node read them");
+                    reported_lost = reader_.lost();
+                }
+                std::lock_guard<std::mutex> lock(callback_mutex_);
+                callback_(buf, host_timestamp);
+                continue;
+            }
+            if (reader_.closed()) {
+                reader_.detach();
+                announce = true;
+                continue;
+            }
+            // sleeps until the writer signals the next packet
+            if (reader_.wait(WAIT_TIMEOUT)) continue;
+            // a ring left behind by a crashed os_sensor never closes
+            if (!reader_.writer_alive()) {
+                ROS_WARN_STREAM(topic_ << ": the writer of packet ring "
+                                       << name_ << " is gone");
+                reader_.detach();
+                announce = true;
+                continue;
+            }
+            // the writer can't be checked from another pid namespace
+            if (steady_clock::now() - last_packet > IDLE_TIMEOUT) {
+                reader_.detach();
+                continue;
+            }
+        }
+    }
+
+    // bounds the time it takes to notice a crashed writer and to stop
+    static constexpr std::chrono::milliseconds WAIT_TIMEOUT{100};
+    static constexpr std::chrono::milliseconds ATTACH_INTERVAL{100};
+    static constexpr std::chrono::seconds IDLE_TIMEOUT{1};
+
+    const std::string topic_;
+    const std::string name_;
+    PacketCallback callback_;
+    ShmPacketRingReader reader_;
+    std::mutex callback_mutex_;
+    std::atomic<bool> active_{true};
+    std::thread thread_;
+};
+
+// holds back the callback of subscriber if there is one
+inline std::unique_lock<std::mutex> pause_fanout(
+    const std::unique_ptr<PacketFanoutSubscriber>& subscriber) {
+    return subscriber ? subscriber->pause() : std::unique_lock<std::mutex>();
+}
+
+}  // namespace ouster_ros
@@ -0,0 +1,215 @@
+/**
+ * Copyright (c) 2018-2024, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file perf_counters.h
+ * @brief Optional hardware performance counter sampling of pipeline stages
+ *
+ * The instrumentation is only active when the package is built with the
+ * ENABLE_PERF_COUNTERS cmake option, otherwise all the types defined here are
+ * empty and every call is an inline no-op that compiles to nothing.
+ */
+
+#pragma once
+
+#include <ros/console.h>
+
+#include <cstdint>
+
+#ifdef OUSTER_ROS_PERF_COUNTERS
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <array>
+#include <cstring>
+#endif
+
+namespace ouster_ros {
+namespace perf {
+
+/**
+ * Values of the sampled hardware counters.
+ */
+struct Sample {
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+    uint64_t cache_misses = 0;
+    uint64_t branch_misses = 0;
+};
+
+#ifdef OUSTER_ROS_PERF_COUNTERS
+
+/**
+ * A group of hardware counters (cycles, instructions, cache misses and branch
+ * misses) that measure the calling thread. The counters of a group are
+ * scheduled together by the kernel so they can be read atomically.
+ */
+class CounterGroup {
+   public:
+    CounterGroup() {
+        static constexpr std::array<uint64_t, COUNTERS> configs{
+            PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+        fds.fill(-1);
+        for (size_t i = 0; i < COUNTERS; ++i) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.size = sizeof(attr);
+            attr.config = configs[i];
+            attr.disabled = i == 0 ? 1 : 0;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP;
+            fds[i] = static_cast<int>(
+                syscall(__NR_perf_event_open, &attr, 0, -1,
+                        i == 0 ? -1 : fds[0], 0));
+            if (fds[i] < 0) {
+                ROS_WARN_STREAM_ONCE(
+                    "perf_event_open failed, hardware counters are not "
+                    "available (check /proc/sys/kernel/perf_event_paranoid)");
+                close_all();
+                return;
+            }
+        }
+        ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+
+    CounterGroup(const CounterGroup&) = delete;
+    CounterGroup& operator=(const CounterGroup&) = delete;
+
+    ~CounterGroup() { close_all(); }
+
+    bool valid() const { return fds[0] >= 0; }
+
+    bool read(Sample& sample) const {
+        if (!valid()) return false;
+        struct {
+            uint64_t nr;
+            uint64_t values[COUNTERS];
+        } data;
+        if (::read(fds[0], &data, sizeof(data)) != sizeof(data)) return false;
+        sample.cycles = data.values[0];
+        sample.instructions = data.values[1];
+        sample.cache_misses = data.values[2];
+        sample.branch_misses = data.values[3];
+        return true;
+    }
+
+    /**
+     * perf counters only measure the thread that opened them, so each thread
+     * gets its own group.
+     */
+    static const CounterGroup& this_thread() {
+        thread_local CounterGroup group;
+        return group;
+    }
+
+   private:
+    void close_all() {
+        for (auto& fd : fds) {
+            if (fd >= 0) close(fd);
+            fd = -1;
+        }
+    }
+
+    static constexpr size_t COUNTERS = 4;
+    std::array<int, COUNTERS> fds;
+};
+
+/**
+ * Accumulates the counters sampled over one pipeline stage.
+ */
+class Stage {
+   public:
+    explicit Stage(const char* name) : name_(name) {}
+
+    void add(const Sample& begin, const Sample& end) {
+        total.cycles += end.cycles - begin.cycles;
+        total.instructions += end.instructions - begin.instructions;
+        total.cache_misses += end.cache_misses - begin.cache_misses;
+        total.branch_misses += end.branch_misses - begin.branch_misses;
+        ++samples;
+    }
+
+    /**
+     * Logs the counters accumulated since the last report then resets them.
+     * Enable the debug level of the ros.ouster_ros.perf logger to see these.
+     */
+    void report() {
+        if (samples == 0) return;
+        const double ipc =
+            total.cycles ? double(total.instructions) / total.cycles : 0.0;
+        ROS_DEBUG_NAMED("perf",
+                        "%s: cycles=%lu instructions=%lu ipc=%.2f "
+                        "cache_misses=%lu branch_misses=%lu samples=%zu",
+                        name_, static_cast<unsigned long>(total.cycles),
+                        static_cast<unsigned long>(total.instructions), ipc,
+                        static_cast<unsigned long>(total.cache_misses),
+                        static_cast<unsigned long>(total.branch_misses),
+                        samples);
+        total = Sample{};
+        samples = 0;
+    }
+
+   private:
+    const char* name_;
+    Sample total;
+    size_t samples = 0;
+};
+
+/**
+ * Samples the counters of the calling thread at construction and destruction
+ * and adds the difference to the given stage.
+ */
+class ScopedStage {
+   public:
+    explicit ScopedStage(Stage& stage) : stage_(stage) {
+        active = CounterGroup::this_thread().read(begin);
+    }
+
+    ~ScopedStage() {
+        Sample end;
+        if (active && CounterGroup::this_thread().read(end))
+            stage_.add(begin, end);
+    }
+
+    ScopedStage(const ScopedStage&) = delete;
+    ScopedStage& operator=(const ScopedStage&) = delete;
+
+   private:
+    Stage& stage_;
+    Sample begin;
+    bool active = false;
+};
+
+#else
+
+class Stage {
+   public:
+    explicit Stage(const char*) {}
+    void report() {}
+};
+
+class ScopedStage {
+   public:
+    explicit ScopedStage(Stage&) {}
+};
+
+#endif
+
+}  // namespace perf
+}  // namespace ouster_ros
+
+#define OUSTER_ROS_PERF_CONCAT_(a, b) a##b
+#define OUSTER_ROS_PERF_CONCAT(a, b) OUSTER_ROS_PERF_CONCAT_(a, b)
+
+/**
+ * Samples the hardware counters over the rest of the enclosing scope and
+ * accumulates them into the supplied perf::Stage object.
+ */
+#define OUSTER_ROS_PERF_SCOPE(stage) \
+    ::ouster_ros::perf::ScopedStage OUSTER_ROS_PERF_CONCAT(perf_scope_, __LINE__)(stage)
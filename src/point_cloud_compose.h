@@ -12,32 +12,6 @@
 
 namespace ouster_ros {
 
-using ouster::sdk::core::ChanFieldType;
-
-template <ChanFieldType T>
-struct TypeSelector { /*undefined*/
-};
-
-template <>
-struct TypeSelector<ChanFieldType::UINT8> {
-    typedef uint8_t type;
-};
-
-template <>
-struct TypeSelector<ChanFieldType::UINT16> {
-    typedef uint16_t type;
-};
-
-template <>
-struct TypeSelector<ChanFieldType::UINT32> {
-    typedef uint32_t type;
-};
-
-template <>
-struct TypeSelector<ChanFieldType::UINT64> {
-    typedef uint64_t type;
-};
-
 /**
  * @brief constructs a suitable tuple at compile time that can store a reference
  * to all the fields of a specific LidarScan object (without conversion)
@@ -14,17 +14,35 @@
 #include "ouster_ros/os_ros.h"
 // clang-format on
 
+#include <cstring>
+#include <stdexcept>
+
 #include <ouster/xyzlut.h>
+#include "adaptive_quality.h"
+#include "async_publisher.h"
 #include "point_cloud_compose.h"
 #include "lidar_packet_handler.h"
+#include "memory_budget.h"
+#include "memory_pinning.h"
+#include "ouster_ros/lidar_scan_plugin.h"
 #include "impl/cartesian.h"
+#include "perf_counters.h"
+#include "scan_columns_observers.h"
+#include "tracepoints.h"
 
 namespace ouster_ros {
 
 // Moved out of PointCloudProcessor to avoid type templatization
+// One entry per return, under a memory budget the returns of multi return
+// profiles are handed over one at a time and the other entries are null.
 using PointCloudProcessor_OutputType =
     std::vector<std::shared_ptr<sensor_msgs::PointCloud2>>;
-using PointCloudProcessor_PostProcessingFn = std::function<void(PointCloudProcessor_OutputType)>;
+using PointCloudProcessor_PostProcessingFn =
+    std::function<void(const PointCloudProcessor_OutputType&)>;
+// One entry per return telling whether anybody consumes its point cloud, the
+// returns that aren't wanted are neither computed nor handed over. An empty
+// list computes every return.
+using PointCloudProcessor_ReturnsWanted = std::vector<std::function<bool()>>;
 
 
 template <class PointT>
@@ -34,7 +52,7 @@ class PointCloudProcessor {
                                         const ouster::sdk::core::PointCloudXYZf& points,
                                         uint64_t scan_ts, const ouster::sdk::core::LidarScan& ls,
                                         const std::vector<int>& pixel_shift_by_row,
-                                        int return_index)>;
+                                        int return_index, int rows_step)>;
 
    public:
     PointCloudProcessor(const ouster::sdk::core::SensorInfo& info,
@@ -43,17 +61,43 @@ class PointCloudProcessor {
                         uint32_t min_range, uint32_t max_range,
                         int rows_step, const std::string& mask_path,
                         ScanToCloudFn scan_to_cloud_fn_,
-                        PointCloudProcessor_PostProcessingFn post_processing_fn_)
+                        PointCloudProcessor_PostProcessingFn post_processing_fn_,
+                        const memory::BufferPinning& pinning = {},
+                        memory::MemoryBudget* budget = nullptr,
+                        std::shared_ptr<LidarScanProducts> products = nullptr,
+                        std::shared_ptr<const AdaptiveQuality> quality = nullptr,
+                        PointCloudProcessor_ReturnsWanted returns_wanted = {},
+                        size_t incremental_xyz_scans = 0)
         : frame(frame_id),
           pixel_shift_by_row(info.format.pixel_shift_by_row),
           cloud{info.format.columns_per_frame,
                 info.format.pixels_per_column / rows_step},
+          sensor_columns(info.format.columns_per_frame),
+          sensor_rows(info.format.pixels_per_column),
+          rows_step_(rows_step), cloud_rows_step(rows_step),
+          quality_(quality),
           min_range_(min_range), max_range_(max_range),
           pc_msgs(info.num_returns()),
+          published_msgs(info.num_returns()),
+          returns_wanted_(std::move(returns_wanted)),
+          share_xyz(products != nullptr),
           scan_to_cloud_fn(scan_to_cloud_fn_),
-          post_processing_fn(post_processing_fn_) {
-        for (size_t i = 0; i < pc_msgs.size(); ++i)
-            pc_msgs[i] = std::make_shared<sensor_msgs::PointCloud2>();
+          post_processing_fn(post_processing_fn_),
+          pinned_buffers(pinning) {
+        const bool compact = budget && budget->limited();
+        // reserve enough room to hold a fully populated cloud so that the
+        // serialization step never reallocates on a per scan basis
+        if (compact && pc_msgs.size() > 1) {
+            // returns are serialized and handed over one at a time through a
+            // single message, pc_msgs only holds it while it is being handed
+            shared_msg = std::make_shared<sensor_msgs::PointCloud2>();
+            shared_msg->data.reserve(cloud.size() * sizeof(PointT));
+        } else {
+            for (size_t i = 0; i < pc_msgs.size(); ++i) {
+                pc_msgs[i] = std::make_shared<sensor_msgs::PointCloud2>();
+                pc_msgs[i]->data.reserve(cloud.size() * sizeof(PointT));
+            }
+        }
         ouster::sdk::core::mat4d additional_transform =
             apply_lidar_to_sensor_transform ? info.lidar_to_sensor_transform
                                             : ouster::sdk::core::mat4d::Identity();
@@ -62,47 +106,399 @@ class PointCloudProcessor {
             ouster::sdk::core::RANGE_UNIT, info.beam_to_lidar_transform,
             additional_transform, info.beam_azimuth_angles,
             info.beam_altitude_angles);
-        // The ouster_ros drive currently only uses single precision when it
-        // produces the point cloud. So it isn't of a benefit to compute point
-        // cloud xyz coordinates using double precision (for the time being).
-        lut_direction = xyz_lut.direction.cast<float>();
-        lut_offset = xyz_lut.offset.cast<float>();
-        points = ouster::sdk::core::PointCloudXYZf(lut_direction.rows(), lut_offset.cols());
-
+        if (compact) {
+            compact_lut = ouster::make_compact_xyz_lut<float>(
+                xyz_lut, info.format.columns_per_frame,
+                info.format.pixels_per_column);
+            if (!compact_lut)
+                ROS_WARN("the xyz lut of the sensor can't be compacted, "
+                         "falling back to the full lut");
+        }
+        if (!compact_lut) {
+            // The ouster_ros drive currently only uses single precision when
+            // it produces the point cloud. So it isn't of a benefit to compute
+            // point cloud xyz coordinates using double precision (for the
+            // time being).
+            lut_direction = xyz_lut.direction.cast<float>();
+            lut_offset = xyz_lut.offset.cast<float>();
+        }
         mask = impl::load_mask<uint32_t>(
             mask_path,
             info.format.pixels_per_column / rows_step,
             info.format.columns_per_frame);
+
+        incremental_xyz_ =
+            incremental_xyz_scans > 0 && incremental_xyz_supported(budget);
+        products_ = products;
+        if (incremental_xyz_) {
+            ROS_INFO("computing the point cloud xyz as the packets arrive");
+            // the coordinates of every scan of the ring, claimed by the scans
+            // as their first packet is observed
+            scans_xyz.resize(incremental_xyz_scans);
+            for (auto& s : scans_xyz) {
+                s.points.resize(pc_msgs.size());
+                s.computed.resize(pc_msgs.size());
+                for (auto& p : s.points)
+                    p = ouster::sdk::core::PointCloudXYZf(sensor_pixels(), 3);
+                for (auto& c : s.computed) c.assign(sensor_columns, 0);
+            }
+        } else {
+            // the coordinates of every return are kept around when shared
+            // with the scan plugins, otherwise all returns go through one
+            // buffer
+            points.resize(products ? pc_msgs.size() : 1);
+            for (auto& p : points)
+                p = ouster::sdk::core::PointCloudXYZf(
+                    xyz_lut.direction.rows(), 3);
+            if (mask.size() != 0)
+                masked_range.resize(mask.rows(), mask.cols());
+        }
+
+        if (budget) {
+            budget->account("point cloud xyz lut",
+                            compact_lut ? compact_lut->bytes()
+                                        : (lut_direction.size() +
+                                           lut_offset.size()) * sizeof(float));
+            budget->account("point cloud xyz",
+                            points.size() * sensor_pixels() * 3 *
+                                sizeof(float));
+            size_t incremental_bytes = 0;
+            for (const auto& s : scans_xyz)
+                incremental_bytes += s.points.size() * sensor_pixels() * 3 *
+                                         sizeof(float) +
+                                     s.computed.size() * sensor_columns;
+            budget->account("point cloud incremental xyz", incremental_bytes);
+            budget->account("point cloud",
+                            cloud.points.capacity() * sizeof(PointT));
+            size_t msg_bytes = shared_msg ? shared_msg->data.capacity() : 0;
+            for (const auto& msg : pc_msgs)
+                if (msg) msg_bytes += msg->data.capacity();
+            budget->account("point cloud msgs", msg_bytes);
+            if (budget->async_publish())
+                budget->account("point cloud async msgs",
+                                AsyncPublisher::spare_msgs(pc_msgs.size()) *
+                                    cloud.size() * sizeof(PointT));
+            budget->account("point cloud mask",
+                            (mask.size() + masked_range.size()) *
+                                sizeof(uint32_t));
+        }
+
+        if (pinning.enabled()) {
+            pinned_buffers.pin_container(lut_direction);
+            pinned_buffers.pin_container(lut_offset);
+            for (const auto& p : points) pinned_buffers.pin_container(p);
+            for (const auto& s : scans_xyz)
+                for (const auto& p : s.points) pinned_buffers.pin_container(p);
+            pinned_buffers.pin_container(cloud.points);
+            pinned_buffers.pin_container(masked_range);
+            for (const auto& msg : pc_msgs)
+                if (msg) pinned_buffers.pin(msg->data.data(), msg->data.capacity());
+            if (shared_msg)
+                pinned_buffers.pin(shared_msg->data.data(),
+                                   shared_msg->data.capacity());
+            ROS_INFO_STREAM("pinned " << pinned_buffers.pinned_bytes()
+                                      << " bytes of point cloud buffers");
+        }
     }
 
    private:
+    /**
+     * Serializes the pcl cloud directly into the ROS message, this skips the
+     * intermediate pcl::PCLPointCloud2 copy and reuses the message buffers.
+     */
     template <typename T>
     void pcl_toROSMsg(const ouster_ros::Cloud<T>& pcl_cloud,
                       sensor_msgs::PointCloud2& cloud) {
-        // TODO: remove the staging step in the future
-        pcl::toPCLPointCloud2(pcl_cloud, staging_pcl_pc2);
-        pcl_conversions::moveFromPCL(staging_pcl_pc2, cloud);
+        if (cloud.fields.empty()) {
+            // the field layout is fixed per point type, compute it only once
+            std::vector<pcl::PCLPointField> pcl_fields;
+            pcl::for_each_type<typename pcl::traits::fieldList<T>::type>(
+                pcl::detail::FieldAdder<T>(pcl_fields));
+            pcl_conversions::fromPCL(pcl_fields, cloud.fields);
+        }
+
+        if (pcl_cloud.width == 0 && pcl_cloud.height == 0) {
+            cloud.width = static_cast<uint32_t>(pcl_cloud.size());
+            cloud.height = 1;
+        } else {
+            cloud.width = pcl_cloud.width;
+            cloud.height = pcl_cloud.height;
+        }
+        cloud.is_bigendian = false;
+        cloud.point_step = sizeof(T);
+        cloud.row_step = sizeof(T) * cloud.width;
+        cloud.is_dense = pcl_cloud.is_dense;
+
+        const size_t data_size = sizeof(T) * pcl_cloud.size();
+        cloud.data.resize(data_size);
+        if (data_size)
+            std::memcpy(cloud.data.data(), pcl_cloud.points.data(), data_size);
+    }
+
+    // rows_step combined with the row decimation of the adaptive quality
+    int effective_rows_step() const {
+        if (!quality_) return rows_step_;
+        // keep at least one row
+        int step = rows_step_ * quality_->row_decimation();
+        while (step > rows_step_ && sensor_rows / step == 0) step /= 2;
+        return step;
+    }
+
+    /**
+     * Reshapes an organized cloud to the rows kept by rows_step, the points
+     * stay within the capacity reserved at construction.
+     */
+    void reshape_cloud(int rows_step) {
+        if (rows_step == cloud_rows_step) return;
+        cloud_rows_step = rows_step;
+        const auto rows = static_cast<uint32_t>(sensor_rows / rows_step);
+        cloud.points.resize(size_t(sensor_columns) * rows);
+        cloud.width = sensor_columns;
+        cloud.height = rows;
+    }
+
+    size_t sensor_pixels() const {
+        return static_cast<size_t>(sensor_columns) * sensor_rows;
+    }
+
+    bool incremental_xyz_supported(const memory::MemoryBudget* budget) const {
+        if (budget && budget->limited()) {
+            ROS_WARN("incremental_xyz keeps the coordinates of every scan of "
+                     "the ring, it is disabled under a memory budget");
+            return false;
+        }
+        if (mask.size() != 0 &&
+            static_cast<size_t>(mask.size()) != sensor_pixels()) {
+            ROS_WARN("incremental_xyz needs a mask covering every beam, it is "
+                     "disabled with v_reduction");
+            return false;
+        }
+        return true;
+    }
+
+    // coordinates of a scan of the ring computed as its packets arrive
+    struct ScanXYZ {
+        // the scan of the ring holding the entry, null while unclaimed
+        const ouster::sdk::core::LidarScan* scan = nullptr;
+        int64_t frame_id = -1;
+        // one entry per return
+        std::vector<ouster::sdk::core::PointCloudXYZf> points;
+        // per return, whether each column of points is up to date
+        std::vector<std::vector<uint8_t>> computed;
+
+        void restart(int64_t id) {
+            frame_id = id;
+            for (auto& c : computed) std::fill(c.begin(), c.end(), 0);
+        }
+    };
+
+    /**
+     * Finds the coordinates of a scan of the ring, a scan claims one of the
+     * entries allocated upfront the first time one of its packets is
+     * observed.
+     */
+    ScanXYZ& scan_xyz(const ouster::sdk::core::LidarScan& ls) {
+        std::lock_guard<std::mutex> lock(scans_xyz_mutex);
+        ScanXYZ* unclaimed = nullptr;
+        for (auto& s : scans_xyz) {
+            if (s.scan == &ls) return s;
+            if (!s.scan && !unclaimed) unclaimed = &s;
+        }
+        if (!unclaimed)
+            throw std::logic_error(
+                "more scans observed than the ring of the observers holds");
+        unclaimed->scan = &ls;
+        return *unclaimed;
+    }
+
+    /**
+     * Converts the columns a packet was just batched into, invoked on the
+     * thread batching the packets while it holds the lock of the scan.
+     */
+    void observe_columns(const ouster::sdk::core::LidarScan& ls,
+                         size_t first_col, size_t cols) {
+        auto& s = scan_xyz(ls);
+        if (s.frame_id != ls.frame_id) s.restart(ls.frame_id);
+        for (int i = 0; i < static_cast<int>(s.points.size()); ++i) {
+            if (!share_xyz && !return_wanted(i)) continue;
+            auto range_channel = i == 0 ? ChanField::RANGE : ChanField::RANGE2;
+            cartesian_columns(s.points[i], ls.field<uint32_t>(range_channel),
+                              first_col, cols);
+            std::fill_n(s.computed[i].begin() + first_col, cols, 1);
+        }
+    }
+
+    /**
+     * Converts the columns of a completed scan no packet was observed for,
+     * e.g. those of missing packets or of returns that weren't wanted.
+     * @return the coordinates of the return.
+     */
+    const ouster::sdk::core::PointCloudXYZf& complete_scan_xyz(
+        ScanXYZ& s, const ouster::sdk::core::LidarScan& ls, int return_index) {
+        auto range_channel =
+            return_index == 0 ? ChanField::RANGE : ChanField::RANGE2;
+        auto range = ls.field<uint32_t>(range_channel);
+        auto& computed = s.computed[return_index];
+        auto& xyz = s.points[return_index];
+        for (size_t v = 0; v < computed.size();) {
+            if (computed[v]) {
+                ++v;
+                continue;
+            }
+            size_t end = v + 1;
+            while (end < computed.size() && !computed[end]) ++end;
+            cartesian_columns(xyz, range, v, end - v);
+            v = end;
+        }
+        return xyz;
     }
 
     void process(const ouster::sdk::core::LidarScan& lidar_scan, uint64_t scan_ts,
                  const ros::Time& msg_ts) {
+        const int rows_step = effective_rows_step();
+        reshape_cloud(rows_step);
+        ScanXYZ* incremental = nullptr;
+        if (incremental_xyz_) {
+            incremental = &scan_xyz(lidar_scan);
+            // a scan none of the packets were observed for
+            if (incremental->frame_id != lidar_scan.frame_id)
+                incremental->restart(lidar_scan.frame_id);
+            if (products_) {
+                products_->xyz.clear();
+                for (const auto& p : incremental->points)
+                    products_->xyz.push_back(&p);
+            }
+        }
+        // the coordinates are overwritten below, until then they are neither
+        // those of the previous scan nor those of this one
+        if (products_) products_->frame_id = -1;
+        bool any_wanted = false;
         for (int i = 0; i < static_cast<int>(pc_msgs.size()); ++i) {
-            auto range_channel = i == 0 ? ChanField::RANGE : ChanField::RANGE2;
-            auto range = lidar_scan.field<uint32_t>(range_channel);
-            auto range_masked = mask.size() != 0 ? range * mask : range;
-            ouster::cartesianT(points, range_masked, lut_direction, lut_offset,
+            const bool wanted = return_wanted(i);
+            any_wanted |= wanted;
+            published_msgs[i] = nullptr;
+            // the scan plugins consume the coordinates of every return
+            if (!wanted && !share_xyz) continue;
+
+            const ouster::sdk::core::PointCloudXYZf* points_of_return;
+            {
+                OUSTER_ROS_PERF_SCOPE(perf_cartesian);
+                if (incremental) {
+                    points_of_return =
+                        &complete_scan_xyz(*incremental, lidar_scan, i);
+                } else {
+                    auto range_channel =
+                        i == 0 ? ChanField::RANGE : ChanField::RANGE2;
+                    auto range = lidar_scan.field<uint32_t>(range_channel);
+                    auto& xyz = points[std::min<size_t>(i, points.size() - 1)];
+                    if (mask.size() != 0) {
+                        masked_range = range * mask;
+                        cartesian(xyz, masked_range);
+                    } else {
+                        cartesian(xyz, range);
+                    }
+                    points_of_return = &xyz;
+                }
+            }
+            if (!wanted) continue;
+            const auto& xyz = *points_of_return;
+
+            {
+                OUSTER_ROS_PERF_SCOPE(perf_compose);
+                scan_to_cloud_fn(cloud, xyz, scan_ts, lidar_scan,
+                                 pixel_shift_by_row, i, rows_step);
+            }
+
+            auto& msg = shared_msg ? shared_msg : pc_msgs[i];
+            {
+                OUSTER_ROS_PERF_SCOPE(perf_serialize);
+                pcl_toROSMsg(cloud, *msg);
+            }
+            msg->header.stamp = msg_ts;
+            msg->header.frame_id = frame;
+
+            if (shared_msg) {
+                // the other entries stay null, publishing serializes the
+                // message so its buffer can be reused by the next return
+                published_msgs[i] = shared_msg;
+                publish();
+                published_msgs[i] = nullptr;
+            } else {
+                published_msgs[i] = pc_msgs[i];
+            }
+        }
+
+        if (products_) {
+            products_->frame_id = lidar_scan.frame_id;
+            products_->scan_ts = scan_ts;
+        }
+
+        perf_cartesian.report();
+        perf_compose.report();
+        perf_serialize.report();
+
+        if (!shared_msg && any_wanted) publish();
+        // the slot of the ring is refilled with the next frames
+        if (incremental) incremental->restart(-1);
+    }
+
+    /**
+     * Points the products at the buffers of this processor, invoked on the
+     * processing thread once the processor is in service since the plugins
+     * read the products from that thread.
+     */
+    void bind_products() {
+        if (!products_) return;
+        products_->xyz.clear();
+        products_->frame_id = -1;
+        products_->scan_ts = 0;
+        // incremental coordinates are bound to the ring slot of each scan
+        if (incremental_xyz_) return;
+        for (const auto& p : points) products_->xyz.push_back(&p);
+    }
+
+    bool return_wanted(int return_index) const {
+        return returns_wanted_.empty() || returns_wanted_[return_index]();
+    }
+
+    template <typename RangeT>
+    void cartesian(ouster::sdk::core::PointCloudXYZf& xyz,
+                   const RangeT& range) {
+        if (compact_lut) {
+            ouster::cartesianT(xyz, range, *compact_lut, min_range_,
+                               max_range_,
+                               std::numeric_limits<float>::quiet_NaN());
+        } else {
+            ouster::cartesianT(xyz, range, lut_direction, lut_offset,
                                min_range_, max_range_,
                                std::numeric_limits<float>::quiet_NaN());
+        }
+    }
 
-            scan_to_cloud_fn(cloud, points, scan_ts, lidar_scan,
-                             pixel_shift_by_row, i);
-
-            pcl_toROSMsg(cloud, *pc_msgs[i]);
-            pc_msgs[i]->header.stamp = msg_ts;
-            pc_msgs[i]->header.frame_id = frame;
+    template <typename RangeT>
+    void cartesian_columns(ouster::sdk::core::PointCloudXYZf& xyz,
+                           const RangeT& range, size_t first_col,
+                           size_t cols) {
+        const uint32_t* mask_data = mask.size() != 0 ? mask.data() : nullptr;
+        if (compact_lut) {
+            ouster::cartesian_columnsT(
+                xyz, range, *compact_lut, min_range_, max_range_,
+                std::numeric_limits<float>::quiet_NaN(), first_col, cols,
+                mask_data);
+        } else {
+            ouster::cartesian_columnsT(
+                xyz, range, lut_direction, lut_offset, min_range_, max_range_,
+                std::numeric_limits<float>::quiet_NaN(), first_col, cols,
+                mask_data);
         }
+    }
 
-        if (post_processing_fn) post_processing_fn(pc_msgs);
+    void publish() {
+        OUSTER_ROS_TRACE2(publish_start, trace::current_handler(),
+                          trace::POINT_CLOUD);
+        if (post_processing_fn) post_processing_fn(published_msgs);
+        OUSTER_ROS_TRACE2(publish_end, trace::current_handler(),
+                          trace::POINT_CLOUD);
     }
 
    public:
@@ -112,11 +508,39 @@ class PointCloudProcessor {
                                      uint32_t min_range, uint32_t max_range,
                                      int rows_step, const std::string& mask_path,
                                      ScanToCloudFn scan_to_cloud_fn_,
-                                     PointCloudProcessor_PostProcessingFn post_processing_fn) {
+                                     PointCloudProcessor_PostProcessingFn post_processing_fn,
+                                     const memory::BufferPinning& pinning = {},
+                                     memory::MemoryBudget* budget = nullptr,
+                                     std::shared_ptr<LidarScanProducts> products = nullptr,
+                                     std::shared_ptr<const AdaptiveQuality> quality = nullptr,
+                                     PointCloudProcessor_ReturnsWanted returns_wanted = {},
+                                     std::shared_ptr<ScanColumnsObservers> column_observers = nullptr,
+                                     size_t processor_index = 0,
+                                     std::function<void()>* on_swap = nullptr) {
         auto handler = std::make_shared<PointCloudProcessor>(
             info, frame, apply_lidar_to_sensor_transform,
             min_range, max_range, rows_step, mask_path,
-            scan_to_cloud_fn_, post_processing_fn);
+            scan_to_cloud_fn_, post_processing_fn, pinning, budget, products,
+            quality, std::move(returns_wanted),
+            column_observers ? column_observers->scans() : 0);
+
+        if (column_observers) {
+            // also takes over from the processor this one was rebuilt from
+            ScanColumnsObservers::Observer observer;
+            if (handler->incremental_xyz_)
+                observer = [handler](const ouster::sdk::core::LidarScan& ls,
+                                     size_t first_col, size_t cols) {
+                    handler->observe_columns(ls, first_col, cols);
+                };
+            column_observers->set(processor_index, std::move(observer));
+        }
+
+        // a processor replacing a running one binds the products when it is
+        // swapped in, until then they belong to the processor it replaces
+        if (on_swap)
+            *on_swap = [handler]() { handler->bind_products(); };
+        else
+            handler->bind_products();
 
         return [handler](const ouster::sdk::core::LidarScan& lidar_scan, uint64_t scan_ts,
                          const ros::Time& msg_ts) {
@@ -125,24 +549,47 @@ class PointCloudProcessor {
     }
 
    private:
-    // a buffer used for staging during the conversion
-    // from a PCL point cloud to a ros point cloud message
-    pcl::PCLPointCloud2 staging_pcl_pc2;
-
     std::string frame;
 
     ouster::sdk::core::ArrayX3fR lut_direction;
     ouster::sdk::core::ArrayX3fR lut_offset;
-    ouster::sdk::core::PointCloudXYZf points;
+    // replaces lut_direction and lut_offset under a memory budget
+    std::optional<ouster::CompactXYZLut<float>> compact_lut;
+    std::vector<ouster::sdk::core::PointCloudXYZf> points;
     std::vector<int> pixel_shift_by_row;
     ouster_ros::Cloud<PointT> cloud;
+    uint32_t sensor_columns;
+    int sensor_rows;
+    // rows_step requested by the user and the one the cloud is shaped for
+    int rows_step_;
+    int cloud_rows_step;
+    std::shared_ptr<const AdaptiveQuality> quality_;
     uint32_t min_range_;
     uint32_t max_range_;
     PointCloudProcessor_OutputType pc_msgs;
+    // entries of pc_msgs handed over for this scan, null when not computed
+    PointCloudProcessor_OutputType published_msgs;
+    PointCloudProcessor_ReturnsWanted returns_wanted_;
+    bool share_xyz;
+    std::shared_ptr<sensor_msgs::PointCloud2> shared_msg;
+    std::shared_ptr<LidarScanProducts> products_;
+    // replaces points when the coordinates are computed as the packets arrive
+    bool incremental_xyz_ = false;
+    std::mutex scans_xyz_mutex;
+    std::vector<ScanXYZ> scans_xyz;
     ScanToCloudFn scan_to_cloud_fn;
     PointCloudProcessor_PostProcessingFn post_processing_fn;
 
     ouster::sdk::core::img_t<uint32_t> mask;
+    // preallocated buffer that holds the range after applying the mask
+    ouster::sdk::core::img_t<uint32_t> masked_range;
+
+    perf::Stage perf_cartesian{"cartesian"};
+    perf::Stage perf_compose{"compose"};
+    perf::Stage perf_serialize{"serialize"};
+
+    // declared last so the pages are unlocked before the buffers are released
+    memory::PinnedRegions pinned_buffers;
 };
 
 }  // namespace ouster_ros
\ No newline at end of file
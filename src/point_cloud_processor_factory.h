@@ -6,19 +6,39 @@ namespace ouster_ros {
 
 using ouster::sdk::core::UDPProfileLidar;
 
+// pcl::PointXYZ only needs the coordinates, which are computed from the range
+// field by the PointCloudProcessor, so no other field is read from the scan
+static constexpr ChanFieldTable<0> Profile_XYZ{{}};
+
 class PointCloudProcessorFactory {
     template <typename PointT>
     static typename PointCloudProcessor<PointT>::ScanToCloudFn
     make_scan_to_cloud_fn(const ouster::sdk::core::SensorInfo& info,
-                          bool organized, bool destagger, int rows_step) {
+                          bool organized, bool destagger) {
+        if constexpr (std::is_same_v<PointT, pcl::PointXYZ>) {
+            return [organized, destagger](
+                ouster_ros::Cloud<PointT>& cloud,
+                const ouster::sdk::core::PointCloudXYZf& points, uint64_t scan_ts,
+                const ouster::sdk::core::LidarScan& ls,
+                const std::vector<int>& pixel_shift_by_row,
+                int /*return_index*/, int rows_step) {
+
+                // any native point works for staging, only x, y, z are kept
+                Point_LEGACY staging_pt;
+                scan_to_cloud_f<Profile_XYZ.size(), Profile_XYZ>(
+                    cloud, staging_pt, points, scan_ts, ls,
+                    pixel_shift_by_row, organized, destagger, rows_step);
+            };
+        }
+
         switch (info.format.udp_profile_lidar) {
             case UDPProfileLidar::LEGACY:
-                return [organized, destagger, rows_step](
+                return [organized, destagger](
                     ouster_ros::Cloud<PointT>& cloud,
                     const ouster::sdk::core::PointCloudXYZf& points, uint64_t scan_ts,
                     const ouster::sdk::core::LidarScan& ls,
                     const std::vector<int>& pixel_shift_by_row,
-                    int /*return_index*/) {
+                    int /*return_index*/, int rows_step) {
 
                     Point_LEGACY staging_pt;
                     scan_to_cloud_f<Profile_LEGACY.size(), Profile_LEGACY>(
@@ -27,12 +47,12 @@ class PointCloudProcessorFactory {
                 };
 
             case UDPProfileLidar::RNG19_RFL8_SIG16_NIR16_DUAL:
-                return [organized, destagger, rows_step](
+                return [organized, destagger](
                     ouster_ros::Cloud<PointT>& cloud,
                     const ouster::sdk::core::PointCloudXYZf& points, uint64_t scan_ts,
                     const ouster::sdk::core::LidarScan& ls,
                     const std::vector<int>& pixel_shift_by_row,
-                    int return_index) {
+                    int return_index, int rows_step) {
 
                     Point_RNG19_RFL8_SIG16_NIR16_DUAL staging_pt;
                     if (return_index == 0) {
@@ -51,12 +71,12 @@ class PointCloudProcessorFactory {
                 };
 
             case UDPProfileLidar::RNG19_RFL8_SIG16_NIR16:
-                return [organized, destagger, rows_step](
+                return [organized, destagger](
                     ouster_ros::Cloud<PointT>& cloud,
                     const ouster::sdk::core::PointCloudXYZf& points, uint64_t scan_ts,
                     const ouster::sdk::core::LidarScan& ls,
                     const std::vector<int>& pixel_shift_by_row,
-                    int /*return_index*/) {
+                    int /*return_index*/, int rows_step) {
 
                     Point_RNG19_RFL8_SIG16_NIR16 staging_pt;
                     scan_to_cloud_f<
@@ -67,12 +87,12 @@ class PointCloudProcessorFactory {
                 };
 
             case UDPProfileLidar::RNG15_RFL8_NIR8:
-                return [organized, destagger, rows_step](
+                return [organized, destagger](
                     ouster_ros::Cloud<PointT>& cloud,
                     const ouster::sdk::core::PointCloudXYZf& points, uint64_t scan_ts,
                     const ouster::sdk::core::LidarScan& ls,
                     const std::vector<int>& pixel_shift_by_row,
-                    int /*return_index*/) {
+                    int /*return_index*/, int rows_step) {
 
                     Point_RNG15_RFL8_NIR8 staging_pt;
                     scan_to_cloud_f<
@@ -84,12 +104,12 @@ class PointCloudProcessorFactory {
 
             case UDPProfileLidar::FUSA_RNG15_RFL8_NIR8_DUAL:
             case UDPProfileLidar::RNG15_RFL8_NIR8_DUAL:
-                return [organized, destagger, rows_step](
+                return [organized, destagger](
                     ouster_ros::Cloud<PointT>& cloud,
                     const ouster::sdk::core::PointCloudXYZf& points, uint64_t scan_ts,
                     const ouster::sdk::core::LidarScan& ls,
                     const std::vector<int>& pixel_shift_by_row,
-                    int return_index) {
+                    int return_index, int rows_step) {
 
                     Point_RNG15_RFL8_NIR8_DUAL staging_pt;
                     if (return_index == 0) {
@@ -108,12 +128,12 @@ class PointCloudProcessorFactory {
                 };
 
             case UDPProfileLidar::RNG15_RFL8_WIN8:
-                return [organized, destagger, rows_step](
+                return [organized, destagger](
                     ouster_ros::Cloud<PointT>& cloud,
                     const ouster::sdk::core::PointCloudXYZf& points, uint64_t scan_ts,
                     const ouster::sdk::core::LidarScan& ls,
                     const std::vector<int>& pixel_shift_by_row,
-                    int /*return_index*/) {
+                    int /*return_index*/, int rows_step) {
 
                     Point_RNG15_RFL8_WIN8 staging_pt;
                     scan_to_cloud_f<
@@ -124,12 +144,12 @@ class PointCloudProcessorFactory {
                 };
 
             case UDPProfileLidar::RNG15_RFL8_NIR8_ZONE16:
-                return [organized, destagger, rows_step](
+                return [organized, destagger](
                     ouster_ros::Cloud<PointT>& cloud,
                     const ouster::sdk::core::PointCloudXYZf& points, uint64_t scan_ts,
                     const ouster::sdk::core::LidarScan& ls,
                     const std::vector<int>& pixel_shift_by_row,
-                    int /*return_index*/) {
+                    int /*return_index*/, int rows_step) {
 
                     Point_RNG15_RFL8_NIR8_ZONE16 staging_pt;
                     scan_to_cloud_f<
@@ -140,12 +160,12 @@ class PointCloudProcessorFactory {
                 };
 
             case UDPProfileLidar::RNG19_RFL8_SIG16_NIR16_ZONE16:
-                return [organized, destagger, rows_step](
+                return [organized, destagger](
                     ouster_ros::Cloud<PointT>& cloud,
                     const ouster::sdk::core::PointCloudXYZf& points, uint64_t scan_ts,
                     const ouster::sdk::core::LidarScan& ls,
                     const std::vector<int>& pixel_shift_by_row,
-                    int /*return_index*/) {
+                    int /*return_index*/, int rows_step) {
 
                     Point_RNG19_RFL8_SIG16_NIR16_ZONE16 staging_pt;
                     scan_to_cloud_f<
@@ -167,13 +187,27 @@ class PointCloudProcessorFactory {
         bool organized, bool destagger,
         uint32_t min_range, uint32_t max_range, int rows_step,
         const std::string& mask_path,
-        PointCloudProcessor_PostProcessingFn post_processing_fn) {
-        auto scan_to_cloud_fn = make_scan_to_cloud_fn<PointT>(
-            info, organized, destagger, rows_step);
+        PointCloudProcessor_PostProcessingFn post_processing_fn,
+        const memory::BufferPinning& pinning, memory::MemoryBudget* budget,
+        std::shared_ptr<LidarScanProducts> products,
+        std::shared_ptr<const AdaptiveQuality> quality,
+        PointCloudProcessor_ReturnsWanted returns_wanted,
+        std::shared_ptr<ScanColumnsObservers> column_observers,
+        size_t processor_index, std::function<void()>* on_swap) {
+        auto scan_to_cloud_fn =
+            make_scan_to_cloud_fn<PointT>(info, organized, destagger);
         return PointCloudProcessor<PointT>::create(
             info, frame, apply_lidar_to_sensor_transform,
             min_range, max_range, rows_step, mask_path,
-            scan_to_cloud_fn, post_processing_fn);
+            scan_to_cloud_fn, post_processing_fn, pinning, budget, products,
+            quality, std::move(returns_wanted), column_observers,
+            processor_index, on_swap);
+    }
+
+    template <std::size_t N>
+    static void append_fields(std::vector<std::string>& fields,
+                              const ChanFieldTable<N>& table) {
+        for (const auto& f : table) fields.emplace_back(f.first);
     }
 
    public:
@@ -189,59 +223,131 @@ class PointCloudProcessorFactory {
                profile == UDPProfileLidar::RNG19_RFL8_SIG16_NIR16_ZONE16;
     }
 
+    /**
+     * Lists the LidarScan fields read by a point cloud processor of the given
+     * point type, the range of each return is always needed for the xyz
+     * coordinates. The remaining fields are copied into the native point of
+     * the profile before being converted to the selected point type.
+     */
+    static std::vector<std::string> required_fields(
+        const std::string& point_type, const ouster::sdk::core::SensorInfo& info) {
+        using ouster::sdk::core::ChanField;
+        std::vector<std::string> fields{ChanField::RANGE};
+        if (info.num_returns() > 1) fields.emplace_back(ChanField::RANGE2);
+        if (point_type == "xyz") return fields;
+
+        switch (info.format.udp_profile_lidar) {
+            case UDPProfileLidar::LEGACY:
+                append_fields(fields, Profile_LEGACY);
+                break;
+            case UDPProfileLidar::RNG19_RFL8_SIG16_NIR16_DUAL:
+                append_fields(fields, Profile_RNG19_RFL8_SIG16_NIR16_DUAL);
+                append_fields(fields,
+                              Profile_RNG19_RFL8_SIG16_NIR16_DUAL_2ND_RETURN);
+                break;
+            case UDPProfileLidar::RNG19_RFL8_SIG16_NIR16:
+                append_fields(fields, Profile_RNG19_RFL8_SIG16_NIR16);
+                break;
+            case UDPProfileLidar::RNG15_RFL8_NIR8:
+                append_fields(fields, Profile_RNG15_RFL8_NIR8);
+                break;
+            case UDPProfileLidar::FUSA_RNG15_RFL8_NIR8_DUAL:
+            case UDPProfileLidar::RNG15_RFL8_NIR8_DUAL:
+                append_fields(fields, Profile_RNG15_RFL8_NIR8_DUAL);
+                append_fields(fields, Profile_RNG15_RFL8_NIR8_DUAL_2ND_RETURN);
+                break;
+            case UDPProfileLidar::RNG15_RFL8_WIN8:
+                append_fields(fields, Profile_RNG15_RFL8_WIN8);
+                break;
+            case UDPProfileLidar::RNG15_RFL8_NIR8_ZONE16:
+                append_fields(fields, Profile_RNG15_RFL8_NIR8_ZONE16);
+                break;
+            case UDPProfileLidar::RNG19_RFL8_SIG16_NIR16_ZONE16:
+                append_fields(fields, Profile_RNG19_RFL8_SIG16_NIR16_ZONE16);
+                break;
+            default:
+                throw std::runtime_error("unsupported udp_profile_lidar");
+        }
+        return fields;
+    }
+
     static LidarScanProcessor create_point_cloud_processor(
         const std::string& point_type, const ouster::sdk::core::SensorInfo& info,
         const std::string& frame, bool apply_lidar_to_sensor_transform,
         bool organized, bool destagger,
         uint32_t min_range, uint32_t max_range, int rows_step,
         const std::string& mask_path,
-        PointCloudProcessor_PostProcessingFn post_processing_fn) {
+        PointCloudProcessor_PostProcessingFn post_processing_fn,
+        const memory::BufferPinning& pinning = {},
+        memory::MemoryBudget* budget = nullptr,
+        std::shared_ptr<LidarScanProducts> products = nullptr,
+        std::shared_ptr<const AdaptiveQuality> quality = nullptr,
+        PointCloudProcessor_ReturnsWanted returns_wanted = {},
+        std::shared_ptr<ScanColumnsObservers> column_observers = nullptr,
+        size_t processor_index = 0,
+        std::function<void()>* on_swap = nullptr) {
         if (point_type == "native") {
             switch (info.format.udp_profile_lidar) {
                 case UDPProfileLidar::LEGACY:
                     return make_point_cloud_processor<Point_LEGACY>(
                         info, frame, apply_lidar_to_sensor_transform,
                         organized, destagger, min_range, max_range, rows_step,
-                        mask_path, post_processing_fn);
+                        mask_path, post_processing_fn, pinning, budget, products,
+                        quality, returns_wanted, column_observers,
+                        processor_index, on_swap);
                 case UDPProfileLidar::RNG19_RFL8_SIG16_NIR16_DUAL:
                     return make_point_cloud_processor<
                         Point_RNG19_RFL8_SIG16_NIR16_DUAL>(
                         info, frame, apply_lidar_to_sensor_transform,
                         organized, destagger, min_range, max_range, rows_step,
-                        mask_path, post_processing_fn);
+                        mask_path, post_processing_fn, pinning, budget, products,
+                        quality, returns_wanted, column_observers,
+                        processor_index, on_swap);
                 case UDPProfileLidar::RNG19_RFL8_SIG16_NIR16:
                     return make_point_cloud_processor<
                         Point_RNG19_RFL8_SIG16_NIR16>(
                         info, frame, apply_lidar_to_sensor_transform,
                         organized, destagger, min_range, max_range, rows_step,
-                        mask_path, post_processing_fn);
+                        mask_path, post_processing_fn, pinning, budget, products,
+                        quality, returns_wanted, column_observers,
+                        processor_index, on_swap);
                 case UDPProfileLidar::RNG15_RFL8_NIR8:
                     return make_point_cloud_processor<Point_RNG15_RFL8_NIR8>(
                         info, frame, apply_lidar_to_sensor_transform,
                         organized, destagger, min_range, max_range, rows_step,
-                        mask_path, post_processing_fn);
+                        mask_path, post_processing_fn, pinning, budget, products,
+                        quality, returns_wanted, column_observers,
+                        processor_index, on_swap);
                 case UDPProfileLidar::FUSA_RNG15_RFL8_NIR8_DUAL:
                 case UDPProfileLidar::RNG15_RFL8_NIR8_DUAL:
                     return make_point_cloud_processor<
                         Point_RNG15_RFL8_NIR8_DUAL>(
                         info, frame, apply_lidar_to_sensor_transform,
                         organized, destagger, min_range, max_range, rows_step,
-                        mask_path, post_processing_fn);
+                        mask_path, post_processing_fn, pinning, budget, products,
+                        quality, returns_wanted, column_observers,
+                        processor_index, on_swap);
                 case UDPProfileLidar::RNG15_RFL8_WIN8:
                     return make_point_cloud_processor<Point_RNG15_RFL8_WIN8>(
                         info, frame, apply_lidar_to_sensor_transform,
                         organized, destagger, min_range, max_range, rows_step,
-                        mask_path, post_processing_fn);
+                        mask_path, post_processing_fn, pinning, budget, products,
+                        quality, returns_wanted, column_observers,
+                        processor_index, on_swap);
                 case UDPProfileLidar::RNG15_RFL8_NIR8_ZONE16:
                     return make_point_cloud_processor<Point_RNG15_RFL8_NIR8_ZONE16>(
                         info, frame, apply_lidar_to_sensor_transform,
                         organized, destagger, min_range, max_range, rows_step,
-                        mask_path, post_processing_fn);
+                        mask_path, post_processing_fn, pinning, budget, products,
+                        quality, returns_wanted, column_observers,
+                        processor_index, on_swap);
                 case UDPProfileLidar::RNG19_RFL8_SIG16_NIR16_ZONE16:
                     return make_point_cloud_processor<Point_RNG19_RFL8_SIG16_NIR16_ZONE16>(
                         info, frame, apply_lidar_to_sensor_transform,
                         organized, destagger, min_range, max_range, rows_step,
-                        mask_path, post_processing_fn);
+                        mask_path, post_processing_fn, pinning, budget, products,
+                        quality, returns_wanted, column_observers,
+                        processor_index, on_swap);
                 default:
                     // TODO: implement fallback?
                     throw std::runtime_error("unsupported udp_profile_lidar");
@@ -250,27 +356,37 @@ class PointCloudProcessorFactory {
             return make_point_cloud_processor<pcl::PointXYZ>(
                 info, frame, apply_lidar_to_sensor_transform,
                 organized, destagger, min_range, max_range, rows_step,
-                mask_path, post_processing_fn);
+                mask_path, post_processing_fn, pinning, budget, products,
+                quality, returns_wanted, column_observers,
+                processor_index, on_swap);
         } else if (point_type == "xyzi") {
             return make_point_cloud_processor<pcl::PointXYZI>(
                 info, frame, apply_lidar_to_sensor_transform,
                 organized, destagger, min_range, max_range, rows_step,
-                mask_path, post_processing_fn);
+                mask_path, post_processing_fn, pinning, budget, products,
+                quality, returns_wanted, column_observers,
+                processor_index, on_swap);
         } else if (point_type == "o_xyzi") {
             return make_point_cloud_processor<ouster_ros::PointXYZI>(
                 info, frame, apply_lidar_to_sensor_transform,
                 organized, destagger, min_range, max_range, rows_step,
-                mask_path, post_processing_fn);
+                mask_path, post_processing_fn, pinning, budget, products,
+                quality, returns_wanted, column_observers,
+                processor_index, on_swap);
         } else if (point_type == "xyzir") {
             return make_point_cloud_processor<PointXYZIR>(
                 info, frame, apply_lidar_to_sensor_transform,
                 organized, destagger, min_range, max_range, rows_step,
-                mask_path, post_processing_fn);
+                mask_path, post_processing_fn, pinning, budget, products,
+                quality, returns_wanted, column_observers,
+                processor_index, on_swap);
         } else if (point_type == "original") {
             return make_point_cloud_processor<ouster_ros::Point>(
                 info, frame, apply_lidar_to_sensor_transform,
                 organized, destagger, min_range, max_range, rows_step,
-                mask_path, post_processing_fn);
+                mask_path, post_processing_fn, pinning, budget, products,
+                quality, returns_wanted, column_observers,
+                processor_index, on_swap);
         }
 
         throw std::runtime_error(
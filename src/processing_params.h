@@ -0,0 +1,219 @@
+/**
+ * Copyright (c) 2018-2024, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file processing_params.h
+ * @brief Processing params that can be changed while the pipeline is running
+ *
+ * The point cloud params (point_type, organized, destagger, min_range,
+ * max_range, v_reduction) and the mask_path are read again from the parameter
+ * server on request. ProcessingReconfigure rebuilds the processors affected by
+ * the changes on the calling thread and stages them in the ProcessorSwap of
+ * the LidarPacketHandler, which puts them in service in between two scans.
+ * Changes that need more than a new processor, e.g. a point type consuming
+ * fields the pipeline doesn't decode, are rejected and still need a restart.
+ */
+
+#pragma once
+
+#include <ros/ros.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "memory_budget.h"
+#include "processor_swap.h"
+
+namespace ouster_ros {
+
+struct ProcessingParams {
+    std::string point_type = "original";
+    bool organized = true;
+    bool destagger = true;
+    double min_range_m = 0.0;
+    double max_range_m = 10000.0;
+    int v_reduction = 1;
+    std::string mask_path;
+
+    static ProcessingParams read(const ros::NodeHandle& pnh) {
+        ProcessingParams params;
+        params.point_type = pnh.param("point_type", params.point_type);
+        params.organized = pnh.param("organized", params.organized);
+        params.destagger = pnh.param("destagger", params.destagger);
+        params.min_range_m = pnh.param("min_range", params.min_range_m);
+        params.max_range_m = pnh.param("max_range", params.max_range_m);
+        params.v_reduction = pnh.param("v_reduction", params.v_reduction);
+        params.mask_path = pnh.param("mask_path", params.mask_path);
+        return params;
+    }
+
+    // throws std::runtime_error describing the first invalid point cloud param
+    void validate_point_cloud() const {
+        if (min_range_m < 0.0 || max_range_m < 0.0)
+            throw std::runtime_error(
+                "min_range and max_range need to be positive");
+        if (min_range_m >= max_range_m)
+            throw std::runtime_error(
+                "min_range can't be equal or exceed max_range");
+        const std::vector<int> valid_values{1, 2, 4, 8, 16};
+        if (std::find(valid_values.begin(), valid_values.end(),
+                      v_reduction) == valid_values.end())
+            throw std::runtime_error(
+                "v_reduction needs to be one of the values: {1, 2, 4, 8, 16}");
+    }
+
+    // range limits in millimeters
+    uint32_t min_range() const { return to_millimeters(min_range_m); }
+    uint32_t max_range() const { return to_millimeters(max_range_m); }
+
+    bool point_cloud_changed(const ProcessingParams& other) const {
+        return point_type != other.point_type ||
+               organized != other.organized ||
+               destagger != other.destagger ||
+               min_range_m != other.min_range_m ||
+               max_range_m != other.max_range_m ||
+               v_reduction != other.v_reduction ||
+               mask_path != other.mask_path;
+    }
+
+   private:
+    static uint32_t to_millimeters(double meters) {
+        const double mm = std::round(meters * 1000);
+        if (mm <= 0.0) return 0;
+        return static_cast<uint32_t>(
+            std::min<double>(mm, std::numeric_limits<uint32_t>::max()));
+    }
+};
+
+template <typename Processor>
+class ProcessingReconfigure {
+   public:
+    using OnSwap = typename ProcessorSwap<Processor>::OnSwap;
+    /**
+     * Builds the processor for the given params. on_swap is null when the
+     * pipeline isn't running yet, otherwise the build may set it to rewire
+     * state shared with other processors once the processor is in service.
+     */
+    using BuildFn = std::function<Processor(
+        const ProcessingParams&, memory::MemoryBudget&, OnSwap* on_swap)>;
+    using FieldsFn =
+        std::function<std::vector<std::string>(const ProcessingParams&)>;
+
+    // forgets the processors of the previous pipeline
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        processors_.clear();
+        swap_ = nullptr;
+    }
+
+    /**
+     * Registers the processor at index of the LidarPacketHandler as one that
+     * gets rebuilt when the params it depends on change.
+     * @param[in] uses_point_cloud_params whether the processor depends on the
+     * point cloud params, otherwise only the mask_path is considered.
+     * @param[in] build builds the processor for the given params.
+     * @param[in] required_fields the lidar scan fields consumed by the
+     * processor for the given params.
+     */
+    void add(size_t index, bool uses_point_cloud_params, BuildFn build,
+             FieldsFn required_fields) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        processors_.push_back({index, uses_point_cloud_params,
+                               std::move(build), std::move(required_fields)});
+    }
+
+    /**
+     * Enables reconfiguration of the registered processors once the
+     * LidarPacketHandler has been created.
+     * @param[in] params the params the processors were built with.
+     * @param[in] decoded_fields the fields decoded into the lidar scans, an
+     * empty list stands for all the fields of the profile.
+     * @param[in] swap hands the rebuilt processors to the handler.
+     * @param[in] memory_budget_bytes limit of the budget the processors are
+     * rebuilt under, zero for no limit.
+     */
+    void attach(const ProcessingParams& params,
+                std::vector<std::string> decoded_fields,
+                std::shared_ptr<ProcessorSwap<Processor>> swap,
+                size_t memory_budget_bytes = 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        params_ = params;
+        decoded_fields_ = std::move(decoded_fields);
+        swap_ = std::move(swap);
+        memory_budget_bytes_ = memory_budget_bytes;
+    }
+
+    /**
+     * Rebuilds the processors affected by the differences between params and
+     * the current params on the calling thread and stages them.
+     * Throws std::runtime_error, leaving the running processors untouched, if
+     * params are invalid or can't be applied without a restart.
+     * @return the number of processors rebuilt.
+     */
+    size_t apply(const ProcessingParams& params) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!swap_)
+            throw std::runtime_error(
+                "no processor of the pipeline can be reconfigured");
+
+        std::vector<const Entry*> affected;
+        for (const auto& p : processors_) {
+            const bool changed = p.uses_point_cloud_params
+                                     ? params.point_cloud_changed(params_)
+                                     : params.mask_path != params_.mask_path;
+            if (changed) affected.push_back(&p);
+        }
+        if (affected.empty()) return 0;
+
+        for (const auto* p : affected) {
+            if (p->uses_point_cloud_params) params.validate_point_cloud();
+            if (decoded_fields_.empty()) continue;
+            for (const auto& field : p->required_fields(params)) {
+                if (std::find(decoded_fields_.begin(), decoded_fields_.end(),
+                              field) == decoded_fields_.end())
+                    throw std::runtime_error(
+                        "the field " + field +
+                        " isn't decoded by the running pipeline, restart the "
+                        "nodelet to apply point_type " + params.point_type);
+            }
+        }
+
+        // build everything before staging anything, a failing build leaves
+        // the pipeline as it was
+        memory::MemoryBudget budget(memory_budget_bytes_);
+        std::vector<Processor> rebuilt;
+        std::vector<OnSwap> on_swap(affected.size());
+        for (size_t i = 0; i < affected.size(); ++i)
+            rebuilt.push_back(affected[i]->build(params, budget, &on_swap[i]));
+        for (size_t i = 0; i < affected.size(); ++i)
+            swap_->stage(affected[i]->index, std::move(rebuilt[i]),
+                         std::move(on_swap[i]));
+        params_ = params;
+        return affected.size();
+    }
+
+   private:
+    struct Entry {
+        size_t index;
+        bool uses_point_cloud_params;
+        BuildFn build;
+        FieldsFn required_fields;
+    };
+
+    std::mutex mutex_;
+    std::vector<Entry> processors_;
+    ProcessingParams params_;
+    std::vector<std::string> decoded_fields_;
+    std::shared_ptr<ProcessorSwap<Processor>> swap_;
+    size_t memory_budget_bytes_ = 0;
+};
+
+}  // namespace ouster_ros
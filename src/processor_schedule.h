@@ -0,0 +1,225 @@
+/**
+ * Copyright (c) 2018-2024, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file processor_schedule.h
+ * @brief Orders the processors of a lidar scan by priority and sheds the ones
+ * that can no longer meet their deadline
+ *
+ * Every processor of the LidarPacketHandler may carry a priority and a
+ * deadline measured from the moment the ScanBatcher completed the scan.
+ * Processors run by decreasing priority, ties keep the order in which they
+ * were registered. Before a processor starts, the time elapsed since the scan
+ * completed plus the recent cost of the processor is compared against its
+ * deadline, when the result would arrive late the processor is skipped for
+ * that scan so the time goes to the scans and processors that can still make
+ * it. Skips are counted per processor. The first run of a processor is cold
+ * and doesn't count towards its cost, and the cost decays on every scan the
+ * processor is shed so that a processor shed after a slow run gets to run,
+ * and be measured, again.
+ *
+ * A processor may also be limited to every n-th scan, e.g. to publish images
+ * at a fraction of the point cloud rate. The decimation is checked before the
+ * processor is invoked so the scans in between cost nothing for it, and the
+ * outputs it does produce keep the timestamps of the scans they came from.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace ouster_ros {
+
+struct ProcessorPolicy {
+    // processors with a higher priority run first
+    int priority = 0;
+    // time since the scan completed by which the processor has to be done,
+    // zero disables load shedding for the processor
+    std::chrono::nanoseconds deadline{0};
+    // the processor runs on the first of every n scans
+    int every_n_scans = 1;
+};
+
+class ProcessorSchedule {
+   public:
+    /**
+     * @param[in] policies one entry per processor, processors past the end of
+     * policies get the default policy.
+     * @param[in] count number of processors.
+     */
+    ProcessorSchedule(const std::vector<ProcessorPolicy>& policies,
+                      size_t count)
+        : policies_(policies),
+          order_(count),
+          cost_ns_(count),
+          runs_(count),
+          scans_seen_(count) {
+        policies_.resize(count);
+        skipped_.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+            skipped_.push_back(std::make_unique<std::atomic<uint64_t>>(0));
+        std::iota(order_.begin(), order_.end(), 0);
+        std::stable_sort(order_.begin(), order_.end(), [this](auto a, auto b) {
+            return policies_[a].priority > policies_[b].priority;
+        });
+    }
+
+    // indices of the processors in the order they are run
+    const std::vector<size_t>& order() const { return order_; }
+
+    const std::vector<ProcessorPolicy>& policies() const { return policies_; }
+
+    /**
+     * Whether the processor would finish past its deadline if it were started
+     * elapsed after the completion of the scan.
+     */
+    bool deadline_lost(size_t processor,
+                       std::chrono::nanoseconds elapsed) const {
+        const auto deadline = policies_[processor].deadline;
+        if (deadline.count() <= 0) return false;
+        return elapsed.count() + cost_ns_[processor] > deadline.count();
+    }
+
+    /**
+     * Counts a scan towards the decimation of the processor, returns whether
+     * the processor runs on it.
+     */
+    bool due(size_t processor) {
+        const int n = std::max(policies_[processor].every_n_scans, 1);
+        auto& seen = scans_seen_[processor];
+        const bool run = seen == 0;
+        seen = (seen + 1) % n;
+        return run;
+    }
+
+    // feeds the duration of a run of the processor to its cost estimate
+    void record(size_t processor, std::chrono::nanoseconds duration) {
+        // caches and lazily allocated buffers make the first run unreliable
+        if (runs_[processor]++ == 0) return;
+        auto& cost = cost_ns_[processor];
+        if (cost == 0)
+            cost = duration.count();
+        else
+            cost += (duration.count() - cost) / COST_SMOOTHING;
+    }
+
+    void skip(size_t processor) {
+        skipped_[processor]->fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * Skips the processor because its deadline was lost, the cost estimate
+     * ages since it is no longer measured while the processor is shed.
+     */
+    void shed(size_t processor) {
+        cost_ns_[processor] -= cost_ns_[processor] / COST_SMOOTHING;
+        skip(processor);
+    }
+
+    uint64_t skipped(size_t processor) const {
+        return skipped_[processor]->load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Parses a '|' separated list of outputs into priorities, the first output
+     * gets the highest priority, e.g. "PCL|SCAN|IMG".
+     */
+    static std::map<std::string, int> parse_priorities(
+        const std::string& outputs) {
+        std::map<std::string, int> priorities;
+        std::vector<std::string> names;
+        size_t begin = 0;
+        while (begin <= outputs.size()) {
+            auto end = std::min(outputs.find('|', begin), outputs.size());
+            if (end > begin) names.push_back(outputs.substr(begin, end - begin));
+            begin = end + 1;
+        }
+        for (size_t i = 0; i < names.size(); ++i)
+            priorities.emplace(names[i], static_cast<int>(names.size() - i));
+        return priorities;
+    }
+
+    /**
+     * Parses a '|' separated list of deadlines in milliseconds per output,
+     * e.g. "PCL:80|IMG:50".
+     */
+    static std::map<std::string, std::chrono::nanoseconds> parse_deadlines(
+        const std::string& deadlines) {
+        std::map<std::string, std::chrono::nanoseconds> parsed;
+        for (const auto& entry : parse_values(deadlines, "deadline")) {
+            if (entry.second < 0.0)
+                throw std::runtime_error("invalid processor deadline: " +
+                                         entry.first);
+            parsed[entry.first] = std::chrono::nanoseconds{
+                static_cast<int64_t>(entry.second * 1e6)};
+        }
+        return parsed;
+    }
+
+    /**
+     * Parses a '|' separated list of scan decimations per output, e.g.
+     * "IMG:10|SCAN:10" runs the image and laser scan processors on every 10th
+     * scan.
+     */
+    static std::map<std::string, int> parse_every_n_scans(
+        const std::string& decimations) {
+        std::map<std::string, int> parsed;
+        for (const auto& entry : parse_values(decimations, "decimation")) {
+            const int n = static_cast<int>(entry.second);
+            if (n < 1 || n != entry.second)
+                throw std::runtime_error("invalid processor decimation: " +
+                                         entry.first);
+            parsed[entry.first] = n;
+        }
+        return parsed;
+    }
+
+   private:
+    // splits OUTPUT:VALUE entries, throws when an entry can't be parsed
+    static std::map<std::string, double> parse_values(const std::string& list,
+                                                      const std::string& what) {
+        std::map<std::string, double> parsed;
+        size_t begin = 0;
+        while (begin < list.size()) {
+            auto end = std::min(list.find('|', begin), list.size());
+            const auto entry = list.substr(begin, end - begin);
+            begin = end + 1;
+            if (entry.empty()) continue;
+            const auto colon = entry.find(':');
+            char* value_end = nullptr;
+            const double value =
+                colon == std::string::npos
+                    ? 0.0
+                    : std::strtod(entry.c_str() + colon + 1, &value_end);
+            if (colon == std::string::npos || colon == 0 || !value_end ||
+                *value_end != '\0' || value_end == entry.c_str() + colon + 1)
+                throw std::runtime_error("invalid processor " + what + ": " +
+                                         entry);
+            parsed[entry.substr(0, colon)] = value;
+        }
+        return parsed;
+    }
+
+    // weight of the latest run in the cost estimate is 1/COST_SMOOTHING, the
+    // estimate loses as much on every scan the processor is shed
+    static constexpr int64_t COST_SMOOTHING = 8;
+
+    std::vector<ProcessorPolicy> policies_;
+    std::vector<size_t> order_;
+    // only touched by the processing thread
+    std::vector<int64_t> cost_ns_;
+    std::vector<uint64_t> runs_;
+    std::vector<int> scans_seen_;
+    std::vector<std::unique_ptr<std::atomic<uint64_t>>> skipped_;
+};
+
+}  // namespace ouster_ros
@@ -0,0 +1,97 @@
+/**
+ * Copyright (c) 2018-2024, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file processor_swap.h
+ * @brief Hands processors built on another thread over to the thread that
+ * runs the processors of each scan
+ *
+ * Rebuilding a processor, e.g. after its point type or range limits changed,
+ * allocates its buffers and lookup tables and takes much longer than a scan.
+ * The replacement is therefore built by the thread that requested the change
+ * and only staged here, the processing thread picks it up in between two
+ * scans so every scan is processed either entirely by the old or entirely by
+ * the new processor. A processor may come with an on_swap callback, invoked
+ * by the processing thread right after the processor went into service, to
+ * rewire the state it shares with the other processors. The processors taken
+ * out of service are kept until the next change is staged, which releases
+ * them off the processing thread.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace ouster_ros {
+
+template <typename Processor>
+class ProcessorSwap {
+   public:
+    using OnSwap = std::function<void()>;
+
+    /**
+     * Stages processor to take the place of the processor at index before the
+     * next scan. A processor staged twice for the same index before being
+     * picked up is replaced by the latest one.
+     * @param[in] on_swap invoked on the processing thread once the processor
+     * is in service, may be empty.
+     */
+    void stage(size_t index, Processor processor, OnSwap on_swap = {}) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        retired_.clear();
+        for (auto& s : staged_) {
+            if (s.index == index) {
+                s.processor = std::move(processor);
+                s.on_swap = std::move(on_swap);
+                return;
+            }
+        }
+        staged_.push_back({index, std::move(processor), std::move(on_swap)});
+        pending_.store(true, std::memory_order_release);
+    }
+
+    bool pending() const { return pending_.load(std::memory_order_acquire); }
+
+    /**
+     * Swaps the staged processors into processors, called by the processing
+     * thread in between scans. Never blocks: while another thread is staging
+     * the swap is left for the next scan. Returns the number of processors
+     * that were replaced.
+     */
+    size_t apply(std::vector<Processor>& processors) {
+        if (!pending()) return 0;
+        std::unique_lock<std::mutex> lock(mutex_, std::try_to_lock);
+        if (!lock.owns_lock()) return 0;
+        size_t replaced = 0;
+        for (auto& s : staged_) {
+            if (s.index >= processors.size()) continue;
+            std::swap(processors[s.index], s.processor);
+            if (s.on_swap) s.on_swap();
+            ++replaced;
+        }
+        // the swapped out processors now sit in staged_
+        std::swap(retired_, staged_);
+        staged_.clear();
+        pending_.store(false, std::memory_order_release);
+        return replaced;
+    }
+
+   private:
+    struct Staged {
+        size_t index;
+        Processor processor;
+        OnSwap on_swap;
+    };
+
+    std::mutex mutex_;
+    std::atomic<bool> pending_{false};
+    std::vector<Staged> staged_;
+    // the swapped out processors, the callbacks already ran
+    std::vector<Staged> retired_;
+};
+
+}  // namespace ouster_ros
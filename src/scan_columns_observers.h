@@ -0,0 +1,135 @@
+/**
+ * Copyright (c) 2018-2024, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file scan_columns_observers.h
+ * @brief Lets processors follow the columns of a lidar scan as its packets
+ * are batched
+ *
+ * A processor that registers an observer gets called on the thread that
+ * batches the packets, with the scan of the ring and the columns each packet
+ * was written to, while the LidarPacketHandler holds the lock of that scan. It
+ * can then spread part of its work across the rotation instead of doing it
+ * all once the scan completes. Scans complete when the first packet of the
+ * next frame arrives, that packet is written to the next scan of the ring and
+ * reported for it once the batcher has replayed it there.
+ */
+
+#pragma once
+
+#include <ouster/lidar_scan.h>
+#include <ouster/types.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace ouster_ros {
+
+class ScanColumnsObservers {
+   public:
+    using Observer = std::function<void(const ouster::sdk::core::LidarScan& ls,
+                                        size_t first_col, size_t cols)>;
+
+    /**
+     * @param[in] scans the number of scans of the ring the observed scans
+     * belong to.
+     */
+    explicit ScanColumnsObservers(size_t scans) : scans_(scans) {}
+
+    /**
+     * The number of distinct scans the observers get called with, processors
+     * allocate what they keep per scan upfront.
+     */
+    size_t scans() const { return scans_; }
+
+    /**
+     * Registers the observer of the processor at index, replacing the one of
+     * the processor it was rebuilt from. An empty observer unregisters it.
+     */
+    void set(size_t index, Observer observer) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (index >= observers_.size()) observers_.resize(index + 1);
+        observers_[index] = std::move(observer);
+        registered_.store(std::count_if(observers_.begin(), observers_.end(),
+                                        [](const Observer& o) {
+                                            return static_cast<bool>(o);
+                                        }),
+                          std::memory_order_release);
+    }
+
+    /**
+     * Reports the columns the packet was batched into, called once per packet
+     * right after it was handed to the batcher.
+     * @param[in] pf the packet format of the sensor.
+     * @param[in] lidar_buf the packet that was just batched.
+     * @param[in] ls the scan the packet was batched into.
+     * @param[in] completed whether batching the packet completed ls.
+     */
+    void batched(const ouster::sdk::core::PacketFormat& pf,
+                 const uint8_t* lidar_buf,
+                 const ouster::sdk::core::LidarScan& ls, bool completed) {
+        // the packet that completed the previous scan went into this one
+        if (replay_) {
+            notify_packet(pf, replayed_packet_.data(), ls);
+            replay_ = false;
+        }
+        if (static_cast<int64_t>(pf.frame_id(lidar_buf)) == ls.frame_id) {
+            notify_packet(pf, lidar_buf, ls);
+        } else if (completed && registered_.load(std::memory_order_acquire)) {
+            // the buffer is only allocated for the first one
+            replayed_packet_.assign(lidar_buf,
+                                    lidar_buf + pf.lidar_packet_size);
+            replay_ = true;
+        }
+    }
+
+   private:
+    void notify(const ouster::sdk::core::LidarScan& ls, size_t first_col,
+                size_t cols) {
+        if (registered_.load(std::memory_order_acquire) == 0) return;
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& o : observers_)
+            if (o) o(ls, first_col, cols);
+    }
+
+    /**
+     * Reports the columns of a packet at their measurement ids, in one go
+     * when they are consecutive which is the case for all but mangled
+     * packets.
+     */
+    void notify_packet(const ouster::sdk::core::PacketFormat& pf,
+                       const uint8_t* lidar_buf,
+                       const ouster::sdk::core::LidarScan& ls) {
+        const size_t w = ls.w;
+        const size_t cols = pf.columns_per_packet;
+        const size_t first = pf.col_measurement_id(pf.nth_col(0, lidar_buf));
+        bool consecutive = first + cols <= w;
+        for (size_t c = 1; consecutive && c < cols; ++c)
+            consecutive =
+                pf.col_measurement_id(pf.nth_col(c, lidar_buf)) == first + c;
+        if (consecutive) {
+            notify(ls, first, cols);
+            return;
+        }
+        for (size_t c = 0; c < cols; ++c) {
+            const size_t m_id =
+                pf.col_measurement_id(pf.nth_col(c, lidar_buf));
+            if (m_id < w) notify(ls, m_id, 1);
+        }
+    }
+
+    const size_t scans_;
+    std::mutex mutex_;
+    // indexed like the processors of the LidarPacketHandler
+    std::vector<Observer> observers_;
+    std::atomic<size_t> registered_{0};
+    // copy of the packet that completed the last scan
+    std::vector<uint8_t> replayed_packet_;
+    bool replay_ = false;
+};
+
+}  // namespace ouster_ros
@@ -0,0 +1,111 @@
+/**
+ * Copyright (c) 2018-2024, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file subscriber_demand.h
+ * @brief Keeps track of which outputs have subscribers so that the processors
+ * only compute what somebody listens to
+ *
+ * Publishers are advertised with connect/disconnect callbacks that refresh a
+ * flag per output from ros::Publisher::getNumSubscribers(). The processors
+ * query the flags once per scan through cheap predicates, an output that
+ * gains a subscriber is computed again starting with the next scan. Several
+ * publishers may back the same output, e.g. a topic and its shared memory
+ * counterpart, the output is wanted while any of them has subscribers.
+ */
+
+#pragma once
+
+#include <ros/ros.h>
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace ouster_ros {
+
+class SubscriberDemand {
+    struct Output {
+        std::vector<ros::Publisher> pubs;
+        std::atomic<bool> wanted{false};
+    };
+
+   public:
+    using WantedFn = std::function<bool()>;
+
+    /**
+     * @param[in] enabled when false every output is reported as wanted, which
+     * restores the eager processing of all outputs.
+     */
+    explicit SubscriberDemand(bool enabled = true) : enabled_(enabled) {}
+
+    void set_enabled(bool enabled) { enabled_ = enabled; }
+
+    /**
+     * Advertises topic as a publisher of output key, the connect and
+     * disconnect callbacks keep the flag of the output up to date.
+     */
+    template <typename MsgT>
+    ros::Publisher advertise(ros::NodeHandle& nh, const std::string& topic,
+                             uint32_t queue_size, const std::string& key) {
+        auto refresh = [this, key](const ros::SingleSubscriberPublisher&) {
+            this->refresh(key);
+        };
+        auto pub = nh.advertise<MsgT>(topic, queue_size, refresh, refresh);
+        add(key, pub);
+        return pub;
+    }
+
+    // registers an already advertised publisher of output key
+    void add(const std::string& key, const ros::Publisher& pub) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            output(key).pubs.push_back(pub);
+        }
+        // subscribers may have connected before the publisher was added
+        refresh(key);
+    }
+
+    bool wanted(const std::string& key) {
+        if (!enabled_) return true;
+        std::lock_guard<std::mutex> lock(mutex_);
+        return output(key).wanted.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Returns a predicate for the processors which doesn't lock, valid for as
+     * long as the SubscriberDemand.
+     */
+    WantedFn wanted_fn(const std::string& key) {
+        if (!enabled_) return [] { return true; };
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& flag = output(key).wanted;
+        return [&flag] { return flag.load(std::memory_order_relaxed); };
+    }
+
+   private:
+    // expects mutex_ to be held
+    Output& output(const std::string& key) {
+        auto& o = outputs_[key];
+        if (!o) o = std::make_unique<Output>();
+        return *o;
+    }
+
+    void refresh(const std::string& key) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& o = output(key);
+        bool wanted = false;
+        for (const auto& pub : o.pubs) wanted |= pub.getNumSubscribers() > 0;
+        o.wanted.store(wanted, std::memory_order_relaxed);
+    }
+
+    bool enabled_;
+    std::mutex mutex_;
+    std::map<std::string, std::unique_ptr<Output>> outputs_;
+};
+
+}  // namespace ouster_ros
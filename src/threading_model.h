@@ -0,0 +1,126 @@
+/**
+ * Copyright (c) 2018-2024, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file threading_model.h
+ * @brief Selects whether lidar scans are processed on a dedicated thread or
+ * inline on the thread that receives the packets
+ *
+ * By default completed scans are handed over to the `os_scan_proc` thread
+ * which decouples packet reception from processing. On hosts with one or two
+ * cores the handoff only adds context switches and cache misses, with the
+ * INLINE model the processors run on the receive thread right after the
+ * ScanBatcher completes a frame. While they run nobody drains the lidar
+ * socket, so the kernel receive buffer is grown to hold a frame worth of
+ * packets and the processing of a scan is cut short once the buffer would be
+ * about to overflow.
+ */
+
+#pragma once
+
+#include <dirent.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+
+#include <ouster/types.h>
+
+namespace ouster_ros {
+namespace threading {
+
+struct InlineProcessing {
+    bool enabled = false;
+    // time after which the remaining processors of a scan are skipped, zero
+    // disables the check
+    std::chrono::nanoseconds deadline{0};
+};
+
+// the kernel charges the skb overhead against the receive buffer, count every
+// datagram at twice its payload to stay on the safe side
+constexpr size_t DATAGRAM_OVERHEAD_FACTOR = 2;
+
+inline int udp_port_of(int fd) {
+    int type = 0;
+    socklen_t len = sizeof(type);
+    if (getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &len) != 0 ||
+        type != SOCK_DGRAM)
+        return 0;
+    sockaddr_storage addr{};
+    len = sizeof(addr);
+    if (getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len) != 0)
+        return 0;
+    if (addr.ss_family == AF_INET)
+        return ntohs(reinterpret_cast<sockaddr_in*>(&addr)->sin_port);
+    if (addr.ss_family == AF_INET6)
+        return ntohs(reinterpret_cast<sockaddr_in6*>(&addr)->sin6_port);
+    return 0;
+}
+
+/**
+ * Grows the receive buffer of the udp sockets of this process bound to port
+ * to at least bytes. The sdk client doesn't expose its sockets, they are
+ * looked up through /proc/self/fd. SO_RCVBUFFORCE is attempted first, which
+ * needs CAP_NET_ADMIN, otherwise the size is capped by net.core.rmem_max.
+ * @return the smallest effective receive buffer size of the matching
+ * sockets, 0 if none was found.
+ */
+inline size_t grow_udp_receive_buffer(int port, size_t bytes) {
+    if (port <= 0) return 0;
+    DIR* dir = opendir("/proc/self/fd");
+    if (!dir) return 0;
+    size_t effective = 0;
+    while (auto entry = readdir(dir)) {
+        char* end;
+        const long fd = std::strtol(entry->d_name, &end, 10);
+        if (*end != '\0' || fd == dirfd(dir)) continue;
+        if (udp_port_of(fd) != port) continue;
+
+        int current = 0;
+        socklen_t len = sizeof(current);
+        getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &current, &len);
+        // the kernel reports twice the requested size
+        if (static_cast<size_t>(current) < 2 * bytes) {
+            const int requested = static_cast<int>(bytes);
+            if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &requested,
+                           sizeof(requested)) != 0)
+                setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &requested,
+                           sizeof(requested));
+            getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &current, &len);
+        }
+        effective = effective ? std::min(effective, size_t(current))
+                              : size_t(current);
+    }
+    closedir(dir);
+    return effective;
+}
+
+// bytes of kernel receive buffer consumed per frame of lidar packets
+inline size_t frame_receive_bytes(const ouster::sdk::core::SensorInfo& info) {
+    const auto& pf = ouster::sdk::core::get_format(info);
+    const size_t packets_per_frame =
+        info.format.columns_per_frame / info.format.columns_per_packet;
+    return packets_per_frame * pf.lidar_packet_size * DATAGRAM_OVERHEAD_FACTOR;
+}
+
+/**
+ * Time it takes the sensor to fill half of the receive buffer, processing that
+ * stays within this deadline leaves the other half as headroom for the
+ * processor that is still running when the deadline passes.
+ */
+inline std::chrono::nanoseconds receive_buffer_deadline(
+    size_t receive_buffer_bytes, const ouster::sdk::core::SensorInfo& info) {
+    const double frequency = ouster::sdk::core::frequency_of_lidar_mode(
+        info.config.lidar_mode.value());
+    const double bytes_per_sec = frame_receive_bytes(info) * frequency;
+    if (receive_buffer_bytes == 0 || bytes_per_sec <= 0)
+        return std::chrono::nanoseconds{0};
+    return std::chrono::nanoseconds{static_cast<int64_t>(
+        0.5e9 * receive_buffer_bytes / bytes_per_sec)};
+}
+
+}  // namespace threading
+}  // namespace ouster_ros
@@ -0,0 +1,86 @@
+/**
+ * Copyright (c) 2018-2024, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file tracepoints.h
+ * @brief Static USDT tracepoints placed in the hot paths of the driver
+ *
+ * When <sys/sdt.h> is available (systemtap-sdt-dev package) each tracepoint
+ * compiles to a single nop instruction plus an ELF note, it only costs
+ * anything while a tracer (bpftrace, perf, LTTng, systemtap) is attached.
+ * Tracepoints can be compiled out entirely by configuring the package with
+ * -DENABLE_TRACEPOINTS=OFF. Check util/tracing for ready to use scripts.
+ *
+ * All probes belong to the `ouster_ros` provider, those of the lidar packet
+ * handlers take the id of the handler first so that the probes of several
+ * sensors in one process can be told apart. A lidar packet is identified by
+ * its host timestamp, which follows it to the decode thread, and the packet
+ * completing a scan is passed to scan_complete:
+ *  - lidar_packet_receive(packet, size)        packet read from the socket
+ *  - lidar_packet_publish(size)                raw packet published by os_sensor
+ *  - packet_enqueue(packet, depth)             packet queued for the decode thread
+ *  - packet_dequeue(packet, depth)             packet taken by the decode thread
+ *  - scan_complete(handler, slot, scan_ts, packet)
+ *                                              ScanBatcher completed a frame
+ *  - ring_enqueue(handler, slot, size)         scan committed to the ring buffer
+ *  - ring_dequeue(handler, slot, size)         scan released from the ring buffer
+ *  - processor_start(handler, index, slot)     processor invoked on a scan
+ *  - processor_end(handler, index, slot)       processor done with a scan
+ *  - publish_start(handler, kind)              processor starts publishing
+ *  - publish_end(handler, kind)                processor done publishing
+ */
+
+#pragma once
+
+#include <atomic>
+
+#if defined(OUSTER_ROS_TRACEPOINTS) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define OUSTER_ROS_HAS_USDT
+#endif
+#endif
+
+#ifdef OUSTER_ROS_HAS_USDT
+#define OUSTER_ROS_TRACE0(name) DTRACE_PROBE(ouster_ros, name)
+#define OUSTER_ROS_TRACE1(name, a) DTRACE_PROBE1(ouster_ros, name, a)
+#define OUSTER_ROS_TRACE2(name, a, b) DTRACE_PROBE2(ouster_ros, name, a, b)
+#define OUSTER_ROS_TRACE3(name, a, b, c) \
+    DTRACE_PROBE3(ouster_ros, name, a, b, c)
+#define OUSTER_ROS_TRACE4(name, a, b, c, d) \
+    DTRACE_PROBE4(ouster_ros, name, a, b, c, d)
+#else
+// sizeof marks the arguments as used without evaluating them
+#define OUSTER_ROS_TRACE0(name) do {} while (0)
+#define OUSTER_ROS_TRACE1(name, a) do { (void)sizeof(a); } while (0)
+#define OUSTER_ROS_TRACE2(name, a, b) \
+    do { (void)sizeof(a); (void)sizeof(b); } while (0)
+#define OUSTER_ROS_TRACE3(name, a, b, c) \
+    do { (void)sizeof(a); (void)sizeof(b); (void)sizeof(c); } while (0)
+#define OUSTER_ROS_TRACE4(name, a, b, c, d) \
+    do { \
+        (void)sizeof(a); (void)sizeof(b); (void)sizeof(c); (void)sizeof(d); \
+    } while (0)
+#endif
+
+namespace ouster_ros {
+namespace trace {
+
+// values passed as the `kind` argument of the publish_start/publish_end probes
+enum PublishKind : int { POINT_CLOUD = 0, LASER_SCAN = 1, IMAGE = 2 };
+
+// ids of the lidar packet handlers of the process, in order of creation
+inline int next_handler_id() {
+    static std::atomic<int> next{0};
+    return next++;
+}
+
+// the handler whose processors run on the calling thread, the processors
+// pass it to the publish probes
+inline int& current_handler() {
+    thread_local int handler = -1;
+    return handler;
+}
+
+}  // namespace trace
+}  // namespace ouster_ros
@@ -0,0 +1,252 @@
+/**
+ * Copyright (c) 2018-2024, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file worker_pool.h
+ * @brief Process wide pool of threads that runs the lidar scan processing of
+ * all the ouster nodelets loaded into a nodelet manager
+ *
+ * With a dedicated processing thread per LidarPacketHandler a manager running
+ * os_driver, os_cloud and os_image for several sensors ends up with more busy
+ * threads than cores. With the POOLED scan processing the handlers instead
+ * submit their scans to a single WorkerPool shared by the whole process.
+ *
+ * Every client (one per LidarPacketHandler) gets a serial Queue: the scans of
+ * a client are processed one at a time and in order, so the processors don't
+ * need to be thread safe, while the scans of different clients run in
+ * parallel. A queue with work is represented by a single token that sits in
+ * the deque of one of the workers. A worker processes one scan of the token at
+ * the front of its deque and then moves the token to the back, so the clients
+ * sharing a worker take turns scan by scan and a sensor with a backlog can't
+ * starve the others. Workers that run out of tokens steal from the back of the
+ * deques of the other workers.
+ */
+
+#pragma once
+
+#include <pthread.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ouster_ros {
+namespace threading {
+
+class WorkerPool : public std::enable_shared_from_this<WorkerPool> {
+   public:
+    class Queue {
+       public:
+        Queue(std::weak_ptr<WorkerPool> pool, std::function<void()> work)
+            : pool_(std::move(pool)), work_(std::move(work)) {}
+
+        /**
+         * Requests one more run of the work of the queue, called by the thread
+         * that completes a scan. Never waits for the work to run, but handing
+         * the token of an idle queue to a worker briefly takes the pool
+         * mutexes and may allocate a block of the worker deque, a queue that
+         * is already scheduled only bumps its pending count.
+         */
+        void notify() {
+            if (closed_.load(std::memory_order_acquire)) return;
+            pending_.fetch_add(1, std::memory_order_acq_rel);
+            schedule();
+        }
+
+        /**
+         * Waits for a run in progress to complete and drops the pending ones,
+         * the work isn't invoked anymore once close returns.
+         */
+        void close() {
+            closed_.store(true, std::memory_order_release);
+            std::lock_guard<std::mutex> lock(run_mutex_);
+            pending_.store(0, std::memory_order_release);
+        }
+
+        size_t pending() const {
+            return pending_.load(std::memory_order_acquire);
+        }
+
+       private:
+        friend class WorkerPool;
+
+        void schedule() {
+            if (scheduled_.exchange(true, std::memory_order_acq_rel)) return;
+            if (auto pool = pool_.lock()) pool->enqueue(self_.lock());
+        }
+
+        // invoked by a worker holding the token of the queue, returns whether
+        // the token needs to be queued again
+        bool run_one() {
+            {
+                std::lock_guard<std::mutex> lock(run_mutex_);
+                if (closed_.load(std::memory_order_acquire)) return false;
+                if (pending_.load(std::memory_order_acquire) > 0) {
+                    work_();
+                    pending_.fetch_sub(1, std::memory_order_acq_rel);
+                }
+            }
+            if (pending() > 0) return true;
+            scheduled_.store(false, std::memory_order_release);
+            // a notify may have slipped in before the flag was cleared
+            return pending() > 0 &&
+                   !scheduled_.exchange(true, std::memory_order_acq_rel);
+        }
+
+        std::weak_ptr<WorkerPool> pool_;
+        std::weak_ptr<Queue> self_;
+        std::function<void()> work_;
+        std::mutex run_mutex_;
+        std::atomic<size_t> pending_{0};
+        std::atomic<bool> scheduled_{false};
+        std::atomic<bool> closed_{false};
+    };
+
+    /**
+     * @param[in] threads number of workers, zero picks one per core.
+     */
+    explicit WorkerPool(size_t threads) : workers_(worker_count(threads)) {
+        for (size_t i = 0; i < workers_.size(); ++i) {
+            workers_[i].thread = std::thread([this, i]() {
+                const auto name = "os_pool_" + std::to_string(i);
+                pthread_setname_np(pthread_self(), name.c_str());
+                run(i);
+            });
+        }
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(idle_mutex_);
+            active_ = false;
+        }
+        idle_.notify_all();
+        for (auto& w : workers_)
+            if (w.thread.joinable()) w.thread.join();
+    }
+
+    /**
+     * Returns the pool of the process, creating it with the given number of
+     * threads if there is none. The pool lives as long as one of its users,
+     * the size requested by later users is ignored.
+     */
+    static std::shared_ptr<WorkerPool> shared(size_t threads) {
+        static std::mutex mutex;
+        static std::weak_ptr<WorkerPool> instance;
+        std::lock_guard<std::mutex> lock(mutex);
+        auto pool = instance.lock();
+        if (!pool) {
+            pool = std::make_shared<WorkerPool>(threads);
+            instance = pool;
+        }
+        return pool;
+    }
+
+    /**
+     * Creates a serial queue whose work is invoked once per notify. The
+     * queue must be closed before anything the work refers to is destroyed.
+     */
+    std::shared_ptr<Queue> create_queue(std::function<void()> work) {
+        auto queue = std::make_shared<Queue>(weak_from_this(), std::move(work));
+        queue->self_ = queue;
+        return queue;
+    }
+
+    size_t size() const { return workers_.size(); }
+
+   private:
+    struct Worker {
+        std::thread thread;
+        std::mutex mutex;
+        std::deque<std::shared_ptr<Queue>> tokens;
+    };
+
+    static size_t worker_count(size_t threads) {
+        if (threads > 0) return threads;
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // index of the worker running on the calling thread, or none
+    static size_t& current_worker() {
+        static thread_local size_t index = SIZE_MAX;
+        return index;
+    }
+
+    void enqueue(std::shared_ptr<Queue> queue) {
+        if (!queue) return;
+        // tokens requeued by a worker stay with it, the others are spread
+        size_t i = current_worker();
+        if (i >= workers_.size())
+            i = next_worker_.fetch_add(1, std::memory_order_relaxed) %
+                workers_.size();
+        {
+            // counted before a thief can take it and decrement the count
+            std::lock_guard<std::mutex> idle_lock(idle_mutex_);
+            {
+                std::lock_guard<std::mutex> lock(workers_[i].mutex);
+                workers_[i].tokens.push_back(std::move(queue));
+            }
+            ++queued_;
+        }
+        idle_.notify_one();
+    }
+
+    std::shared_ptr<Queue> take(size_t self) {
+        std::shared_ptr<Queue> queue;
+        {
+            std::lock_guard<std::mutex> lock(workers_[self].mutex);
+            if (!workers_[self].tokens.empty()) {
+                queue = std::move(workers_[self].tokens.front());
+                workers_[self].tokens.pop_front();
+            }
+        }
+        for (size_t k = 1; !queue && k < workers_.size(); ++k) {
+            auto& victim = workers_[(self + k) % workers_.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tokens.empty()) {
+                queue = std::move(victim.tokens.back());
+                victim.tokens.pop_back();
+            }
+        }
+        if (queue) {
+            std::lock_guard<std::mutex> lock(idle_mutex_);
+            --queued_;
+        }
+        return queue;
+    }
+
+    void run(size_t self) {
+        current_worker() = self;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(idle_mutex_);
+                idle_.wait(lock, [this] { return queued_ > 0 || !active_; });
+                if (!active_) return;
+            }
+            auto queue = take(self);
+            if (queue && queue->run_one()) enqueue(std::move(queue));
+        }
+    }
+
+    std::vector<Worker> workers_;
+    std::atomic<size_t> next_worker_{0};
+    std::mutex idle_mutex_;
+    std::condition_variable idle_;
+    // tokens sitting in the deques of the workers
+    size_t queued_ = 0;
+    bool active_ = true;
+};
+
+}  // namespace threading
+}  // namespace ouster_ros
@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "../src/adaptive_quality.h"
+
+using namespace ouster_ros;
+using namespace std::chrono_literals;
+
+namespace {
+
+constexpr auto FRAME_PERIOD = 100ms;
+
+void feed(AdaptiveQuality& quality, std::chrono::nanoseconds processing_time,
+          int scans) {
+    for (int i = 0; i < scans; ++i) quality.update(processing_time);
+}
+
+}  // namespace
+
+TEST(AdaptiveQualityTest, StaysAtFullQualityUnderNormalLoad) {
+    AdaptiveQuality quality(FRAME_PERIOD);
+    feed(quality, 70ms, 1000);
+    EXPECT_EQ(quality.level(), AdaptiveQuality::FULL_QUALITY);
+    EXPECT_EQ(quality.row_decimation(), 1);
+}
+
+TEST(AdaptiveQualityTest, SingleSlowScansDontDegrade) {
+    AdaptiveQuality quality(FRAME_PERIOD);
+    for (int i = 0; i < 100; ++i) {
+        feed(quality, 150ms, AdaptiveQuality::RAISE_AFTER_SCANS - 1);
+        feed(quality, 50ms, 1);
+    }
+    EXPECT_EQ(quality.level(), AdaptiveQuality::FULL_QUALITY);
+}
+
+TEST(AdaptiveQualityTest, DegradesUnderOverloadAndRestores) {
+    std::vector<int> levels;
+    AdaptiveQuality quality(FRAME_PERIOD,
+                            [&levels](int level) { levels.push_back(level); });
+
+    feed(quality, 150ms, AdaptiveQuality::RAISE_AFTER_SCANS);
+    EXPECT_EQ(quality.level(), 1);
+    EXPECT_EQ(quality.row_decimation(), 2);
+    feed(quality, 150ms, AdaptiveQuality::RAISE_AFTER_SCANS);
+    EXPECT_EQ(quality.row_decimation(), 4);
+    feed(quality, 150ms, 10 * AdaptiveQuality::RAISE_AFTER_SCANS);
+    EXPECT_EQ(quality.level(), AdaptiveQuality::MAX_LEVEL);
+
+    // load drops, the levels are restored one at a time
+    feed(quality, 10ms, AdaptiveQuality::RESTORE_AFTER_SCANS - 1);
+    EXPECT_EQ(quality.level(), AdaptiveQuality::MAX_LEVEL);
+    feed(quality, 10ms, 1);
+    EXPECT_EQ(quality.level(), AdaptiveQuality::MAX_LEVEL - 1);
+    feed(quality, 10ms, AdaptiveQuality::MAX_LEVEL *
+                            AdaptiveQuality::RESTORE_AFTER_SCANS);
+    EXPECT_EQ(quality.level(), AdaptiveQuality::FULL_QUALITY);
+
+    EXPECT_EQ(levels, (std::vector<int>{1, 2, 3, 2, 1, 0}));
+}
+
+TEST(AdaptiveQualityTest, SkipsLowPriorityProcessorsAtTheLastLevel) {
+    AdaptiveQuality quality(FRAME_PERIOD);
+    quality.set_low_priority(2);
+    EXPECT_FALSE(quality.skip(2));
+
+    feed(quality, 150ms, (AdaptiveQuality::SKIP_LOW_PRIORITY_LEVEL - 1) *
+                             AdaptiveQuality::RAISE_AFTER_SCANS);
+    EXPECT_FALSE(quality.skip(2));
+    feed(quality, 150ms, AdaptiveQuality::RAISE_AFTER_SCANS);
+    EXPECT_FALSE(quality.skip(0));
+    EXPECT_FALSE(quality.skip(1));
+    EXPECT_TRUE(quality.skip(2));
+    EXPECT_FALSE(quality.skip(3));
+}
+
+TEST(AdaptiveQualityTest, BacksOffWhenRestoringOverloadsAgain) {
+    AdaptiveQuality quality(FRAME_PERIOD);
+    // full quality costs 120ms per scan, half the rows 40ms
+    feed(quality, 120ms, AdaptiveQuality::RAISE_AFTER_SCANS);
+    ASSERT_EQ(quality.level(), 1);
+
+    int restores = 0;
+    for (int scan = 0; scan < 20 * AdaptiveQuality::RESTORE_AFTER_SCANS;
+         ++scan) {
+        const int level = quality.level();
+        quality.update(level == 0 ? 120ms : 40ms);
+        if (quality.level() < level) ++restores;
+    }
+    // without the back off the level would be restored 19 times
+    EXPECT_LE(restores, 5);
+}
@@ -0,0 +1,167 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <set>
+
+#include "../src/async_publisher.h"
+
+using namespace ouster_ros;
+
+namespace {
+
+struct TestMsg {
+    int seq = 0;
+    std::vector<uint8_t> data;
+};
+
+// publish function that blocks until released, emulating a slow subscriber
+class Gate {
+   public:
+    void wait_open() {
+        std::unique_lock<std::mutex> lock(mutex);
+        ++waiting;
+        cv.notify_all();
+        cv.wait(lock, [this] { return open; });
+    }
+
+    void wait_blocked(int count) {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [this, count] { return waiting >= count; });
+    }
+
+    void release() {
+        std::lock_guard<std::mutex> lock(mutex);
+        open = true;
+        cv.notify_all();
+    }
+
+   private:
+    std::mutex mutex;
+    std::condition_variable cv;
+    int waiting = 0;
+    bool open = false;
+};
+
+// counts the copies made of it, swaps only move
+struct CountedMsg {
+    static int copies;
+    int seq = 0;
+
+    CountedMsg() = default;
+    CountedMsg(const CountedMsg& other) : seq(other.seq) { ++copies; }
+    CountedMsg(CountedMsg&&) = default;
+    CountedMsg& operator=(const CountedMsg& other) {
+        seq = other.seq;
+        ++copies;
+        return *this;
+    }
+    CountedMsg& operator=(CountedMsg&&) = default;
+};
+
+int CountedMsg::copies = 0;
+
+}  // namespace
+
+TEST(AsyncPublisherTest, LatestMessageWins) {
+    Gate gate;
+    std::vector<int> published;
+    std::mutex published_mutex;
+    AsyncPublisher publisher;
+    auto topic = publisher.add_topic<TestMsg>([&](const TestMsg& msg) {
+        gate.wait_open();
+        std::lock_guard<std::mutex> lock(published_mutex);
+        published.push_back(msg.seq);
+    });
+
+    TestMsg msg;
+    msg.data.resize(16);
+    msg.seq = 1;
+    topic->publish(msg);
+    gate.wait_blocked(1);
+
+    // none of these block even though the subscriber is stuck
+    for (int seq = 2; seq <= 5; ++seq) {
+        msg.seq = seq;
+        topic->publish(msg);
+    }
+    EXPECT_EQ(publisher.superseded_msgs(), 3U);
+
+    gate.release();
+    for (int i = 0; i < 100; ++i) {
+        {
+            std::lock_guard<std::mutex> lock(published_mutex);
+            if (published.size() == 2) break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    std::lock_guard<std::mutex> lock(published_mutex);
+    EXPECT_EQ(published, (std::vector<int>{1, 5}));
+}
+
+TEST(AsyncPublisherTest, BuffersKeepTheirLayoutWithoutCopies) {
+    AsyncPublisher publisher;
+    auto topic = publisher.add_topic<TestMsg>([](const TestMsg&) {});
+
+    TestMsg msg;
+    msg.data.resize(1024);
+    topic->publish(msg);
+    // the caller gets a buffer of the same layout back
+    EXPECT_EQ(msg.data.size(), 1024U);
+
+    // once initialized the buffers only change hands
+    std::set<const uint8_t*> buffers;
+    for (int i = 0; i < 20; ++i) {
+        topic->publish(msg);
+        buffers.insert(msg.data.data());
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_LE(buffers.size(), 3U);
+}
+
+TEST(AsyncPublisherTest, TopicsPassTheirIndex) {
+    std::mutex mutex;
+    std::vector<int> seen(3, 0);
+    {
+        AsyncPublisher publisher;
+        auto topics = publisher.add_topics<TestMsg>(
+            3, [&](size_t i, const TestMsg& msg) {
+                std::lock_guard<std::mutex> lock(mutex);
+                seen[i] = msg.seq;
+            });
+        ASSERT_EQ(topics.size(), 3U);
+        for (int i = 0; i < 3; ++i) {
+            TestMsg msg;
+            msg.seq = 10 + i;
+            topics[i]->publish(msg);
+        }
+        for (int i = 0; i < 100; ++i) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (seen[2] != 0 && seen[1] != 0 && seen[0] != 0) break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+    EXPECT_EQ(seen, (std::vector<int>{10, 11, 12}));
+}
+
+TEST(AsyncPublisherTest, TopicsAddedTogetherShareTheMessageBeingPublished) {
+    AsyncPublisher publisher;
+    auto topics = publisher.add_topics<CountedMsg>(
+        3, [](size_t, const CountedMsg&) {});
+    auto single = publisher.add_topic<CountedMsg>([](const CountedMsg&) {});
+
+    CountedMsg::copies = 0;
+    CountedMsg msg;
+    for (int i = 0; i < 10; ++i)
+        for (auto& topic : topics) topic->publish(msg);
+    EXPECT_EQ(CountedMsg::copies,
+              static_cast<int>(AsyncPublisher::spare_msgs(topics.size())));
+
+    CountedMsg::copies = 0;
+    for (int i = 0; i < 10; ++i) single->publish(msg);
+    EXPECT_EQ(CountedMsg::copies,
+              static_cast<int>(AsyncPublisher::spare_msgs(1)));
+}
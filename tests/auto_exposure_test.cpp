@@ -0,0 +1,103 @@
+#include <gtest/gtest.h>
+
+#include "../src/auto_exposure.h"
+
+using namespace ouster_ros::image;
+using ouster::sdk::core::img_t;
+
+namespace {
+
+// pixels 1..rows*cols in row major order
+img_t<float> ramp(size_t rows, size_t cols) {
+    img_t<float> image(rows, cols);
+    for (Eigen::Index i = 0; i < image.size(); ++i)
+        image(i / image.cols(), i % image.cols()) = i + 1;
+    return image;
+}
+
+}  // namespace
+
+TEST(AutoExposureTest, StretchesThePercentilesToTheUnitRange) {
+    auto image = ramp(64, 1024);
+    AutoExposure ae(image.size());
+    ae(image);
+    EXPECT_EQ(image.minCoeff(), 0.0f);
+    EXPECT_EQ(image.maxCoeff(), 1.0f);
+    // the pixels below the 10% and above the 90% percentile are clamped
+    const double n = image.size();
+    EXPECT_NEAR((image == 0.0f).count() / n, 0.1, 0.01);
+    EXPECT_NEAR((image == 1.0f).count() / n, 0.1, 0.01);
+    EXPECT_NEAR(image(31, 1023), 0.5f, 0.01);
+}
+
+TEST(AutoExposureTest, MissingReturnsDontCount) {
+    auto image = ramp(64, 1024);
+    auto with_holes = image;
+    // no returns in the first half of the rows
+    with_holes.topRows(32).setZero();
+    AutoExposure ae(image.size()), ae_holes(image.size());
+    ae(image);
+    ae_holes(with_holes);
+    EXPECT_TRUE((with_holes.topRows(32) == 0.0f).all());
+    EXPECT_EQ(with_holes.maxCoeff(), 1.0f);
+    // the remaining half is stretched over the whole range
+    EXPECT_LT(with_holes(40, 0), image(40, 0));
+}
+
+TEST(AutoExposureTest, UpdatesAreDampedAndOnlyEveryFewImages) {
+    const auto image = ramp(64, 1024);
+    AutoExposure ae(image.size(), AutoExposure::DEFAULT_PERCENTILE,
+                    AutoExposure::DEFAULT_PERCENTILE, 2);
+    auto first = image;
+    ae(first);
+    // twice as bright, not an update image
+    img_t<float> brighter = image * 2;
+    ae(brighter);
+    EXPECT_GT(brighter(10, 0), first(10, 0));
+    // the next update only moves part of the way
+    img_t<float> updated = image * 2;
+    ae(updated);
+    EXPECT_LT(updated(10, 0), brighter(10, 0));
+    img_t<float> adapted = image * 2;
+    AutoExposure fresh(image.size());
+    fresh(adapted);
+    EXPECT_GT(updated(10, 0), adapted(10, 0));
+}
+
+TEST(AutoExposureTest, OnlyStateUpdatesAreCounted) {
+    const auto image = ramp(64, 1024);
+    AutoExposure ae(image.size(), AutoExposure::DEFAULT_PERCENTILE,
+                    AutoExposure::DEFAULT_PERCENTILE, 2);
+    auto first = image;
+    ae(first);
+    // a second return neither updates the state nor counts as an image
+    img_t<float> second = image * 4;
+    ae(second, false);
+    img_t<float> third = image * 4;
+    ae(third);
+    EXPECT_TRUE((third == second).all());
+}
+
+TEST(BeamUniformityCorrectorTest, RemovesTheOffsetOfEveryBeam) {
+    const size_t rows = 64, cols = 1024;
+    img_t<float> image(rows, cols);
+    for (size_t u = 0; u < rows; ++u)
+        for (size_t v = 0; v < cols; ++v)
+            image(u, v) = 100.0f + (v % 10) + 3.0f * (u % 4);
+    BeamUniformityCorrector buc(rows, cols);
+    buc(image);
+    for (size_t u = 0; u < rows; ++u)
+        for (size_t v = 0; v < cols; ++v)
+            ASSERT_FLOAT_EQ(image(u, v), 100.0f + (v % 10)) << u << ", " << v;
+}
+
+TEST(BeamUniformityCorrectorTest, NeverGoesNegative) {
+    const size_t rows = 4, cols = 8;
+    img_t<float> image = img_t<float>::Zero(rows, cols);
+    image.row(1).setConstant(5.0f);
+    image(1, 3) = 1.0f;
+    BeamUniformityCorrector buc(rows, cols);
+    buc(image);
+    EXPECT_EQ(image.minCoeff(), 0.0f);
+    EXPECT_EQ(image(1, 0), 0.0f);
+}
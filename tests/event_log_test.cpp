@@ -0,0 +1,77 @@
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+#include "../src/event_log.h"
+
+using namespace ouster_ros;
+
+namespace {
+
+struct Summary {
+    int calls = 0;
+    uint64_t count = 0;
+    uint64_t last_value = 0;
+};
+
+}  // namespace
+
+TEST(EventLogTest, CountsAreSummarizedOncePerFlush) {
+    // long period so that only explicit flushes report
+    EventLog log("test", std::chrono::hours(1));
+    Summary summary;
+    auto& event = log.add([&summary](std::ostream& os, uint64_t count,
+                                     uint64_t last_value, double) {
+        ++summary.calls;
+        summary.count = count;
+        summary.last_value = last_value;
+        os << "dropped " << count;
+    });
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&event]() {
+            for (int i = 0; i < 1000; ++i) event.record(7);
+        });
+    }
+    for (auto& t : threads) t.join();
+
+    log.flush();
+    EXPECT_EQ(summary.calls, 1);
+    EXPECT_EQ(summary.count, 4000U);
+    EXPECT_EQ(summary.last_value, 7U);
+
+    // nothing recorded since, nothing to report
+    log.flush();
+    EXPECT_EQ(summary.calls, 1);
+}
+
+TEST(EventLogTest, PendingEventsAreReportedOnDestruction) {
+    Summary summary;
+    {
+        EventLog log("test", std::chrono::hours(1));
+        auto& event = log.add(
+            [&summary](std::ostream&, uint64_t count, uint64_t, double) {
+                ++summary.calls;
+                summary.count = count;
+            });
+        event.record();
+        event.record();
+    }
+    EXPECT_EQ(summary.calls, 1);
+    EXPECT_EQ(summary.count, 2U);
+}
+
+TEST(EventLogTest, BackgroundThreadReportsPeriodically) {
+    EventLog log("test", std::chrono::milliseconds(10));
+    std::atomic<uint64_t> reported{0};
+    auto& event = log.add(
+        [&reported](std::ostream&, uint64_t count, uint64_t, double) {
+            reported += count;
+        });
+    event.record();
+    for (int i = 0; i < 100 && reported == 0; ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    EXPECT_EQ(reported.load(), 1U);
+}
@@ -0,0 +1,233 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <random>
+
+// prevent clang-format from altering the location of "ouster_ros/os_ros.h", the
+// header file needs to be the first include due to PCL_NO_PRECOMPILE flag
+// clang-format off
+#include "ouster_ros/os_ros.h"
+// clang-format on
+
+#include "../src/frame_completion.h"
+#include "../src/packet_decoder.h"
+#include "packet_source.h"
+
+using namespace ouster_ros;
+using namespace ouster::sdk::core;
+using test::PacketSource;
+using test::expect_same_scan;
+
+namespace {
+
+void complete(ScanBatcher&, LidarScan&) {}
+
+void complete(ProfileScanBatcher& batcher, LidarScan& ls) {
+    batcher.complete(ls);
+}
+
+}  // namespace
+
+class EarlyFrameCompletionTest : public ::testing::TestWithParam<bool> {
+   protected:
+    void SetUp() override {
+        info = default_sensor_info(LidarMode::MODE_1024x10);
+        info.format.udp_profile_lidar = UDPProfileLidar::RNG19_RFL8_SIG16_NIR16;
+    }
+
+    // two scans used in turns like the ring of the LidarPacketHandler,
+    // holding garbage as if they were left from older frames
+    std::vector<LidarScan> ring() const {
+        std::vector<LidarScan> scans(2, LidarScan(info));
+        for (auto& ls : scans) {
+            for (auto& f : ls.fields())
+                std::memset(f.second.get(), 0xab, f.second.bytes());
+            ls.status().setConstant(0x01);
+            ls.timestamp().setConstant(1);
+        }
+        return scans;
+    }
+
+    // batches the packets the way the LidarPacketHandler does without early
+    // completion
+    std::vector<LidarScan> batch(const std::vector<LidarPacket>& packets) {
+        ScanBatcher batcher(info);
+        auto scans = ring();
+        std::vector<LidarScan> completed;
+        for (const auto& p : packets) {
+            auto& ls = scans[completed.size() % 2];
+            if (batcher(p, ls)) completed.push_back(ls);
+        }
+        return completed;
+    }
+
+    /**
+     * Batches the packets the way the LidarPacketHandler does with early
+     * completion, with the ScanBatcher or the ProfileScanBatcher.
+     * @param[out] completing the index of the packets completing each scan.
+     */
+    std::vector<LidarScan> batch_early(const std::vector<LidarPacket>& packets,
+                                       std::vector<size_t>* completing) {
+        if (GetParam()) {
+            ProfileScanBatcher batcher(
+                info, get_field_types(info.format.udp_profile_lidar), 2);
+            return batch_early(batcher, packets, completing);
+        }
+        ScanBatcher batcher(info);
+        return batch_early(batcher, packets, completing);
+    }
+
+    template <typename Batcher>
+    std::vector<LidarScan> batch_early(Batcher& batcher,
+                                       const std::vector<LidarPacket>& packets,
+                                       std::vector<size_t>* completing) {
+        const auto& pf = get_format(info);
+        EarlyFrameCompletion frame_completion(info);
+        auto scans = ring();
+        std::vector<LidarScan> completed;
+        for (size_t i = 0; i < packets.size(); ++i) {
+            const auto& p = packets[i];
+            auto& ls = scans[completed.size() % 2];
+            const auto admission = frame_completion.admit(pf, p.buf.data(), ls);
+            if (admission == EarlyFrameCompletion::Admission::DROP_LATE) {
+                ++late;
+                continue;
+            }
+            bool done = batcher(p, ls);
+            if (!done && frame_completion.completes(pf, p.buf.data(), ls)) {
+                complete(batcher, ls);
+                frame_completion.zero_trailing_columns(ls);
+                done = true;
+            }
+            if (!done) continue;
+            completed.push_back(ls);
+            if (completing) completing->push_back(i);
+        }
+        return completed;
+    }
+
+    static std::vector<LidarPacket> concat(
+        const std::vector<std::vector<LidarPacket>>& frames) {
+        std::vector<LidarPacket> packets;
+        for (const auto& frame : frames)
+            packets.insert(packets.end(), frame.begin(), frame.end());
+        return packets;
+    }
+
+    SensorInfo info;
+    int late = 0;
+};
+
+TEST_P(EarlyFrameCompletionTest, CompletesScansOnTheirLastPacket) {
+    PacketSource source(info);
+    std::vector<std::vector<LidarPacket>> frames;
+    for (uint16_t frame_id = 1; frame_id <= 4; ++frame_id)
+        frames.push_back(source.frame(frame_id));
+    const auto packets = concat(frames);
+
+    std::vector<size_t> completing;
+    const auto early = batch_early(packets, &completing);
+    const auto expected = batch(packets);
+    // the last frame doesn't wait for a next one
+    ASSERT_EQ(early.size(), 4U);
+    ASSERT_EQ(expected.size(), 3U);
+    for (size_t i = 0; i < early.size(); ++i)
+        EXPECT_EQ(completing[i], (i + 1) * source.packets_per_frame - 1);
+    for (size_t i = 0; i < expected.size(); ++i)
+        expect_same_scan(early[i], expected[i]);
+    EXPECT_EQ(late, 0);
+}
+
+TEST_P(EarlyFrameCompletionTest, FallsBackToTheNextFrameOnLoss) {
+    PacketSource source(info);
+    std::vector<std::vector<LidarPacket>> frames;
+    for (uint16_t frame_id = 1; frame_id <= 4; ++frame_id)
+        frames.push_back(source.frame(frame_id));
+    // frame 2 misses its last packet and a few others
+    frames[1].pop_back();
+    frames[1].erase(frames[1].begin() + 10, frames[1].begin() + 12);
+    const auto packets = concat(frames);
+
+    std::vector<size_t> completing;
+    const auto early = batch_early(packets, &completing);
+    const auto expected = batch(packets);
+    ASSERT_EQ(early.size(), 4U);
+    // completed by the first packet of frame 3
+    EXPECT_EQ(completing[1], frames[0].size() + frames[1].size());
+    for (size_t i = 0; i < expected.size(); ++i)
+        expect_same_scan(early[i], expected[i]);
+}
+
+TEST_P(EarlyFrameCompletionTest, DropsPacketsArrivingAfterTheLastColumn) {
+    PacketSource source(info);
+    std::vector<std::vector<LidarPacket>> frames;
+    for (uint16_t frame_id = 1; frame_id <= 3; ++frame_id)
+        frames.push_back(source.frame(frame_id));
+    // the last two packets of frame 2 are swapped and a packet of frame 1
+    // arrives late as well
+    auto& second = frames[1];
+    std::swap(second[second.size() - 1], second[second.size() - 2]);
+    second.push_back(frames[0][7]);
+    const auto early = batch_early(concat(frames), nullptr);
+    EXPECT_EQ(late, 2);
+
+    // same as never getting the late packets
+    const auto late_packet = second[second.size() - 2];
+    second.pop_back();
+    second.pop_back();
+    auto packets = concat(frames);
+    packets.push_back(source.packet(4, 0));
+    const auto expected = batch(packets);
+    ASSERT_EQ(early.size(), 3U);
+    ASSERT_EQ(expected.size(), 3U);
+    for (size_t i = 0; i < expected.size(); ++i)
+        expect_same_scan(early[i], expected[i]);
+    const auto& pf = get_format(info);
+    const size_t m_id =
+        pf.col_measurement_id(pf.nth_col(0, late_packet.buf.data()));
+    EXPECT_EQ(early[1].status()[m_id], 0U);
+}
+
+TEST_P(EarlyFrameCompletionTest, CompletesAtTheEndOfTheAzimuthWindow) {
+    info.format.column_window = {0, 511};
+    EXPECT_EQ(EarlyFrameCompletion::expected_last_measurement_id(info), 511U);
+    PacketSource source(info);
+    std::vector<std::vector<LidarPacket>> frames;
+    for (uint16_t frame_id = 1; frame_id <= 3; ++frame_id)
+        frames.push_back(source.frame(frame_id, 0, 511));
+    const auto packets = concat(frames);
+
+    std::vector<size_t> completing;
+    const auto early = batch_early(packets, &completing);
+    const auto expected = batch(packets);
+    ASSERT_EQ(early.size(), 3U);
+    EXPECT_EQ(completing[0], frames[0].size() - 1);
+    // the columns past the window don't hold the data of older scans
+    for (size_t i = 0; i < expected.size(); ++i)
+        expect_same_scan(early[i], expected[i]);
+}
+
+TEST_P(EarlyFrameCompletionTest, WrappedWindowsEndWithTheFrame) {
+    info.format.column_window = {768, 255};
+    EXPECT_EQ(EarlyFrameCompletion::expected_last_measurement_id(info),
+              1023U);
+    PacketSource source(info);
+    std::vector<std::vector<LidarPacket>> frames;
+    for (uint16_t frame_id = 1; frame_id <= 3; ++frame_id) {
+        frames.push_back(source.frame(frame_id, 0, 255));
+        const auto end = source.frame(frame_id, 768);
+        frames.back().insert(frames.back().end(), end.begin(), end.end());
+    }
+    const auto packets = concat(frames);
+
+    std::vector<size_t> completing;
+    const auto early = batch_early(packets, &completing);
+    const auto expected = batch(packets);
+    ASSERT_EQ(early.size(), 3U);
+    EXPECT_EQ(completing[0], frames[0].size() - 1);
+    for (size_t i = 0; i < expected.size(); ++i)
+        expect_same_scan(early[i], expected[i]);
+}
+
+INSTANTIATE_TEST_SUITE_P(Batchers, EarlyFrameCompletionTest,
+                         ::testing::Values(false, true));
@@ -0,0 +1,66 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+// prevent clang-format from altering the location of "ouster_ros/os_ros.h", the
+// header file needs to be the first include due to PCL_NO_PRECOMPILE flag
+// clang-format off
+#include "ouster_ros/os_ros.h"
+// clang-format on
+
+#include "../src/lidar_packet_handler.h"
+#include "packet_source.h"
+
+using namespace ouster_ros;
+using namespace ouster::sdk::core;
+using test::PacketSource;
+
+TEST(LidarPacketHandlerTest, QueuedScansKeepTheirOwnTimestamps) {
+    auto info = default_sensor_info(LidarMode::MODE_1024x10);
+    info.format.udp_profile_lidar = UDPProfileLidar::RNG19_RFL8_SIG16_NIR16;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool released = false;
+    // frame id, estimated ts and msg ts of every processed scan
+    std::vector<std::tuple<int64_t, uint64_t, ros::Time>> processed;
+    LidarScanProcessor processor = [&](const LidarScan& ls, uint64_t ts,
+                                       const ros::Time& msg_ts) {
+        std::unique_lock<std::mutex> lock(mutex);
+        // hold the first scan so that the next ones queue up in the ring
+        cv.wait(lock, [&]() { return released; });
+        processed.emplace_back(ls.frame_id, ts, msg_ts);
+        cv.notify_all();
+    };
+
+    {
+        auto handler = LidarPacketHandler::create(
+            info, {processor}, "TIME_FROM_INTERNAL_OSC", 0, 0.0f);
+        PacketSource source(info);
+        // the first packet of a frame completes the scan of the previous one
+        for (uint16_t frame_id = 1; frame_id <= 4; ++frame_id)
+            for (const auto& p : source.frame(frame_id)) handler(p);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        released = true;
+        cv.notify_all();
+        ASSERT_TRUE(cv.wait_for(lock, std::chrono::seconds(5),
+                                [&]() { return processed.size() == 3; }));
+    }
+
+    for (size_t i = 0; i < processed.size(); ++i) {
+        const auto frame_id = std::get<0>(processed[i]);
+        EXPECT_EQ(frame_id, static_cast<int64_t>(i + 1));
+        // the first column of a frame is stamped frame_id * 100000000
+        const uint64_t expected_ts = frame_id * 100000000ull;
+        EXPECT_EQ(std::get<1>(processed[i]), expected_ts)
+            << "frame " << frame_id;
+        EXPECT_EQ(std::get<2>(processed[i]),
+                  ouster_ros::impl::ts_to_ros_time(expected_ts))
+            << "frame " << frame_id;
+    }
+}
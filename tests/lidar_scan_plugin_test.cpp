@@ -0,0 +1,143 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+
+// prevent clang-format from altering the location of "ouster_ros/os_ros.h", the
+// header file needs to be the first include due to PCL_NO_PRECOMPILE flag
+// clang-format off
+#include "ouster_ros/os_ros.h"
+// clang-format on
+#include "../src/point_cloud_processor_factory.h"
+#include "../src/lidar_scan_plugin_processor.h"
+
+using namespace ouster_ros;
+using namespace ouster::sdk::core;
+
+namespace {
+
+class RecordingPlugin : public LidarScanPlugin {
+   public:
+    void initialize(ros::NodeHandle&, ros::NodeHandle&,
+                    const SensorInfo&) override {}
+
+    std::vector<std::string> required_fields(
+        const SensorInfo&) const override {
+        return {ChanField::RANGE};
+    }
+
+    void process(const LidarScan& scan, uint64_t scan_ts, const ros::Time&,
+                 const LidarScanProducts& products) override {
+        last_scan_ts = scan_ts;
+        xyz_valid = products.xyz_valid(scan, scan_ts);
+        valid_points.clear();
+        for (const auto* xyz : products.xyz) {
+            size_t valid = 0;
+            for (int i = 0; i < xyz->rows(); ++i)
+                if (!std::isnan((*xyz)(i, 0))) ++valid;
+            valid_points.push_back(valid);
+        }
+        if (throws) throw std::runtime_error("plugin failure");
+    }
+
+    uint64_t last_scan_ts = 0;
+    bool xyz_valid = false;
+    std::vector<size_t> valid_points;
+    bool throws = false;
+};
+
+}  // namespace
+
+class LidarScanPluginTest : public ::testing::Test {
+   protected:
+    void SetUp() override {
+        info = default_sensor_info(LidarMode::MODE_1024x10);
+        info.config.lidar_mode = LidarMode::MODE_1024x10;
+        info.format.udp_profile_lidar =
+            UDPProfileLidar::RNG19_RFL8_SIG16_NIR16_DUAL;
+        ls = std::make_unique<LidarScan>(info);
+        // first return valid everywhere, second return only on half the pixels
+        auto range = ls->field<uint32_t>(ChanField::RANGE);
+        auto range2 = ls->field<uint32_t>(ChanField::RANGE2);
+        for (int i = 0; i < range.size(); ++i) {
+            range.data()[i] = 5000;
+            range2.data()[i] = i % 2 ? 7000 : 0;
+        }
+    }
+
+    SensorInfo info;
+    std::unique_ptr<LidarScan> ls;
+};
+
+TEST_F(LidarScanPluginTest, ParseNamesKeepsOrder) {
+    EXPECT_EQ(LidarScanPluginProcessor::parse_names(" b::Z | a::Y||c::X "),
+              (std::vector<std::string>{"b::Z", "a::Y", "c::X"}));
+    EXPECT_TRUE(LidarScanPluginProcessor::parse_names("").empty());
+}
+
+TEST_F(LidarScanPluginTest, PluginsReceiveXYZOfEveryReturn) {
+    auto products = std::make_shared<LidarScanProducts>();
+    auto pcl_processor =
+        PointCloudProcessorFactory::create_point_cloud_processor(
+            "xyz", info, "os_lidar", true, true, true, 1,
+            std::numeric_limits<uint32_t>::max(), 1, "",
+            [](const PointCloudProcessor_OutputType&) {}, {}, nullptr,
+            products);
+    ASSERT_EQ(products->xyz.size(), 2U);
+
+    auto plugin = std::make_shared<RecordingPlugin>();
+    auto plugin_processor =
+        LidarScanPluginProcessor::create({{"recording", plugin}}, products);
+
+    pcl_processor(*ls, 42, ros::Time(1, 0));
+    plugin_processor(*ls, 42, ros::Time(1, 0));
+
+    const size_t pixels = info.format.columns_per_frame *
+                          info.format.pixels_per_column;
+    EXPECT_EQ(plugin->last_scan_ts, 42U);
+    EXPECT_TRUE(plugin->xyz_valid);
+    EXPECT_EQ(plugin->valid_points,
+              (std::vector<size_t>{pixels, pixels / 2}));
+}
+
+TEST_F(LidarScanPluginTest, PluginsTellXYZOfSkippedScansApart) {
+    auto products = std::make_shared<LidarScanProducts>();
+    auto pcl_processor =
+        PointCloudProcessorFactory::create_point_cloud_processor(
+            "xyz", info, "os_lidar", true, true, true, 1,
+            std::numeric_limits<uint32_t>::max(), 1, "",
+            [](const PointCloudProcessor_OutputType&) {}, {}, nullptr,
+            products);
+    auto plugin = std::make_shared<RecordingPlugin>();
+    auto plugin_processor =
+        LidarScanPluginProcessor::create({{"recording", plugin}}, products);
+
+    // nothing computed yet
+    ls->frame_id = 1;
+    plugin_processor(*ls, 100, ros::Time(1, 0));
+    EXPECT_FALSE(plugin->xyz_valid);
+
+    pcl_processor(*ls, 100, ros::Time(1, 0));
+    plugin_processor(*ls, 100, ros::Time(1, 0));
+    EXPECT_TRUE(plugin->xyz_valid);
+
+    // the point cloud processor skipped the next scan, xyz is still the one
+    // of frame 1
+    ls->frame_id = 2;
+    plugin_processor(*ls, 200, ros::Time(1, 1));
+    EXPECT_FALSE(plugin->xyz_valid);
+    EXPECT_EQ(products->frame_id, 1);
+    EXPECT_EQ(products->scan_ts, 100U);
+}
+
+TEST_F(LidarScanPluginTest, PluginExceptionsDoNotPropagate) {
+    auto products = std::make_shared<LidarScanProducts>();
+    auto failing = std::make_shared<RecordingPlugin>();
+    failing->throws = true;
+    auto next = std::make_shared<RecordingPlugin>();
+    auto plugin_processor = LidarScanPluginProcessor::create(
+        {{"failing", failing}, {"next", next}}, products);
+
+    EXPECT_NO_THROW(plugin_processor(*ls, 7, ros::Time(1, 0)));
+    EXPECT_EQ(next->last_scan_ts, 7U);
+    EXPECT_TRUE(next->valid_points.empty());
+}
@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+
+#include <random>
+
+// prevent clang-format from altering the location of "ouster_ros/os_ros.h", the
+// header file needs to be the first include due to PCL_NO_PRECOMPILE flag
+// clang-format off
+#include "ouster_ros/os_ros.h"
+// clang-format on
+#include "../src/point_cloud_processor_factory.h"
+#include "../src/memory_budget.h"
+
+using namespace ouster_ros;
+using namespace ouster::sdk::core;
+
+class CompactXYZLutTest : public ::testing::Test {
+   protected:
+    void SetUp() override {
+        info = default_sensor_info(LidarMode::MODE_1024x10);
+        W = info.format.columns_per_frame;
+        H = info.format.pixels_per_column;
+        lut = make_xyz_lut(W, H, RANGE_UNIT, info.beam_to_lidar_transform,
+                           info.lidar_to_sensor_transform,
+                           info.beam_azimuth_angles, info.beam_altitude_angles);
+    }
+
+    SensorInfo info;
+    size_t W, H;
+    XYZLut lut;
+};
+
+TEST_F(CompactXYZLutTest, MatchesFullLut) {
+    auto compact = ouster::make_compact_xyz_lut<float>(lut, W, H);
+    ASSERT_TRUE(compact);
+    EXPECT_LT(compact->bytes(), W * H * sizeof(float));
+
+    img_t<uint32_t> range(H, W);
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<uint32_t> range_dist(0, 150000);
+    for (int i = 0; i < range.size(); ++i) range.data()[i] = range_dist(rng);
+
+    ArrayX3fR direction = lut.direction.cast<float>();
+    ArrayX3fR offset = lut.offset.cast<float>();
+    PointCloudXYZf expected(W * H, 3), actual(W * H, 3);
+    ouster::cartesianT(expected, range, direction, offset, 0U, 100000U, -1.0f);
+    ouster::cartesianT(actual, range, *compact, 0U, 100000U, -1.0f);
+
+    // float rounding only, well below the range resolution
+    EXPECT_LT((expected - actual).abs().maxCoeff(), 1e-4f);
+}
+
+TEST_F(CompactXYZLutTest, RejectsNonFactorableLut) {
+    lut.direction(W + 3, 0) += 1e-4;
+    EXPECT_FALSE(ouster::make_compact_xyz_lut<float>(lut, W, H));
+}
+
+TEST(MemoryBudgetTest, RingDepthFitsRemainingBudget) {
+    memory::MemoryBudget unlimited;
+    EXPECT_EQ(unlimited.ring_depth(100, 3, 10), 10U);
+
+    memory::MemoryBudget budget(1000);
+    budget.account("lut", 300);
+    budget.account("lut", 100);
+    EXPECT_EQ(budget.components().size(), 1U);
+    EXPECT_EQ(budget.remaining(), 600U);
+    EXPECT_EQ(budget.ring_depth(100, 3, 10), 6U);
+    EXPECT_EQ(budget.ring_depth(10, 3, 10), 10U);
+    EXPECT_EQ(budget.ring_depth(1000, 3, 10), 3U);
+}
+
+TEST(MemoryBudgetTest, PointCloudProcessorHandsOverOneReturnAtATime) {
+    auto info = default_sensor_info(LidarMode::MODE_1024x10);
+    info.format.udp_profile_lidar = UDPProfileLidar::RNG19_RFL8_SIG16_NIR16_DUAL;
+    LidarScan ls(info.format.columns_per_frame, info.format.pixels_per_column,
+                 info.format.udp_profile_lidar);
+
+    memory::MemoryBudget budget(64 * 1000000);
+    std::vector<size_t> handed_over;
+    auto processor = PointCloudProcessorFactory::create_point_cloud_processor(
+        "original", info, "os_lidar", true, true, true, 0,
+        std::numeric_limits<uint32_t>::max(), 1, "",
+        [&handed_over](const PointCloudProcessor_OutputType& msgs) {
+            ASSERT_EQ(msgs.size(), 2U);
+            for (size_t i = 0; i < msgs.size(); ++i)
+                if (msgs[i]) handed_over.push_back(i);
+        },
+        {}, &budget);
+    processor(ls, 0, ros::Time(1, 0));
+
+    EXPECT_EQ(handed_over, (std::vector<size_t>{0, 1}));
+    EXPECT_GT(budget.total(), 0U);
+}
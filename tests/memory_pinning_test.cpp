@@ -0,0 +1,86 @@
+#include <gtest/gtest.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <string>
+
+#include "../src/memory_pinning.h"
+
+using namespace ouster_ros::memory;
+
+namespace {
+
+size_t locked_kb() {
+    std::ifstream status("/proc/self/status");
+    std::string key;
+    size_t value;
+    while (status >> key) {
+        if (key == "VmLck:" && status >> value) return value;
+        status.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    }
+    return 0;
+}
+
+// page aligned buffer unmapped once the test is done
+class Pages {
+   public:
+    explicit Pages(size_t count)
+        : page_size(sysconf(_SC_PAGESIZE)), bytes(count * page_size) {
+        data = static_cast<uint8_t*>(mmap(nullptr, bytes,
+                                          PROT_READ | PROT_WRITE,
+                                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    }
+    ~Pages() { munmap(data, bytes); }
+
+    const size_t page_size;
+    const size_t bytes;
+    uint8_t* data;
+};
+
+}  // namespace
+
+TEST(UncoveredTest, LeavesThePartsNoOtherRangeOverlaps) {
+    using impl::PageRange;
+    EXPECT_EQ(impl::uncovered({10, 20}, {}),
+              (std::vector<PageRange>{{10, 20}}));
+    EXPECT_EQ(impl::uncovered({10, 20}, {{15, 18}, {0, 12}}),
+              (std::vector<PageRange>{{12, 15}, {18, 20}}));
+    EXPECT_EQ(impl::uncovered({10, 20}, {{20, 30}, {0, 10}}),
+              (std::vector<PageRange>{{10, 20}}));
+    EXPECT_TRUE(impl::uncovered({10, 20}, {{12, 30}, {5, 14}}).empty());
+}
+
+TEST(PinnedRegionsTest, SharedPagesAreCountedOnce) {
+    Pages pages(4);
+    BufferPinning pinning;
+    pinning.hugepages = true;
+    PinnedRegions pinned(pinning);
+    // two buffers sharing their boundary page
+    EXPECT_EQ(pinned.pin(pages.data, pages.page_size + 8), 2 * pages.page_size);
+    EXPECT_EQ(pinned.pin(pages.data + pages.page_size + 8, pages.page_size),
+              pages.page_size);
+    EXPECT_EQ(pinned.pinned_bytes(), 3 * pages.page_size);
+}
+
+TEST(PinnedRegionsTest, SharedPagesStayLockedUntilTheLastRegionGoes) {
+    Pages pages(4);
+    BufferPinning pinning;
+    pinning.mlock = true;
+    const size_t before = locked_kb();
+    auto first = std::make_unique<PinnedRegions>(pinning);
+    auto second = std::make_unique<PinnedRegions>(pinning);
+    // the first buffer ends and the second one starts on the second page
+    first->pin(pages.data, pages.page_size + 8);
+    second->pin(pages.data + pages.page_size + 8, 2 * pages.page_size - 8);
+    const size_t page_kb = pages.page_size / 1024;
+    if (locked_kb() != before + 3 * page_kb)
+        GTEST_SKIP() << "mlock is not permitted (RLIMIT_MEMLOCK)";
+
+    first.reset();
+    EXPECT_EQ(locked_kb(), before + 2 * page_kb);
+    second.reset();
+    EXPECT_EQ(locked_kb(), before);
+}
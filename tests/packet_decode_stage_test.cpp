@@ -0,0 +1,138 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../src/packet_decode_stage.h"
+
+using namespace ouster_ros;
+using namespace ouster::sdk::core;
+using namespace std::chrono_literals;
+
+namespace {
+
+// polls until condition holds or the timeout passes
+template <typename Condition>
+bool eventually(Condition condition, std::chrono::milliseconds timeout = 5s) {
+    const auto until = std::chrono::steady_clock::now() + timeout;
+    while (!condition()) {
+        if (std::chrono::steady_clock::now() > until) return false;
+        std::this_thread::sleep_for(1ms);
+    }
+    return true;
+}
+
+constexpr size_t PACKET_SIZE = 64;
+
+LidarPacket packet_of(uint32_t seq) {
+    LidarPacket p;
+    p.buf.assign(PACKET_SIZE, static_cast<uint8_t>(seq));
+    std::memcpy(p.buf.data(), &seq, sizeof(seq));
+    p.host_timestamp = seq;
+    return p;
+}
+
+uint32_t seq_of(const LidarPacket& p) {
+    uint32_t seq;
+    std::memcpy(&seq, p.buf.data(), sizeof(seq));
+    return seq;
+}
+
+}  // namespace
+
+TEST(PacketDecodeStageTest, DecodesEveryPacketInOrderOnItsOwnThread) {
+    std::mutex mutex;
+    std::vector<uint32_t> decoded;
+    std::thread::id decode_thread;
+    bool intact = true;
+    PacketDecodeStage stage(
+        [&](const LidarPacket& p) {
+            std::lock_guard<std::mutex> lock(mutex);
+            decode_thread = std::this_thread::get_id();
+            intact &= p.host_timestamp == seq_of(p) &&
+                      p.buf.back() == static_cast<uint8_t>(seq_of(p));
+            decoded.push_back(seq_of(p));
+        },
+        16, PACKET_SIZE, "test");
+
+    // the receive thread reuses its packet, as OusterSensor does
+    LidarPacket packet;
+    for (uint32_t seq = 0; seq < 1000; ++seq) {
+        packet = packet_of(seq);
+        // keeps the ring from overflowing
+        ASSERT_TRUE(eventually([&]() { return stage.size() < 16; }));
+        EXPECT_TRUE(stage.push(packet));
+        // the decode thread sleeps in between at times
+        if (seq % 100 == 0) std::this_thread::sleep_for(2ms);
+    }
+
+    ASSERT_TRUE(eventually([&]() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return decoded.size() == 1000;
+    }));
+    std::lock_guard<std::mutex> lock(mutex);
+    for (uint32_t seq = 0; seq < decoded.size(); ++seq)
+        ASSERT_EQ(decoded[seq], seq);
+    EXPECT_TRUE(intact);
+    EXPECT_NE(decode_thread, std::this_thread::get_id());
+    EXPECT_EQ(stage.dropped(), 0U);
+}
+
+TEST(PacketDecodeStageTest, DropsPacketsOnceFullAndReportsTheDepth) {
+    std::atomic<bool> released{false};
+    std::atomic<int> decoded{0};
+    auto stats = std::make_shared<PipelineStats>();
+    PacketDecodeStage stage(
+        [&](const LidarPacket&) {
+            while (!released) std::this_thread::sleep_for(1ms);
+            ++decoded;
+        },
+        4, PACKET_SIZE, "test", stats);
+    // unblocks the decoder before the stage joins it, failed or not
+    struct Release {
+        std::atomic<bool>& released;
+        ~Release() { released = true; }
+    } release{released};
+    EXPECT_EQ(stage.capacity(), 4U);
+    EXPECT_EQ(stats->packet_queue_capacity, 4U);
+
+    // the packet being decoded holds on to its slot
+    for (uint32_t seq = 0; seq < 4; ++seq)
+        EXPECT_TRUE(stage.push(packet_of(seq)));
+    EXPECT_FALSE(stage.push(packet_of(4)));
+    EXPECT_FALSE(stage.push(packet_of(5)));
+    EXPECT_EQ(stage.size(), 4U);
+    EXPECT_EQ(stage.high_water_mark(), 4U);
+    EXPECT_EQ(stage.dropped(), 2U);
+    EXPECT_EQ(stats->packet_queue_depth, 4U);
+    EXPECT_EQ(stats->packet_queue_high_water_mark, 4U);
+    EXPECT_EQ(stats->packet_queue_drops, 2U);
+
+    released = true;
+    ASSERT_TRUE(eventually([&]() { return decoded == 4; }));
+    EXPECT_TRUE(eventually([&]() { return stats->packet_queue_depth == 0; }));
+    EXPECT_EQ(stage.size(), 0U);
+    EXPECT_EQ(stage.high_water_mark(), 4U);
+}
+
+TEST(PacketDecodeStageTest, WakesUpPromptlyOnAPacket) {
+    std::promise<std::chrono::steady_clock::time_point> decoded_at;
+    PacketDecodeStage stage(
+        [&](const LidarPacket&) {
+            decoded_at.set_value(std::chrono::steady_clock::now());
+        },
+        4, PACKET_SIZE, "test");
+    // gives the decode thread time to go to sleep on the empty ring
+    std::this_thread::sleep_for(20ms);
+    const auto pushed_at = std::chrono::steady_clock::now();
+    stage.push(packet_of(1));
+    auto decoded = decoded_at.get_future();
+    ASSERT_EQ(decoded.wait_for(1s), std::future_status::ready);
+    // well below the timeout of the wait
+    EXPECT_LT(decoded.get() - pushed_at, 50ms);
+}
@@ -0,0 +1,154 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <random>
+#include <tuple>
+
+// prevent clang-format from altering the location of "ouster_ros/os_ros.h", the
+// header file needs to be the first include due to PCL_NO_PRECOMPILE flag
+// clang-format off
+#include "ouster_ros/os_ros.h"
+// clang-format on
+
+#include "../src/packet_decoder.h"
+#include "packet_source.h"
+
+using namespace ouster_ros;
+using namespace ouster::sdk::core;
+using test::PacketSource;
+using test::expect_same_scan;
+
+// the profile and whether the kernels gather with AVX2
+class PacketDecoderTest
+    : public ::testing::TestWithParam<std::tuple<UDPProfileLidar, bool>> {
+   protected:
+    void SetUp() override {
+        info = default_sensor_info(LidarMode::MODE_1024x10);
+        info.format.udp_profile_lidar = profile();
+    }
+
+    UDPProfileLidar profile() const { return std::get<0>(GetParam()); }
+    bool avx2() const { return std::get<1>(GetParam()); }
+
+    /**
+     * Batches the packets with the ScanBatcher and the ProfileScanBatcher,
+     * alternating between two scans each so the scans hold the data of an
+     * older frame, and compares every completed scan.
+     * @return the number of completed scans.
+     */
+    int batch_and_compare(const std::vector<LidarPacket>& packets,
+                          const LidarScanFieldTypes& field_types) {
+        ScanBatcher reference(info);
+        ProfileScanBatcher specialized(info, field_types, 2, avx2());
+        EXPECT_FALSE(specialized.specialized_fields().empty());
+        EXPECT_STREQ(specialized.implementation(),
+                     avx2() && decoding::avx2_supported() ? "avx2" : "scalar");
+        std::vector<LidarScan> expected, actual;
+        for (int i = 0; i < 2; ++i) {
+            expected.emplace_back(info.format.columns_per_frame,
+                                  info.format.pixels_per_column, field_types,
+                                  info.format.columns_per_packet);
+            actual.emplace_back(info.format.columns_per_frame,
+                                info.format.pixels_per_column, field_types,
+                                info.format.columns_per_packet);
+        }
+        int completed = 0;
+        for (const auto& p : packets) {
+            const bool done = reference(p, expected[completed % 2]);
+            EXPECT_EQ(specialized(p, actual[completed % 2]), done);
+            // the frame being batched is known before the scan completes
+            EXPECT_EQ(actual[completed % 2].frame_id,
+                      expected[completed % 2].frame_id);
+            if (!done) continue;
+            expect_same_scan(actual[completed % 2], expected[completed % 2]);
+            ++completed;
+        }
+        return completed;
+    }
+
+    SensorInfo info;
+};
+
+TEST_P(PacketDecoderTest, DecodesCompleteFramesLikeTheScanBatcher) {
+    PacketSource source(info);
+    std::vector<LidarPacket> packets;
+    for (uint16_t frame_id = 1; frame_id <= 4; ++frame_id) {
+        const auto frame = source.frame(frame_id);
+        packets.insert(packets.end(), frame.begin(), frame.end());
+    }
+    EXPECT_EQ(batch_and_compare(packets, get_field_types(profile())), 3);
+}
+
+TEST_P(PacketDecoderTest, HandlesMissingAndLatePacketsLikeTheScanBatcher) {
+    PacketSource source(info);
+    std::vector<std::vector<LidarPacket>> frames;
+    for (uint16_t frame_id = 1; frame_id <= 4; ++frame_id)
+        frames.push_back(source.frame(frame_id));
+    // frame 2 misses a few packets and its last one, one of them arrives
+    // once frame 3 started
+    const auto late = frames[1][5];
+    frames[1].erase(frames[1].begin() + 10, frames[1].begin() + 13);
+    frames[1].erase(frames[1].begin() + 5);
+    frames[1].pop_back();
+    frames[2].insert(frames[2].begin() + 3, late);
+    // frame 3 has two packets swapped
+    std::swap(frames[2][20], frames[2][21]);
+
+    std::vector<LidarPacket> packets;
+    for (const auto& frame : frames)
+        packets.insert(packets.end(), frame.begin(), frame.end());
+    EXPECT_EQ(batch_and_compare(packets, get_field_types(profile())), 3);
+}
+
+TEST_P(PacketDecoderTest, LeavesInvalidColumnsOutLikeTheScanBatcher) {
+    PacketSource source(info);
+    // a single column of a packet, a whole packet and the last column
+    source.invalid_columns = {17, 32, 33, 34, 35, 36, 37, 38, 39,
+                              40, 41, 42, 43, 44, 45, 46, 47, 1023};
+    std::vector<LidarPacket> packets;
+    for (uint16_t frame_id = 1; frame_id <= 4; ++frame_id) {
+        const auto frame = source.frame(frame_id);
+        packets.insert(packets.end(), frame.begin(), frame.end());
+    }
+    EXPECT_EQ(batch_and_compare(packets, get_field_types(profile())), 3);
+}
+
+TEST_P(PacketDecoderTest, DecodesASubsetOfTheFields) {
+    PacketSource source(info);
+    std::vector<LidarPacket> packets;
+    for (uint16_t frame_id = 1; frame_id <= 3; ++frame_id) {
+        const auto frame = source.frame(frame_id);
+        packets.insert(packets.end(), frame.begin(), frame.end());
+    }
+    LidarScanFieldTypes range_only;
+    for (const auto& ft : get_field_types(profile()))
+        if (ft.name == ChanField::RANGE) range_only.push_back(ft);
+    EXPECT_EQ(batch_and_compare(packets, range_only), 2);
+}
+
+TEST_P(PacketDecoderTest, TargetScansAreLimitedToThoseAllocatedUpfront) {
+    PacketSource source(info);
+    const auto field_types = get_field_types(profile());
+    ProfileScanBatcher batcher(info, field_types, 1, avx2());
+    EXPECT_GT(batcher.memory_bytes(), 0U);
+    LidarScan first(info), second(info);
+    const auto packet = source.packet(1, 0);
+    batcher(packet, first);
+    batcher(packet, first);
+    EXPECT_THROW(batcher(packet, second), std::logic_error);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    SpecializedProfiles, PacketDecoderTest,
+    ::testing::Combine(
+        ::testing::Values(UDPProfileLidar::RNG19_RFL8_SIG16_NIR16,
+                          UDPProfileLidar::RNG15_RFL8_NIR8,
+                          UDPProfileLidar::RNG19_RFL8_SIG16_NIR16_DUAL),
+        ::testing::Bool()));
+
+TEST(PacketDecoderSupportTest, OtherProfilesAreLeftToTheScanBatcher) {
+    EXPECT_TRUE(PacketDecoder::supported(UDPProfileLidar::RNG15_RFL8_NIR8));
+    EXPECT_FALSE(PacketDecoder::supported(UDPProfileLidar::LEGACY));
+    EXPECT_FALSE(
+        PacketDecoder::supported(UDPProfileLidar::RNG15_RFL8_NIR8_ZONE16));
+}
@@ -0,0 +1,85 @@
+/**
+ * Copyright (c) 2018-2024, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file packet_source.h
+ * @brief Lidar packets shared by the tests of the packet batching
+ */
+
+#pragma once
+
+#include <ouster/impl/packet_writer.h>
+#include <ouster/lidar_scan.h>
+#include <ouster/types.h>
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <set>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace ouster_ros {
+namespace test {
+
+// packets of a frame with random pixel data, including the bits the profile
+// doesn't use, and consecutive columns
+class PacketSource {
+   public:
+    explicit PacketSource(const ouster::sdk::core::SensorInfo& info)
+        : writer(info),
+          packets_per_frame(info.format.columns_per_frame /
+                            info.format.columns_per_packet) {}
+
+    ouster::sdk::core::LidarPacket packet(uint16_t frame_id, int index) {
+        ouster::sdk::core::LidarPacket p;
+        p.buf.resize(writer.lidar_packet_size);
+        std::generate(p.buf.begin(), p.buf.end(), [this]() { return rng(); });
+        writer.set_frame_id(p.buf.data(), frame_id);
+        for (int c = 0; c < writer.columns_per_packet; ++c) {
+            auto* col = writer.nth_col(c, p.buf.data());
+            const uint16_t m_id = index * writer.columns_per_packet + c;
+            writer.set_col_measurement_id(col, m_id);
+            writer.set_col_timestamp(col, frame_id * 100000000ull + m_id);
+            writer.set_col_status(col,
+                                  invalid_columns.count(m_id) ? 0 : 0x01);
+        }
+        p.host_timestamp = frame_id * 100000000ull + index;
+        return p;
+    }
+
+    // the packets of a frame holding the columns [first_col, last_col]
+    std::vector<ouster::sdk::core::LidarPacket> frame(uint16_t frame_id,
+                                                      int first_col = 0,
+                                                      int last_col = -1) {
+        const int cpp = writer.columns_per_packet;
+        const int last_packet =
+            last_col < 0 ? packets_per_frame - 1 : last_col / cpp;
+        std::vector<ouster::sdk::core::LidarPacket> packets;
+        for (int i = first_col / cpp; i <= last_packet; ++i)
+            packets.push_back(packet(frame_id, i));
+        return packets;
+    }
+
+    ouster::sdk::core::impl::PacketWriter writer;
+    const int packets_per_frame;
+    std::mt19937 rng{42};
+    // measurement ids of the columns flagged invalid in every frame
+    std::set<uint16_t> invalid_columns;
+};
+
+inline void expect_same_scan(const ouster::sdk::core::LidarScan& actual,
+                             const ouster::sdk::core::LidarScan& expected) {
+    for (const auto& f : expected.fields()) {
+        const auto& other = actual.field(f.first);
+        ASSERT_EQ(other.bytes(), f.second.bytes()) << f.first;
+        EXPECT_EQ(std::memcmp(other.get(), f.second.get(), f.second.bytes()),
+                  0)
+            << "field " << f.first << " differs";
+    }
+    EXPECT_TRUE(actual == expected);
+}
+
+}  // namespace test
+}  // namespace ouster_ros
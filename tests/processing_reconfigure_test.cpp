@@ -0,0 +1,217 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <functional>
+#include <thread>
+
+#include "../src/processing_params.h"
+
+using namespace ouster_ros;
+
+namespace {
+
+using Processor = std::function<int()>;
+
+Processor returning(int value) {
+    return [value] { return value; };
+}
+
+std::vector<int> run(const std::vector<Processor>& processors) {
+    std::vector<int> results;
+    for (const auto& p : processors) results.push_back(p());
+    return results;
+}
+
+// a processor whose output reflects the params it was built with
+int tag_of(const ProcessingParams& p) {
+    return p.v_reduction * 1000 + static_cast<int>(p.max_range_m);
+}
+
+}  // namespace
+
+TEST(ProcessorSwapTest, SwapsStagedProcessorsOnApply) {
+    ProcessorSwap<Processor> swap;
+    std::vector<Processor> processors{returning(1), returning(2)};
+    EXPECT_EQ(swap.apply(processors), 0U);
+
+    swap.stage(1, returning(20));
+    EXPECT_TRUE(swap.pending());
+    // nothing changes until the processing thread picks it up
+    EXPECT_EQ(run(processors), (std::vector<int>{1, 2}));
+    EXPECT_EQ(swap.apply(processors), 1U);
+    EXPECT_FALSE(swap.pending());
+    EXPECT_EQ(run(processors), (std::vector<int>{1, 20}));
+    EXPECT_EQ(swap.apply(processors), 0U);
+}
+
+TEST(ProcessorSwapTest, LatestStagedProcessorWins) {
+    ProcessorSwap<Processor> swap;
+    std::vector<Processor> processors{returning(1)};
+    swap.stage(0, returning(10));
+    swap.stage(0, returning(11));
+    // out of range indices are ignored
+    swap.stage(5, returning(50));
+    EXPECT_EQ(swap.apply(processors), 1U);
+    EXPECT_EQ(run(processors), (std::vector<int>{11}));
+}
+
+TEST(ProcessorSwapTest, InvokesOnSwapOnceTheProcessorIsInService) {
+    ProcessorSwap<Processor> swap;
+    std::vector<Processor> processors{returning(1)};
+    std::vector<int> seen;
+    swap.stage(0, returning(10), [&] { seen.push_back(processors[0]()); });
+    EXPECT_TRUE(seen.empty());
+    swap.apply(processors);
+    EXPECT_EQ(seen, (std::vector<int>{10}));
+    // the callback of a processor replaced before the swap is dropped
+    swap.stage(0, returning(20), [&] { seen.push_back(-1); });
+    swap.stage(0, returning(21));
+    swap.apply(processors);
+    EXPECT_EQ(seen, (std::vector<int>{10}));
+}
+
+TEST(ProcessorSwapTest, ReleasesRetiredProcessorsOnNextStage) {
+    ProcessorSwap<Processor> swap;
+    auto token = std::make_shared<int>(0);
+    std::weak_ptr<int> old_state = token;
+    std::vector<Processor> processors{[token] { return *token; }};
+    token.reset();
+
+    swap.stage(0, returning(1));
+    swap.apply(processors);
+    // kept alive so it isn't destroyed on the processing thread
+    EXPECT_FALSE(old_state.expired());
+    swap.stage(0, returning(2));
+    EXPECT_TRUE(old_state.expired());
+}
+
+TEST(ProcessorSwapTest, StagesConcurrentlyWithTheProcessingThread) {
+    ProcessorSwap<Processor> swap;
+    std::vector<Processor> processors{returning(0), returning(0)};
+    std::atomic<bool> done{false};
+    std::thread stager([&swap, &done] {
+        for (int generation = 1; generation <= 1000; ++generation) {
+            swap.stage(0, returning(generation));
+            swap.stage(1, returning(generation));
+        }
+        done = true;
+    });
+    // staged processors are never lost or taken over out of order
+    bool monotonic = true;
+    std::vector<int> last{0, 0};
+    while (!done || swap.pending()) {
+        swap.apply(processors);
+        const auto results = run(processors);
+        for (size_t i = 0; i < results.size(); ++i) {
+            monotonic &= results[i] >= last[i];
+            last[i] = results[i];
+        }
+    }
+    stager.join();
+    EXPECT_TRUE(monotonic);
+    EXPECT_EQ(run(processors), (std::vector<int>{1000, 1000}));
+}
+
+TEST(ProcessingParamsTest, ValidatesPointCloudParams) {
+    ProcessingParams params;
+    EXPECT_NO_THROW(params.validate_point_cloud());
+    params.min_range_m = 5.0;
+    params.max_range_m = 5.0;
+    EXPECT_THROW(params.validate_point_cloud(), std::runtime_error);
+    params.max_range_m = -1.0;
+    EXPECT_THROW(params.validate_point_cloud(), std::runtime_error);
+    params.max_range_m = 100.0;
+    params.v_reduction = 3;
+    EXPECT_THROW(params.validate_point_cloud(), std::runtime_error);
+}
+
+TEST(ProcessingParamsTest, ConvertsRangesToMillimeters) {
+    ProcessingParams params;
+    params.min_range_m = 0.5004;
+    params.max_range_m = 1e12;
+    EXPECT_EQ(params.min_range(), 500U);
+    EXPECT_EQ(params.max_range(), std::numeric_limits<uint32_t>::max());
+}
+
+class ProcessingReconfigureTest : public ::testing::Test {
+   protected:
+    void SetUp() override {
+        swap = std::make_shared<ProcessorSwap<Processor>>();
+        auto cloud = [this](const ProcessingParams& p, memory::MemoryBudget&,
+                            std::function<void()>* on_swap) {
+            ++cloud_builds;
+            if (on_swap) *on_swap = [this] { ++swapped_in; };
+            return returning(tag_of(p));
+        };
+        auto cloud_fields = [](const ProcessingParams& p) {
+            return p.point_type == "xyzi"
+                       ? std::vector<std::string>{"RANGE", "SIGNAL"}
+                       : std::vector<std::string>{"RANGE"};
+        };
+        auto image = [this](const ProcessingParams&, memory::MemoryBudget&,
+                            std::function<void()>*) {
+            ++image_builds;
+            return returning(-1);
+        };
+        auto image_fields = [](const ProcessingParams&) {
+            return std::vector<std::string>{"RANGE"};
+        };
+        reconfigure.add(0, true, cloud, cloud_fields);
+        reconfigure.add(1, false, image, image_fields);
+        processors = {cloud(initial, budget, nullptr),
+                      image(initial, budget, nullptr)};
+        cloud_builds = image_builds = 0;
+        reconfigure.attach(initial, {"RANGE"}, swap);
+    }
+
+    ProcessingParams initial;
+    memory::MemoryBudget budget;
+    std::shared_ptr<ProcessorSwap<Processor>> swap;
+    ProcessingReconfigure<Processor> reconfigure;
+    std::vector<Processor> processors;
+    int cloud_builds = 0;
+    int image_builds = 0;
+    int swapped_in = 0;
+};
+
+TEST_F(ProcessingReconfigureTest, RebuildsOnlyTheAffectedProcessors) {
+    EXPECT_EQ(reconfigure.apply(initial), 0U);
+
+    auto params = initial;
+    params.v_reduction = 4;
+    params.max_range_m = 50.0;
+    EXPECT_EQ(reconfigure.apply(params), 1U);
+    EXPECT_EQ(cloud_builds, 1);
+    EXPECT_EQ(image_builds, 0);
+    // shared state is only rewired by the processing thread
+    EXPECT_EQ(swapped_in, 0);
+    swap->apply(processors);
+    EXPECT_EQ(swapped_in, 1);
+    EXPECT_EQ(processors[0](), 4050);
+
+    // the mask affects both
+    params.mask_path = "mask.png";
+    EXPECT_EQ(reconfigure.apply(params), 2U);
+    EXPECT_EQ(cloud_builds, 2);
+    EXPECT_EQ(image_builds, 1);
+}
+
+TEST_F(ProcessingReconfigureTest, RejectsChangesThatNeedARestart) {
+    auto params = initial;
+    params.v_reduction = 3;
+    EXPECT_THROW(reconfigure.apply(params), std::runtime_error);
+
+    params = initial;
+    params.point_type = "xyzi";
+    EXPECT_THROW(reconfigure.apply(params), std::runtime_error);
+
+    EXPECT_EQ(cloud_builds, 0);
+    EXPECT_FALSE(swap->pending());
+    // a rejected change doesn't become the reference for the next one
+    EXPECT_EQ(reconfigure.apply(initial), 0U);
+}
+
+TEST_F(ProcessingReconfigureTest, NothingToReconfigureAfterClear) {
+    reconfigure.clear();
+    EXPECT_THROW(reconfigure.apply(initial), std::runtime_error);
+}
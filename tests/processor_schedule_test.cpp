@@ -0,0 +1,142 @@
+#include <gtest/gtest.h>
+
+#include "../src/processor_schedule.h"
+
+using namespace ouster_ros;
+using namespace std::chrono_literals;
+
+TEST(ProcessorScheduleTest, RunsHighPriorityFirst) {
+    ProcessorSchedule schedule({{0, 0ns}, {2, 0ns}, {1, 0ns}, {2, 0ns}}, 5);
+    // ties and processors without a policy keep the registration order
+    EXPECT_EQ(schedule.order(), (std::vector<size_t>{1, 3, 2, 0, 4}));
+}
+
+TEST(ProcessorScheduleTest, DefaultPoliciesKeepRegistrationOrder) {
+    ProcessorSchedule schedule({}, 3);
+    EXPECT_EQ(schedule.order(), (std::vector<size_t>{0, 1, 2}));
+    EXPECT_FALSE(schedule.deadline_lost(0, 10s));
+}
+
+TEST(ProcessorScheduleTest, DeadlineAccountsForTheCostOfTheProcessor) {
+    ProcessorSchedule schedule({{1, 50ms}, {0, 0ns}}, 2);
+    EXPECT_FALSE(schedule.deadline_lost(0, 40ms));
+    EXPECT_TRUE(schedule.deadline_lost(0, 60ms));
+
+    // the cold first run doesn't count
+    schedule.record(0, 1s);
+    EXPECT_FALSE(schedule.deadline_lost(0, 40ms));
+    schedule.record(0, 20ms);
+    // starting at 40ms it would be done around 60ms
+    EXPECT_TRUE(schedule.deadline_lost(0, 40ms));
+    EXPECT_FALSE(schedule.deadline_lost(0, 20ms));
+    // no deadline, never shed
+    schedule.record(1, 1s);
+    EXPECT_FALSE(schedule.deadline_lost(1, 10s));
+}
+
+TEST(ProcessorScheduleTest, CostFollowsRecentRuns) {
+    ProcessorSchedule schedule({{0, 100ms}}, 1);
+    schedule.record(0, 10ms);
+    schedule.record(0, 90ms);
+    EXPECT_TRUE(schedule.deadline_lost(0, 20ms));
+    for (int i = 0; i < 50; ++i) schedule.record(0, 10ms);
+    EXPECT_FALSE(schedule.deadline_lost(0, 20ms));
+}
+
+namespace {
+
+// runs the processor on scans started right after completion, its runs take
+// the durations given and then fast, returns the number of runs
+int run_scans(ProcessorSchedule& schedule, int scans,
+              const std::vector<std::chrono::nanoseconds>& slow_runs) {
+    int runs = 0;
+    for (int scan = 0; scan < scans; ++scan) {
+        if (schedule.deadline_lost(0, 1ms)) {
+            schedule.shed(0);
+            continue;
+        }
+        schedule.record(0, runs < static_cast<int>(slow_runs.size())
+                               ? slow_runs[runs]
+                               : 5ms);
+        ++runs;
+    }
+    return runs;
+}
+
+}  // namespace
+
+TEST(ProcessorScheduleTest, ColdFirstRunDoesNotShedTheProcessor) {
+    ProcessorSchedule schedule({{0, 50ms}}, 1);
+    EXPECT_EQ(run_scans(schedule, 1000, {60ms}), 1000);
+    EXPECT_EQ(schedule.skipped(0), 0U);
+}
+
+TEST(ProcessorScheduleTest, ProcessorsRecoverFromSlowRuns) {
+    ProcessorSchedule schedule({{0, 50ms}}, 1);
+    // after a warm slow run the processor is shed a few scans until its aged
+    // cost fits the deadline again, then the fast runs bring the cost down
+    const int runs = run_scans(schedule, 1000, {5ms, 200ms});
+    EXPECT_GT(schedule.skipped(0), 0U);
+    EXPECT_EQ(runs + schedule.skipped(0), 1000U);
+    EXPECT_GT(runs, 980);
+    EXPECT_FALSE(schedule.deadline_lost(0, 1ms));
+}
+
+TEST(ProcessorScheduleTest, RunsDecimatedProcessorsOnEveryNthScan) {
+    ProcessorPolicy every_third;
+    every_third.every_n_scans = 3;
+    ProcessorSchedule schedule({{}, every_third}, 2);
+    std::vector<bool> full, decimated;
+    for (int scan = 0; scan < 7; ++scan) {
+        full.push_back(schedule.due(0));
+        decimated.push_back(schedule.due(1));
+    }
+    EXPECT_EQ(full, std::vector<bool>(7, true));
+    EXPECT_EQ(decimated, (std::vector<bool>{true, false, false, true, false,
+                                            false, true}));
+    // the scans in between aren't skips
+    EXPECT_EQ(schedule.skipped(1), 0U);
+}
+
+TEST(ProcessorScheduleTest, CountsSkipsPerProcessor) {
+    ProcessorSchedule schedule({}, 2);
+    schedule.skip(1);
+    schedule.skip(1);
+    EXPECT_EQ(schedule.skipped(0), 0U);
+    EXPECT_EQ(schedule.skipped(1), 2U);
+}
+
+TEST(ProcessorScheduleTest, ParsesPriorities) {
+    auto priorities = ProcessorSchedule::parse_priorities("PCL|SCAN||IMG");
+    ASSERT_EQ(priorities.size(), 3U);
+    EXPECT_GT(priorities["PCL"], priorities["SCAN"]);
+    EXPECT_GT(priorities["SCAN"], priorities["IMG"]);
+    EXPECT_GT(priorities["IMG"], 0);
+    EXPECT_TRUE(ProcessorSchedule::parse_priorities("").empty());
+}
+
+TEST(ProcessorScheduleTest, ParsesDeadlines) {
+    auto deadlines = ProcessorSchedule::parse_deadlines("PCL:80|IMG:12.5");
+    ASSERT_EQ(deadlines.size(), 2U);
+    EXPECT_EQ(deadlines["PCL"], 80ms);
+    EXPECT_EQ(deadlines["IMG"], 12500us);
+    EXPECT_TRUE(ProcessorSchedule::parse_deadlines("").empty());
+
+    for (const auto& invalid : {"PCL", "PCL:", ":80", "PCL:-1", "PCL:8x"})
+        EXPECT_THROW(ProcessorSchedule::parse_deadlines(invalid),
+                     std::runtime_error)
+            << invalid;
+}
+
+TEST(ProcessorScheduleTest, ParsesEveryNScans) {
+    auto decimations = ProcessorSchedule::parse_every_n_scans("IMG:10|SCAN:1");
+    ASSERT_EQ(decimations.size(), 2U);
+    EXPECT_EQ(decimations["IMG"], 10);
+    EXPECT_EQ(decimations["SCAN"], 1);
+    EXPECT_TRUE(ProcessorSchedule::parse_every_n_scans("").empty());
+
+    for (const auto& invalid : {"IMG", "IMG:", ":2", "IMG:0", "IMG:2.5"})
+        EXPECT_THROW(ProcessorSchedule::parse_every_n_scans(invalid),
+                     std::runtime_error)
+            << invalid;
+}
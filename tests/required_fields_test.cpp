@@ -0,0 +1,103 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+
+// prevent clang-format from altering the location of "ouster_ros/os_ros.h", the
+// header file needs to be the first include due to PCL_NO_PRECOMPILE flag
+// clang-format off
+#include "ouster_ros/os_ros.h"
+// clang-format on
+#include "../src/point_cloud_processor_factory.h"
+#include "../src/laser_scan_processor.h"
+#include "../src/image_processor.h"
+
+using namespace ouster_ros;
+using namespace ouster::sdk::core;
+
+class RequiredFieldsTest : public ::testing::Test {
+   protected:
+    void SetUp() override {
+        info = default_sensor_info(LidarMode::MODE_1024x10);
+        info.config.lidar_mode = LidarMode::MODE_1024x10;
+        info.format.udp_profile_lidar =
+            UDPProfileLidar::RNG19_RFL8_SIG16_NIR16_DUAL;
+    }
+
+    // builds a scan the way LidarPacketHandler does for the given fields
+    std::unique_ptr<LidarScan> make_scan(
+        const std::vector<std::string>& fields) {
+        auto ls = std::make_unique<LidarScan>(
+            info.format.columns_per_frame, info.format.pixels_per_column,
+            LidarPacketHandler::scan_field_types(info, fields),
+            info.format.columns_per_packet);
+        for (auto field : {ChanField::RANGE, ChanField::RANGE2}) {
+            auto range = ls->field<uint32_t>(field);
+            for (int i = 0; i < range.size(); ++i) range.data()[i] = 1000 + i;
+        }
+        return ls;
+    }
+
+    static std::vector<std::string> names_of(const LidarScanFieldTypes& ft) {
+        std::vector<std::string> names;
+        for (const auto& f : ft) names.push_back(f.name);
+        std::sort(names.begin(), names.end());
+        return names;
+    }
+
+    SensorInfo info;
+};
+
+TEST_F(RequiredFieldsTest, EmptyListSelectsAllProfileFields) {
+    EXPECT_EQ(LidarPacketHandler::scan_field_types(info, {}).size(),
+              get_field_types(info.format.udp_profile_lidar).size());
+}
+
+TEST_F(RequiredFieldsTest, XYZOnlyRequiresRange) {
+    auto fields = PointCloudProcessorFactory::required_fields("xyz", info);
+    auto names = names_of(LidarPacketHandler::scan_field_types(info, fields));
+    EXPECT_EQ(names, (std::vector<std::string>{ChanField::RANGE,
+                                               ChanField::RANGE2}));
+}
+
+TEST_F(RequiredFieldsTest, UnknownFieldsAreIgnored) {
+    auto names = names_of(LidarPacketHandler::scan_field_types(
+        info, {ChanField::RANGE, "NOT_A_FIELD"}));
+    EXPECT_EQ(names, (std::vector<std::string>{ChanField::RANGE}));
+}
+
+TEST_F(RequiredFieldsTest, PointCloudProcessorsRunOnReducedScans) {
+    for (auto point_type : {"xyz", "xyzi", "xyzir", "original", "native"}) {
+        auto ls = make_scan(
+            PointCloudProcessorFactory::required_fields(point_type, info));
+        size_t published = 0;
+        auto processor = PointCloudProcessorFactory::create_point_cloud_processor(
+            point_type, info, "os_lidar", true, true, true, 0,
+            std::numeric_limits<uint32_t>::max(), 1, "",
+            [&published](const PointCloudProcessor_OutputType& msgs) {
+                published += msgs.size();
+            });
+        EXPECT_NO_THROW(processor(*ls, 0, ros::Time(1, 0))) << point_type;
+        EXPECT_EQ(published, 2U) << point_type;
+    }
+}
+
+TEST_F(RequiredFieldsTest, LaserScanProcessorRunsOnReducedScan) {
+    auto ls = make_scan(LaserScanProcessor::required_fields(info));
+    EXPECT_FALSE(ls->has_field(ChanField::REFLECTIVITY));
+    size_t published = 0;
+    auto processor = LaserScanProcessor::create(
+        info, "os_lidar", 0,
+        [&published](const LaserScanProcessor::OutputType& msgs) {
+            published += msgs.size();
+        });
+    EXPECT_NO_THROW(processor(*ls, 0, ros::Time(1, 0)));
+    EXPECT_EQ(published, 2U);
+}
+
+TEST_F(RequiredFieldsTest, ImageProcessorRunsOnReducedScan) {
+    auto ls = make_scan(ImageProcessor::required_fields(info));
+    EXPECT_FALSE(ls->has_field(ChanField::FLAGS));
+    auto processor = ImageProcessor::create(
+        info, "os_lidar", "", [](const ImageProcessor::OutputType&) {});
+    EXPECT_NO_THROW(processor(*ls, 0, ros::Time(1, 0)));
+}
@@ -0,0 +1,243 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <map>
+#include <random>
+
+#include <ouster/xyzlut.h>
+
+#include "../src/impl/cartesian.h"
+#include "../src/scan_columns_observers.h"
+#include "packet_source.h"
+
+using namespace ouster_ros;
+using namespace ouster::sdk::core;
+using test::PacketSource;
+
+namespace {
+
+// a lut of the factored form of OS sensors with random per beam vectors
+XYZLut factorable_lut(size_t w, size_t h) {
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<double> dist(-1.0, 1.0);
+    XYZLut lut;
+    lut.direction.resize(w * h, 3);
+    lut.offset.resize(w * h, 3);
+    for (size_t u = 0; u < h; ++u) {
+        double p[3], q[3], z[3], op[3], oq[3], oz[3];
+        for (int k = 0; k < 3; ++k) {
+            p[k] = dist(rng), q[k] = dist(rng), z[k] = dist(rng);
+            op[k] = dist(rng), oq[k] = dist(rng), oz[k] = dist(rng);
+        }
+        for (size_t v = 0; v < w; ++v) {
+            const double c = std::cos(2.0 * M_PI * v / w);
+            const double s = std::sin(2.0 * M_PI * v / w);
+            for (int k = 0; k < 3; ++k) {
+                lut.direction(u * w + v, k) = c * p[k] + s * q[k] + z[k];
+                lut.offset(u * w + v, k) = c * op[k] + s * oq[k] + oz[k];
+            }
+        }
+    }
+    return lut;
+}
+
+}  // namespace
+
+class IncrementalCartesianTest : public ::testing::Test {
+   protected:
+    void SetUp() override {
+        range.resize(H, W);
+        mask.resize(H, W);
+        std::mt19937 rng(7);
+        std::uniform_int_distribution<uint32_t> range_dist(0, 150000);
+        for (int i = 0; i < range.size(); ++i) {
+            range.data()[i] = range_dist(rng);
+            mask.data()[i] = rng() % 4 != 0;
+        }
+        lut = factorable_lut(W, H);
+        // the columns of the packets in arrival order, a few swapped
+        for (size_t c = 0; c < W; c += COLS) packets.push_back(c);
+        std::swap(packets[3], packets[4]);
+        std::swap(packets[10], packets[20]);
+    }
+
+    static constexpr size_t W = 512, H = 32, COLS = 16;
+    img_t<uint32_t> range, mask;
+    XYZLut lut;
+    std::vector<size_t> packets;
+};
+
+TEST_F(IncrementalCartesianTest, ColumnsMatchTheWholeScan) {
+    ArrayX3fR direction = lut.direction.cast<float>();
+    ArrayX3fR offset = lut.offset.cast<float>();
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    img_t<uint32_t> masked = range * mask;
+    PointCloudXYZf expected(W * H, 3), actual(W * H, 3);
+    ouster::cartesianT(expected, masked, direction, offset, 100U, 100000U,
+                       nan);
+    actual.setZero();
+    for (auto first_col : packets)
+        ouster::cartesian_columnsT(actual, range, direction, offset, 100U,
+                                   100000U, nan, first_col, COLS,
+                                   mask.data());
+    for (int i = 0; i < expected.size(); ++i) {
+        if (std::isnan(expected.data()[i]))
+            EXPECT_TRUE(std::isnan(actual.data()[i])) << i;
+        else
+            EXPECT_FLOAT_EQ(actual.data()[i], expected.data()[i]) << i;
+    }
+}
+
+TEST_F(IncrementalCartesianTest, CompactLutColumnsMatchTheWholeScan) {
+    auto compact = ouster::make_compact_xyz_lut<float>(lut, W, H);
+    ASSERT_TRUE(compact);
+    PointCloudXYZf expected(W * H, 3), actual(W * H, 3);
+    ouster::cartesianT(expected, range, *compact, 0U, 100000U, -1.0f);
+    actual.setZero();
+    for (auto first_col : packets)
+        ouster::cartesian_columnsT(actual, range, *compact, 0U, 100000U,
+                                   -1.0f, first_col, COLS);
+    EXPECT_LT((expected - actual).abs().maxCoeff(), 1e-4f);
+
+    // the other columns are left untouched
+    actual.setZero();
+    ouster::cartesian_columnsT(actual, range, *compact, 0U, 100000U, -1.0f,
+                               COLS, COLS);
+    for (size_t u = 0; u < H; ++u) {
+        EXPECT_EQ(actual.row(u * W + COLS - 1).abs().sum(), 0.0f);
+        EXPECT_EQ(actual.row(u * W + 2 * COLS).abs().sum(), 0.0f);
+    }
+}
+
+class ScanColumnsObserversTest : public ::testing::Test {
+   protected:
+    void SetUp() override {
+        info = default_sensor_info(LidarMode::MODE_1024x10);
+        info.format.udp_profile_lidar = UDPProfileLidar::RNG19_RFL8_SIG16_NIR16;
+    }
+
+    /**
+     * Batches the packets into two scans used in turns like the ring of the
+     * LidarPacketHandler and checks that every column reported for a scan
+     * still holds the data it had when it was reported once the scan
+     * completes.
+     * @return the columns reported for each completed scan
+     */
+    std::vector<std::vector<size_t>> batch(
+        const std::vector<LidarPacket>& packets) {
+        const auto& pf = get_format(info);
+        ScanBatcher batcher(info);
+        std::vector<LidarScan> scans(2, LidarScan(info));
+        ScanColumnsObservers observers(scans.size());
+        // column -> range of the column when it was reported, per scan
+        std::map<const LidarScan*, std::map<size_t, std::vector<uint32_t>>>
+            reported;
+        observers.set(1, [&](const LidarScan& ls, size_t first_col,
+                             size_t cols) {
+            auto range = ls.field<uint32_t>(ChanField::RANGE);
+            for (size_t c = first_col; c < first_col + cols; ++c) {
+                auto& column = reported[&ls][c];
+                column.resize(ls.h);
+                for (size_t u = 0; u < ls.h; ++u) column[u] = range(u, c);
+            }
+        });
+
+        std::vector<std::vector<size_t>> completed;
+        for (const auto& p : packets) {
+            auto& ls = scans[completed.size() % 2];
+            const bool done = batcher(p, ls);
+            observers.batched(pf, p.buf.data(), ls, done);
+            if (!done) continue;
+
+            auto range = ls.field<uint32_t>(ChanField::RANGE);
+            std::vector<size_t> columns;
+            for (const auto& r : reported[&ls]) {
+                columns.push_back(r.first);
+                for (size_t u = 0; u < ls.h; ++u)
+                    EXPECT_EQ(r.second[u], range(u, r.first))
+                        << "column " << r.first << " changed once reported";
+            }
+            reported[&ls].clear();
+            completed.push_back(columns);
+        }
+        return completed;
+    }
+
+    static std::vector<size_t> columns(size_t first, size_t last) {
+        std::vector<size_t> c;
+        for (size_t i = first; i < last; ++i) c.push_back(i);
+        return c;
+    }
+
+    SensorInfo info;
+};
+
+TEST_F(ScanColumnsObserversTest, ReportsEveryColumnOfCompleteFrames) {
+    PacketSource source(info);
+    std::vector<LidarPacket> packets;
+    for (uint16_t frame_id = 1; frame_id <= 4; ++frame_id) {
+        const auto frame = source.frame(frame_id);
+        packets.insert(packets.end(), frame.begin(), frame.end());
+    }
+    const auto completed = batch(packets);
+    ASSERT_EQ(completed.size(), 3U);
+    // the first packet of each frame completes the previous one and is
+    // reported for the next scan once replayed
+    for (const auto& c : completed)
+        EXPECT_EQ(c, columns(0, info.format.columns_per_frame));
+}
+
+TEST_F(ScanColumnsObserversTest, ReportsTheColumnsPacketsWereWrittenTo) {
+    PacketSource source(info);
+    const size_t cpp = info.format.columns_per_packet;
+    auto first = source.frame(1);
+    auto second = source.frame(2);
+    // the second column of a mangled packet overwrites the first of the frame
+    source.writer.set_col_measurement_id(
+        source.writer.nth_col(1, second[10].buf.data()), 0);
+    // a late packet of frame 1 arrives during frame 2
+    const auto late = first[5];
+    first.erase(first.begin() + 5, first.begin() + 7);
+    second.insert(second.begin() + 3, late);
+
+    std::vector<LidarPacket> packets(first);
+    packets.insert(packets.end(), second.begin(), second.end());
+    const auto frame = source.frame(3);
+    packets.insert(packets.end(), frame.begin(), frame.end());
+
+    const auto completed = batch(packets);
+    ASSERT_EQ(completed.size(), 2U);
+    auto expected = columns(0, 5 * cpp);
+    const auto rest = columns(7 * cpp, info.format.columns_per_frame);
+    expected.insert(expected.end(), rest.begin(), rest.end());
+    EXPECT_EQ(completed[0], expected);
+
+    expected = columns(0, info.format.columns_per_frame);
+    expected.erase(expected.begin() + 10 * cpp + 1);
+    EXPECT_EQ(completed[1], expected);
+}
+
+TEST(ScanColumnsObserversSetTest, RebuiltProcessorsReplaceTheirObserver) {
+    auto info = default_sensor_info(LidarMode::MODE_1024x10);
+    info.format.udp_profile_lidar = UDPProfileLidar::RNG19_RFL8_SIG16_NIR16;
+    const auto& pf = get_format(info);
+    PacketSource source(info);
+    LidarScan ls(info);
+    ScanBatcher batcher(info);
+    ScanColumnsObservers observers(1);
+    std::vector<int> calls(3, 0);
+    observers.set(0, [&](const LidarScan&, size_t, size_t) { ++calls[0]; });
+    observers.set(2, [&](const LidarScan&, size_t, size_t) { ++calls[1]; });
+    // the processor at index 2 was rebuilt
+    observers.set(2, [&](const LidarScan&, size_t, size_t) { ++calls[2]; });
+
+    auto p = source.packet(1, 0);
+    observers.batched(pf, p.buf.data(), ls, batcher(p, ls));
+    EXPECT_EQ(calls, (std::vector<int>{1, 0, 1}));
+
+    observers.set(0, {});
+    observers.set(2, {});
+    p = source.packet(1, 1);
+    observers.batched(pf, p.buf.data(), ls, batcher(p, ls));
+    EXPECT_EQ(calls, (std::vector<int>{1, 0, 1}));
+}
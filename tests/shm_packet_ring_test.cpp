@@ -0,0 +1,211 @@
+#include <gtest/gtest.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "ouster_ros/shm_packet_ring.h"
+
+using namespace ouster_ros;
+
+namespace {
+
+// a packet filled with its sequence number
+std::vector<uint8_t> packet_of(uint32_t seq, size_t size = 64) {
+    std::vector<uint8_t> buf(size, static_cast<uint8_t>(seq));
+    std::memcpy(buf.data(), &seq, sizeof(seq));
+    return buf;
+}
+
+uint32_t seq_of(const std::vector<uint8_t>& buf) {
+    uint32_t seq;
+    std::memcpy(&seq, buf.data(), sizeof(seq));
+    return seq;
+}
+
+bool intact(const std::vector<uint8_t>& buf) {
+    const auto seq = seq_of(buf);
+    for (size_t i = sizeof(seq); i < buf.size(); ++i)
+        if (buf[i] != static_cast<uint8_t>(seq)) return false;
+    return true;
+}
+
+}  // namespace
+
+class ShmPacketRingTest : public ::testing::Test {
+   protected:
+    // unique per process so that parallel test runs don't collide
+    const std::string name = shm::packet_ring_name(
+        "/test_" + std::to_string(getpid()) + "/lidar_packets");
+
+    void write(ShmPacketRingWriter& writer, uint32_t seq) {
+        const auto buf = packet_of(seq);
+        ASSERT_TRUE(writer.write(buf.data(), buf.size(), 1000 + seq));
+    }
+};
+
+TEST_F(ShmPacketRingTest, NamesFollowTheTopic) {
+    EXPECT_EQ(shm::packet_ring_name("/ouster/lidar_packets"),
+              "/ouster_ros_ouster_lidar_packets_ring");
+}
+
+TEST_F(ShmPacketRingTest, LateReadersStartWithTheNextPacket) {
+    ShmPacketRingReader reader;
+    EXPECT_FALSE(reader.attach(name));
+
+    ShmPacketRingWriter writer(name, 8, 64);
+    write(writer, 1);
+    ASSERT_TRUE(reader.attach(name));
+    std::vector<uint8_t> buf;
+    uint64_t ts = 0;
+    EXPECT_FALSE(reader.read(buf, ts));
+
+    write(writer, 2);
+    write(writer, 3);
+    for (uint32_t seq : {2, 3}) {
+        ASSERT_TRUE(reader.read(buf, ts));
+        EXPECT_EQ(seq_of(buf), seq);
+        EXPECT_EQ(buf.size(), 64U);
+        EXPECT_EQ(ts, 1000U + seq);
+    }
+    EXPECT_FALSE(reader.read(buf, ts));
+    EXPECT_EQ(reader.lost(), 0U);
+}
+
+TEST_F(ShmPacketRingTest, ReadersLappedByTheWriterLoseTheOldestPackets) {
+    ShmPacketRingWriter writer(name, 4, 64);
+    ShmPacketRingReader reader;
+    ASSERT_TRUE(reader.attach(name));
+    for (uint32_t seq = 0; seq < 10; ++seq) write(writer, seq);
+
+    std::vector<uint8_t> buf;
+    uint64_t ts;
+    for (uint32_t seq = 6; seq < 10; ++seq) {
+        ASSERT_TRUE(reader.read(buf, ts));
+        EXPECT_EQ(seq_of(buf), seq);
+    }
+    EXPECT_FALSE(reader.read(buf, ts));
+    EXPECT_EQ(reader.lost(), 6U);
+}
+
+TEST_F(ShmPacketRingTest, OversizedPacketsAreDropped) {
+    ShmPacketRingWriter writer(name, 4, 64);
+    const auto buf = packet_of(1, 65);
+    EXPECT_FALSE(writer.write(buf.data(), buf.size(), 0));
+    EXPECT_EQ(writer.oversized(), 1U);
+    EXPECT_EQ(writer.written(), 0U);
+}
+
+TEST_F(ShmPacketRingTest, ReadersSeeTheWriterGo) {
+    ShmPacketRingReader reader;
+    {
+        ShmPacketRingWriter writer(name, 4, 64);
+        ASSERT_TRUE(reader.attach(name));
+        EXPECT_FALSE(reader.closed());
+    }
+    EXPECT_TRUE(reader.closed());
+    ShmPacketRingReader late;
+    EXPECT_FALSE(late.attach(name));
+}
+
+TEST_F(ShmPacketRingTest, ReadersWaitForTheNextPacket) {
+    using namespace std::chrono;
+    ShmPacketRingWriter writer(name, 4, 64);
+    ShmPacketRingReader reader;
+    ASSERT_TRUE(reader.attach(name));
+
+    auto t0 = steady_clock::now();
+    EXPECT_FALSE(reader.wait(milliseconds(20)));
+    EXPECT_GE(steady_clock::now() - t0, milliseconds(20));
+
+    std::thread later([&]() {
+        std::this_thread::sleep_for(milliseconds(20));
+        write(writer, 1);
+    });
+    t0 = steady_clock::now();
+    EXPECT_TRUE(reader.wait(seconds(10)));
+    EXPECT_LT(steady_clock::now() - t0, seconds(5));
+    later.join();
+    // returns right away while packets are left to read
+    EXPECT_TRUE(reader.wait(seconds(10)));
+    std::vector<uint8_t> buf;
+    uint64_t ts;
+    ASSERT_TRUE(reader.read(buf, ts));
+    EXPECT_EQ(seq_of(buf), 1U);
+}
+
+TEST_F(ShmPacketRingTest, ReadersSeeACrashedWriterGone) {
+    const pid_t pid = fork();
+    ASSERT_GE(pid, 0);
+    if (pid == 0) {
+        // leaves the ring open, like a writer that crashed
+        new ShmPacketRingWriter(name, 4, 64);
+        _exit(0);
+    }
+    ASSERT_EQ(waitpid(pid, nullptr, 0), pid);
+
+    ShmPacketRingReader reader;
+    ASSERT_TRUE(reader.attach(name));
+    EXPECT_FALSE(reader.closed());
+    EXPECT_FALSE(reader.writer_alive());
+    reader.detach();
+    shm_unlink(name.c_str());
+
+    ShmPacketRingWriter writer(name, 4, 64);
+    ASSERT_TRUE(reader.attach(name));
+    EXPECT_TRUE(reader.writer_alive());
+}
+
+TEST_F(ShmPacketRingTest, ConcurrentReadersGetIntactPacketsInOrder) {
+    constexpr uint32_t PACKETS = 200000;
+    ShmPacketRingWriter writer(name, 64, 1024);
+    std::atomic<bool> done{false};
+    std::atomic<int> attached{0};
+
+    struct Result {
+        uint64_t read = 0;
+        uint64_t lost = 0;
+        bool in_order = true;
+        bool intact = true;
+    };
+    std::vector<Result> results(3);
+    std::vector<std::thread> readers;
+    for (auto& result : results) {
+        readers.emplace_back([&]() {
+            ShmPacketRingReader reader;
+            if (!reader.attach(name)) return;
+            ++attached;
+            std::vector<uint8_t> buf;
+            uint64_t ts;
+            int64_t last = -1;
+            while (true) {
+                const bool finished = done;
+                while (reader.read(buf, ts)) {
+                    ++result.read;
+                    result.intact &= intact(buf) && ts == seq_of(buf);
+                    result.in_order &= static_cast<int64_t>(seq_of(buf)) > last;
+                    last = seq_of(buf);
+                }
+                if (finished) break;
+            }
+            result.lost = reader.lost();
+        });
+    }
+    while (attached < static_cast<int>(results.size()))
+        std::this_thread::yield();
+
+    for (uint32_t seq = 0; seq < PACKETS; ++seq) {
+        const auto buf = packet_of(seq, 64 + seq % 960);
+        writer.write(buf.data(), buf.size(), seq);
+    }
+    done = true;
+    for (auto& t : readers) t.join();
+
+    for (const auto& result : results) {
+        EXPECT_TRUE(result.intact);
+        EXPECT_TRUE(result.in_order);
+        EXPECT_EQ(result.read + result.lost, PACKETS);
+    }
+}
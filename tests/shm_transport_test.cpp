@@ -0,0 +1,186 @@
+#include <gtest/gtest.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "ouster_ros/shm_transport.h"
+
+using namespace ouster_ros;
+
+class ShmTransportTest : public ::testing::Test {
+   protected:
+    // unique per process so that parallel test runs don't collide
+    const std::string prefix = "/test_" + std::to_string(getpid()) + "/points";
+    std::vector<uint8_t> small = std::vector<uint8_t>(1000, 7);
+    std::vector<uint8_t> large = std::vector<uint8_t>(5000, 9);
+};
+
+TEST_F(ShmTransportTest, ReaderSeesWrittenPayload) {
+    ShmWriter writer(prefix, 2);
+    ShmReader reader;
+    auto buffer = writer.write(small.data(), small.size());
+    ASSERT_TRUE(buffer);
+    auto view = reader.acquire(*buffer);
+    ASSERT_TRUE(view);
+    ASSERT_EQ(view.size(), small.size());
+    EXPECT_EQ(std::vector<uint8_t>(view.data(), view.data() + view.size()),
+              small);
+}
+
+TEST_F(ShmTransportTest, HeldSegmentsAreNotOverwritten) {
+    ShmWriter writer(prefix, 2);
+    ShmReader reader;
+    auto first = writer.write(small.data(), small.size());
+    auto second = writer.write(large.data(), large.size());
+    ASSERT_TRUE(first && second);
+    EXPECT_NE(first->segment, second->segment);
+
+    auto first_view = reader.acquire(*first);
+    auto second_view = reader.acquire(*second);
+    ASSERT_TRUE(first_view && second_view);
+    EXPECT_FALSE(writer.write(small.data(), small.size()));
+    EXPECT_EQ(writer.skipped(), 1U);
+
+    second_view.release();
+    auto third = writer.write(small.data(), small.size());
+    ASSERT_TRUE(third);
+    EXPECT_EQ(third->segment, second->segment);
+    EXPECT_EQ(first_view.data()[0], 7);
+    // the second payload is gone
+    EXPECT_FALSE(reader.acquire(*second));
+}
+
+TEST_F(ShmTransportTest, SegmentsGrowToFitPayload) {
+    ShmWriter writer(prefix, 1);
+    ShmReader reader;
+    auto buffer = writer.write(small.data(), small.size());
+    ASSERT_TRUE(reader.acquire(*buffer));
+    buffer = writer.write(large.data(), large.size());
+    ASSERT_TRUE(buffer);
+    auto view = reader.acquire(*buffer);
+    ASSERT_TRUE(view);
+    EXPECT_EQ(view.size(), large.size());
+    EXPECT_EQ(view.data()[large.size() - 1], 9);
+}
+
+TEST_F(ShmTransportTest, PointCloudMetadataIsKept) {
+    ShmWriter writer(prefix, 1);
+    ShmReader reader;
+    sensor_msgs::PointCloud2 cloud;
+    cloud.header.frame_id = "os_lidar";
+    cloud.width = 250;
+    cloud.height = 1;
+    cloud.point_step = 4;
+    cloud.row_step = 1000;
+    cloud.data = small;
+    auto msg = to_shm_msg(writer, cloud);
+    ASSERT_TRUE(msg);
+    EXPECT_TRUE(msg->cloud.data.empty());
+    EXPECT_EQ(msg->cloud.header.frame_id, "os_lidar");
+    EXPECT_EQ(msg->cloud.row_step, 1000U);
+    auto view = reader.acquire(*msg);
+    ASSERT_TRUE(view);
+    EXPECT_EQ(view.size(), cloud.data.size());
+}
+
+TEST_F(ShmTransportTest, SegmentsAreUnlinkedWithTheWriter) {
+    ShmBuffer buffer;
+    {
+        ShmWriter writer(prefix, 1);
+        buffer = *writer.write(small.data(), small.size());
+    }
+    ShmReader reader;
+    EXPECT_FALSE(reader.acquire(buffer));
+}
+
+TEST_F(ShmTransportTest, SegmentsOfARestartedWriterAreRemapped) {
+    ShmReader reader;
+    ShmBuffer old_buffer;
+    {
+        ShmWriter writer(prefix, 1);
+        old_buffer = *writer.write(small.data(), small.size());
+        ASSERT_TRUE(reader.acquire(old_buffer));
+    }
+    // same name and sequence, a different segment
+    ShmWriter writer(prefix, 1);
+    auto buffer = writer.write(small.data(), small.size() / 2);
+    ASSERT_TRUE(buffer);
+    EXPECT_EQ(buffer->segment, old_buffer.segment);
+    EXPECT_EQ(buffer->seq, old_buffer.seq);
+    EXPECT_NE(buffer->writer, old_buffer.writer);
+
+    auto view = reader.acquire(*buffer);
+    ASSERT_TRUE(view);
+    EXPECT_EQ(view.size(), small.size() / 2);
+    view.release();
+    EXPECT_FALSE(reader.acquire(old_buffer));
+    EXPECT_TRUE(reader.acquire(*buffer));
+}
+
+TEST_F(ShmTransportTest, SegmentsHeldByDeadReadersAreReclaimed) {
+    ShmWriter writer(prefix, 1);
+    auto buffer = writer.write(small.data(), small.size());
+    ASSERT_TRUE(buffer);
+
+    // a reader process that exits without releasing the segment
+    const pid_t child = fork();
+    ASSERT_GE(child, 0);
+    if (child == 0) {
+        auto view = new ShmView(ShmReader().acquire(*buffer));
+        _exit(*view ? 0 : 1);
+    }
+    int status = 0;
+    ASSERT_EQ(waitpid(child, &status, 0), child);
+    ASSERT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    // held by a live reader the segment is not reclaimed
+    ShmReader reader;
+    auto view = reader.acquire(*buffer);
+    ASSERT_TRUE(view);
+    EXPECT_FALSE(writer.write(large.data(), large.size()));
+    EXPECT_EQ(writer.skipped(), 1U);
+    EXPECT_EQ(writer.reclaimed(), 1U);
+
+    view.release();
+    EXPECT_TRUE(writer.write(large.data(), large.size()));
+}
+
+TEST_F(ShmTransportTest, OnlyHoldersOfTheSamePidNamespaceAreReclaimed) {
+    const uint64_t pid_ns = shm::pid_namespace();
+    ASSERT_NE(pid_ns, 0U);
+    // the pid of a process that is gone
+    const pid_t child = fork();
+    ASSERT_GE(child, 0);
+    if (child == 0) _exit(0);
+    ASSERT_EQ(waitpid(child, nullptr, 0), child);
+    const auto pid = static_cast<uint32_t>(child);
+
+    shm::SegmentHeader header{};
+    // the same pid in another namespace holds a slot of its own
+    auto local = shm::holder(&header, pid, pid_ns);
+    auto foreign = shm::holder(&header, pid, pid_ns + 1);
+    ASSERT_TRUE(local && foreign);
+    EXPECT_NE(local, foreign);
+    EXPECT_EQ(shm::holder(&header, pid, pid_ns + 1), foreign);
+    local->refs = 1;
+    foreign->refs = 2;
+    header.refs = 3;
+
+    EXPECT_EQ(shm::reclaim(&header, 0), 0U);
+    EXPECT_EQ(shm::reclaim(&header, pid_ns), 1U);
+    EXPECT_EQ(header.refs, 2U);
+    EXPECT_EQ(local->pid, 0U);
+    EXPECT_EQ(foreign->pid, pid);
+    EXPECT_EQ(foreign->refs, 2U);
+}
+
+TEST_F(ShmTransportTest, FailingToCreateASegmentFailsTheWrite) {
+    // longer than the names shm_open accepts
+    ShmWriter writer(std::string(300, 'x'), 1);
+    std::optional<ShmBuffer> buffer;
+    EXPECT_NO_THROW(buffer = writer.write(small.data(), small.size()));
+    EXPECT_FALSE(buffer);
+    EXPECT_EQ(writer.failed(), 1U);
+    EXPECT_EQ(writer.skipped(), 0U);
+    EXPECT_NE(writer.error().find("failed to create shm segment"),
+              std::string::npos);
+}
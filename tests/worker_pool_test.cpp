@@ -0,0 +1,145 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../src/worker_pool.h"
+
+using namespace ouster_ros::threading;
+using namespace std::chrono_literals;
+
+namespace {
+
+// polls until condition holds or the timeout passes
+template <typename Condition>
+bool eventually(Condition condition, std::chrono::milliseconds timeout = 5s) {
+    const auto until = std::chrono::steady_clock::now() + timeout;
+    while (!condition()) {
+        if (std::chrono::steady_clock::now() > until) return false;
+        std::this_thread::sleep_for(1ms);
+    }
+    return true;
+}
+
+}  // namespace
+
+TEST(WorkerPoolTest, RunsTheWorkOncePerNotifyOneAtATime) {
+    auto pool = std::make_shared<WorkerPool>(4);
+    std::atomic<int> runs{0};
+    std::atomic<int> running{0};
+    std::atomic<bool> overlapped{false};
+    auto queue = pool->create_queue([&]() {
+        if (running.fetch_add(1) != 0) overlapped = true;
+        std::this_thread::sleep_for(50us);
+        running.fetch_sub(1);
+        ++runs;
+    });
+
+    std::vector<std::thread> notifiers;
+    for (int t = 0; t < 4; ++t)
+        notifiers.emplace_back([&queue]() {
+            for (int i = 0; i < 100; ++i) queue->notify();
+        });
+    for (auto& t : notifiers) t.join();
+
+    EXPECT_TRUE(eventually([&]() { return runs == 400; }));
+    EXPECT_FALSE(overlapped);
+    queue->close();
+}
+
+TEST(WorkerPoolTest, QueuesTakeTurns) {
+    auto pool = std::make_shared<WorkerPool>(1);
+    std::mutex mutex;
+    std::vector<char> order;
+    std::promise<void> release;
+    auto released = release.get_future().share();
+    // holds the only worker until both queues have a backlog
+    auto gate = pool->create_queue([released]() { released.wait(); });
+    auto record = [&](char c) {
+        return [&, c]() {
+            std::lock_guard<std::mutex> lock(mutex);
+            order.push_back(c);
+        };
+    };
+    auto busy = pool->create_queue(record('a'));
+    auto quiet = pool->create_queue(record('b'));
+
+    gate->notify();
+    for (int i = 0; i < 20; ++i) busy->notify();
+    for (int i = 0; i < 3; ++i) quiet->notify();
+    release.set_value();
+
+    ASSERT_TRUE(eventually([&]() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return order.size() == 23;
+    }));
+    // the quiet queue doesn't wait for the backlog of the busy one
+    std::vector<char> head(order.begin(), order.begin() + 6);
+    EXPECT_EQ(head, (std::vector<char>{'a', 'b', 'a', 'b', 'a', 'b'}));
+    gate->close();
+    busy->close();
+    quiet->close();
+}
+
+TEST(WorkerPoolTest, RunsQueuesInParallel) {
+    auto pool = std::make_shared<WorkerPool>(2);
+    std::mutex mutex;
+    std::condition_variable cv;
+    int arrived = 0;
+    bool met = true;
+    // each run waits for the other queue, only completes when both run at once
+    auto rendezvous = [&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        ++arrived;
+        cv.notify_all();
+        met &= cv.wait_for(lock, 2s, [&]() { return arrived >= 2; });
+    };
+    auto first = pool->create_queue(rendezvous);
+    auto second = pool->create_queue(rendezvous);
+    first->notify();
+    second->notify();
+    EXPECT_TRUE(eventually([&]() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return arrived == 2;
+    }));
+    first->close();
+    second->close();
+    EXPECT_TRUE(met);
+}
+
+TEST(WorkerPoolTest, CloseWaitsForTheRunningWorkAndDropsTheRest) {
+    auto pool = std::make_shared<WorkerPool>(1);
+    std::atomic<bool> started{false};
+    std::atomic<int> runs{0};
+    auto queue = pool->create_queue([&]() {
+        started = true;
+        std::this_thread::sleep_for(20ms);
+        ++runs;
+    });
+    for (int i = 0; i < 10; ++i) queue->notify();
+    ASSERT_TRUE(eventually([&]() { return started.load(); }));
+    queue->close();
+    const int runs_at_close = runs;
+    EXPECT_GE(runs_at_close, 1);
+    std::this_thread::sleep_for(50ms);
+    EXPECT_EQ(runs, runs_at_close);
+    // notifications of a closed queue are ignored
+    queue->notify();
+    EXPECT_EQ(queue->pending(), 0U);
+}
+
+TEST(WorkerPoolTest, SharedPoolIsReusedWhileInUse) {
+    auto pool = WorkerPool::shared(2);
+    EXPECT_EQ(pool->size(), 2U);
+    // the size of the running pool wins
+    EXPECT_EQ(WorkerPool::shared(3), pool);
+    std::weak_ptr<WorkerPool> released = pool;
+    pool.reset();
+    EXPECT_TRUE(released.expired());
+    EXPECT_EQ(WorkerPool::shared(3)->size(), 3U);
+}
@@ -0,0 +1,310 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+
+// prevent clang-format from altering the location of "ouster_ros/os_ros.h", the
+// header file needs to be the first include due to PCL_NO_PRECOMPILE flag
+// clang-format off
+#include "ouster_ros/os_ros.h"
+// clang-format on
+#include "../src/point_cloud_processor_factory.h"
+#include "../src/laser_scan_processor.h"
+#include "../src/image_processor.h"
+#include "../src/imu_packet_handler.h"
+#include "../src/lidar_packet_handler.h"
+#include "../src/telemetry_handler.h"
+#include "packet_source.h"
+
+// The following interposes the malloc family of functions for this test
+// binary. operator new and the Eigen/PCL aligned allocators all end up calling
+// one of these, so counting here covers every heap allocation performed by the
+// calling thread while an AllocationCounter is alive.
+#if defined(__GLIBC__)
+#define OUSTER_ROS_COUNT_ALLOCATIONS
+namespace {
+thread_local bool count_allocations = false;
+thread_local size_t allocations_count = 0;
+
+inline void note_allocation() {
+    if (count_allocations) ++allocations_count;
+}
+}  // namespace
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+
+void* malloc(size_t size) {
+    note_allocation();
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+    note_allocation();
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    note_allocation();
+    return __libc_realloc(ptr, size);
+}
+
+void* memalign(size_t alignment, size_t size) {
+    note_allocation();
+    return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+    note_allocation();
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** ptr, size_t alignment, size_t size) {
+    note_allocation();
+    *ptr = __libc_memalign(alignment, size);
+    return *ptr ? 0 : ENOMEM;
+}
+}
+#endif
+
+namespace {
+
+/**
+ * Counts the heap allocations performed by the current thread during the
+ * lifetime of the object.
+ */
+class AllocationCounter {
+   public:
+    AllocationCounter() {
+#ifdef OUSTER_ROS_COUNT_ALLOCATIONS
+        allocations_count = 0;
+        count_allocations = true;
+#endif
+    }
+
+    ~AllocationCounter() { stop(); }
+
+    size_t stop() {
+#ifdef OUSTER_ROS_COUNT_ALLOCATIONS
+        count_allocations = false;
+        return allocations_count;
+#else
+        return 0;
+#endif
+    }
+};
+
+}  // namespace
+
+using namespace ouster_ros;
+using namespace ouster::sdk::core;
+
+class ZeroAllocationTest : public ::testing::Test {
+   protected:
+    static constexpr int WARMUP_SCANS = 3;
+    static constexpr int MEASURED_SCANS = 10;
+
+    void SetUp() override {
+#ifndef OUSTER_ROS_COUNT_ALLOCATIONS
+        GTEST_SKIP() << "allocation counting requires glibc";
+#endif
+        info = default_sensor_info(LidarMode::MODE_1024x10);
+        info.config.lidar_mode = LidarMode::MODE_1024x10;
+        info.format.udp_profile_lidar = UDPProfileLidar::RNG19_RFL8_SIG16_NIR16;
+
+        ls = std::make_unique<LidarScan>(info.format.columns_per_frame,
+                                         info.format.pixels_per_column,
+                                         info.format.udp_profile_lidar);
+        auto range = ls->field<uint32_t>(ChanField::RANGE);
+        auto signal = ls->field<uint16_t>(ChanField::SIGNAL);
+        // leave every 7th pixel without a return to exercise invalid points
+        for (int i = 0; i < range.size(); ++i) {
+            range.data()[i] = i % 7 == 0 ? 0 : 1000 + i;
+            signal.data()[i] = static_cast<uint16_t>(i);
+        }
+        auto ts = ls->timestamp();
+        for (int i = 0; i < ts.size(); ++i) ts[i] = 1000000000ULL + i * 97656;
+        ls->status().setConstant(0x01);
+    }
+
+    // runs the processor a few times to let it settle its buffers then
+    // returns the number of allocations observed over MEASURED_SCANS scans
+    size_t count_processor_allocations(LidarScanProcessor& processor) {
+        const ros::Time msg_ts(1, 0);
+        for (int i = 0; i < WARMUP_SCANS; ++i)
+            processor(*ls, 1000000000ULL, msg_ts);
+
+        AllocationCounter counter;
+        for (int i = 0; i < MEASURED_SCANS; ++i)
+            processor(*ls, 1000000000ULL, msg_ts);
+        return counter.stop();
+    }
+
+    // feeds a few frames to a handler processing the scans inline to let it
+    // settle its buffers then returns the number of allocations observed
+    // while batching the packets of the next frames
+    size_t count_lidar_packet_handler_allocations() {
+        size_t scans = 0;
+        threading::InlineProcessing inline_processing;
+        inline_processing.enabled = true;
+        auto handler = LidarPacketHandler::create(
+            info,
+            {[&scans](const LidarScan&, uint64_t, const ros::Time&) {
+                ++scans;
+            }},
+            "TIME_FROM_INTERNAL_OSC", 0, 0.0f, nullptr, {}, {}, nullptr,
+            inline_processing);
+        test::PacketSource source(info);
+        std::vector<LidarPacket> warmup, measured;
+        for (uint16_t frame_id = 1; frame_id <= WARMUP_SCANS; ++frame_id) {
+            const auto frame = source.frame(frame_id);
+            warmup.insert(warmup.end(), frame.begin(), frame.end());
+        }
+        for (uint16_t frame_id = WARMUP_SCANS + 1;
+             frame_id <= WARMUP_SCANS + MEASURED_SCANS; ++frame_id) {
+            const auto frame = source.frame(frame_id);
+            measured.insert(measured.end(), frame.begin(), frame.end());
+        }
+        for (const auto& p : warmup) handler(p);
+        const size_t warmup_scans = scans;
+
+        AllocationCounter counter;
+        for (const auto& p : measured) handler(p);
+        const size_t allocations = counter.stop();
+        EXPECT_EQ(scans - warmup_scans, static_cast<size_t>(MEASURED_SCANS));
+        return allocations;
+    }
+
+    LidarScanProcessor make_point_cloud_processor(const std::string& point_type,
+                                                  bool organized) {
+        return PointCloudProcessorFactory::create_point_cloud_processor(
+            point_type, info, "os_lidar", true, organized, true, 0,
+            std::numeric_limits<uint32_t>::max(), 1, "",
+            [this](const PointCloudProcessor_OutputType& msgs) {
+                published += msgs.size();
+            });
+    }
+
+    SensorInfo info;
+    std::unique_ptr<LidarScan> ls;
+    size_t published = 0;
+};
+
+TEST_F(ZeroAllocationTest, PointCloudProcessorOrganizedOriginal) {
+    auto processor = make_point_cloud_processor("original", true);
+    EXPECT_EQ(count_processor_allocations(processor), 0U);
+    EXPECT_GT(published, 0U);
+}
+
+TEST_F(ZeroAllocationTest, PointCloudProcessorUnorganizedOriginal) {
+    auto processor = make_point_cloud_processor("original", false);
+    EXPECT_EQ(count_processor_allocations(processor), 0U);
+    EXPECT_GT(published, 0U);
+}
+
+TEST_F(ZeroAllocationTest, PointCloudProcessorXYZ) {
+    auto processor = make_point_cloud_processor("xyz", true);
+    EXPECT_EQ(count_processor_allocations(processor), 0U);
+}
+
+TEST_F(ZeroAllocationTest, PointCloudProcessorNative) {
+    auto processor = make_point_cloud_processor("native", false);
+    EXPECT_EQ(count_processor_allocations(processor), 0U);
+}
+
+TEST_F(ZeroAllocationTest, LaserScanProcessor) {
+    auto processor = LaserScanProcessor::create(
+        info, "os_lidar", 0,
+        [this](const LaserScanProcessor::OutputType& msgs) {
+            published += msgs.size();
+        });
+    EXPECT_EQ(count_processor_allocations(processor), 0U);
+    EXPECT_GT(published, 0U);
+}
+
+TEST_F(ZeroAllocationTest, UnsubscribedOutputsAreSkipped) {
+    bool subscribed = false;
+    auto wanted = [&subscribed] { return subscribed; };
+    size_t clouds = 0;
+    auto point_cloud = PointCloudProcessorFactory::create_point_cloud_processor(
+        "original", info, "os_lidar", true, true, true, 0,
+        std::numeric_limits<uint32_t>::max(), 1, "",
+        [&clouds](const PointCloudProcessor_OutputType& msgs) {
+            for (const auto& msg : msgs) clouds += msg != nullptr;
+        },
+        {}, nullptr, nullptr, nullptr, {wanted});
+    size_t scans = 0;
+    auto laser_scan = LaserScanProcessor::create(
+        info, "os_lidar", 0,
+        [&scans](const LaserScanProcessor::OutputType& msgs) {
+            for (const auto& msg : msgs) scans += msg != nullptr;
+        },
+        {wanted});
+
+    EXPECT_EQ(count_processor_allocations(point_cloud), 0U);
+    EXPECT_EQ(count_processor_allocations(laser_scan), 0U);
+    EXPECT_EQ(clouds, 0U);
+    EXPECT_EQ(scans, 0U);
+
+    // resumes with the next scan once somebody subscribes
+    subscribed = true;
+    point_cloud(*ls, 1000000000ULL, ros::Time(1, 0));
+    laser_scan(*ls, 1000000000ULL, ros::Time(1, 0));
+    EXPECT_EQ(clouds, 1U);
+    EXPECT_EQ(scans, 1U);
+}
+
+TEST_F(ZeroAllocationTest, TelemetryHandlerPerPacket) {
+    auto handler = TelemetryHandler::create(info, "", 0);
+    const auto& pf = get_format(info);
+    LidarPacket lidar_packet(pf.lidar_packet_size);
+    lidar_packet.format = std::make_shared<PacketFormat>(pf);
+
+    for (int i = 0; i < WARMUP_SCANS; ++i) handler(lidar_packet);
+
+    AllocationCounter counter;
+    for (int i = 0; i < MEASURED_SCANS; ++i) handler(lidar_packet);
+    EXPECT_EQ(counter.stop(), 0U);
+}
+
+TEST_F(ZeroAllocationTest, ImuPacketHandlerPerPacket) {
+    auto handler = ImuPacketHandler::create(info, "os_imu", "", 0);
+    const auto& pf = get_format(info);
+    ImuPacket imu_packet(pf.imu_packet_size);
+    imu_packet.format = std::make_shared<PacketFormat>(pf);
+
+    for (int i = 0; i < WARMUP_SCANS; ++i) handler(imu_packet);
+
+    // the LEGACY IMU profile is read without the ImuPacket accessors
+    AllocationCounter counter;
+    size_t msgs = 0;
+    for (int i = 0; i < MEASURED_SCANS; ++i) msgs += handler(imu_packet).size();
+    EXPECT_EQ(counter.stop(), 0U);
+    EXPECT_GT(msgs, 0U);
+}
+
+TEST_F(ZeroAllocationTest, ImageProcessor) {
+    size_t images = 0;
+    auto processor = ImageProcessor::create(
+        info, "os_lidar", "",
+        [&images](const ImageProcessor::OutputType& msgs) {
+            for (const auto& it : msgs) images += it.second != nullptr;
+        });
+    EXPECT_EQ(count_processor_allocations(processor), 0U);
+    // range, signal, reflectivity and near ir
+    EXPECT_EQ(images, 4U * (WARMUP_SCANS + MEASURED_SCANS));
+}
+
+TEST_F(ZeroAllocationTest, LidarPacketHandlerPerPacket) {
+    // batched with the ProfileScanBatcher
+    EXPECT_EQ(count_lidar_packet_handler_allocations(), 0U);
+}
+
+TEST_F(ZeroAllocationTest, LidarPacketHandlerPerPacketWithScanBatcher) {
+    info.format.udp_profile_lidar = UDPProfileLidar::LEGACY;
+    EXPECT_EQ(count_lidar_packet_handler_allocations(), 0U);
+}
@@ -0,0 +1,63 @@
+#!/usr/bin/env python3
+
+"""
+Reports the latency between the ouster driver receiving packets and a consumer
+getting them delivered over ROS, along with the number of packets lost in
+transit. Requires the driver to run with stamped_packets:=true.
+
+usage: rosrun ouster_ros packet-latency.py [--topic /ouster/lidar_packets]
+                                           [--period 1.0]
+"""
+
+import argparse
+
+import rospy
+from ouster_ros.msg import StampedPacketMsg
+
+
+class LatencyMonitor:
+    def __init__(self, topic, period):
+        self.topic = topic
+        self.latencies = []
+        self.last_seq = None
+        self.received = 0
+        self.lost = 0
+        rospy.Subscriber(topic, StampedPacketMsg, self.on_packet,
+                         queue_size=1000, tcp_nodelay=True)
+        rospy.Timer(rospy.Duration(period), self.report)
+
+    def on_packet(self, msg):
+        self.latencies.append((rospy.Time.now() - msg.receive_stamp).to_sec())
+        if self.last_seq is not None and msg.seq > self.last_seq + 1:
+            self.lost += msg.seq - self.last_seq - 1
+        self.last_seq = msg.seq
+        self.received += 1
+
+    def report(self, _):
+        latencies, self.latencies = sorted(self.latencies), []
+        if not latencies:
+            rospy.loginfo("%s: no packets received", self.topic)
+            return
+        n = len(latencies)
+        rospy.loginfo(
+            "%s: packets=%d lost=%d latency ms: min=%.3f mean=%.3f "
+            "p50=%.3f p99=%.3f max=%.3f", self.topic, n, self.lost,
+            1e3 * latencies[0], 1e3 * sum(latencies) / n,
+            1e3 * latencies[n // 2], 1e3 * latencies[min(n - 1, n * 99 // 100)],
+            1e3 * latencies[-1])
+        self.lost = 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("--topic", default="/ouster/lidar_packets")
+    parser.add_argument("--period", type=float, default=1.0,
+                        help="reporting period in seconds")
+    args = parser.parse_args(rospy.myargv()[1:])
+    rospy.init_node("packet_latency", anonymous=True)
+    LatencyMonitor(args.topic, args.period)
+    rospy.spin()
+
+
+if __name__ == "__main__":
+    main()
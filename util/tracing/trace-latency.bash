@@ -0,0 +1,28 @@
+#!/bin/bash
+
+# Attaches scan_latency.bt to the USDT probes of the ouster_ros nodelets and
+# prints per stage latency histograms upon exit (Ctrl-C).
+#
+# usage: sudo ./trace-latency.bash [path/to/libouster_ros_nodelets.so]
+#
+# When no library path is given the script attempts to locate it through
+# rospack, this requires the ROS environment to be sourced.
+# NOTE: the probes are only present when the package was built with the
+# systemtap-sdt-dev headers installed and ENABLE_TRACEPOINTS=ON (default).
+
+set -e
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+
+LIB="$1"
+if [ -z "$LIB" ]; then
+    LIB_DIR="$(catkin_find --first-only --lib ouster_ros 2>/dev/null || true)"
+    LIB="${LIB_DIR}/libouster_ros_nodelets.so"
+fi
+
+if [ ! -f "$LIB" ]; then
+    echo "could not find libouster_ros_nodelets.so, pass its path explicitly"
+    exit 1
+fi
+
+bpftrace -e "$(sed "s|@LIB@|${LIB}|g" "${SCRIPT_DIR}/scan_latency.bt")"